@@ -0,0 +1,328 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <thread>
+#include "bench_util.h"
+#include "data_structures/bid_cache.h"
+#include "data_structures/memory_pool.h"
+#include "data_structures/lockfree_queue.h"
+#include "data_structures/circuit_breaker.h"
+#include "data_structures/frequency_cap_store.h"
+#include "win_notice_ingest.h"
+#include "qos_scheduler.h"
+
+namespace {
+
+constexpr size_t kCacheKeys = 1 << 14;
+
+// Shared across threads and across thread counts; never destroyed.
+BidCache& sharedCache() {
+    static BidCache* cache = [] {
+        auto* c = new BidCache(kCacheKeys * 2, 3600);
+        bidding::BidResponse response;
+        response.set_status("success");
+        for (size_t i = 0; i < kCacheKeys; ++i) {
+            response.set_id("key-" + std::to_string(i));
+            c->put(response.id(), response);
+        }
+        return c;
+    }();
+    return *cache;
+}
+
+std::vector<std::string>& cacheKeys() {
+    static std::vector<std::string> keys = [] {
+        std::vector<std::string> k;
+        for (size_t i = 0; i < kCacheKeys; ++i) {
+            k.push_back("key-" + std::to_string(i));
+        }
+        return k;
+    }();
+    return keys;
+}
+
+constexpr size_t kCapUsers = 1 << 20;
+constexpr size_t kCapCampaigns = 16;
+
+std::vector<std::string>& capUsers() {
+    static std::vector<std::string> users = [] {
+        std::vector<std::string> u;
+        for (size_t i = 0; i < kCapUsers; ++i) {
+            u.push_back("user-" + std::to_string(i * 2654435761u));
+        }
+        return u;
+    }();
+    return users;
+}
+
+std::vector<std::string>& capCampaigns() {
+    static std::vector<std::string> campaigns = [] {
+        std::vector<std::string> c;
+        for (size_t i = 0; i < kCapCampaigns; ++i) {
+            c.push_back("campaign-" + std::to_string(i));
+        }
+        return c;
+    }();
+    return campaigns;
+}
+
+// 64 MB table (8M pairs), every user with one impression on one campaign.
+// Shared across threads and across thread counts; never destroyed.
+FrequencyCapStore& sharedCaps() {
+    static FrequencyCapStore* store = [] {
+        FrequencyCapConfig config;
+        config.memory_mb = 64;
+        config.default_cap = 3;
+        auto* s = new FrequencyCapStore(config);
+        for (size_t i = 0; i < kCapUsers; ++i) {
+            s->record(capUsers()[i], capCampaigns()[i % kCapCampaigns]);
+        }
+        return s;
+    }();
+    return *store;
+}
+
+constexpr size_t kNoticeDatagrams = 1024;
+constexpr size_t kNoticeCampaigns = 1000;
+
+// Full-MTU datagrams over kNoticeCampaigns campaigns, a fifth of them wins
+std::vector<std::string>& noticeDatagrams() {
+    static std::vector<std::string> datagrams = [] {
+        std::vector<std::string> d;
+        size_t n = 0;
+        for (size_t i = 0; i < kNoticeDatagrams; ++i) {
+            WinNoticeHeader header = {kWinNoticeMagic, kWinNoticeVersion,
+                                      static_cast<uint16_t>(kWinNoticesPerDatagram), i};
+            std::string bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (size_t j = 0; j < kWinNoticesPerDatagram; ++j, ++n) {
+                WinNotice notice = {};
+                setNoticeCampaign(notice, "campaign-" + std::to_string((n * 2654435761u) % kNoticeCampaigns));
+                notice.bid_micros = 1000000;
+                notice.outcome = static_cast<uint8_t>(n % 5 == 0 ? NoticeOutcome::WIN : NoticeOutcome::LOSS);
+                notice.price_micros = notice.outcome ? 700000 : 0;
+                bytes.append(reinterpret_cast<const char*>(&notice), sizeof(notice));
+            }
+            d.push_back(bytes);
+        }
+        return d;
+    }();
+    return datagrams;
+}
+
+}
+
+static void BM_BidCache_Get(benchmark::State& state) {
+    BidCache& cache = sharedCache();
+    auto& keys = cacheKeys();
+    bidding::BidResponse value;
+    size_t i = state.thread_index() * 7919;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get(keys[i++ & (kCacheKeys - 1)], value));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BidCache_Get)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_BidCache_Put(benchmark::State& state) {
+    BidCache& cache = sharedCache();
+    auto& keys = cacheKeys();
+    bidding::BidResponse response;
+    response.set_status("success");
+    size_t i = state.thread_index() * 7919;
+    
+    for (auto _ : state) {
+        cache.put(keys[i++ & (kCacheKeys - 1)], response);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BidCache_Put)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_BidCache_Mixed90Read(benchmark::State& state) {
+    BidCache& cache = sharedCache();
+    auto& keys = cacheKeys();
+    bidding::BidResponse value;
+    size_t i = state.thread_index() * 7919;
+    
+    for (auto _ : state) {
+        const std::string& key = keys[i++ & (kCacheKeys - 1)];
+        if (i % 10 == 0) {
+            cache.put(key, value);
+        } else {
+            benchmark::DoNotOptimize(cache.get(key, value));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BidCache_Mixed90Read)->ThreadRange(1, 64)->UseRealTime();
+
+// Warm start: time to map a snapshot of the shared cache into an empty one
+static void BM_BidCache_LoadSnapshot(benchmark::State& state) {
+    const std::string path = "/tmp/bench_bid_cache.snap";
+    sharedCache().saveSnapshot(path);
+    
+    for (auto _ : state) {
+        BidCache cache(kCacheKeys * 2, 3600);
+        benchmark::DoNotOptimize(cache.loadSnapshot(path));
+    }
+    state.SetItemsProcessed(state.iterations() * kCacheKeys);
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_BidCache_LoadSnapshot)->Unit(benchmark::kMillisecond);
+
+static void BM_MemoryPool_AllocFree(benchmark::State& state) {
+    MemoryPool pool(10000);
+    std::vector<void*> held(state.range(0));
+    
+    // Keep part of the pool in use; allocation cost should not depend on it
+    for (auto& ptr : held) {
+        ptr = pool.allocate(512);
+    }
+    
+    for (auto _ : state) {
+        void* ptr = pool.allocate(512);
+        benchmark::DoNotOptimize(ptr);
+        pool.deallocate(ptr);
+    }
+    
+    for (auto ptr : held) {
+        pool.deallocate(ptr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryPool_AllocFree)->Arg(0)->Arg(1000)->Arg(9000);
+
+static void BM_MemoryPool_Contended(benchmark::State& state) {
+    static MemoryPool* pool = new MemoryPool(10000);
+    
+    for (auto _ : state) {
+        void* ptr = pool->allocate(512);
+        benchmark::DoNotOptimize(ptr);
+        pool->deallocate(ptr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryPool_Contended)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_LockFreeQueue_PushPop(benchmark::State& state) {
+    LockFreeQueue<uint64_t> queue(1024);
+    uint64_t value = 0;
+    
+    for (auto _ : state) {
+        queue.push(value);
+        queue.pop(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockFreeQueue_PushPop);
+
+static void BM_LockFreeQueue_BidRequest(benchmark::State& state) {
+    LockFreeQueue<bidding::BidRequest> queue(1024);
+    auto requests = bench::makeBidRequests(64);
+    bidding::BidRequest out;
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        queue.push(requests[i++ & 63]);
+        queue.pop(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockFreeQueue_BidRequest);
+
+static void BM_LockFreeQueue_Contended(benchmark::State& state) {
+    static LockFreeQueue<uint64_t>* queue = new LockFreeQueue<uint64_t>(1 << 16);
+    uint64_t value = state.thread_index();
+    
+    for (auto _ : state) {
+        if (queue->push(value)) {
+            queue->pop(value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockFreeQueue_Contended)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_CircuitBreaker_IsOpen(benchmark::State& state) {
+    static CircuitBreaker* breaker = new CircuitBreaker(50, 60);
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breaker->isOpen());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CircuitBreaker_IsOpen)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_CircuitBreaker_RecordSuccess(benchmark::State& state) {
+    static CircuitBreaker* breaker = new CircuitBreaker(50, 60);
+    
+    for (auto _ : state) {
+        breaker->recordSuccess();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CircuitBreaker_RecordSuccess)->ThreadRange(1, 64)->UseRealTime();
+
+// Random users over a table much larger than the caches, as in production
+static void BM_FrequencyCap_Record(benchmark::State& state) {
+    FrequencyCapStore& caps = sharedCaps();
+    auto& users = capUsers();
+    auto& campaigns = capCampaigns();
+    size_t i = state.thread_index() * 7919;
+    
+    for (auto _ : state) {
+        size_t n = (i++ * 2654435761u) & (kCapUsers - 1);
+        caps.record(users[n], campaigns[n % kCapCampaigns]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrequencyCap_Record)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_FrequencyCap_IsCapped(benchmark::State& state) {
+    FrequencyCapStore& caps = sharedCaps();
+    auto& users = capUsers();
+    auto& campaigns = capCampaigns();
+    size_t i = state.thread_index() * 7919;
+    
+    for (auto _ : state) {
+        size_t n = (i++ * 2654435761u) & (kCapUsers - 1);
+        benchmark::DoNotOptimize(caps.isCapped(users[n], campaigns[n % kCapCampaigns]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrequencyCap_IsCapped)->ThreadRange(1, 64)->UseRealTime();
+
+// Parse and apply one datagram of notices, as a receive thread does after
+// recvmmsg; items are notices
+static void BM_WinNoticeIngest_Datagram(benchmark::State& state) {
+    static WinNoticeIngest* ingest = new WinNoticeIngest(WinNoticeConfig());
+    auto& datagrams = noticeDatagrams();
+    size_t i = state.thread_index() * 97;
+    
+    for (auto _ : state) {
+        const std::string& datagram = datagrams[i++ % kNoticeDatagrams];
+        benchmark::DoNotOptimize(ingest->ingest(datagram.data(), datagram.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * kWinNoticesPerDatagram);
+}
+BENCHMARK(BM_WinNoticeIngest_Datagram)->ThreadRange(1, 8)->UseRealTime();
+
+// The scheduler's cost per frame; past concurrency threads queue, so the
+// higher thread counts measure handoffs between waiting frames
+static void BM_QosScheduler_AcquireRelease(benchmark::State& state) {
+    static QosScheduler* qos = [] {
+        QosConfig config;
+        config.concurrency = 4;
+        config.max_wait_us = 1000000;
+        config.classes.push_back({"premium", 8, 1024, {}});
+        return new QosScheduler(config);
+    }();
+    size_t tenant = state.thread_index() % qos->classCount();
+    
+    for (auto _ : state) {
+        if (qos->acquire(tenant)) {
+            qos->release(tenant, 1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QosScheduler_AcquireRelease)->ThreadRange(1, 16)->UseRealTime();
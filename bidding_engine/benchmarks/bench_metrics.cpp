@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include "metrics.h"
+#include "stats.h"
+
+static void BM_Metrics_RecordRequest(benchmark::State& state) {
+    static MetricsCollector* metrics = new MetricsCollector();
+    int64_t latency = state.thread_index();
+    
+    for (auto _ : state) {
+        metrics->recordRequest(latency++ & 15, true);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Metrics_RecordRequest)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_Metrics_RecordCacheHit(benchmark::State& state) {
+    static MetricsCollector* metrics = new MetricsCollector();
+    bool hit = false;
+    
+    for (auto _ : state) {
+        metrics->recordCacheHit(hit = !hit);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Metrics_RecordCacheHit)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_Metrics_PrometheusFormat(benchmark::State& state) {
+    MetricsCollector metrics;
+    for (int i = 0; i < 10000; ++i) {
+        metrics.recordRequest(i % 20, i % 50 != 0);
+    }
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(metrics.getPrometheusFormat());
+    }
+}
+BENCHMARK(BM_Metrics_PrometheusFormat);
+
+// Contention: every thread bumps the same counter. The baseline is the
+// old layout, one shared seq_cst atomic.
+static void BM_Stats_SharedAtomic(benchmark::State& state) {
+    static std::atomic<uint64_t> counter(0);
+    
+    for (auto _ : state) {
+        counter.fetch_add(1);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Stats_SharedAtomic)->ThreadRange(1, 64)->UseRealTime();
+
+// Each thread its own atomic, but packed together as adjacent stats were:
+// no logical sharing, the cache line still bounces
+static void BM_Stats_AdjacentAtomics(benchmark::State& state) {
+    static std::atomic<uint64_t> counters[64];
+    std::atomic<uint64_t>& counter = counters[state.thread_index() & 63];
+    
+    for (auto _ : state) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Stats_AdjacentAtomics)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_Stats_Counter(benchmark::State& state) {
+    static stats::Counter* counter = new stats::Counter();
+    
+    for (auto _ : state) {
+        counter->add();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Stats_Counter)->ThreadRange(1, 64)->UseRealTime();
+
+// Read side: summing the slots, as a metrics scrape does per stat
+static void BM_Stats_CounterValue(benchmark::State& state) {
+    stats::Counter counter;
+    counter.add();
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(counter.value());
+    }
+}
+BENCHMARK(BM_Stats_CounterValue);
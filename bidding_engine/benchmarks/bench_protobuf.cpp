@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+#include "bench_util.h"
+
+static void BM_Protobuf_ParseBidRequest(benchmark::State& state) {
+    auto requests = bench::makeBidRequests(256, state.range(0));
+    std::vector<std::string> frames;
+    for (const auto& request : requests) {
+        frames.push_back(request.SerializeAsString());
+    }
+    
+    bidding::BidRequest parsed;
+    size_t bytes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        const std::string& frame = frames[i++ & 255];
+        benchmark::DoNotOptimize(parsed.ParseFromArray(frame.data(), frame.size()));
+        bytes += frame.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_Protobuf_ParseBidRequest)->Arg(0)->Arg(4)->Arg(8)->Arg(15);
+
+static void BM_Protobuf_SerializeBidRequest(benchmark::State& state) {
+    auto requests = bench::makeBidRequests(256, state.range(0));
+    std::string out;
+    size_t bytes = 0;
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        requests[i++ & 255].SerializeToString(&out);
+        bytes += out.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_Protobuf_SerializeBidRequest)->Arg(0)->Arg(4)->Arg(8)->Arg(15);
+
+static void BM_Protobuf_SerializeBidResponse(benchmark::State& state) {
+    bidding::BidResponse response;
+    response.set_id("req-1234567890");
+    response.set_campaign_id("campaign-42");
+    response.set_winning_bid(2.5);
+    response.set_price(2.0);
+    response.set_latency_ms(1);
+    response.set_status("success");
+    response.set_won(true);
+    
+    std::string out;
+    for (auto _ : state) {
+        response.SerializeToString(&out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Protobuf_SerializeBidResponse);
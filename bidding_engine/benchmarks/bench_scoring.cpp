@@ -0,0 +1,292 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "bench_util.h"
+#include "bid_handler.h"
+#include "auction.h"
+#include "scoring_rules.h"
+#include "pricing_model.h"
+
+static void BM_BidHandler_ScoreBid(benchmark::State& state) {
+    BidHandler handler(1);
+    auto requests = bench::makeBidRequests(1024, state.range(0));
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(handler.scoreBid(requests[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BidHandler_ScoreBid)->Arg(2)->Arg(8)->Arg(15);
+
+static void BM_BidHandler_ProcessBid(benchmark::State& state) {
+    BidHandler handler(1);
+    auto requests = bench::makeBidRequests(1024);
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(handler.processBid(requests[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BidHandler_ProcessBid);
+
+// Items are ad slots. Both benchmarks cover what the server does per
+// frame (parse, process, serialize), so they compare per-slot cost of one
+// batch frame against one frame per slot.
+static void BM_BidHandler_BatchFrame(benchmark::State& state) {
+    BidHandler handler(1);
+    std::mt19937_64 rng(42);
+    std::string frame = bench::makeBatchRequest(rng, state.range(0)).SerializeAsString();
+    bidding::BidBatchRequest request;
+    std::string output;
+    
+    for (auto _ : state) {
+        request.ParseFromString(frame);
+        handler.processBatch(request).SerializeToString(&output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BidHandler_BatchFrame)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+
+static void BM_BidHandler_FramePerSlot(benchmark::State& state) {
+    BidHandler handler(1);
+    std::mt19937_64 rng(42);
+    std::vector<std::string> frames;
+    for (const auto& request : bench::splitBatchRequest(bench::makeBatchRequest(rng, state.range(0)))) {
+        frames.push_back(request.SerializeAsString());
+    }
+    bidding::BidRequest request;
+    std::string output;
+    
+    for (auto _ : state) {
+        for (const auto& frame : frames) {
+            request.ParseFromString(frame);
+            handler.processBid(request).SerializeToString(&output);
+            benchmark::DoNotOptimize(output.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BidHandler_FramePerSlot)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+
+// Three scoring sources that usually take 200us but 5% of the time 5ms.
+// Arg 0 calls them one after another, as scoreBid would without the
+// fan-out; 1 runs them in parallel; 2 also hedges after 500us; 3 gives
+// up after 1ms with the best bid so far. Reports latency percentiles.
+static void BM_BidHandler_ScoringSources(benchmark::State& state) {
+    const int mode = state.range(0);
+    ScoringSource slow_source = [](const bidding::BidRequest& request, SourceBid& bid) {
+        thread_local std::mt19937 rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        bool tail = std::uniform_int_distribution<int>(0, 99)(rng) < 5;
+        std::this_thread::sleep_for(std::chrono::microseconds(tail ? 5000 : 200));
+        bid.campaign_id = "campaign-" + std::to_string(rng() % 16);
+        bid.bid = request.floor_price() * (1.0 + (rng() % 100) / 100.0);
+        return true;
+    };
+    
+    BidHandler handler(8);
+    for (int i = 0; i < 3 && mode > 0; ++i) {
+        handler.addScoringSource("source-" + std::to_string(i), slow_source, mode == 2);
+    }
+    handler.setScoringBudget(std::chrono::microseconds(mode == 3 ? 1000 : 20000),
+                             std::chrono::microseconds(mode == 2 ? 500 : 0));
+    handler.start();
+    
+    std::vector<std::shared_ptr<const bidding::BidRequest>> requests;
+    for (auto& request : bench::makeBidRequests(1024)) {
+        requests.push_back(std::make_shared<const bidding::BidRequest>(std::move(request)));
+    }
+    std::vector<double> latencies;
+    size_t i = 0;
+    SourceBid bid;
+    
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        const auto& request = requests[i++ & 1023];
+        for (int s = 0; s < 3 && mode == 0; ++s) {
+            slow_source(*request, bid);
+        }
+        benchmark::DoNotOptimize(handler.scoreBid(request));
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    handler.stop();
+    
+    std::sort(latencies.begin(), latencies.end());
+    state.counters["p50_us"] = latencies[latencies.size() / 2];
+    state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+    state.counters["max_us"] = latencies.back();
+}
+BENCHMARK(BM_BidHandler_ScoringSources)->DenseRange(0, 3)->Iterations(2000)->Unit(benchmark::kMicrosecond);
+
+// Same request mix through both rule paths; Arg is targeting keys per request
+static void BM_Scoring_Compiled(benchmark::State& state) {
+    auto requests = bench::makeBidRequests(1024, state.range(0));
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CompiledScorer<kAuctionScoreRules>::multiplier(requests[i++ & 1023].targeting()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Scoring_Compiled)->Arg(2)->Arg(8)->Arg(15);
+
+static void BM_Scoring_Interpreted(benchmark::State& state) {
+    auto requests = bench::makeBidRequests(1024, state.range(0));
+    ScoringRuleSet rules(kAuctionScoreRules);
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rules.multiplier(requests[i++ & 1023].targeting()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Scoring_Interpreted)->Arg(2)->Arg(8)->Arg(15);
+
+// Synthetic model: floor price, targeting count, every bench targeting key
+// and key=value pair, then never-matching keys up to `features`. Trees split
+// on random features; the real-valued floor price at random thresholds.
+static std::unique_ptr<PricingModel> makePricingModel(size_t features, unsigned depth, size_t trees) {
+    std::mt19937_64 rng(11);
+    std::uniform_real_distribution<float> weight(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> price(0.05f, 5.0f);
+    
+    auto model = std::make_unique<PricingModel>();
+    model->addFloorPriceFeature();
+    model->addTargetingCountFeature();
+    for (const auto& key : bench::targetingKeys()) {
+        if (model->featureCount() < features) {
+            model->addKeyFeature(key);
+        }
+    }
+    for (const auto& key : bench::targetingKeys()) {
+        for (const auto& value : bench::targetingValues()) {
+            if (model->featureCount() < features) {
+                model->addKeyValueFeature(key, value);
+            }
+        }
+    }
+    while (model->featureCount() < features) {
+        model->addKeyFeature("unused_" + std::to_string(model->featureCount()));
+    }
+    
+    std::vector<float> weights(features);
+    for (auto& w : weights) {
+        w = weight(rng);
+    }
+    model->setLinear(weight(rng), weights);
+    
+    std::uniform_int_distribution<uint32_t> column(0, features - 1);
+    for (size_t t = 0; t < trees; ++t) {
+        std::vector<PricingModel::Split> splits((size_t(1) << depth) - 1);
+        for (auto& split : splits) {
+            split.feature = column(rng);
+            split.threshold = split.feature == 0 ? price(rng) : 0.5f;
+        }
+        std::vector<float> leaves(size_t(1) << depth);
+        for (auto& leaf : leaves) {
+            leaf = weight(rng) * 0.1f;
+        }
+        model->addTree(depth, splits, leaves);
+    }
+    return model;
+}
+
+// Whole per-request cost (extract + evaluate) of a linear model; Arg is features
+static void BM_PricingModel_Linear(benchmark::State& state) {
+    auto model = makePricingModel(state.range(0), 1, 0);
+    auto requests = bench::makeBidRequests(1024);
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(model->price(2.0, requests[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PricingModel_Linear)->Arg(8)->Arg(32)->Arg(128)->Arg(256);
+
+// Args are tree depth and tree count over 64 features
+static void BM_PricingModel_Trees(benchmark::State& state) {
+    auto model = makePricingModel(64, state.range(0), state.range(1));
+    auto requests = bench::makeBidRequests(1024);
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(model->price(2.0, requests[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PricingModel_Trees)->ArgsProduct({{2, 4, 6, 8}, {10, 100}});
+
+// Evaluation only, 64 pre-extracted rows per call; items are rows
+static void BM_PricingModel_TreesBatch(benchmark::State& state) {
+    constexpr size_t kRows = 64;
+    auto model = makePricingModel(64, state.range(0), state.range(1));
+    auto requests = bench::makeBidRequests(kRows);
+    std::vector<float> rows(kRows * model->rowStride());
+    for (size_t r = 0; r < kRows; ++r) {
+        model->extract(requests[r].floor_price(), requests[r].targeting(), rows.data() + r * model->rowStride());
+    }
+    std::vector<float> shades(kRows);
+    
+    for (auto _ : state) {
+        model->shadeBatch(rows.data(), kRows, shades.data());
+        benchmark::DoNotOptimize(shades.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRows);
+}
+BENCHMARK(BM_PricingModel_TreesBatch)->ArgsProduct({{2, 4, 6, 8}, {10, 100}});
+
+// Same rows one at a time, for comparison with the batch
+static void BM_PricingModel_TreesRow(benchmark::State& state) {
+    constexpr size_t kRows = 64;
+    auto model = makePricingModel(64, state.range(0), state.range(1));
+    auto requests = bench::makeBidRequests(kRows);
+    std::vector<float> rows(kRows * model->rowStride());
+    for (size_t r = 0; r < kRows; ++r) {
+        model->extract(requests[r].floor_price(), requests[r].targeting(), rows.data() + r * model->rowStride());
+    }
+    
+    for (auto _ : state) {
+        for (size_t r = 0; r < kRows; ++r) {
+            benchmark::DoNotOptimize(model->shade(rows.data() + r * model->rowStride()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kRows);
+}
+BENCHMARK(BM_PricingModel_TreesRow)->ArgsProduct({{2, 4, 6, 8}, {10, 100}});
+
+static void BM_Auction_SecondPrice(benchmark::State& state) {
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> amount(0.01, 10.0);
+    
+    std::vector<Bid> bids(state.range(0));
+    for (size_t i = 0; i < bids.size(); ++i) {
+        bids[i].id = "bid-" + std::to_string(i);
+        bids[i].campaign_id = "campaign-" + std::to_string(i % 100);
+        bids[i].amount = amount(rng);
+        bids[i].floor_price = 0.5;
+    }
+    
+    AuctionEngine auction;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(auction.runSecondPriceAuction(bids, 0.5));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Auction_SecondPrice)->RangeMultiplier(4)->Range(1, 4096)->Complexity();
+
+static void BM_Auction_CalculateBidScore(benchmark::State& state) {
+    auto requests = bench::makeBidRequests(1024);
+    AuctionEngine auction;
+    size_t i = 0;
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(auction.calculateBidScore(requests[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Auction_CalculateBidScore);
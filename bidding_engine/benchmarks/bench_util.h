@@ -0,0 +1,102 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+#include "proto/bid.pb.h"
+
+namespace bench {
+
+inline const std::vector<std::string>& targetingKeys() {
+    static const std::vector<std::string> keys = {
+        "premium_user", "high_value_region", "mobile", "geo", "os",
+        "device", "browser", "language", "age_bucket", "interest",
+        "site_category", "connection", "hour_of_day", "gender", "carrier"
+    };
+    return keys;
+}
+
+inline const std::vector<std::string>& targetingValues() {
+    static const std::vector<std::string> values = {
+        "true", "false", "us-east", "ios", "android", "chrome", "en", "25-34"
+    };
+    return values;
+}
+
+// Builds a BidRequest shaped like exchange traffic: a handful of targeting
+// keys, a few of which hit the scoring multipliers.
+inline bidding::BidRequest makeBidRequest(std::mt19937_64& rng, size_t targeting_keys = 8) {
+    const auto& keys = targetingKeys();
+    const auto& values = targetingValues();
+    
+    std::uniform_real_distribution<double> price(0.05, 5.0);
+    std::uniform_int_distribution<uint64_t> id;
+    std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+    
+    bidding::BidRequest request;
+    request.set_id("req-" + std::to_string(id(rng)));
+    request.set_timestamp(1700000000000LL);
+    request.set_user_id("user-" + std::to_string(id(rng) % 1000000));
+    request.set_ad_slot_id("slot-" + std::to_string(id(rng) % 1000));
+    request.set_floor_price(price(rng));
+    request.set_campaign_id("campaign-" + std::to_string(id(rng) % 100));
+    
+    auto& targeting = *request.mutable_targeting();
+    for (size_t i = 0; i < targeting_keys && i < keys.size(); ++i) {
+        targeting[keys[i]] = values[pick(rng)];
+    }
+    return request;
+}
+
+inline std::vector<bidding::BidRequest> makeBidRequests(size_t count, size_t targeting_keys = 8) {
+    std::mt19937_64 rng(42);
+    std::vector<bidding::BidRequest> requests;
+    requests.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        requests.push_back(makeBidRequest(rng, targeting_keys));
+    }
+    return requests;
+}
+
+// Splits a BidRequest's user-level fields across `slots` ad slots with
+// `candidates` competing campaigns, for batch vs per-slot comparisons.
+inline bidding::BidBatchRequest makeBatchRequest(std::mt19937_64& rng, size_t slots, size_t candidates = 8) {
+    bidding::BidRequest single = makeBidRequest(rng);
+    std::uniform_real_distribution<double> price(0.05, 5.0);
+    std::uniform_real_distribution<double> bid(0.1, 10.0);
+    
+    bidding::BidBatchRequest request;
+    request.set_id(single.id());
+    request.set_timestamp(single.timestamp());
+    request.set_user_id(single.user_id());
+    *request.mutable_targeting() = single.targeting();
+    for (size_t i = 0; i < slots; ++i) {
+        auto* slot = request.add_slots();
+        slot->set_ad_slot_id("slot-" + std::to_string(i));
+        slot->set_floor_price(price(rng));
+    }
+    for (size_t i = 0; i < candidates; ++i) {
+        auto* candidate = request.add_candidates();
+        candidate->set_campaign_id("campaign-" + std::to_string(i));
+        candidate->set_bid(bid(rng));
+    }
+    return request;
+}
+
+// The same work as one BidRequest per slot, as a client without batching sends it
+inline std::vector<bidding::BidRequest> splitBatchRequest(const bidding::BidBatchRequest& batch) {
+    std::vector<bidding::BidRequest> requests;
+    for (const auto& slot : batch.slots()) {
+        bidding::BidRequest request;
+        request.set_id(slot.ad_slot_id());
+        request.set_timestamp(batch.timestamp());
+        request.set_user_id(batch.user_id());
+        request.set_ad_slot_id(slot.ad_slot_id());
+        request.set_floor_price(slot.floor_price());
+        *request.mutable_targeting() = batch.targeting();
+        requests.push_back(std::move(request));
+    }
+    return requests;
+}
+
+}
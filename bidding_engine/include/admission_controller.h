@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "stats.h"
+
+enum class LimitAlgorithm {
+    AIMD,
+    GRADIENT
+};
+
+struct AdmissionConfig {
+    LimitAlgorithm algorithm = LimitAlgorithm::GRADIENT;
+    size_t initial_limit = 64;
+    size_t min_limit = 8;
+    size_t max_limit = 1024;
+    
+    // AIMD: latency above this counts as congestion
+    int64_t latency_threshold_us = 5000;
+    double backoff_ratio = 0.9;
+    
+    // Gradient: allowed ratio between short-term and long-term latency
+    double tolerance = 1.5;
+    double smoothing = 0.2;
+    size_t long_window = 600;
+};
+
+// Adaptive concurrency limiter sitting between TCPServer and BidHandler.
+// tryAcquire() is a single atomic increment; the limit is recomputed from
+// observed latencies on release(), by whichever thread wins the update lock.
+class AdmissionController {
+public:
+    AdmissionController(const AdmissionConfig& config = AdmissionConfig());
+    
+    bool tryAcquire();
+    void release(int64_t latency_us, bool dropped = false);
+    // Ends an admitted request that was never served, such as an
+    // unparseable frame, without feeding a latency sample to the limit
+    void cancel();
+    
+    size_t getLimit() const { return limit_.load(std::memory_order_relaxed); }
+    size_t getInFlight() const { return in_flight_.load(std::memory_order_relaxed); }
+    uint64_t getRejectedCount() const { return rejected_count_.value(); }
+    
+    std::string getPrometheusFormat() const;
+    
+    static LimitAlgorithm parseAlgorithm(const std::string& name);
+
+private:
+    void updateAimd(int64_t latency_us, bool dropped, size_t in_flight);
+    void updateGradient(int64_t latency_us, bool dropped, size_t in_flight);
+    void setLimit(double limit);
+    
+    AdmissionConfig config_;
+    
+    alignas(64) std::atomic<size_t> in_flight_;
+    alignas(64) std::atomic<size_t> limit_;
+    stats::Counter rejected_count_;
+    
+    // Estimator state, only touched under update_mutex_
+    std::mutex update_mutex_;
+    double estimated_limit_;
+    double short_rtt_us_;
+    double long_rtt_us_;
+    size_t long_samples_;
+};
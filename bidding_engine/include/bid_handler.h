@@ -5,12 +5,32 @@
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include "data_structures/lockfree_queue.h"
 #include "data_structures/memory_pool.h"
+#include "data_structures/campaign_outcome_table.h"
 #include "data_structures/circuit_breaker.h"
+#include "data_structures/frequency_cap_store.h"
+#include "campaign_budgets.h"
+#include "stats.h"
+#include "scoring_rules.h"
+#include "pricing_model.h"
 #include "proto/bid.pb.h"
 
+// A candidate bid from one scoring source
+struct SourceBid {
+    std::string campaign_id;
+    double bid = 0.0;
+};
+
+// Extra bidder consulted by scoreBid, such as a model server or a campaign
+// lookup. Runs on a worker thread, concurrently with the other sources and
+// possibly with a hedged copy of itself. Returns false to abstain.
+using ScoringSource = std::function<bool(const bidding::BidRequest&, SourceBid&)>;
+
 class BidHandler {
 public:
     BidHandler(size_t thread_pool_size = 8);
@@ -21,29 +41,109 @@ public:
     
     bool submitBidRequest(const bidding::BidRequest& request);
     bidding::BidResponse processBid(const bidding::BidRequest& request);
+    bidding::BidBatchResponse processBatch(const bidding::BidBatchRequest& request);
+    
+    // Pure scoring steps, without circuit breaker or callback (used by benchmarks)
+    bidding::BidResponse scoreBid(const bidding::BidRequest& request);
+    bidding::BidBatchResponse scoreBatch(const bidding::BidBatchRequest& request);
+    
+    // Scoring sources can outlive the call, so their fan-out shares the
+    // request. These take it already shared; the overloads above copy it
+    // once per request when any source is registered.
+    bidding::BidResponse processBid(std::shared_ptr<const bidding::BidRequest> request);
+    bidding::BidResponse scoreBid(std::shared_ptr<const bidding::BidRequest> request);
     
     void setBidCallback(std::function<void(const bidding::BidResponse&)> callback);
+    // Replaces the compiled-in kBidRules with an interpreted rule set; call before start()
+    void setScoringRules(const ScoringRuleSet& rules);
+    // Shades prices with a model instead of the flat 20%; call before start()
+    void setPricingModel(std::unique_ptr<PricingModel> model);
+    // Drops campaigns at their cap before the auction and records wins
+    void setFrequencyCaps(FrequencyCapStore* store) { frequency_caps_ = store; }
+    // Drops campaigns whose budget lease is spent. Spend is charged from win
+    // notices, not at bid time, since a bid only wins if the exchange says so.
+    void setBudgets(CampaignBudgets* budgets) { budgets_ = budgets; }
+    // Win notice totals, used to correct the pricing model's shade for each
+    // campaign by its observed win rate; call before start()
+    void setOutcomes(const CampaignOutcomeTable* outcomes) { outcomes_ = outcomes; }
+    
+    // Sources run in parallel on the worker pool and the highest bid wins.
+    // Once the budget is spent scoreBid goes ahead with the best bid so far;
+    // sources still running finish in the background and are ignored.
+    // A source is never run on the calling thread: with the task queue full
+    // it is skipped for that request, as if it had abstained. A hedged
+    // source still running after hedge_after is started a second time on
+    // another worker and the first answer is used, so it must be
+    // idempotent. Call before start().
+    void addScoringSource(const std::string& name, ScoringSource source, bool hedge = false);
+    // hedge_after of zero turns hedging off
+    void setScoringBudget(std::chrono::microseconds budget, std::chrono::microseconds hedge_after);
     
     // Statistics
-    uint64_t getProcessedCount() const { return processed_count_.load(); }
-    uint64_t getErrorCount() const { return error_count_.load(); }
+    uint64_t getProcessedCount() const { return processed_count_.value(); }
+    uint64_t getErrorCount() const { return error_count_.value(); }
+    
+    std::string getPrometheusFormat() const;
 
 private:
+    struct Source {
+        std::string name;
+        ScoringSource score;
+        bool hedge;
+        stats::Counter late;
+        stats::Counter rejected;
+    };
+    
+    // One request's fan-out; shared with tasks that may outlive the request
+    struct FanOut {
+        std::shared_ptr<const bidding::BidRequest> request;
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        std::vector<uint8_t> done;
+        size_t remaining;
+        SourceBid best;
+    };
+    
     void workerThread();
-    bidding::BidResponse scoreBid(const bidding::BidRequest& request);
+    // shared is null when the caller holds the request only by reference
+    bidding::BidResponse process(const bidding::BidRequest& request,
+                                 const std::shared_ptr<const bidding::BidRequest>& shared);
+    bidding::BidResponse score(const bidding::BidRequest& request,
+                               const std::shared_ptr<const bidding::BidRequest>& shared);
+    bool scoreSources(const std::shared_ptr<const bidding::BidRequest>& request, SourceBid& best);
+    void runSource(const std::shared_ptr<FanOut>& fan, size_t index, bool hedged);
+    // False if the queue is full or the pool stopped; the task is not run
+    bool submitTask(std::function<void()> task);
     bool validateBidRequest(const bidding::BidRequest& request);
+    double targetingMultiplier(const TargetingMap& targeting) const;
     
     size_t thread_pool_size_;
     std::vector<std::thread> worker_threads_;
     std::atomic<bool> running_;
     
     LockFreeQueue<bidding::BidRequest> request_queue_;
+    LockFreeQueue<std::function<void()>> task_queue_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
     std::unique_ptr<MemoryPool> memory_pool_;
     std::unique_ptr<CircuitBreaker> circuit_breaker_;
     
     std::function<void(const bidding::BidResponse&)> bid_callback_;
+    std::unique_ptr<ScoringRuleSet> runtime_rules_;
+    std::unique_ptr<PricingModel> pricing_model_;
+    FrequencyCapStore* frequency_caps_;
+    CampaignBudgets* budgets_;
+    const CampaignOutcomeTable* outcomes_;
+    
+    std::vector<std::unique_ptr<Source>> sources_;
+    std::chrono::microseconds scoring_budget_;
+    std::chrono::microseconds hedge_after_;
+    stats::Counter fan_outs_;
+    stats::Counter budget_expired_;
+    stats::Counter hedges_;
+    stats::Counter hedge_wins_;
     
-    std::atomic<uint64_t> processed_count_;
-    std::atomic<uint64_t> error_count_;
+    stats::Counter processed_count_;
+    stats::Counter error_count_;
 };
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+// C ABI of the same-host shared-memory transport (libbidding_shm), for
+// clients that cannot link C++ such as the api-gateway's Node addon.
+// Payloads are serialized BidRequest/BidResponse (or the batch variants
+// when batch is non-zero); the library adds and strips the length prefix.
+//
+// One thread may send while another receives on the same client; two
+// concurrent senders or two concurrent receivers are not supported.
+
+#if defined(__GNUC__)
+#define BIDDING_SHM_API __attribute__((visibility("default")))
+#else
+#define BIDDING_SHM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bidding_shm_client bidding_shm_client;
+
+// Connects to the engine's control socket (server.shm.path) and maps the
+// session's rings. Returns NULL and sets errno on failure.
+BIDDING_SHM_API bidding_shm_client* bidding_shm_connect(const char* path);
+
+// Ends the session and frees the client
+BIDDING_SHM_API void bidding_shm_close(bidding_shm_client* client);
+
+// Queues one frame, waiting for ring space as needed.
+// Returns 0, or -1 with errno EPIPE once the engine has gone away (EPROTO
+// if the ring indexes were found out of range).
+BIDDING_SHM_API int bidding_shm_send(bidding_shm_client* client, const void* payload, uint32_t length, int batch);
+
+// Receives one frame into buffer, waiting up to timeout_ms (-1 = forever).
+// Returns the payload length. A return value larger than capacity means
+// nothing was consumed: retry with a buffer of at least that size.
+// Returns -1 with errno ETIMEDOUT, EPIPE or EPROTO otherwise.
+BIDDING_SHM_API int64_t bidding_shm_recv(bidding_shm_client* client, void* buffer, uint32_t capacity,
+                                         int* batch, int timeout_ms);
+
+// Event-loop integration: bidding_shm_arm() returns 1 if a response is
+// already queued, otherwise 0 after asking the engine to signal the fd from
+// bidding_shm_event_fd() when one is. Call bidding_shm_recv() with a zero
+// timeout when the fd becomes readable.
+BIDDING_SHM_API int bidding_shm_event_fd(const bidding_shm_client* client);
+BIDDING_SHM_API int bidding_shm_arm(bidding_shm_client* client);
+
+// Busy-poll window before a blocked call sleeps; defaults to the engine's hint
+BIDDING_SHM_API void bidding_shm_set_spin_us(bidding_shm_client* client, uint32_t spin_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "peer_sync_protocol.h"
+#include "stats.h"
+
+// Per-campaign spend limits shared by every replica of the engine.
+//
+// Spend is what won auctions cleared at, charged as win notices arrive
+// (WinNoticeIngest). It is a G-counter: each replica only ever raises its
+// own total, and a campaign's spend is the sum over replicas. A replica may not spend the
+// remaining budget freely, since every other replica could do the same;
+// instead it holds a lease, its own spend plus a share of what is left,
+// and stops bidding on the campaign once the lease is used up. rebalance()
+// resizes leases from the merged view of all replicas: the share is in
+// proportion to each live replica's recent demand, so traffic moving
+// between replicas moves the budget with it. Replicas compute the same
+// shares from (nearly) the same view, so leases add up to the budget, and
+// over-delivery is bounded by spend not yet synced rather than growing with
+// the number of replicas.
+//
+// allow() and recordWin() are the hot path and only touch atomics. The
+// merged view belongs to the sync side (PeerSync) and is locked only
+// against metric scrapes.
+class CampaignBudgets {
+public:
+    // budgets in currency units by campaign id. node_id identifies this
+    // engine among its peers; expected_replicas sizes the first lease,
+    // before any peer has been heard from.
+    CampaignBudgets(const std::unordered_map<std::string, double>& budgets, uint32_t node_id,
+                    size_t expected_replicas = 1);
+    
+    CampaignBudgets(const CampaignBudgets&) = delete;
+    CampaignBudgets& operator=(const CampaignBudgets&) = delete;
+    
+    // Counts the request towards the campaign's demand; false once this
+    // replica has spent its lease. Campaigns without a budget always pass.
+    bool allow(const std::string& campaign_id);
+    // Charges a win notice's clearing price. campaign_id is
+    // kWinNoticeCampaignBytes, zero padded as in WinNotice, so budgets match
+    // notices on the id's first kWinNoticeCampaignBytes bytes.
+    void recordWin(const char* campaign_id, uint64_t price_micros);
+    // Lease this replica has left to spend on the campaign; infinite for
+    // campaigns without a budget. Not counted as demand.
+    double remaining(const std::string& campaign_id) const;
+    
+    // Unique per process start, so a restarted engine is a new G-counter
+    // replica and its earlier spend still counts
+    uint64_t replicaId() const { return replica_id_; }
+    bool empty() const { return campaigns_.empty(); }
+    
+    // Sync side, called from one thread
+    //
+    // Max-merges another replica's counter; true if it raised anything
+    bool merge(const PeerCounter& counter);
+    // Appends up to max_entries counters that changed since they were last
+    // taken (all of them with everything set), own ones first
+    size_t takeCounters(std::vector<PeerCounter>& out, size_t max_entries, bool everything);
+    // Recomputes this replica's leases; live holds the peers heard from
+    // recently, elapsed_seconds the time since the last call
+    void rebalance(const std::unordered_set<uint64_t>& live, double elapsed_seconds);
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    struct ReplicaCounters {
+        uint64_t spend_micros = 0;
+        uint64_t demand = 0;
+        bool dirty = false;
+        uint64_t rate_demand = 0;       // demand at the last rebalance
+        double demand_rate = 0.0;       // smoothed requests/sec
+    };
+    
+    struct Campaign {
+        std::string id;
+        uint64_t key;                               // winNoticeKey() of the truncated id
+        uint64_t budget_micros;
+        std::atomic<uint64_t> spend_micros{0};     // this replica's, drives allow()
+        std::atomic<uint64_t> lease_micros{0};
+        stats::Counter demand;
+        stats::Counter exhausted;
+        // Merged view by replica id, this one included; under view_mutex_
+        std::unordered_map<uint64_t, ReplicaCounters> replicas;
+        uint64_t known_spend_micros = 0;
+    };
+    
+    Campaign* find(const std::string& campaign_id) const;
+    // Copies the hot-path counters into the merged view; under view_mutex_
+    ReplicaCounters& refreshOwn(Campaign& campaign);
+    
+    uint64_t replica_id_;
+    std::vector<std::unique_ptr<Campaign>> campaigns_;
+    std::unordered_map<std::string, Campaign*> by_id_;
+    std::unordered_map<uint64_t, Campaign*> by_key_;
+    mutable std::mutex view_mutex_;
+};
@@ -5,6 +5,8 @@
 #include <mutex>
 #include <shared_mutex>
 #include <chrono>
+#include "profiler.h"
+#include "stats.h"
 #include "proto/bid.pb.h"
 
 class BidCache {
@@ -18,6 +20,16 @@ public:
     
     size_t size() const;
     double getHitRate() const;
+    
+    // Writes unexpired entries and their expiry to `path`, through a
+    // temporary file and a rename. Entries are serialized under the read
+    // lock, so get() carries on and only put() waits. Returns the number of
+    // entries written; throws std::runtime_error if the file cannot be written.
+    size_t saveSnapshot(const std::string& path) const;
+    // Maps a snapshot written by saveSnapshot() and adds the entries that
+    // have not expired since. Returns the number added, 0 if the file is
+    // missing or not a snapshot.
+    size_t loadSnapshot(const std::string& path);
 
 private:
     struct CacheEntry {
@@ -30,9 +42,9 @@ private:
     size_t max_size_;
     size_t ttl_seconds_;
     std::unordered_map<std::string, CacheEntry> cache_;
-    mutable std::shared_mutex mutex_;
+    mutable ProfiledSharedMutex mutex_;
     
-    std::atomic<uint64_t> hits_;
-    std::atomic<uint64_t> misses_;
+    stats::Counter hits_;
+    stats::Counter misses_;
 };
 
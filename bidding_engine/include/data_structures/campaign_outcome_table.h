@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "win_notice_protocol.h"
+
+// Totals for one campaign since the engine started. Callers wanting a rate
+// over a period (pacing, shading feedback) diff two reads.
+struct CampaignOutcome {
+    std::string campaign_id;
+    uint64_t notices = 0;           // wins and losses
+    uint64_t wins = 0;
+    uint64_t spend_micros = 0;      // sum of clearing prices on wins
+    uint64_t won_bid_micros = 0;    // sum of our bids on wins
+    
+    double winRate() const { return notices ? static_cast<double>(wins) / notices : 0.0; }
+    // Average share of the bid actually paid when winning
+    double priceToBid() const {
+        return won_bid_micros ? static_cast<double>(spend_micros) / won_bid_micros : 0.0;
+    }
+    double spend() const { return spend_micros / 1e6; }
+};
+
+// Per-campaign outcome counters in a fixed open-addressed table, one cache
+// line per campaign, so notices are applied without locks or allocation.
+//
+// A new campaign claims an empty slot with a CAS on its key, writes its id
+// and then publishes the real key; readers and other writers that find the
+// slot mid-claim wait for the publish. Slots are never freed. Counters are
+// relaxed atomics, so a concurrent read may see a win without its spend.
+class CampaignOutcomeTable {
+public:
+    // Sized for at most max_campaigns, at half load
+    explicit CampaignOutcomeTable(size_t max_campaigns);
+    
+    CampaignOutcomeTable(const CampaignOutcomeTable&) = delete;
+    CampaignOutcomeTable& operator=(const CampaignOutcomeTable&) = delete;
+    
+    // campaign_id is kWinNoticeCampaignBytes, zero padded as in WinNotice.
+    // False if the campaign is new and the table is full.
+    bool apply(const char* campaign_id, NoticeOutcome outcome, uint32_t bid_micros, uint32_t price_micros);
+    
+    // False if no notice has been seen for the campaign
+    bool get(const std::string& campaign_id, CampaignOutcome& outcome) const;
+    std::vector<CampaignOutcome> snapshot() const;
+    
+    size_t size() const { return used_.load(std::memory_order_relaxed); }
+    size_t maxCampaigns() const { return max_campaigns_; }
+
+private:
+    static constexpr uint64_t kEmpty = 0;
+    static constexpr uint64_t kClaiming = 1;
+    
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> key{kEmpty};
+        char campaign_id[kWinNoticeCampaignBytes];
+        std::atomic<uint64_t> notices{0};
+        std::atomic<uint64_t> wins{0};
+        std::atomic<uint64_t> spend_micros{0};
+        std::atomic<uint64_t> won_bid_micros{0};
+    };
+    static_assert(sizeof(Slot) == 64, "Slot must stay one cache line");
+    
+    static uint64_t keyFor(const char* campaign_id);
+    Slot* find(const char* campaign_id, bool insert) const;
+    static CampaignOutcome read(const Slot& slot);
+    
+    size_t max_campaigns_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    mutable std::atomic<size_t> used_;
+};
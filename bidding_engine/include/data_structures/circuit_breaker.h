@@ -3,6 +3,7 @@
 #include <atomic>
 #include <chrono>
 #include <mutex>
+#include "profiler.h"
 
 enum class CircuitState {
     CLOSED,
@@ -10,6 +11,9 @@ enum class CircuitState {
     HALF_OPEN
 };
 
+// The state and failure streak drive decisions, so they are exact atomics
+// rather than stats::Counter; the per-request calls (isOpen, recordSuccess
+// while closed) only read them and take no lock.
 class CircuitBreaker {
 public:
     CircuitBreaker(size_t failure_threshold, size_t timeout_seconds);
@@ -22,15 +26,15 @@ public:
     size_t getFailureCount() const { return failure_count_.load(); }
 
 private:
-    void checkAndUpdateState();
+    void checkAndUpdateState() const;
     
-    std::atomic<CircuitState> state_;
+    mutable std::atomic<CircuitState> state_;
     std::atomic<size_t> failure_count_;
-    std::atomic<size_t> success_count_;
+    mutable std::atomic<size_t> success_count_;
     size_t failure_threshold_;
     size_t timeout_seconds_;
     std::chrono::steady_clock::time_point last_failure_time_;
-    mutable std::mutex mutex_;
+    mutable ProfiledMutex mutex_;
     size_t half_open_requests_;
 };
 
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "data_structures/huge_pages.h"
+#include "stats.h"
+
+struct FrequencyCapConfig {
+    bool enabled = false;
+    size_t memory_mb = 256;                 // fixed table size, 8 bytes per (user, campaign)
+    unsigned window_seconds = 86400;
+    uint32_t default_cap = 0;               // impressions per user per window, 0 = uncapped
+    std::unordered_map<std::string, uint32_t> campaign_caps;
+    std::string snapshot_file;              // empty = counts start from zero on every restart
+    unsigned snapshot_interval_seconds = 10;
+    HugePageConfig pages;
+};
+
+// Header of a snapshot file; the table follows at kSnapshotTableOffset so
+// it can be mapped directly
+struct FrequencyCapSnapshotHeader {
+    char magic[8];              // "BIDFCAP\1"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t bucket_count;
+    uint64_t window_ms;
+    uint64_t saved_unix_ms;
+    uint64_t occupied;
+};
+
+// Per-(user, campaign) impression counts over a sliding window, in a fixed
+// block of memory so tens of millions of users fit in a few GB.
+//
+// Each pair is one packed 64-bit word: a 24-bit fingerprint of the pair's
+// hash, the 16-bit index of the window it was last touched in, and 12-bit
+// counts for that window and the one before. A count is the current window
+// plus the previous one weighted by how much of it still overlaps the
+// sliding window. Words roll forward on update, so nothing sweeps the table.
+//
+// Buckets are one cache line of eight words; a pair only ever lives in its
+// bucket. Updates are a CAS on one word, reads a plain load. Two threads
+// inserting the same new pair at once can each claim a slot; the inserter
+// that notices folds the later slot into the earlier one. A full bucket
+// evicts its lowest count, so under memory pressure a user can see a capped
+// campaign again; fingerprint collisions go the other way and cap early.
+// Counts saturate at 4095.
+//
+// Windows are numbered from the Unix epoch, so words stay meaningful across
+// restarts. With a snapshot file the table is saved incrementally: record()
+// marks the 64 KB chunk it touched, and a background thread rewrites only
+// marked chunks in place, reading them with plain atomic loads, so the hot
+// path never waits on it. Words are independent, so a half-written pass
+// still leaves a usable file. On startup a matching snapshot is mapped
+// copy-on-write as the table itself, so pages load lazily on first touch;
+// with huge pages or prefaulting configured it is read into the table
+// instead, since file pages can be neither.
+class FrequencyCapStore {
+public:
+    static constexpr uint32_t kMaxCount = 4095;
+    
+    static constexpr size_t kSnapshotTableOffset = 4096;
+    
+    // Throws std::runtime_error if the table cannot be mapped. A snapshot
+    // that is unreadable, from a different table size or window, or more
+    // than a window old is ignored and overwritten.
+    explicit FrequencyCapStore(const FrequencyCapConfig& config);
+    ~FrequencyCapStore();
+    
+    FrequencyCapStore(const FrequencyCapStore&) = delete;
+    FrequencyCapStore& operator=(const FrequencyCapStore&) = delete;
+    
+    // 0 if the campaign is uncapped
+    uint32_t capFor(const std::string& campaign_id) const;
+    
+    // Impressions in the sliding window
+    uint32_t count(const std::string& user_id, const std::string& campaign_id) const;
+    void record(const std::string& user_id, const std::string& campaign_id, uint32_t impressions = 1);
+    // record() for a pair already hashed with pairHash(), e.g. one replicated
+    // from a peer; not passed to the replicator
+    void recordHashed(uint64_t hash, uint32_t impressions);
+    
+    // Called with every impression record() counts, so it can be sent to
+    // the other replicas. Set before traffic starts.
+    void setReplicator(std::function<void(uint64_t, uint32_t)> replicator) { replicator_ = std::move(replicator); }
+    
+    static uint64_t pairHash(const std::string& user_id, const std::string& campaign_id);
+    
+    // True if the campaign is capped and the user has reached the cap;
+    // counted as a filtered candidate
+    bool isCapped(const std::string& user_id, const std::string& campaign_id);
+    
+    size_t capacity() const { return bucket_count_ * kBucketSlots; }
+    size_t memoryBytes() const { return bucket_count_ * sizeof(Bucket); }
+    bool restoredFromSnapshot() const { return restored_; }
+    
+    // Background snapshots, if a snapshot file is configured. stop() writes
+    // a final one.
+    void start();
+    void stop();
+    // Writes the chunks changed since the last call; returns bytes written
+    size_t snapshot();
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    static constexpr size_t kBucketSlots = 8;
+    static constexpr size_t kChunkBuckets = 1024;
+    
+    struct alignas(64) Bucket {
+        std::atomic<uint64_t> slots[kBucketSlots];
+    };
+    
+    struct Window {
+        uint16_t index;
+        float previous_weight;          // share of the previous window still inside the sliding one
+    };
+    
+    Window currentWindow() const;
+    Bucket& bucketFor(uint64_t hash) const;
+    void markDirty(uint64_t hash);
+    // Adds to the pair's word, inserting it if absent
+    void addCounts(Bucket& bucket, uint32_t fingerprint, uint16_t window, uint32_t previous, uint32_t current);
+    // Folds copies of a pair that racing inserts left in several slots
+    void mergeDuplicates(Bucket& bucket, uint32_t fingerprint, uint16_t window);
+    bool mapSnapshot();
+    bool readSnapshot(int fd);
+    void createSnapshot();
+    void snapshotThread();
+    
+    size_t bucket_count_;
+    size_t bucket_mask_;
+    Bucket* buckets_;
+    HugePageConfig pages_;
+    std::unique_ptr<HugePageRegion> region_;    // null when the table maps the snapshot
+    
+    uint64_t window_ms_;
+    uint32_t default_cap_;
+    std::unordered_map<std::string, uint32_t> campaign_caps_;
+    std::function<void(uint64_t, uint32_t)> replicator_;
+    
+    stats::Counter recorded_;
+    stats::Counter filtered_;
+    stats::Counter evictions_;
+    stats::Gauge occupied_;
+    
+    std::string snapshot_file_;
+    unsigned snapshot_interval_seconds_;
+    int snapshot_fd_;
+    bool restored_;
+    size_t chunk_count_;
+    std::unique_ptr<std::atomic<uint8_t>[]> dirty_;
+    std::thread snapshot_thread_;
+    std::mutex snapshot_mutex_;
+    std::condition_variable snapshot_cv_;
+    bool snapshot_running_;
+    std::atomic<uint64_t> snapshots_;
+    std::atomic<uint64_t> snapshot_bytes_;
+    std::atomic<uint64_t> snapshot_failures_;
+};
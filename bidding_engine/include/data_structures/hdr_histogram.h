@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <ostream>
+
+// Log-linear latency histogram in the style of HdrHistogram: values are
+// bucketed by power of two, each power split into linear sub-buckets so
+// that every recorded value keeps the requested significant digits.
+// Not thread-safe; record per thread and merge() for reporting.
+class HdrHistogram {
+public:
+    HdrHistogram(uint64_t highest_trackable_value = 60000000000ULL, int significant_digits = 3);
+    
+    void record(uint64_t value) { recordCount(value, 1); }
+    void recordCount(uint64_t value, uint64_t count);
+    void merge(const HdrHistogram& other);
+    void reset();
+    
+    uint64_t count() const { return total_count_; }
+    uint64_t min() const { return total_count_ ? min_value_ : 0; }
+    uint64_t max() const { return max_value_; }
+    double mean() const;
+    uint64_t valueAtPercentile(double percentile) const;
+    
+    // Percentile table (HdrHistogram "percentile distribution" layout),
+    // values divided by unit_scale for display.
+    void printPercentiles(std::ostream& os, double unit_scale = 1000.0, const char* unit = "us") const;
+
+private:
+    size_t indexFor(uint64_t value) const;
+    uint64_t highestEquivalentValue(size_t index) const;
+    
+    uint64_t highest_trackable_value_;
+    int sub_bucket_bits_;
+    uint64_t sub_bucket_count_;
+    uint64_t sub_bucket_half_count_;
+    std::vector<uint64_t> counts_;
+    
+    uint64_t total_count_;
+    uint64_t min_value_;
+    uint64_t max_value_;
+    long double sum_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+enum class HugePageMode {
+    NONE,               // 4 KB pages
+    TRANSPARENT,        // THP via madvise(MADV_HUGEPAGE)
+    EXPLICIT            // MAP_HUGETLB from the reserved pool (vm.nr_hugepages)
+};
+
+struct HugePageConfig {
+    HugePageMode mode = HugePageMode::NONE;
+    bool prefault = false;      // fault every page in at startup rather than on the bid path
+    int numa_node = -1;         // bind to this node; -1 leaves first-touch placement
+};
+
+// Zeroed anonymous memory for a large engine table, on huge pages where
+// the kernel can provide them. EXPLICIT falls back to TRANSPARENT and that
+// to 4 KB pages, with a warning, so a host without huge pages still runs.
+// Without prefaulting the mapping is MAP_NORESERVE and pages are only
+// backed as they are first written.
+//
+// Every live region is listed in getPrometheusFormat() with the bytes the
+// kernel actually put on huge pages, read from /proc/self/smaps: THP is
+// best effort and can come back partially or not at all.
+class HugePageRegion {
+public:
+    // Throws std::runtime_error if no mapping at all can be made
+    HugePageRegion(const std::string& name, size_t bytes, const HugePageConfig& config);
+    ~HugePageRegion();
+    
+    HugePageRegion(const HugePageRegion&) = delete;
+    HugePageRegion& operator=(const HugePageRegion&) = delete;
+    
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& name() const { return name_; }
+    // What the region got, after any fallback
+    HugePageMode backing() const { return backing_; }
+    
+    // "none" | "thp" | "hugetlb"
+    static HugePageMode parseMode(const std::string& name);
+    static const char* modeName(HugePageMode mode);
+    
+    static std::string getPrometheusFormat();
+
+private:
+    bool mapExplicit(size_t bytes);
+    void mapAnonymous(size_t bytes, bool transparent);
+    void bindNode(int node);
+    void prefault();
+    
+    std::string name_;
+    void* data_;
+    size_t size_;               // requested
+    void* mapping_;
+    size_t mapping_size_;       // rounded up to the page size actually used
+    HugePageMode backing_;
+    HugePageMode requested_;
+};
@@ -2,32 +2,100 @@
 
 #include <atomic>
 #include <memory>
-#include <boost/lockfree/queue.hpp>
+#include <cstddef>
+#include <utility>
 
+// Bounded MPMC ring (Vyukov). Unlike boost::lockfree::queue it accepts
+// non-trivial element types such as protobuf messages.
 template<typename T>
 class LockFreeQueue {
 public:
-    LockFreeQueue(size_t capacity = 10000) 
-        : queue_(capacity) {
+    LockFreeQueue(size_t capacity = 10000)
+        : capacity_(roundUpPowerOfTwo(capacity))
+        , mask_(capacity_ - 1)
+        , cells_(new Cell[capacity_])
+        , enqueue_pos_(0)
+        , dequeue_pos_(0) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
     
     bool push(const T& item) {
-        return queue_.push(item);
+        Cell* cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
     }
     
     bool pop(T& item) {
-        return queue_.pop(item);
+        Cell* cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
     }
     
     bool empty() const {
-        return queue_.empty();
+        return size() == 0;
     }
     
     size_t size() const {
-        return queue_.size();
+        size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+    
+    size_t capacity() const {
+        return capacity_;
     }
 
 private:
-    boost::lockfree::queue<T> queue_;
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    
+    static size_t roundUpPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+    
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
 };
-
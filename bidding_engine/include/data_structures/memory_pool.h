@@ -1,30 +1,39 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <cstddef>
+#include <string>
+#include "data_structures/huge_pages.h"
 
+// Fixed-size block allocator over one contiguous arena. Requests larger
+// than the block size, or made while the pool is exhausted, fall back to
+// malloc; deallocate() tells the two apart by address. The arena is a
+// HugePageRegion, so it can sit on huge pages and be prefaulted.
 class MemoryPool {
 public:
-    MemoryPool(size_t pool_size);
+    MemoryPool(size_t pool_size, size_t block_size = 1024, const HugePageConfig& pages = HugePageConfig(),
+               const std::string& name = "memory_pool");
     ~MemoryPool();
     
     void* allocate(size_t size);
     void deallocate(void* ptr);
     
-    size_t getUsedCount() const { return used_count_; }
+    // Safe from any thread, e.g. for metrics
+    size_t getUsedCount() const { return used_count_.load(std::memory_order_relaxed); }
     size_t getTotalCount() const { return pool_size_; }
+    size_t getBlockSize() const { return block_size_; }
 
 private:
-    struct Block {
-        void* data;
-        bool in_use;
-    };
+    bool owns(const void* ptr) const;
     
     size_t pool_size_;
-    std::vector<Block> blocks_;
+    size_t block_size_;
+    std::unique_ptr<HugePageRegion> region_;
+    char* arena_;
+    std::vector<void*> free_blocks_;
     std::mutex mutex_;
-    size_t used_count_;
+    std::atomic<size_t> used_count_;    // written under mutex_
 };
-
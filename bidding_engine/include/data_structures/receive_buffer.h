@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include "data_structures/huge_pages.h"
+#include "data_structures/memory_pool.h"
+
+// Top bit of the length prefix: the frame carries a BidBatchRequest (or,
+// from the engine, a BidBatchResponse) instead of a single message
+static constexpr uint32_t kBatchFrameFlag = 0x80000000u;
+
+struct ReceiveBufferConfig {
+    size_t slab_bytes = 8192;
+    size_t pool_slabs = 4096;           // shared by all connections
+    size_t max_frame_bytes = 1 << 20;   // larger frames are answered with an error
+    HugePageConfig pages;               // backing of the slab pool
+};
+
+// Per-connection receive buffer for length-prefixed frames. Bytes live in a
+// chain of fixed-size slabs from a shared MemoryPool, so a recv can fill
+// the tail slab and a frame larger than one slab simply spans several.
+// Frames above max_frame_bytes are reported once and their body is then
+// discarded as it arrives, so the connection stays usable and buffered
+// bytes never exceed about one maximum frame.
+class ReceiveBuffer {
+public:
+    enum class FrameStatus {
+        INCOMPLETE,
+        COMPLETE,
+        TOO_LARGE
+    };
+    
+    ReceiveBuffer(MemoryPool& pool, size_t max_frame_bytes);
+    ~ReceiveBuffer();
+    
+    ReceiveBuffer(const ReceiveBuffer&) = delete;
+    ReceiveBuffer& operator=(const ReceiveBuffer&) = delete;
+    
+    // Free space at the tail for the next recv; grows the chain when full
+    size_t prepareWrite(char*& dest);
+    void commitWrite(size_t bytes);
+    void append(const char* data, size_t length);
+    
+    // COMPLETE: data/length is the frame body, valid until consumeFrame().
+    // TOO_LARGE: data/length is the already buffered prefix of the body
+    // (enough to recover the request id); consumeFrame() skips the rest.
+    FrameStatus nextFrame(const char*& data, size_t& length);
+    void consumeFrame();
+    // Whether the frame last returned by nextFrame() had kBatchFrameFlag set
+    bool isBatchFrame() const { return pending_batch_; }
+    
+    size_t size() const { return size_; }
+
+private:
+    struct Slab {
+        char* data;
+        size_t begin;
+        size_t end;
+    };
+    
+    void copyOut(size_t offset, char* dest, size_t length) const;
+    void consume(size_t bytes);
+    
+    MemoryPool& pool_;
+    size_t slab_bytes_;
+    size_t max_frame_bytes_;
+    std::deque<Slab> slabs_;
+    size_t size_;
+    
+    size_t pending_bytes_;
+    bool pending_too_large_;
+    bool pending_batch_;
+    size_t skip_remaining_;
+    std::string scratch_;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Control block of a byte ring placed in memory shared between processes.
+// head/tail count bytes ever written/read, so they never wrap in practice.
+struct ShmRingHeader {
+    alignas(64) std::atomic<uint64_t> head;             // written by the producer
+    std::atomic<uint32_t> producer_waiting;             // producer is blocked on a full ring
+    alignas(64) std::atomic<uint64_t> tail;             // written by the consumer
+    std::atomic<uint32_t> consumer_waiting;             // consumer is blocked on an empty ring
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory rings need lock-free 64-bit atomics");
+
+// Single-producer/single-consumer byte pipe over a ShmRingHeader followed
+// by a power-of-two data area. Each process builds its own view; the cached
+// indexes are process-local so the common case touches one shared line.
+//
+// Sleeping follows the usual flag protocol: a side that is about to block
+// sets its waiting flag and re-checks the ring, the other side checks the
+// flag after publishing and sends a wakeup only if it is set. The fences in
+// setWaiting/needsWake order the flag against the index on both sides.
+//
+// Both indexes live in memory the other process can write, so neither is
+// trusted: indexes further apart than the capacity (a tail past the head
+// wraps to the same thing) mark the ring corrupt, after which it reads as
+// full to the producer and empty to the consumer and no copy can leave the
+// data area. The owner of the ring should then drop the session.
+class ShmRing {
+public:
+    static size_t bytesFor(size_t capacity) { return sizeof(ShmRingHeader) + capacity; }
+    
+    ShmRing()
+        : header_(nullptr), data_(nullptr), capacity_(0), mask_(0), cached_head_(0), cached_tail_(0), corrupt_(false) {
+    }
+    
+    ShmRing(void* base, size_t capacity)
+        : header_(static_cast<ShmRingHeader*>(base))
+        , data_(static_cast<char*>(base) + sizeof(ShmRingHeader))
+        , capacity_(capacity)
+        , mask_(capacity - 1)
+        , cached_head_(0)
+        , cached_tail_(0)
+        , corrupt_(false) {
+    }
+    
+    // Creator only, before the segment is shared
+    void init() {
+        header_->head.store(0, std::memory_order_relaxed);
+        header_->tail.store(0, std::memory_order_relaxed);
+        header_->producer_waiting.store(0, std::memory_order_relaxed);
+        header_->consumer_waiting.store(0, std::memory_order_relaxed);
+    }
+    
+    size_t capacity() const { return capacity_; }
+    bool corrupt() const { return corrupt_; }
+    
+    // Producer side
+    size_t writable() {
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        cached_tail_ = header_->tail.load(std::memory_order_acquire);
+        return space(head, cached_tail_);
+    }
+    
+    size_t write(const char* data, size_t length) {
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        size_t free_bytes = space(head, cached_tail_);
+        if (free_bytes < length) {
+            free_bytes = writable();
+        }
+        size_t n = length < free_bytes ? length : free_bytes;
+        if (n == 0) {
+            return 0;
+        }
+        
+        size_t offset = static_cast<size_t>(head) & mask_;
+        size_t first = n < capacity_ - offset ? n : capacity_ - offset;
+        std::memcpy(data_ + offset, data, first);
+        std::memcpy(data_, data + first, n - first);
+        header_->head.store(head + n, std::memory_order_release);
+        return n;
+    }
+    
+    // Consumer side
+    size_t readable() {
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        cached_head_ = header_->head.load(std::memory_order_acquire);
+        return distance(cached_head_, tail);
+    }
+    
+    // Copies up to length bytes without consuming them
+    size_t peek(char* dest, size_t length) {
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        size_t available = distance(cached_head_, tail);
+        if (available < length) {
+            available = readable();
+        }
+        size_t n = length < available ? length : available;
+        
+        size_t offset = static_cast<size_t>(tail) & mask_;
+        size_t first = n < capacity_ - offset ? n : capacity_ - offset;
+        std::memcpy(dest, data_ + offset, first);
+        std::memcpy(dest + first, data_, n - first);
+        return n;
+    }
+    
+    void consume(size_t length) {
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        header_->tail.store(tail + length, std::memory_order_release);
+    }
+    
+    size_t read(char* dest, size_t length) {
+        size_t n = peek(dest, length);
+        if (n > 0) {
+            consume(n);
+        }
+        return n;
+    }
+    
+    // Wakeup protocol
+    void setProducerWaiting(bool waiting) { setWaiting(header_->producer_waiting, waiting); }
+    void setConsumerWaiting(bool waiting) { setWaiting(header_->consumer_waiting, waiting); }
+    bool producerNeedsWake() const { return needsWake(header_->producer_waiting); }
+    bool consumerNeedsWake() const { return needsWake(header_->consumer_waiting); }
+
+private:
+    // Bytes between the indexes, or 0 with the ring marked corrupt once
+    // they are further apart than it holds
+    size_t distance(uint64_t head, uint64_t tail) {
+        uint64_t bytes = head - tail;
+        if (corrupt_ || bytes > capacity_) {
+            corrupt_ = true;
+            return 0;
+        }
+        return static_cast<size_t>(bytes);
+    }
+    
+    size_t space(uint64_t head, uint64_t tail) {
+        size_t bytes = distance(head, tail);
+        return corrupt_ ? 0 : capacity_ - bytes;
+    }
+    
+    static void setWaiting(std::atomic<uint32_t>& flag, bool waiting) {
+        flag.store(waiting ? 1 : 0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    
+    static bool needsWake(const std::atomic<uint32_t>& flag) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return flag.load(std::memory_order_relaxed) != 0;
+    }
+    
+    ShmRingHeader* header_;
+    char* data_;
+    size_t capacity_;
+    size_t mask_;
+    uint64_t cached_head_;      // consumer's last view of head
+    uint64_t cached_tail_;      // producer's last view of tail
+    bool corrupt_;              // the peer moved an index out of range
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Wait-free single-producer/single-consumer ring. Head and tail live on
+// separate cache lines and each side caches the other's index, so the
+// common case touches no shared line at all.
+template<typename T>
+class SpscRing {
+public:
+    SpscRing(size_t capacity = 4096)
+        : capacity_(roundUpPowerOfTwo(capacity))
+        , mask_(capacity_ - 1)
+        , buffer_(new T[capacity_])
+        , head_(0)
+        , cached_tail_(0)
+        , tail_(0)
+        , cached_head_(0) {
+    }
+    
+    bool tryPush(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ >= capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ >= capacity_) {
+                return false;
+            }
+        }
+        buffer_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool tryPop(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == cached_head_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail == cached_head_) {
+                return false;
+            }
+        }
+        item = buffer_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    
+    size_t capacity() const { return capacity_; }
+
+private:
+    static size_t roundUpPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+    
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<T[]> buffer_;
+    
+    // Producer side
+    alignas(64) std::atomic<size_t> head_;
+    size_t cached_tail_;
+    
+    // Consumer side
+    alignas(64) std::atomic<size_t> tail_;
+    size_t cached_head_;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "data_structures/spsc_ring.h"
+#include "proto/bid.pb.h"
+
+enum class BidEventType : uint8_t {
+    BID = 1,
+    WIN = 2
+};
+
+enum class BidEventStatus : uint8_t {
+    SUCCESS = 0,
+    THROTTLED = 1,
+    CIRCUIT_OPEN = 2,
+    ERROR = 3,
+    OTHER = 255
+};
+
+// Fixed-size binary event record; ids longer than the fields are truncated
+struct BidEventRecord {
+    uint64_t timestamp_ns;
+    double winning_bid;
+    double price;
+    int32_t latency_ms;
+    uint8_t type;
+    uint8_t status;
+    uint8_t won;
+    uint8_t reserved;
+    char request_id[48];
+    char campaign_id[48];
+};
+static_assert(sizeof(BidEventRecord) == 128, "BidEventRecord must stay 128 bytes");
+
+// Each file is a sequence of 4 KB-aligned blocks: an EventBlockHeader, a
+// zlib-compressed array of BidEventRecords, then zero padding.
+struct EventBlockHeader {
+    uint32_t magic;             // kEventBlockMagic
+    uint32_t record_count;
+    uint32_t raw_bytes;
+    uint32_t compressed_bytes;
+    uint64_t first_timestamp_ns;
+    uint64_t last_timestamp_ns;
+};
+
+static constexpr uint32_t kEventBlockMagic = 0x42455631; // "BEV1"
+static constexpr size_t kEventBlockAlign = 4096;
+
+struct EventLoggerConfig {
+    std::string directory = "/var/log";
+    std::string prefix = "bid_events";
+    size_t ring_capacity = 16384;       // records per worker thread
+    size_t rotate_bytes = 256ULL << 20;
+    size_t max_files = 16;
+    int flush_interval_ms = 50;
+    bool direct_io = true;
+};
+
+// Asynchronous bid/win event log. Worker threads push into their own SPSC
+// ring and never block: a full ring drops the record and bumps a counter.
+// A background thread drains all rings, compresses each batch and writes
+// it with O_DIRECT to size-rotated files.
+class EventLogger {
+public:
+    EventLogger(const EventLoggerConfig& config);
+    ~EventLogger();
+    
+    void start();
+    void stop();
+    
+    void logBid(const bidding::BidResponse& response);
+    bool log(const BidEventRecord& record);
+    
+    uint64_t getWrittenCount() const { return written_count_.load(std::memory_order_relaxed); }
+    uint64_t getDroppedCount() const;
+    
+    std::string getPrometheusFormat() const;
+    
+    static BidEventStatus statusFromString(const std::string& status);
+
+private:
+    struct ThreadRing {
+        SpscRing<BidEventRecord> ring;
+        alignas(64) std::atomic<uint64_t> dropped;
+        
+        ThreadRing(size_t capacity) : ring(capacity), dropped(0) {}
+    };
+    
+    ThreadRing* localRing();
+    void writerThread();
+    size_t drain(std::vector<BidEventRecord>& batch);
+    void writeBlock(const std::vector<BidEventRecord>& batch);
+    bool openNextFile();
+    void closeFile();
+    
+    EventLoggerConfig config_;
+    const uint64_t instance_id_;
+    
+    mutable std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<ThreadRing>> rings_;
+    
+    std::thread writer_thread_;
+    std::atomic<bool> running_;
+    
+    int fd_;
+    bool fd_direct_;
+    size_t file_bytes_;
+    uint64_t file_sequence_;
+    std::deque<std::string> files_;
+    
+    char* block_buffer_;
+    size_t block_buffer_size_;
+    
+    std::atomic<uint64_t> written_count_;
+    std::atomic<uint64_t> write_errors_;
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<uint64_t> rotations_;
+};
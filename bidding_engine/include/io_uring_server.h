@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "data_structures/receive_buffer.h"
+
+struct IoUringConfig {
+    int loops = 0;                      // event loop threads, 0 = one per CPU
+    unsigned queue_depth = 1024;        // SQ entries per loop
+    unsigned buffer_count = 1024;       // provided receive buffers per loop
+    unsigned buffer_size = 4096;
+    bool sqpoll = false;
+    unsigned sqpoll_idle_ms = 1000;
+};
+
+// Network backend built directly on io_uring (raw syscalls, no liburing).
+// Each loop thread owns a ring and an SO_REUSEPORT listener, keeps one
+// multishot accept and one multishot recv per connection armed, receives
+// into a registered buffer ring and coalesces all responses produced by a
+// completion batch into a single send per connection. One io_uring_enter
+// submits every queued SQE and reaps every ready CQE, so under load the
+// syscall cost is shared by all connections served by the loop.
+//
+// A handler can park a connection whose next frame has to wait its turn
+// (QoS). The loop then holds the connection's input, stops reading once
+// about a maximum frame is buffered, and calls the handler again when
+// resume() is called with the connection's token, or after the park
+// timeout, whichever comes first.
+class IoUringServer {
+public:
+    enum class FrameResult {
+        SERVED,         // every complete frame answered
+        PARKED,         // the next frame waits; call again on resume() or the park timeout
+        CLOSE
+    };
+    
+    // Serves complete frames in input, appending framed responses to
+    // output. tenant is what the classifier returned for the connection, 0
+    // without one; resume_token identifies the connection to resume().
+    using FrameHandler = std::function<FrameResult(uint32_t connection_id, size_t tenant, uint64_t resume_token,
+                                                   ReceiveBuffer& input, std::string& output)>;
+    // Picks a connection's tenant from its socket, once at accept
+    using TenantClassifier = std::function<size_t(int fd)>;
+    // Called on the loop thread when a parked connection goes away, so
+    // whatever it waits on can forget it
+    using ParkCancel = std::function<void(uint32_t connection_id, size_t tenant)>;
+    
+    IoUringServer(const std::string& host, int port, const IoUringConfig& config,
+                  MemoryPool& receive_pool, size_t max_frame_bytes, FrameHandler handler);
+    ~IoUringServer();
+    
+    // Throws std::runtime_error when the kernel lacks the required features
+    void start();
+    void stop();
+    
+    // Sockets to accept on instead of binding, shared by all loops; the
+    // server owns them from here on. Call before start().
+    void setListeners(const std::vector<int>& fds);
+    // Call before start()
+    void setTenantClassifier(TenantClassifier classifier) { classifier_ = std::move(classifier); }
+    // Call before start()
+    void setParking(std::chrono::microseconds timeout, ParkCancel cancel) {
+        park_timeout_ = timeout;
+        park_cancel_ = std::move(cancel);
+    }
+    // Serves a parked connection again; safe from any thread, and a stale
+    // token is ignored
+    void resume(uint64_t resume_token);
+    std::vector<int> getListeningSockets() const;
+    // Stops accepting and closes connections as they go idle
+    void beginDrain();
+    size_t getActiveConnections() const;
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    class Loop;
+    
+    std::string host_;
+    int port_;
+    IoUringConfig config_;
+    MemoryPool& receive_pool_;
+    size_t max_frame_bytes_;
+    FrameHandler handler_;
+    TenantClassifier classifier_;
+    std::chrono::microseconds park_timeout_;
+    ParkCancel park_cancel_;
+    std::atomic<bool> running_;
+    std::atomic<bool> draining_;
+    std::atomic<uint32_t> next_connection_id_;
+    std::vector<int> inherited_fds_;
+    
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::vector<std::thread> threads_;
+};
@@ -5,6 +5,9 @@
 #include <chrono>
 #include <mutex>
 #include <string>
+#include <functional>
+#include "profiler.h"
+#include "stats.h"
 #include "proto/bid.pb.h"
 
 class MetricsCollector {
@@ -17,21 +20,29 @@ public:
     bidding::Metrics getMetrics() const;
     std::string getPrometheusFormat() const;
     
+    // Extra Prometheus text appended by other components (admission, etc.)
+    void addExporter(std::function<std::string()> exporter);
+    
     void reset();
 
 private:
-    void updatePercentiles();
+    struct Percentiles {
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
     
-    mutable std::mutex mutex_;
-    std::vector<int64_t> latency_samples_;
-    std::atomic<uint64_t> total_requests_;
-    std::atomic<uint64_t> successful_requests_;
-    std::atomic<uint64_t> cache_hits_;
-    std::atomic<uint64_t> cache_misses_;
+    // Over the sample window; call with mutex_ held
+    Percentiles percentiles() const;
     
-    double p50_latency_;
-    double p95_latency_;
-    double p99_latency_;
+    mutable ProfiledMutex mutex_;
+    std::vector<int64_t> latency_samples_;     // ring of the last MAX_SAMPLES
+    size_t next_sample_;
+    stats::Counter total_requests_;
+    stats::Counter successful_requests_;
+    stats::Counter cache_hits_;
+    stats::Counter cache_misses_;
+    std::vector<std::function<std::string()>> exporters_;
     
     static constexpr size_t MAX_SAMPLES = 10000;
 };
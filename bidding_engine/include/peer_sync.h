@@ -0,0 +1,110 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "campaign_budgets.h"
+#include "data_structures/frequency_cap_store.h"
+#include "data_structures/lockfree_queue.h"
+#include "peer_sync_protocol.h"
+#include "stats.h"
+
+struct PeerSyncConfig {
+    bool enabled = false;
+    uint32_t node_id = 0;                   // unique among the peers
+    std::string host = "0.0.0.0";
+    int port = 7100;
+    std::vector<std::string> peers;         // "host:port" of every other engine
+    unsigned interval_ms = 100;
+    unsigned full_sync_every = 50;          // rounds between resending all counters, 0 = never
+    size_t max_datagrams_per_round = 64;    // per peer
+    unsigned peer_timeout_ms = 1000;        // silent this long and a peer no longer gets budget
+    size_t impression_queue = 65536;
+};
+
+// Keeps budgets and frequency caps consistent across engine replicas.
+//
+// One thread owns one UDP socket. Every interval it rebalances the budget
+// leases from what it has heard, then sends each peer the counters that
+// changed plus the frequency cap impressions recorded since the last round,
+// packed into datagrams of at most kPeerSyncDatagramBytes and capped per
+// round, so sync traffic stays bounded however busy the engine is; what
+// does not fit waits for the next round. Every round sends at least a
+// header, which doubles as the liveness heartbeat. Between rounds it merges
+// what peers send.
+//
+// Counters converge whatever the network does to them (see
+// peer_sync_protocol.h), and every full_sync_every rounds all of them are
+// resent to repair losses. Impressions are sent once; a full queue drops
+// them and counts the drop, since blocking a bid on sync is never worth it.
+//
+// Peers send from the socket bound to their own sync port, so a datagram's
+// source must be exactly one of config.peers.
+class PeerSync {
+public:
+    // Either of budgets and frequency_caps may be null
+    PeerSync(const PeerSyncConfig& config, CampaignBudgets* budgets, FrequencyCapStore* frequency_caps);
+    ~PeerSync();
+    
+    PeerSync(const PeerSync&) = delete;
+    PeerSync& operator=(const PeerSync&) = delete;
+    
+    // Throws std::runtime_error on an unparseable peer or if the port cannot
+    // be bound
+    void start();
+    void stop();
+    
+    // Queues an impression for the peers; frequency caps' replicator
+    void enqueueImpression(uint64_t pair_hash, uint32_t impressions);
+    
+    // Applies one datagram; start() feeds this from the socket. Datagrams
+    // from an address and port not in config.peers are counted and dropped,
+    // so only the configured engines can move budgets and caps.
+    void receive(const char* data, size_t length, const struct sockaddr_in& from);
+    
+    size_t livePeers() const { return live_peers_.load(std::memory_order_relaxed); }
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    void syncThread();
+    void runRound(bool full, double elapsed_seconds);
+    bool isPeer(const struct sockaddr_in& address) const;
+    
+    PeerSyncConfig config_;
+    CampaignBudgets* budgets_;
+    FrequencyCapStore* frequency_caps_;
+    uint64_t replica_id_;
+    
+    std::vector<struct sockaddr_in> peer_addresses_;
+    LockFreeQueue<PeerImpression> impressions_;
+    // Last datagram by replica id; sync thread only
+    std::unordered_map<uint64_t, Clock::time_point> last_seen_;
+    
+    int fd_;
+    int wake_fd_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<size_t> live_peers_;
+    
+    stats::Counter datagrams_sent_;
+    stats::Counter datagrams_received_;
+    stats::Counter bytes_sent_;
+    stats::Counter bytes_received_;
+    stats::Counter send_errors_;
+    stats::Counter malformed_;
+    stats::Counter unknown_sender_;
+    stats::Counter counters_sent_;
+    stats::Counter counters_merged_;
+    stats::Counter impressions_sent_;
+    stats::Counter impressions_applied_;
+    stats::Counter impressions_dropped_;
+    stats::Counter rounds_;
+};
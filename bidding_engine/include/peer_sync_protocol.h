@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Replica-to-replica state exchange over UDP (see PeerSync).
+//
+// Each datagram is a PeerSyncHeader, header.counter_count PeerCounters,
+// then header.impression_count PeerImpressions, all little-endian and
+// packed. Datagrams stay under kPeerSyncDatagramBytes.
+//
+// Counters are G-counter state: the values one replica has reached, merged
+// by taking the max, so duplicates, reordering and loss are all harmless
+// and any replica may forward what it knows about another. Impressions are
+// frequency cap increments, applied once on receipt: one lost is one
+// impression under-counted on that peer.
+
+static constexpr uint32_t kPeerSyncMagic = 0x42505331;     // "BPS1"
+static constexpr uint16_t kPeerSyncVersion = 1;
+static constexpr size_t kPeerSyncDatagramBytes = 1400;
+
+#pragma pack(push, 1)
+
+struct PeerSyncHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t sender;                // replica id of the sending engine
+    uint16_t counter_count;
+    uint16_t impression_count;
+    uint32_t reserved2;
+};
+
+// One replica's totals for one campaign
+struct PeerCounter {
+    uint64_t campaign_key;          // winNoticeKey() of the campaign id
+    uint64_t replica;               // node_id << 32 | incarnation
+    uint64_t spend_micros;
+    uint64_t demand;                // requests that wanted to bid on the campaign
+};
+
+struct PeerImpression {
+    uint64_t pair_hash;             // FrequencyCapStore::pairHash(user, campaign)
+    uint32_t impressions;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(PeerSyncHeader) == 24, "PeerSyncHeader must stay 24 bytes");
+static_assert(sizeof(PeerCounter) == 32, "PeerCounter must stay 32 bytes");
+static_assert(sizeof(PeerImpression) == 12, "PeerImpression must stay 12 bytes");
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "data_structures/campaign_outcome_table.h"
+#include "scoring_rules.h"
+#include "proto/bid.pb.h"
+
+// Bid shading model evaluated inline by BidHandler::scoreBid, and once per
+// page view over all slots by BidHandler::scoreBatch.
+//
+// A request is turned into a dense row of float features: numeric features
+// (floor price, number of targeting keys) and 0/1 targeting features, either
+// "key is present" or "key equals value". Targeting features are interned
+// when the model is loaded, so extraction is one hash probe per targeting
+// entry. The logit is a logistic-regression term (bias plus a SIMD dot
+// product over the row) plus the sum of gradient-boosted trees; its sigmoid
+// is the predicted win-rate at a given shade, mapped onto
+// [min_shade, max_shade] as the fraction of the bid to pay.
+//
+// Trees are stored flattened: each tree is padded to the model's depth and
+// laid out as a complete binary tree in level order (children of node i are
+// 2i+1 and 2i+2), so evaluation is a fixed number of branch-free steps.
+// A row value greater than the split threshold goes right.
+//
+// The model predicts from the request alone. With win-rate feedback, what
+// win notices report for the bidding campaign corrects it: a campaign
+// winning less often than the target pays a larger share of its bid, one
+// winning more often a smaller share.
+class PricingModel {
+public:
+    static constexpr size_t kMaxFeatures = 256;
+    static constexpr unsigned kMaxDepth = 12;
+    
+    struct Split {
+        uint32_t feature;
+        float threshold;
+    };
+    
+    PricingModel();
+    
+    // YAML model file, see config/pricing_model.yaml. Throws std::runtime_error
+    // if the file cannot be read or does not describe a valid model.
+    static std::unique_ptr<PricingModel> loadFile(const std::string& path);
+    
+    // Builders, in feature order; each returns the feature's column.
+    // Throws std::runtime_error on duplicates or past kMaxFeatures.
+    size_t addFloorPriceFeature();
+    size_t addTargetingCountFeature();
+    size_t addKeyFeature(const std::string& key);
+    size_t addKeyValueFeature(const std::string& key, const std::string& value);
+    
+    // weights.size() must not exceed featureCount(); missing weights are zero
+    void setLinear(float bias, const std::vector<float>& weights);
+    // splits: 2^depth - 1 internal nodes in level order, leaves: 2^depth values
+    void addTree(unsigned depth, const std::vector<Split>& splits, const std::vector<float>& leaves);
+    void setShadeRange(float min_shade, float max_shade);
+    // Moves the shade by gain per unit of (target_win_rate - observed win
+    // rate), within the shade range, once a campaign has min_notices
+    // outcomes. A gain of zero turns feedback off.
+    void setWinRateFeedback(float target_win_rate, float gain, uint64_t min_notices);
+    
+    size_t featureCount() const { return feature_count_; }
+    // Floats per row, featureCount() rounded up to the SIMD width
+    size_t rowStride() const { return row_stride_; }
+    size_t treeCount() const { return tree_count_; }
+    unsigned depth() const { return depth_; }
+    
+    // Writes rowStride() floats
+    void extract(double floor_price, const TargetingMap& targeting, float* row) const;
+    // Rows for the slots of one page view, which differ only in floor
+    // price; the targeting is read once. Writes count * rowStride() floats.
+    void extractSlots(const double* floor_prices, size_t count, const TargetingMap& targeting,
+                      float* rows) const;
+    
+    float shade(const float* row) const;
+    // rows is count * rowStride() floats, row-major. Trees are walked one at
+    // a time over the whole batch so each stays in cache.
+    void shadeBatch(const float* rows, size_t count, float* shades) const;
+    // A shade corrected by the campaign's outcomes so far
+    float adjustShade(float shade, const CampaignOutcome& outcome) const;
+    
+    // Price to pay for a bid: the shaded bid, never below the floor.
+    // outcome is the bidding campaign's, or null if none is known.
+    double price(double bid_amount, const bidding::BidRequest& request,
+                 const CampaignOutcome* outcome = nullptr) const;
+
+private:
+    struct KeyEntry {
+        uint64_t hash;
+        std::string key;
+        int32_t present_column;     // -1 if the key itself is not a feature
+        bool has_values;            // some key=value feature uses this key
+    };
+    
+    struct ValueEntry {
+        uint64_t hash;
+        std::string key;
+        std::string value;
+        uint32_t column;
+    };
+    
+    size_t addColumn();
+    KeyEntry& internKey(const std::string& key);
+    const KeyEntry* findKey(uint64_t hash, const std::string& key) const;
+    const ValueEntry* findValue(uint64_t hash, const std::string& key, const std::string& value) const;
+    void rehash();
+    float linear(const float* row) const;
+    float toShade(float logit) const;
+    
+    size_t feature_count_;
+    size_t row_stride_;
+    int32_t floor_price_column_;
+    int32_t targeting_count_column_;
+    
+    // Open addressing, power-of-two sized, empty slots have an empty key
+    std::vector<KeyEntry> keys_;
+    std::vector<ValueEntry> values_;
+    size_t key_count_;
+    size_t value_count_;
+    
+    float bias_;
+    std::vector<float> weights_;    // rowStride() floats, zero padded
+    bool has_linear_;
+    
+    unsigned depth_;
+    size_t tree_count_;
+    std::vector<Split> splits_;     // tree_count_ * (2^depth_ - 1)
+    std::vector<float> leaves_;     // tree_count_ * 2^depth_
+    
+    float min_shade_;
+    float max_shade_;
+    
+    float target_win_rate_;
+    float feedback_gain_;
+    uint64_t feedback_min_notices_;
+};
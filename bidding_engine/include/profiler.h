@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+enum class ProfileMode {
+    CPU,        // where threads spend CPU time, sampled by SIGPROF
+    OFF_CPU     // where threads block on engine mutexes, weighted by time blocked
+};
+
+struct ProfilerConfig {
+    bool enabled = false;
+    unsigned frequency_hz = 99;         // CPU samples per second of process CPU time
+    unsigned max_seconds = 60;          // longest session a request may ask for
+    size_t max_samples = 65536;         // per session; later samples are dropped
+};
+
+// On-demand sampling profiler, one session at a time.
+//
+// A CPU session arms ITIMER_PROF, so the kernel sends SIGPROF to whichever
+// thread is burning CPU each 1/frequency_hz of process CPU time. The handler
+// unwinds the interrupted stack with backtrace() (warmed up at construction,
+// so it does not allocate) into a per-thread buffer: threads claim samples
+// from their own buffer with one atomic add and never share a line.
+//
+// An off-CPU session instead records, from ProfiledMutex and
+// ProfiledSharedMutex, the stack of every lock acquisition that had to wait,
+// weighted by the microseconds spent waiting.
+//
+// When no session runs the signal handler is never invoked and the mutexes
+// only pay a relaxed load on the contended path.
+//
+// Results are folded stacks, one "root;...;leaf count" line per distinct
+// stack, ready for flamegraph.pl. Frames are symbolized with dladdr, so the
+// executable must export its symbols (-rdynamic); frames it cannot name show
+// as module+offset.
+class Profiler {
+public:
+    explicit Profiler(const ProfilerConfig& config);
+    ~Profiler();
+    
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    
+    // Samples for the given duration (capped at max_seconds) and returns
+    // folded stacks. Blocks the caller for the session. Throws
+    // std::runtime_error if another session is running.
+    std::string profile(ProfileMode mode, std::chrono::milliseconds duration);
+    // Ends a running session early, with what it has sampled so far, and
+    // makes later sessions return at once; for shutdown
+    void shutdown();
+    bool active() const { return session_running_.load(); }
+    
+    const ProfilerConfig& config() const { return config_; }
+    
+    static ProfileMode parseMode(const std::string& name);
+    static const char* modeName(ProfileMode mode);
+    
+    // For ProfiledMutex: true while an off-CPU session runs
+    static bool offCpuActive() { return off_cpu_active_.load(std::memory_order_relaxed); }
+    static void recordBlocked(const char* site, std::chrono::nanoseconds waited);
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    static constexpr int kMaxFrames = 64;
+    
+    struct Sample {
+        uint64_t weight;
+        const char* site;               // off-CPU: the contended mutex
+        int depth;
+        void* frames[kMaxFrames];
+    };
+    
+    struct alignas(64) ThreadBuffer {
+        std::atomic<size_t> next{0};
+        std::unique_ptr<Sample[]> samples;
+    };
+    
+    struct Session {
+        ProfileMode mode;
+        size_t buffer_count;
+        size_t per_buffer;
+        std::unique_ptr<ThreadBuffer[]> buffers;
+    };
+    
+    static void signalHandler(int sig);
+    static void record(int skip, uint64_t weight, const char* site);
+    std::string fold(const Session& session);
+    
+    ProfilerConfig config_;
+    std::atomic<bool> session_running_;
+    std::mutex session_mutex_;
+    std::condition_variable session_cv_;
+    bool stopped_;
+    
+    std::atomic<uint64_t> sessions_;
+    std::atomic<uint64_t> samples_;
+    std::atomic<uint64_t> dropped_;
+    
+    // Read from the signal handler, so static
+    static std::atomic<Session*> current_;
+    static std::atomic<int> in_flight_;
+    static std::atomic<uint64_t> session_dropped_;
+    static std::atomic<bool> off_cpu_active_;
+};
+
+// std::mutex that reports contended acquisitions to an off-CPU profile.
+// The uncontended path is the same single CAS as std::mutex::lock.
+class ProfiledMutex {
+public:
+    explicit ProfiledMutex(const char* site) : site_(site) {}
+    
+    void lock() {
+        if (!mutex_.try_lock()) {
+            lockContended();
+        }
+    }
+    bool try_lock() { return mutex_.try_lock(); }
+    void unlock() { mutex_.unlock(); }
+
+private:
+    void lockContended();
+    
+    std::mutex mutex_;
+    const char* site_;
+};
+
+// std::shared_mutex counterpart of ProfiledMutex
+class ProfiledSharedMutex {
+public:
+    explicit ProfiledSharedMutex(const char* site) : site_(site) {}
+    
+    void lock() {
+        if (!mutex_.try_lock()) {
+            lockContended();
+        }
+    }
+    bool try_lock() { return mutex_.try_lock(); }
+    void unlock() { mutex_.unlock(); }
+    
+    void lock_shared() {
+        if (!mutex_.try_lock_shared()) {
+            lockSharedContended();
+        }
+    }
+    bool try_lock_shared() { return mutex_.try_lock_shared(); }
+    void unlock_shared() { mutex_.unlock_shared(); }
+
+private:
+    void lockContended();
+    void lockSharedContended();
+    
+    std::shared_mutex mutex_;
+    const char* site_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "data_structures/hdr_histogram.h"
+
+struct QosClassConfig {
+    std::string name;
+    unsigned weight = 1;                    // share of scoring slots under contention
+    size_t max_queue = 1024;                // frames waiting for a slot; more are shed
+    std::vector<std::string> sources;       // client networks, "10.1.0.0/16", or "unix" for shared memory
+};
+
+struct QosConfig {
+    bool enabled = false;
+    size_t concurrency = 8;                 // frames scored at once, across all classes
+    unsigned max_wait_us = 20000;           // a frame still queued after this is shed
+    std::string default_class = "default";  // connections no class claims
+    std::vector<QosClassConfig> classes;
+};
+
+// Weighted fair scheduling of request frames between tenant classes, such
+// as one per exchange.
+//
+// Each connection belongs to a class, picked once from its peer address.
+// At most config.concurrency frames are scored at a time; a frame that
+// finds every slot taken waits in its class's bounded queue, and each slot
+// that frees up goes to the next class in deficit round robin order, so
+// under overload classes share the slots by weight and a burst from one
+// class only lengthens its own queue. A frame is shed when its queue is
+// full or it has waited max_wait_us. Per-class latency, from arrival to
+// response, is kept in an HdrHistogram.
+//
+// Callers that must never block, like the io_uring loops, use admit()
+// instead of acquire(): a frame that has to wait is queued in the same
+// line under a key, the caller sets it aside, and a callback tells it when
+// to ask again.
+class QosScheduler {
+public:
+    enum class Admission {
+        ADMITTED,
+        QUEUED,
+        SHED
+    };
+    
+    // Throws std::runtime_error on an unparseable source network
+    explicit QosScheduler(const QosConfig& config);
+    
+    QosScheduler(const QosScheduler&) = delete;
+    QosScheduler& operator=(const QosScheduler&) = delete;
+    
+    // Class of the connection on fd, by its peer address
+    size_t classify(int fd) const;
+    size_t classCount() const { return classes_.size(); }
+    const std::string& className(size_t tenant) const { return classes_[tenant].name; }
+    
+    // Blocks until the frame may be scored; false if it was shed
+    bool acquire(size_t tenant);
+    // acquire() without blocking. A frame that has to wait is queued under
+    // key, which the caller keeps unique among its waiting frames, and
+    // QUEUED is returned; the caller then calls admit() with the same key
+    // again once on_grant has run, or once max_wait() has passed, to get
+    // ADMITTED or SHED. on_grant runs on the thread that freed the slot,
+    // with the scheduler locked, so it should only wake the caller up.
+    // queued_us is how long an ADMITTED frame waited.
+    Admission admit(size_t tenant, uint64_t key, const std::function<void()>& on_grant, int64_t& queued_us);
+    // Withdraws a frame queued by admit(), such as a closing connection's;
+    // a slot already granted to it is given back
+    void cancel(size_t tenant, uint64_t key);
+    // Ends a frame that was let through, latency_us counted from arrival
+    void release(size_t tenant, int64_t latency_us);
+    
+    std::chrono::microseconds maxWait() const { return max_wait_; }
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    struct Waiter {
+        std::condition_variable cv;
+        bool granted = false;
+        std::function<void()> on_grant;     // set for admit(), instead of waking cv
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    
+    struct TenantClass {
+        std::string name;
+        unsigned weight;
+        size_t max_queue;
+        std::deque<Waiter*> queue;
+        std::unordered_map<uint64_t, std::shared_ptr<Waiter>> parked;  // admit()ed, by key
+        unsigned deficit = 0;               // grants left in the current turn
+        HdrHistogram latency_us{60000000, 3};
+        uint64_t admitted = 0;
+        uint64_t queued = 0;
+        uint64_t shed_full = 0;
+        uint64_t shed_timeout = 0;
+    };
+    
+    struct Network {
+        uint32_t address;
+        uint32_t mask;
+        size_t tenant;
+    };
+    
+    size_t findOrAddClass(const std::string& name, unsigned weight, size_t max_queue);
+    // Hands free slots to waiters; call with mutex_ held
+    void dispatch();
+    
+    size_t concurrency_;
+    std::chrono::microseconds max_wait_;
+    size_t default_class_;
+    size_t unix_class_;
+    std::vector<Network> networks_;         // longest prefix first
+    
+    // Everything below is under mutex_
+    mutable std::mutex mutex_;
+    std::vector<TenantClass> classes_;
+    size_t in_flight_;
+    size_t waiting_;
+    size_t cursor_;
+};
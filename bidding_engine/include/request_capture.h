@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "data_structures/receive_buffer.h"
+#include "stats.h"
+
+// On-disk layout of a capture log: one CaptureFileHeader followed by
+// CaptureRecordHeader + payload pairs, all little-endian.
+struct CaptureFileHeader {
+    char magic[8];              // "BIDCAP\0\1"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t start_unix_ns;     // wall clock when capture started
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestamp_ns;      // arrival time, relative to capture start
+    uint32_t connection_id;
+    uint32_t length;            // top bit (kBatchFrameFlag) marks a batch frame
+};
+
+static constexpr char kCaptureMagic[8] = {'B', 'I', 'D', 'C', 'A', 'P', '\0', '\1'};
+static constexpr uint32_t kCaptureVersion = 2;   // v1 logs carry no batch frames
+
+// Records received frames to an append-only log. Connection threads only
+// claim a ring slot and memcpy the frame; a background thread batches the
+// slots into large sequential writes.
+class RequestCapture {
+public:
+    RequestCapture(const std::string& path, size_t ring_slots = 65536, size_t max_frame_bytes = 4096);
+    ~RequestCapture();
+    
+    void start();
+    void stop();
+    
+    bool record(uint32_t connection_id, const char* data, size_t length, bool batch = false);
+    
+    uint64_t getCapturedCount() const { return captured_count_.value(); }
+    uint64_t getDroppedCount() const { return dropped_count_.value(); }
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    struct SlotHeader {
+        std::atomic<uint64_t> sequence;
+        CaptureRecordHeader record;
+    };
+    
+    SlotHeader* slotAt(uint64_t pos) const;
+    void writerThread();
+    bool drainSlot(std::vector<char>& batch);
+    void flush(std::vector<char>& batch);
+    
+    std::string path_;
+    size_t capacity_;
+    size_t mask_;
+    size_t max_frame_bytes_;
+    size_t slot_stride_;
+    char* slots_;
+    
+    int fd_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::thread writer_thread_;
+    std::atomic<bool> running_;
+    
+    alignas(64) std::atomic<uint64_t> enqueue_pos_;
+    uint64_t dequeue_pos_;
+    
+    stats::Counter captured_count_;
+    stats::Counter dropped_count_;
+    std::atomic<uint64_t> bytes_written_;
+};
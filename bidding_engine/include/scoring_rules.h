@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "proto/bid.pb.h"
+
+using TargetingMap = google::protobuf::Map<std::string, std::string>;
+
+enum class RuleMatch : uint8_t {
+    PRESENT,    // key is set, any value
+    EQUALS      // key is set to value
+};
+
+// One targeting multiplier: a request matching the rule has its score
+// multiplied by `multiplier`. Rules are independent and all matches apply.
+struct ScoringRule {
+    std::string_view key;
+    RuleMatch match;
+    std::string_view value;
+    double multiplier;
+};
+
+// Rule sets compiled into the engine. Edit these and rebuild to change
+// scoring; scoring.rules in config.yaml overrides kBidRules at
+// runtime through the interpreted ScoringRuleSet instead.
+static constexpr ScoringRule kBidRules[] = {
+    {"premium_user",      RuleMatch::PRESENT, "", 1.5},
+    {"high_value_region", RuleMatch::PRESENT, "", 1.3},
+};
+
+static constexpr ScoringRule kAuctionScoreRules[] = {
+    {"premium_user",      RuleMatch::EQUALS, "true", 1.5},
+    {"high_value_region", RuleMatch::EQUALS, "true", 1.3},
+    {"mobile",            RuleMatch::EQUALS, "true", 1.2},
+};
+
+// Scorer specialized for one constexpr rule table; every rule is unrolled
+// into straight-line code with constant-length compares and a selected
+// (not branched-on) multiplier. Small targeting maps are scanned once,
+// each key filtered through a compile-time table indexed by key length
+// that rejects almost every key with one load. Maps with at least as many
+// entries as there are rules do one heterogeneous lookup per rule instead,
+// which never allocates a key string.
+template <const auto& Rules>
+class CompiledScorer {
+public:
+    static constexpr size_t kRuleCount = std::size(Rules);
+    static constexpr size_t kMaxKeyLength = 64;
+    static_assert(kRuleCount <= 64, "rule candidates are tracked in a 64-bit mask");
+    
+    static double multiplier(const TargetingMap& targeting) {
+        if (targeting.size() >= kRuleCount) {
+            return lookupAll(targeting, std::make_index_sequence<kRuleCount>{});
+        }
+        
+        double result = 1.0;
+        for (const auto& entry : targeting) {
+            const std::string& key = entry.first;
+            if (key.size() >= kMaxKeyLength) {
+                continue;
+            }
+            uint64_t candidates = kRulesByKeyLength[key.size()];
+            if (candidates != 0) {
+                result *= matchAll(key, entry.second, candidates, std::make_index_sequence<kRuleCount>{});
+            }
+        }
+        return result;
+    }
+
+private:
+    static constexpr std::array<uint64_t, kMaxKeyLength> buildLengthTable() {
+        std::array<uint64_t, kMaxKeyLength> table{};
+        for (size_t i = 0; i < kRuleCount; ++i) {
+            table[Rules[i].key.size()] |= uint64_t(1) << i;
+        }
+        return table;
+    }
+    
+    static constexpr bool keysFit() {
+        for (size_t i = 0; i < kRuleCount; ++i) {
+            if (Rules[i].key.empty() || Rules[i].key.size() >= kMaxKeyLength) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(keysFit(), "rule keys must be 1-63 characters");
+    
+    static constexpr std::array<uint64_t, kMaxKeyLength> kRulesByKeyLength = buildLengthTable();
+    
+    static bool equals(const std::string& s, std::string_view expected) {
+        return s.size() == expected.size() && std::memcmp(s.data(), expected.data(), expected.size()) == 0;
+    }
+    
+    template <size_t... I>
+    static double lookupAll(const TargetingMap& targeting, std::index_sequence<I...>) {
+        return (lookupOne<I>(targeting) * ...);
+    }
+    
+    template <size_t I>
+    static double lookupOne(const TargetingMap& targeting) {
+        constexpr ScoringRule rule = Rules[I];
+        auto it = targeting.find(rule.key);
+        bool hit = it != targeting.end();
+        if constexpr (rule.match == RuleMatch::EQUALS) {
+            hit = hit && equals(it->second, rule.value);
+        }
+        return hit ? rule.multiplier : 1.0;
+    }
+    
+    template <size_t... I>
+    static double matchAll(const std::string& key, const std::string& value, uint64_t candidates,
+                           std::index_sequence<I...>) {
+        return (matchOne<I>(key, value, candidates) * ...);
+    }
+    
+    template <size_t I>
+    static double matchOne(const std::string& key, const std::string& value, uint64_t candidates) {
+        constexpr ScoringRule rule = Rules[I];
+        // The length table guarantees key.size() == rule.key.size() when the bit is set
+        bool hit = ((candidates >> I) & 1) != 0 &&
+                   std::memcmp(key.data(), rule.key.data(), rule.key.size()) == 0;
+        if constexpr (rule.match == RuleMatch::EQUALS) {
+            hit = hit && equals(value, rule.value);
+        }
+        return hit ? rule.multiplier : 1.0;
+    }
+};
+
+// Interpreted rules for rule sets only known at runtime (loaded from
+// config). Same semantics as CompiledScorer, one map lookup per rule.
+class ScoringRuleSet {
+public:
+    ScoringRuleSet() = default;
+    
+    template <size_t N>
+    explicit ScoringRuleSet(const ScoringRule (&rules)[N]) {
+        for (const auto& rule : rules) {
+            add(std::string(rule.key), rule.match, std::string(rule.value), rule.multiplier);
+        }
+    }
+    
+    void add(const std::string& key, RuleMatch match, const std::string& value, double multiplier);
+    
+    double multiplier(const TargetingMap& targeting) const;
+    
+    size_t size() const { return rules_.size(); }
+    bool empty() const { return rules_.empty(); }
+
+private:
+    struct Rule {
+        std::string key;
+        RuleMatch match;
+        std::string value;
+        double multiplier;
+    };
+    
+    std::vector<Rule> rules_;
+};
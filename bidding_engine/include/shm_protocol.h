@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "data_structures/shm_ring.h"
+
+// Same-host transport between the engine and local clients.
+//
+// A client connects to the engine's UNIX control socket and receives one
+// ShmHello carrying four descriptors (SCM_RIGHTS, in ShmFd order): a memfd
+// segment holding a request ring and a response ring, and three eventfds.
+// The rings carry exactly the TCP byte stream: 4-byte big-endian length
+// (top bit marks a batch frame) followed by the protobuf payload. The
+// session ends when either side closes the control socket.
+//
+// Segment layout: ShmSegmentHeader | request ring | response ring, each ring
+// a ShmRingHeader followed by ring_bytes of data.
+
+static constexpr uint32_t kShmMagic = 0x42534d31;      // "BSM1"
+static constexpr uint32_t kShmVersion = 1;
+
+enum ShmFd {
+    SHM_FD_SEGMENT = 0,
+    SHM_FD_SERVER_EVENT = 1,        // client -> engine: requests queued or response space freed
+    SHM_FD_CLIENT_DATA = 2,         // engine -> client: responses queued
+    SHM_FD_CLIENT_SPACE = 3,        // engine -> client: request space freed
+    SHM_FD_COUNT = 4
+};
+
+struct alignas(64) ShmSegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_bytes;
+};
+
+struct ShmHello {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t segment_bytes;
+    uint64_t ring_bytes;
+    uint32_t spin_us;               // suggested busy-poll window before sleeping
+    uint32_t reserved;
+};
+
+inline size_t shmSegmentBytes(size_t ring_bytes) {
+    return sizeof(ShmSegmentHeader) + 2 * ShmRing::bytesFor(ring_bytes);
+}
+
+inline ShmRing shmRequestRing(void* segment, size_t ring_bytes) {
+    return ShmRing(static_cast<char*>(segment) + sizeof(ShmSegmentHeader), ring_bytes);
+}
+
+inline ShmRing shmResponseRing(void* segment, size_t ring_bytes) {
+    return ShmRing(static_cast<char*>(segment) + sizeof(ShmSegmentHeader) + ShmRing::bytesFor(ring_bytes),
+                   ring_bytes);
+}
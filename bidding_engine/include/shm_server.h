@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "data_structures/receive_buffer.h"
+#include "shm_protocol.h"
+
+struct ShmTransportConfig {
+    bool enabled = false;
+    std::string path = "/tmp/bidding_engine.sock";    // UNIX control socket
+    size_t ring_bytes = 1 << 20;                        // per direction, rounded up to a power of two
+    unsigned spin_us = 50;                              // busy-poll before sleeping on the eventfd
+    size_t max_clients = 64;
+};
+
+// Engine side of the shared-memory transport (see shm_protocol.h). Each
+// client gets its own segment and a serving thread that moves request
+// bytes into a pooled ReceiveBuffer, runs the shared frame handler and
+// writes the responses straight into the response ring. While traffic
+// flows neither side makes a syscall; an idle side spins for spin_us and
+// then sleeps on its eventfd.
+class ShmServer {
+public:
+    // Same contracts as IoUringServer's
+    using FrameHandler = std::function<bool(uint32_t connection_id, size_t tenant, ReceiveBuffer& input,
+                                            std::string& output)>;
+    using TenantClassifier = std::function<size_t(int fd)>;
+    
+    ShmServer(const ShmTransportConfig& config, MemoryPool& receive_pool, size_t max_frame_bytes,
+              FrameHandler handler);
+    ~ShmServer();
+    
+    // Throws std::runtime_error if the control socket cannot be bound
+    void start();
+    void stop();
+    
+    // Classifies each client by its control socket; call before start()
+    void setTenantClassifier(TenantClassifier classifier) { classifier_ = std::move(classifier); }
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    struct Client;
+    
+    void acceptClients();
+    std::unique_ptr<Client> createClient(int control_fd);
+    void serveClient(Client* client);
+    bool waitForWork(Client* client, bool want_input);
+    void signal(int event_fd);
+    void reapClients(bool all);
+    
+    ShmTransportConfig config_;
+    MemoryPool& receive_pool_;
+    size_t max_frame_bytes_;
+    FrameHandler handler_;
+    TenantClassifier classifier_;
+    
+    int listen_fd_;
+    int stop_fd_;
+    std::atomic<bool> running_;
+    std::thread accept_thread_;
+    
+    std::mutex clients_mutex_;
+    std::vector<std::unique_ptr<Client>> clients_;
+    std::atomic<uint32_t> next_connection_id_;
+    
+    std::atomic<uint64_t> clients_total_;
+    std::atomic<uint64_t> clients_active_;
+    std::atomic<uint64_t> wakeups_sent_;
+    std::atomic<uint64_t> sleeps_;
+    std::atomic<uint64_t> malformed_;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HandoffConfig {
+    bool enabled = false;
+    std::string path = "/tmp/bidding_engine.handoff";
+    int timeout_ms = 5000;          // how long the old engine waits for READY
+};
+
+// Listening sockets passed from a running engine to its replacement, so a
+// deploy never has a moment where the port is closed.
+struct HandoffSockets {
+    std::vector<int> server;
+    int metrics = -1;
+};
+
+// Old-engine side of a socket handoff. Listens on a unix socket; a new
+// engine started with --takeover connects, receives duplicates of the
+// listening sockets (SCM_RIGHTS) and answers READY once it is accepting on
+// them. Only then does the old engine call on_handed_off and start draining;
+// if the new engine dies or times out first, nothing changes and the old
+// engine keeps serving.
+//
+// Wire format: HandoffHello then the descriptors in one message (server
+// sockets first, then the metrics socket if has_metrics), answered by the
+// single byte kHandoffReady.
+struct HandoffHello {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t server_count;
+    uint8_t has_metrics;
+};
+
+static constexpr uint32_t kHandoffMagic = 0x4f444e48;  // "HNDO"
+static constexpr uint16_t kHandoffVersion = 1;
+static constexpr uint8_t kHandoffReady = 'R';
+static constexpr size_t kHandoffMaxSockets = 64;
+
+class SocketHandoff {
+public:
+    using SocketProvider = std::function<HandoffSockets()>;
+    
+    SocketHandoff(const HandoffConfig& config, SocketProvider provider, std::function<void()> on_handed_off);
+    ~SocketHandoff();
+    
+    // Binds the unix socket, replacing a stale one. Throws std::runtime_error
+    // if it cannot.
+    void start();
+    void stop();
+    
+    bool handedOff() const { return handed_off_.load(); }
+    
+    // New-engine side: connects and receives the sockets. Throws
+    // std::runtime_error if no engine is listening or the exchange fails;
+    // the caller then binds its own sockets.
+    class Takeover {
+    public:
+        Takeover(const std::string& path, int timeout_ms);
+        ~Takeover();
+        
+        Takeover(const Takeover&) = delete;
+        Takeover& operator=(const Takeover&) = delete;
+        
+        // Ownership passes to the caller
+        const HandoffSockets& sockets() const { return sockets_; }
+        // Tells the old engine to drain; call once accepting on sockets()
+        bool confirm();
+    
+    private:
+        int fd_;
+        HandoffSockets sockets_;
+    };
+
+private:
+    void listenThread();
+    bool serve(int client_fd);
+    
+    HandoffConfig config_;
+    SocketProvider provider_;
+    std::function<void()> on_handed_off_;
+    
+    int listen_fd_;
+    int stop_fd_;
+    std::thread thread_;
+    std::atomic<bool> handed_off_;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Counters and gauges for engine statistics that many threads bump at once.
+//
+// A single std::atomic shared by every worker makes each increment a
+// cache-line transfer, and neighbouring counters false-share. Here every
+// stat is split into cache-line-padded slots, each thread increments its
+// own slot with a relaxed add, and the slots are only summed when the
+// value is read (metrics scrape, getters). Slots are handed to threads
+// round-robin, one per hardware thread; threads beyond that share a slot,
+// which stays correct, just no longer uncontended.
+//
+// Reads are not a snapshot: adds racing with value() may or may not be
+// counted. Use plain atomics for values that drive decisions.
+namespace stats {
+
+constexpr size_t kCacheLine = 64;
+
+// Number of slots per stat, a power of two
+size_t slotCount();
+// Next slot in round-robin order
+size_t assignSlot();
+
+// The calling thread's slot
+inline size_t threadSlot() {
+    thread_local size_t slot = assignSlot();
+    return slot;
+}
+
+class Counter {
+public:
+    Counter();
+    
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+    
+    void add(uint64_t n = 1) {
+        cells_[threadSlot()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+    void reset();
+
+private:
+    struct alignas(kCacheLine) Cell {
+        std::atomic<uint64_t> value{0};
+    };
+    
+    std::unique_ptr<Cell[]> cells_;
+};
+
+// Up/down value such as open connections: the sum of every thread's adds
+// and subs, so a thread may sub what another added
+class Gauge {
+public:
+    Gauge();
+    
+    Gauge(const Gauge&) = delete;
+    Gauge& operator=(const Gauge&) = delete;
+    
+    void add(int64_t n = 1) {
+        cells_[threadSlot()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    void sub(int64_t n = 1) { add(-n); }
+    int64_t value() const;
+    void reset();
+
+private:
+    struct alignas(kCacheLine) Cell {
+        std::atomic<int64_t> value{0};
+    };
+    
+    std::unique_ptr<Cell[]> cells_;
+};
+
+}
@@ -5,8 +5,24 @@
 #include <thread>
 #include <atomic>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <list>
+#include "admission_controller.h"
+#include "qos_scheduler.h"
+#include "io_uring_server.h"
+#include "shm_server.h"
+#include "data_structures/memory_pool.h"
+#include "data_structures/receive_buffer.h"
+#include "request_capture.h"
+#include "stats.h"
 #include "proto/bid.pb.h"
 
+enum class ServerBackend {
+    THREADS,    // one blocking thread per connection
+    IO_URING
+};
+
 class TCPServer {
 public:
     TCPServer(const std::string& host, int port);
@@ -15,18 +31,105 @@ public:
     void start();
     void stop();
     
+    // Stops accepting; every connection is then closed at the first frame
+    // boundary where all requests read so far have been answered. Poll
+    // getActiveConnections() until 0 or a deadline, then call stop().
+    void beginDrain();
+    size_t getActiveConnections() const;
+    
+    // Listening sockets handed over by a previous engine (see SocketHandoff),
+    // used by start() instead of binding. Sockets for another port are closed.
+    void adoptListeners(const std::vector<int>& fds);
+    // The sockets currently accepted on, for handing over to a new engine
+    std::vector<int> getListeningSockets() const;
+    
     void setRequestHandler(std::function<bidding::BidResponse(const bidding::BidRequest&)> handler);
+    void setBatchHandler(std::function<bidding::BidBatchResponse(const bidding::BidBatchRequest&)> handler);
+    void setAdmissionController(AdmissionController* admission);
+    // Schedules frames by the tenant class of their connection; call before start()
+    void setQosScheduler(QosScheduler* qos);
+    void setRequestCapture(RequestCapture* capture);
+    // Falls back to THREADS at start() if io_uring is unavailable
+    void setBackend(ServerBackend backend, const IoUringConfig& io_uring_config = IoUringConfig());
+    void setReceiveBufferConfig(const ReceiveBufferConfig& config);
+    // Same-host shared-memory ingress, served alongside either backend
+    void setShmTransport(const ShmTransportConfig& config);
+    
+    ServerBackend getBackend() const { return backend_; }
+    bool isShmEnabled() const { return shm_ != nullptr; }
+    std::string getPrometheusFormat() const;
+    
+    static ServerBackend parseBackend(const std::string& name);
 
 private:
+    struct ClientThread {
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    
+    // Where a frame came from
+    struct FrameOrigin {
+        uint32_t connection_id;
+        size_t tenant;
+        bool may_block;         // false on io_uring loops, which serve many connections
+        uint64_t resume_token;  // io_uring only: resumes the connection once its turn comes
+    };
+    
+    // A frame's QoS admission
+    struct Turn {
+        enum State {
+            ADMITTED,
+            SHED,
+            PARKED          // queued; the connection is served again on its turn
+        };
+        State state;
+        std::chrono::steady_clock::time_point arrival;
+    };
+    
+    int openListener();
     void acceptConnections();
-    void handleClient(int client_fd);
+    void stopAccepting();
+    void reapClients(bool all);
+    void handleClient(int client_fd, ClientThread* self);
+    IoUringServer::FrameResult serveFrames(const FrameOrigin& origin, ReceiveBuffer& input, std::string& output);
+    Turn takeTurn(const FrameOrigin& origin);
+    bool handleFrame(const FrameOrigin& origin, const Turn& turn, const char* data, size_t length, bool batch,
+                     std::string& response_data);
+    bool processFrame(const Turn& turn, const char* data, size_t length, bool batch, std::string& response_data);
+    template <typename Request, typename Response>
+    bool processMessage(const Turn& turn, const char* data, size_t length,
+                        const std::function<Response(const Request&)>& handler, std::string& response_data);
     
     std::string host_;
     int port_;
-    int server_fd_;
+    std::vector<int> listen_fds_;
+    std::vector<int> inherited_fds_;
+    int stop_fd_;
     std::atomic<bool> running_;
-    std::vector<std::thread> client_threads_;
+    std::atomic<bool> draining_;
+    std::thread accept_thread_;
+    
+    std::mutex clients_mutex_;
+    std::list<std::unique_ptr<ClientThread>> client_threads_;
+    stats::Gauge connections_active_;
     
     std::function<bidding::BidResponse(const bidding::BidRequest&)> request_handler_;
+    std::function<bidding::BidBatchResponse(const bidding::BidBatchRequest&)> batch_handler_;
+    AdmissionController* admission_;
+    QosScheduler* qos_;
+    RequestCapture* capture_;
+    std::atomic<uint32_t> next_connection_id_;
+    
+    ReceiveBufferConfig receive_config_;
+    std::unique_ptr<MemoryPool> receive_pool_;
+    stats::Counter frames_served_;
+    stats::Counter frames_too_large_;
+    
+    ServerBackend backend_;
+    IoUringConfig io_uring_config_;
+    std::unique_ptr<IoUringServer> io_uring_;
+    
+    ShmTransportConfig shm_config_;
+    std::unique_ptr<ShmServer> shm_;
 };
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "campaign_budgets.h"
+#include "data_structures/campaign_outcome_table.h"
+#include "stats.h"
+#include "win_notice_protocol.h"
+
+struct WinNoticeConfig {
+    bool enabled = false;
+    std::string host = "0.0.0.0";
+    int port = 5001;
+    size_t threads = 1;                 // sockets sharing the port with SO_REUSEPORT
+    size_t batch = 64;                  // datagrams per recvmmsg
+    size_t max_campaigns = 16384;
+    int receive_buffer_bytes = 8 << 20; // SO_RCVBUF; absorbs bursts while a thread is descheduled
+};
+
+// UDP ingress for auction outcome notices (win_notice_protocol.h).
+//
+// Each thread owns one SO_REUSEPORT socket and drains it with recvmmsg,
+// config.batch datagrams per call, into buffers allocated once at start.
+// Notices are applied straight to a CampaignOutcomeTable from the receiving
+// thread, so the ingest path takes no locks and allocates nothing. With
+// budgets set, each win's clearing price is also charged to its campaign.
+// Malformed and truncated datagrams are counted and skipped, and datagrams
+// the kernel dropped for a full receive buffer are read from SO_RXQ_OVFL.
+class WinNoticeIngest {
+public:
+    explicit WinNoticeIngest(const WinNoticeConfig& config);
+    ~WinNoticeIngest();
+    
+    WinNoticeIngest(const WinNoticeIngest&) = delete;
+    WinNoticeIngest& operator=(const WinNoticeIngest&) = delete;
+    
+    // Throws std::runtime_error if a socket cannot be bound
+    void start();
+    void stop();
+    
+    // Applies one datagram and returns the notices applied; start() feeds
+    // this from the sockets
+    size_t ingest(const char* data, size_t length);
+    
+    const CampaignOutcomeTable& outcomes() const { return outcomes_; }
+    // Call before start()
+    void setBudgets(CampaignBudgets* budgets) { budgets_ = budgets; }
+    
+    uint64_t getNoticeCount() const { return notices_.value(); }
+    
+    std::string getPrometheusFormat() const;
+
+private:
+    int openSocket();
+    void receiveThread(size_t index);
+    
+    WinNoticeConfig config_;
+    CampaignOutcomeTable outcomes_;
+    CampaignBudgets* budgets_;
+    
+    std::vector<int> sockets_;
+    std::unique_ptr<std::atomic<uint64_t>[]> kernel_drops_;    // per socket, as last reported
+    std::vector<std::thread> threads_;
+    int wake_fd_;
+    std::atomic<bool> running_;
+    
+    stats::Counter datagrams_;
+    stats::Counter notices_;
+    stats::Counter wins_;
+    stats::Counter malformed_;
+    stats::Counter truncated_;
+    stats::Counter unplaced_;
+    stats::Counter receive_calls_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Auction outcome notices sent to the engine over UDP.
+//
+// Each datagram is a WinNoticeHeader followed by header.count WinNotice
+// records, all little-endian. Notices are independent: a lost datagram only
+// loses its own notices, and nothing is acknowledged. Datagrams are kept
+// under the path MTU by senders; kWinNoticesPerDatagram fits 1500 bytes.
+
+static constexpr uint32_t kWinNoticeMagic = 0x424e5731;    // "BNW1"
+static constexpr uint16_t kWinNoticeVersion = 1;
+static constexpr size_t kWinNoticeCampaignBytes = 24;
+
+enum class NoticeOutcome : uint8_t {
+    LOSS = 0,
+    WIN = 1
+};
+
+struct WinNoticeHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint64_t sequence;              // per sender, for spotting loss; not checked by the engine
+};
+
+// One bid's outcome. Amounts are in millionths of the currency unit so the
+// engine can sum them with integer atomics.
+struct WinNotice {
+    char campaign_id[kWinNoticeCampaignBytes];  // zero padded; longer ids are truncated
+    uint64_t request_key;           // winNoticeKey() of the request id, 0 if unknown
+    uint32_t bid_micros;            // what the engine bid
+    uint32_t price_micros;          // clearing price paid, 0 on a loss
+    uint8_t outcome;                // NoticeOutcome
+    uint8_t reserved[7];
+};
+static_assert(sizeof(WinNoticeHeader) == 16, "WinNoticeHeader must stay 16 bytes");
+static_assert(sizeof(WinNotice) == 48, "WinNotice must stay 48 bytes");
+
+static constexpr size_t kWinNoticesPerDatagram = (1472 - sizeof(WinNoticeHeader)) / sizeof(WinNotice);
+
+// FNV-1a, used for request keys and to place campaigns in the outcome table
+inline uint64_t winNoticeKey(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline void setNoticeCampaign(WinNotice& notice, const std::string& campaign_id) {
+    std::memset(notice.campaign_id, 0, sizeof(notice.campaign_id));
+    std::memcpy(notice.campaign_id, campaign_id.data(),
+                std::min(campaign_id.size(), sizeof(notice.campaign_id)));
+}
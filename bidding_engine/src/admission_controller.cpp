@@ -0,0 +1,118 @@
+#include "admission_controller.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+AdmissionController::AdmissionController(const AdmissionConfig& config)
+    : config_(config)
+    , in_flight_(0)
+    , limit_(config.initial_limit)
+    , estimated_limit_(static_cast<double>(config.initial_limit))
+    , short_rtt_us_(0.0)
+    , long_rtt_us_(0.0)
+    , long_samples_(0)
+{
+    config_.min_limit = std::max<size_t>(config_.min_limit, 1);
+    config_.max_limit = std::max(config_.max_limit, config_.min_limit);
+    setLimit(estimated_limit_);
+}
+
+bool AdmissionController::tryAcquire() {
+    size_t current = in_flight_.fetch_add(1, std::memory_order_relaxed);
+    if (current >= limit_.load(std::memory_order_relaxed)) {
+        in_flight_.fetch_sub(1, std::memory_order_relaxed);
+        rejected_count_.add();
+        return false;
+    }
+    return true;
+}
+
+void AdmissionController::release(int64_t latency_us, bool dropped) {
+    size_t in_flight = in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    
+    // Limit updates are sampled: a release that finds another thread
+    // already updating simply skips its sample instead of waiting.
+    std::unique_lock<std::mutex> lock(update_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    
+    if (config_.algorithm == LimitAlgorithm::AIMD) {
+        updateAimd(latency_us, dropped, in_flight);
+    } else {
+        updateGradient(latency_us, dropped, in_flight);
+    }
+}
+
+void AdmissionController::cancel() {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AdmissionController::updateAimd(int64_t latency_us, bool dropped, size_t in_flight) {
+    if (dropped || latency_us > config_.latency_threshold_us) {
+        setLimit(estimated_limit_ * config_.backoff_ratio);
+    } else if (in_flight * 2 >= static_cast<size_t>(estimated_limit_)) {
+        // Only grow when the limit is actually being used
+        setLimit(estimated_limit_ + 1.0);
+    }
+}
+
+void AdmissionController::updateGradient(int64_t latency_us, bool dropped, size_t in_flight) {
+    double rtt = static_cast<double>(std::max<int64_t>(latency_us, 1));
+    
+    if (long_samples_ < config_.long_window) {
+        long_samples_++;
+    }
+    long_rtt_us_ += (rtt - long_rtt_us_) / static_cast<double>(long_samples_);
+    short_rtt_us_ = short_rtt_us_ == 0.0 ? rtt : short_rtt_us_ * 0.8 + rtt * 0.2;
+    
+    // Let the baseline drift down quickly after a sustained latency drop
+    if (long_rtt_us_ / short_rtt_us_ > 2.0) {
+        long_rtt_us_ *= 0.95;
+    }
+    
+    if (!dropped && in_flight * 2 < static_cast<size_t>(estimated_limit_)) {
+        return;
+    }
+    
+    double gradient = 0.5;
+    if (!dropped) {
+        gradient = std::clamp(config_.tolerance * long_rtt_us_ / short_rtt_us_, 0.5, 1.0);
+    }
+    
+    double queue_size = std::sqrt(estimated_limit_);
+    double new_limit = estimated_limit_ * gradient + queue_size;
+    setLimit(estimated_limit_ * (1.0 - config_.smoothing) + new_limit * config_.smoothing);
+}
+
+void AdmissionController::setLimit(double limit) {
+    estimated_limit_ = std::clamp(limit,
+        static_cast<double>(config_.min_limit),
+        static_cast<double>(config_.max_limit));
+    limit_.store(static_cast<size_t>(estimated_limit_), std::memory_order_relaxed);
+}
+
+std::string AdmissionController::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_admission_limit Current adaptive concurrency limit\n";
+    oss << "# TYPE bidding_admission_limit gauge\n";
+    oss << "bidding_admission_limit " << getLimit() << "\n";
+    
+    oss << "# HELP bidding_admission_in_flight Requests currently admitted\n";
+    oss << "# TYPE bidding_admission_in_flight gauge\n";
+    oss << "bidding_admission_in_flight " << getInFlight() << "\n";
+    
+    oss << "# HELP bidding_admission_rejected_total Requests rejected as throttled\n";
+    oss << "# TYPE bidding_admission_rejected_total counter\n";
+    oss << "bidding_admission_rejected_total " << getRejectedCount() << "\n";
+    
+    return oss.str();
+}
+
+LimitAlgorithm AdmissionController::parseAlgorithm(const std::string& name) {
+    if (name == "aimd") {
+        return LimitAlgorithm::AIMD;
+    }
+    return LimitAlgorithm::GRADIENT;
+}
@@ -1,4 +1,5 @@
 #include "auction.h"
+#include "scoring_rules.h"
 #include <cmath>
 
 AuctionEngine::AuctionEngine() {
@@ -48,21 +49,6 @@ bidding::BidResponse AuctionEngine::runSecondPriceAuction(
 }
 
 double AuctionEngine::calculateBidScore(const bidding::BidRequest& request) {
-    double score = request.floor_price();
-    
-    // Apply targeting multipliers
-    for (const auto& [key, value] : request.targeting()) {
-        if (key == "premium_user" && value == "true") {
-            score *= 1.5;
-        }
-        if (key == "high_value_region" && value == "true") {
-            score *= 1.3;
-        }
-        if (key == "mobile" && value == "true") {
-            score *= 1.2;
-        }
-    }
-    
-    return score;
+    return request.floor_price() * CompiledScorer<kAuctionScoreRules>::multiplier(request.targeting());
 }
 
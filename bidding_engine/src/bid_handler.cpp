@@ -1,14 +1,21 @@
 #include "bid_handler.h"
 #include "auction.h"
 #include "data_structures/bid_cache.h"
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <limits>
+#include <sstream>
 
 BidHandler::BidHandler(size_t thread_pool_size)
     : thread_pool_size_(thread_pool_size)
     , running_(false)
-    , processed_count_(0)
-    , error_count_(0)
+    , task_queue_(4096)
+    , frequency_caps_(nullptr)
+    , budgets_(nullptr)
+    , outcomes_(nullptr)
+    , scoring_budget_(5000)
+    , hedge_after_(0)
 {
     memory_pool_ = std::make_unique<MemoryPool>(10000);
     circuit_breaker_ = std::make_unique<CircuitBreaker>(50, 60);
@@ -36,7 +43,11 @@ void BidHandler::stop() {
         return;
     }
     
-    running_.store(false);
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        running_.store(false);
+    }
+    idle_cv_.notify_all();
     
     for (auto& thread : worker_threads_) {
         if (thread.joinable()) {
@@ -52,7 +63,7 @@ bool BidHandler::submitBidRequest(const bidding::BidRequest& request) {
     }
     
     if (!validateBidRequest(request)) {
-        error_count_.fetch_add(1);
+        error_count_.add();
         return false;
     }
     
@@ -60,11 +71,20 @@ bool BidHandler::submitBidRequest(const bidding::BidRequest& request) {
 }
 
 bidding::BidResponse BidHandler::processBid(const bidding::BidRequest& request) {
+    return process(request, nullptr);
+}
+
+bidding::BidResponse BidHandler::processBid(std::shared_ptr<const bidding::BidRequest> request) {
+    return process(*request, request);
+}
+
+bidding::BidResponse BidHandler::process(const bidding::BidRequest& request,
+                                         const std::shared_ptr<const bidding::BidRequest>& shared) {
     auto start_time = std::chrono::high_resolution_clock::now();
     
     try {
         if (!circuit_breaker_->isOpen()) {
-            bidding::BidResponse response = scoreBid(request);
+            bidding::BidResponse response = score(request, shared);
             
             auto end_time = std::chrono::high_resolution_clock::now();
             auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -77,7 +97,7 @@ bidding::BidResponse BidHandler::processBid(const bidding::BidRequest& request)
                 bid_callback_(response);
             }
             
-            processed_count_.fetch_add(1);
+            processed_count_.add();
             circuit_breaker_->recordSuccess();
             
             return response;
@@ -86,12 +106,12 @@ bidding::BidResponse BidHandler::processBid(const bidding::BidRequest& request)
             bidding::BidResponse response;
             response.set_id(request.id());
             response.set_status("circuit_breaker_open");
-            error_count_.fetch_add(1);
+            error_count_.add();
             return response;
         }
     } catch (const std::exception& e) {
         circuit_breaker_->recordFailure();
-        error_count_.fetch_add(1);
+        error_count_.add();
         
         bidding::BidResponse response;
         response.set_id(request.id());
@@ -102,17 +122,139 @@ bidding::BidResponse BidHandler::processBid(const bidding::BidRequest& request)
 
 void BidHandler::workerThread() {
     bidding::BidRequest request;
+    std::function<void()> task;
     
     while (running_.load()) {
-        if (request_queue_.pop(request)) {
+        // Fan-out tasks first: a request thread is waiting on them
+        if (task_queue_.pop(task)) {
+            task();
+            task = nullptr;
+        } else if (request_queue_.pop(request)) {
             processBid(request);
         } else {
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            // submitTask() wakes us; queued requests are picked up on the timeout
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_cv_.wait_for(lock, std::chrono::microseconds(100),
+                              [this] { return !task_queue_.empty() || !running_.load(); });
+        }
+    }
+}
+
+bool BidHandler::submitTask(std::function<void()> task) {
+    // Running it here instead would hold the caller past its budget
+    if (!running_.load() || !task_queue_.push(task)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_cv_.notify_one();
+    return true;
+}
+
+bool BidHandler::scoreSources(const std::shared_ptr<const bidding::BidRequest>& request, SourceBid& best) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + scoring_budget_;
+    auto hedge_at = hedge_after_.count() > 0 ? start + hedge_after_ : deadline;
+    fan_outs_.add();
+    
+    auto fan = std::make_shared<FanOut>();
+    fan->request = request;
+    fan->done.assign(sources_.size(), 0);
+    fan->remaining = sources_.size();
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (!submitTask([this, fan, i] { runSource(fan, i, false); })) {
+            sources_[i]->rejected.add();
+            std::lock_guard<std::mutex> lock(fan->mutex);
+            fan->done[i] = 1;
+            --fan->remaining;
         }
     }
+    
+    bool hedged = hedge_after_.count() == 0;
+    std::unique_lock<std::mutex> lock(fan->mutex);
+    while (fan->remaining > 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            budget_expired_.add();
+            for (size_t i = 0; i < sources_.size(); ++i) {
+                if (!fan->done[i]) {
+                    sources_[i]->late.add();
+                }
+            }
+            break;
+        }
+        if (!hedged && now >= hedge_at) {
+            hedged = true;
+            std::vector<size_t> slow;
+            for (size_t i = 0; i < sources_.size(); ++i) {
+                if (!fan->done[i] && sources_[i]->hedge) {
+                    slow.push_back(i);
+                }
+            }
+            lock.unlock();
+            for (size_t i : slow) {
+                if (submitTask([this, fan, i] { runSource(fan, i, true); })) {
+                    hedges_.add();
+                }
+            }
+            lock.lock();
+            continue;
+        }
+        fan->done_cv.wait_until(lock, hedged ? deadline : hedge_at);
+    }
+    
+    best = fan->best;
+    return best.bid > 0.0;
+}
+
+void BidHandler::runSource(const std::shared_ptr<FanOut>& fan, size_t index, bool hedged) {
+    SourceBid bid;
+    bool ok = false;
+    {
+        std::lock_guard<std::mutex> lock(fan->mutex);
+        if (fan->done[index]) {
+            return;
+        }
+    }
+    try {
+        ok = sources_[index]->score(*fan->request, bid) && bid.bid > 0.0;
+    } catch (const std::exception& e) {
+        ok = false;
+    }
+    if (ok && frequency_caps_ && frequency_caps_->isCapped(fan->request->user_id(), bid.campaign_id)) {
+        ok = false;
+    }
+    if (ok && budgets_ && !budgets_->allow(bid.campaign_id)) {
+        ok = false;
+    }
+    
+    std::lock_guard<std::mutex> lock(fan->mutex);
+    if (fan->done[index]) {
+        return;
+    }
+    fan->done[index] = 1;
+    if (hedged) {
+        hedge_wins_.add();
+    }
+    if (ok && bid.bid > fan->best.bid) {
+        fan->best = std::move(bid);
+    }
+    if (--fan->remaining == 0) {
+        fan->done_cv.notify_one();
+    }
 }
 
 bidding::BidResponse BidHandler::scoreBid(const bidding::BidRequest& request) {
+    return score(request, nullptr);
+}
+
+bidding::BidResponse BidHandler::scoreBid(std::shared_ptr<const bidding::BidRequest> request) {
+    return score(*request, request);
+}
+
+bidding::BidResponse BidHandler::score(const bidding::BidRequest& request,
+                                       const std::shared_ptr<const bidding::BidRequest>& shared) {
     // Vectorized bid scoring using SIMD
     AuctionEngine auction;
     
@@ -120,13 +262,7 @@ bidding::BidResponse BidHandler::scoreBid(const bidding::BidRequest& request) {
     double base_score = request.floor_price();
     
     // Apply targeting multipliers
-    double multiplier = 1.0;
-    if (request.targeting().count("premium_user")) {
-        multiplier *= 1.5;
-    }
-    if (request.targeting().count("high_value_region")) {
-        multiplier *= 1.3;
-    }
+    double multiplier = targetingMultiplier(request.targeting());
     
     double bid_amount = base_score * multiplier;
     
@@ -134,13 +270,225 @@ bidding::BidResponse BidHandler::scoreBid(const bidding::BidRequest& request) {
     bidding::BidResponse response;
     response.set_id(request.id());
     response.set_campaign_id(request.campaign_id());
+    bool eligible = (!frequency_caps_ || !frequency_caps_->isCapped(request.user_id(), request.campaign_id())) &&
+                    (!budgets_ || budgets_->allow(request.campaign_id()));
+    if (!sources_.empty()) {
+        SourceBid best;
+        bool scored = scoreSources(shared ? shared : std::make_shared<const bidding::BidRequest>(request), best);
+        if (scored && (!eligible || best.bid > bid_amount)) {
+            response.set_campaign_id(best.campaign_id);
+            bid_amount = best.bid;
+            eligible = true;
+        }
+    }
+    if (!eligible) {
+        response.set_won(false);
+        return response;
+    }
     response.set_winning_bid(bid_amount);
-    response.set_price(bid_amount * 0.8); // Second-price auction
+    // Shaded price; without a model a flat 20% below the bid
+    if (pricing_model_) {
+        CampaignOutcome outcome;
+        bool observed = outcomes_ && outcomes_->get(response.campaign_id(), outcome);
+        response.set_price(pricing_model_->price(bid_amount, request, observed ? &outcome : nullptr));
+    } else {
+        response.set_price(bid_amount * 0.8);
+    }
     response.set_won(bid_amount >= request.floor_price());
+    if (frequency_caps_ && response.won()) {
+        frequency_caps_->record(request.user_id(), response.campaign_id());
+    }
     
     return response;
 }
 
+bidding::BidBatchResponse BidHandler::processBatch(const bidding::BidBatchRequest& request) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    auto fail = [&request](const std::string& status) {
+        bidding::BidBatchResponse batch;
+        batch.set_id(request.id());
+        batch.set_status(status);
+        for (const auto& slot : request.slots()) {
+            bidding::BidResponse* response = batch.add_responses();
+            response->set_id(slot.ad_slot_id());
+            response->set_status(status);
+        }
+        return batch;
+    };
+    
+    try {
+        if (circuit_breaker_->isOpen()) {
+            circuit_breaker_->recordFailure();
+            error_count_.add();
+            return fail("circuit_breaker_open");
+        }
+        
+        bidding::BidBatchResponse batch = scoreBatch(request);
+        
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+            end_time - start_time).count();
+        
+        batch.set_latency_ms(static_cast<int32_t>(latency));
+        batch.set_status("success");
+        for (auto& response : *batch.mutable_responses()) {
+            response.set_latency_ms(static_cast<int32_t>(latency));
+            response.set_status("success");
+            if (bid_callback_) {
+                bid_callback_(response);
+            }
+        }
+        
+        processed_count_.add(batch.responses_size());
+        circuit_breaker_->recordSuccess();
+        
+        return batch;
+    } catch (const std::exception& e) {
+        circuit_breaker_->recordFailure();
+        error_count_.add();
+        return fail("error");
+    }
+}
+
+bidding::BidBatchResponse BidHandler::scoreBatch(const bidding::BidBatchRequest& request) {
+    bidding::BidBatchResponse batch;
+    batch.set_id(request.id());
+    
+    // User-level work runs once per page view, not once per slot
+    double multiplier = targetingMultiplier(request.targeting());
+    
+    // Every slot sees the same candidates, so they are ranked once, best
+    // bid per campaign. Each slot then goes to the best campaign with cap
+    // and lease left for it, at the next such campaign's bid, and is
+    // charged against both before the following slot is auctioned.
+    struct Ranked {
+        const bidding::Candidate* candidate;
+        double bid;
+        uint32_t cap_left;
+        double budget_left;
+        uint32_t won;
+        CampaignOutcome outcome;
+    };
+    std::vector<Ranked> ranked;
+    ranked.reserve(request.candidates_size());
+    for (const auto& candidate : request.candidates()) {
+        if (candidate.bid() <= 0.0) {
+            continue;
+        }
+        if (frequency_caps_ && frequency_caps_->isCapped(request.user_id(), candidate.campaign_id())) {
+            continue;
+        }
+        if (budgets_ && !budgets_->allow(candidate.campaign_id())) {
+            continue;
+        }
+        Ranked entry{&candidate, candidate.bid() * multiplier, std::numeric_limits<uint32_t>::max(),
+                     std::numeric_limits<double>::infinity(), 0, CampaignOutcome{}};
+        if (frequency_caps_) {
+            uint32_t cap = frequency_caps_->capFor(candidate.campaign_id());
+            if (cap > 0) {
+                uint32_t seen = frequency_caps_->count(request.user_id(), candidate.campaign_id());
+                entry.cap_left = seen < cap ? cap - seen : 0;
+            }
+        }
+        if (budgets_) {
+            entry.budget_left = budgets_->remaining(candidate.campaign_id());
+        }
+        ranked.push_back(entry);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const Ranked& a, const Ranked& b) { return a.bid > b.bid; });
+    auto duplicate = [&ranked](size_t i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (ranked[j].candidate->campaign_id() == ranked[i].candidate->campaign_id()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    size_t kept = 0;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        if (!duplicate(i)) {
+            ranked[kept++] = ranked[i];
+        }
+    }
+    ranked.resize(kept);
+    if (pricing_model_ && outcomes_) {
+        for (auto& entry : ranked) {
+            outcomes_->get(entry.candidate->campaign_id(), entry.outcome);
+        }
+    }
+    
+    // With a model each slot's price is the winning bid shaded for that
+    // slot and corrected by the winner's win rate, as in scoreBid; every
+    // slot is shaded in one pass over the trees
+    thread_local std::vector<double> floors;
+    thread_local std::vector<float> rows;
+    thread_local std::vector<float> shades;
+    if (pricing_model_ && !ranked.empty()) {
+        size_t count = request.slots_size();
+        floors.resize(count);
+        rows.resize(count * pricing_model_->rowStride());
+        shades.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            floors[i] = request.slots(i).floor_price();
+        }
+        pricing_model_->extractSlots(floors.data(), count, request.targeting(), rows.data());
+        pricing_model_->shadeBatch(rows.data(), count, shades.data());
+    }
+    
+    batch.mutable_responses()->Reserve(request.slots_size());
+    for (int i = 0; i < request.slots_size(); ++i) {
+        const auto& slot = request.slots(i);
+        bidding::BidResponse* response = batch.add_responses();
+        response->set_id(slot.ad_slot_id());
+        
+        Ranked* winner = nullptr;
+        const Ranked* runner_up = nullptr;
+        for (auto& entry : ranked) {
+            if (entry.cap_left == 0 || entry.budget_left <= 0.0) {
+                continue;
+            }
+            if (winner) {
+                runner_up = &entry;
+                break;
+            }
+            winner = &entry;
+        }
+        if (!winner || winner->bid < slot.floor_price()) {
+            response->set_won(false);
+            continue;
+        }
+        double price = runner_up ? runner_up->bid : 0.0;
+        if (pricing_model_) {
+            price = winner->bid * pricing_model_->adjustShade(shades[i], winner->outcome);
+        }
+        price = std::max(price, slot.floor_price());
+        response->set_campaign_id(winner->candidate->campaign_id());
+        response->set_winning_bid(winner->bid);
+        response->set_price(price);
+        response->set_won(true);
+        
+        --winner->cap_left;
+        winner->budget_left -= price;
+        ++winner->won;
+    }
+    for (const auto& entry : ranked) {
+        if (frequency_caps_ && entry.won > 0) {
+            frequency_caps_->record(request.user_id(), entry.candidate->campaign_id(), entry.won);
+        }
+    }
+    
+    return batch;
+}
+
+double BidHandler::targetingMultiplier(const TargetingMap& targeting) const {
+    if (runtime_rules_) {
+        return runtime_rules_->multiplier(targeting);
+    }
+    return CompiledScorer<kBidRules>::multiplier(targeting);
+}
+
 bool BidHandler::validateBidRequest(const bidding::BidRequest& request) {
     if (request.id().empty()) {
         return false;
@@ -158,3 +506,59 @@ void BidHandler::setBidCallback(std::function<void(const bidding::BidResponse&)>
     bid_callback_ = callback;
 }
 
+void BidHandler::setScoringRules(const ScoringRuleSet& rules) {
+    runtime_rules_ = std::make_unique<ScoringRuleSet>(rules);
+}
+
+void BidHandler::setPricingModel(std::unique_ptr<PricingModel> model) {
+    pricing_model_ = std::move(model);
+}
+
+void BidHandler::addScoringSource(const std::string& name, ScoringSource source, bool hedge) {
+    auto entry = std::make_unique<Source>();
+    entry->name = name;
+    entry->score = std::move(source);
+    entry->hedge = hedge;
+    sources_.push_back(std::move(entry));
+}
+
+void BidHandler::setScoringBudget(std::chrono::microseconds budget, std::chrono::microseconds hedge_after) {
+    scoring_budget_ = budget;
+    hedge_after_ = hedge_after;
+}
+
+std::string BidHandler::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_scoring_fanouts_total Requests scored by the parallel sources\n";
+    oss << "# TYPE bidding_scoring_fanouts_total counter\n";
+    oss << "bidding_scoring_fanouts_total " << fan_outs_.value() << "\n";
+    
+    oss << "# HELP bidding_scoring_budget_expired_total Requests answered with the best bid so far\n";
+    oss << "# TYPE bidding_scoring_budget_expired_total counter\n";
+    oss << "bidding_scoring_budget_expired_total " << budget_expired_.value() << "\n";
+    
+    oss << "# HELP bidding_scoring_hedges_total Hedged second runs of a slow source\n";
+    oss << "# TYPE bidding_scoring_hedges_total counter\n";
+    oss << "bidding_scoring_hedges_total " << hedges_.value() << "\n";
+    
+    oss << "# HELP bidding_scoring_hedge_wins_total Hedged runs that answered first\n";
+    oss << "# TYPE bidding_scoring_hedge_wins_total counter\n";
+    oss << "bidding_scoring_hedge_wins_total " << hedge_wins_.value() << "\n";
+    
+    oss << "# HELP bidding_scoring_source_late_total Times a source missed the budget\n";
+    oss << "# TYPE bidding_scoring_source_late_total counter\n";
+    for (const auto& source : sources_) {
+        oss << "bidding_scoring_source_late_total{source=\"" << source->name << "\"} "
+            << source->late.value() << "\n";
+    }
+    
+    oss << "# HELP bidding_scoring_source_rejected_total Times a source was skipped for a full task queue\n";
+    oss << "# TYPE bidding_scoring_source_rejected_total counter\n";
+    for (const auto& source : sources_) {
+        oss << "bidding_scoring_source_rejected_total{source=\"" << source->name << "\"} "
+            << source->rejected.value() << "\n";
+    }
+    
+    return oss.str();
+}
@@ -0,0 +1,341 @@
+#include "bidding_shm.h"
+#include "shm_protocol.h"
+#include "data_structures/receive_buffer.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+struct bidding_shm_client {
+    int control_fd = -1;
+    int fds[SHM_FD_COUNT] = {-1, -1, -1, -1};
+    void* segment = MAP_FAILED;
+    size_t segment_bytes = 0;
+    ShmRing requests;
+    ShmRing responses;
+    uint32_t spin_us = 0;
+    bool armed = false;
+    bool closed = false;
+    
+    ~bidding_shm_client() {
+        if (segment != MAP_FAILED) {
+            munmap(segment, segment_bytes);
+        }
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        if (control_fd >= 0) {
+            close(control_fd);
+        }
+    }
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+void signalEvent(int event_fd) {
+    uint64_t one = 1;
+    ssize_t written = write(event_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void drainEvent(int event_fd) {
+    uint64_t value;
+    ssize_t drained = read(event_fd, &value, sizeof(value));
+    (void)drained;
+}
+
+bool receiveHello(int control_fd, ShmHello& hello, int (&fds)[SHM_FD_COUNT]) {
+    struct iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    if (recvmsg(control_fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(hello))) {
+        return false;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        return false;
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    return true;
+}
+
+// Spins for the client's window, then sleeps on event_fd with the ring's
+// waiting flag set. Returns false with errno set on timeout or hangup.
+template <typename Ready>
+bool waitUntil(bidding_shm_client* client, ShmRing& ring, bool consumer, int event_fd,
+               Ready ready, int timeout_ms) {
+    if (ready()) {
+        return true;
+    }
+    if (client->closed) {
+        errno = EPIPE;
+        return false;
+    }
+    if (ring.corrupt()) {
+        errno = EPROTO;
+        return false;
+    }
+    if (timeout_ms == 0) {
+        errno = ETIMEDOUT;
+        return false;
+    }
+    
+    auto start = Clock::now();
+    auto spin = std::chrono::microseconds(client->spin_us);
+    while (Clock::now() - start < spin) {
+        if (ready()) {
+            return true;
+        }
+        cpuRelax();
+    }
+    
+    auto deadline = start + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        if (consumer) {
+            ring.setConsumerWaiting(true);
+        } else {
+            ring.setProducerWaiting(true);
+        }
+        
+        int wait_ms = -1;
+        if (timeout_ms > 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            wait_ms = remaining.count() > 0 ? static_cast<int>(remaining.count()) : 0;
+        }
+        struct pollfd fds[2] = {{event_fd, POLLIN, 0}, {client->control_fd, POLLIN, 0}};
+        int ready_fds = ready() ? 1 : poll(fds, 2, wait_ms);
+        
+        if (consumer) {
+            ring.setConsumerWaiting(false);
+        } else {
+            ring.setProducerWaiting(false);
+        }
+        if (fds[0].revents & POLLIN) {
+            drainEvent(event_fd);
+        }
+        if (ready()) {
+            return true;
+        }
+        if (ring.corrupt()) {
+            errno = EPROTO;
+            return false;
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            client->closed = true;
+            errno = EPIPE;
+            return false;
+        }
+        if (ready_fds == 0 && timeout_ms > 0 && Clock::now() >= deadline) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+    }
+}
+
+bool writeAll(bidding_shm_client* client, const char* data, size_t length) {
+    ShmRing& ring = client->requests;
+    while (length > 0) {
+        size_t n = ring.write(data, length);
+        if (n > 0) {
+            data += n;
+            length -= n;
+            if (ring.consumerNeedsWake()) {
+                signalEvent(client->fds[SHM_FD_SERVER_EVENT]);
+            }
+            continue;
+        }
+        if (!waitUntil(client, ring, false, client->fds[SHM_FD_CLIENT_SPACE],
+                       [&ring]() { return ring.writable() > 0; }, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readAll(bidding_shm_client* client, char* dest, size_t length) {
+    ShmRing& ring = client->responses;
+    while (length > 0) {
+        size_t n = ring.read(dest, length);
+        if (n > 0) {
+            dest += n;
+            length -= n;
+            if (ring.producerNeedsWake()) {
+                signalEvent(client->fds[SHM_FD_SERVER_EVENT]);
+            }
+            continue;
+        }
+        if (!waitUntil(client, ring, true, client->fds[SHM_FD_CLIENT_DATA],
+                       [&ring]() { return ring.readable() > 0; }, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+extern "C" {
+
+bidding_shm_client* bidding_shm_connect(const char* path) {
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (!path || std::strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return nullptr;
+    }
+    std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    
+    auto* client = new (std::nothrow) bidding_shm_client();
+    if (!client) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    
+    client->control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->control_fd < 0 ||
+        connect(client->control_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        int saved = errno;
+        delete client;
+        errno = saved;
+        return nullptr;
+    }
+    
+    ShmHello hello;
+    if (!receiveHello(client->control_fd, hello, client->fds) ||
+        hello.magic != kShmMagic || hello.version != kShmVersion ||
+        hello.segment_bytes != shmSegmentBytes(hello.ring_bytes)) {
+        delete client;
+        errno = EPROTO;
+        return nullptr;
+    }
+    
+    client->segment_bytes = hello.segment_bytes;
+    client->segment = mmap(nullptr, client->segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           client->fds[SHM_FD_SEGMENT], 0);
+    if (client->segment == MAP_FAILED) {
+        int saved = errno;
+        delete client;
+        errno = saved;
+        return nullptr;
+    }
+    
+    const auto* header = static_cast<const ShmSegmentHeader*>(client->segment);
+    if (header->magic != kShmMagic || header->ring_bytes != hello.ring_bytes) {
+        delete client;
+        errno = EPROTO;
+        return nullptr;
+    }
+    client->requests = shmRequestRing(client->segment, hello.ring_bytes);
+    client->responses = shmResponseRing(client->segment, hello.ring_bytes);
+    client->spin_us = hello.spin_us;
+    return client;
+}
+
+void bidding_shm_close(bidding_shm_client* client) {
+    delete client;
+}
+
+int bidding_shm_send(bidding_shm_client* client, const void* payload, uint32_t length, int batch) {
+    if (client->closed) {
+        errno = EPIPE;
+        return -1;
+    }
+    uint32_t prefix = htonl((length & ~kBatchFrameFlag) | (batch ? kBatchFrameFlag : 0));
+    if (!writeAll(client, reinterpret_cast<const char*>(&prefix), sizeof(prefix)) ||
+        !writeAll(client, static_cast<const char*>(payload), length)) {
+        return -1;
+    }
+    return 0;
+}
+
+int64_t bidding_shm_recv(bidding_shm_client* client, void* buffer, uint32_t capacity, int* batch,
+                         int timeout_ms) {
+    ShmRing& ring = client->responses;
+    if (client->armed) {
+        ring.setConsumerWaiting(false);
+        drainEvent(client->fds[SHM_FD_CLIENT_DATA]);
+        client->armed = false;
+    }
+    
+    if (!waitUntil(client, ring, true, client->fds[SHM_FD_CLIENT_DATA],
+                   [&ring]() { return ring.readable() >= sizeof(uint32_t); }, timeout_ms)) {
+        return -1;
+    }
+    uint32_t prefix;
+    ring.peek(reinterpret_cast<char*>(&prefix), sizeof(prefix));
+    prefix = ntohl(prefix);
+    uint32_t length = prefix & ~kBatchFrameFlag;
+    if (length > capacity) {
+        return length;
+    }
+    
+    // Frames that fit the ring are only taken whole, so a timeout never
+    // leaves half a frame consumed; larger ones are streamed through
+    size_t frame_bytes = sizeof(prefix) + length;
+    if (frame_bytes <= ring.capacity() &&
+        !waitUntil(client, ring, true, client->fds[SHM_FD_CLIENT_DATA],
+                   [&ring, frame_bytes]() { return ring.readable() >= frame_bytes; }, timeout_ms)) {
+        return -1;
+    }
+    ring.consume(sizeof(prefix));
+    if (!readAll(client, static_cast<char*>(buffer), length)) {
+        return -1;
+    }
+    if (ring.producerNeedsWake()) {
+        signalEvent(client->fds[SHM_FD_SERVER_EVENT]);
+    }
+    
+    if (batch) {
+        *batch = (prefix & kBatchFrameFlag) ? 1 : 0;
+    }
+    return length;
+}
+
+int bidding_shm_event_fd(const bidding_shm_client* client) {
+    return client->fds[SHM_FD_CLIENT_DATA];
+}
+
+int bidding_shm_arm(bidding_shm_client* client) {
+    ShmRing& ring = client->responses;
+    if (ring.readable() > 0) {
+        return 1;
+    }
+    ring.setConsumerWaiting(true);
+    client->armed = true;
+    return ring.readable() > 0 ? 1 : 0;
+}
+
+void bidding_shm_set_spin_us(bidding_shm_client* client, uint32_t spin_us) {
+    client->spin_us = spin_us;
+}
+
+}
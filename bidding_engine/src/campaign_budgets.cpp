@@ -0,0 +1,225 @@
+#include "campaign_budgets.h"
+#include "win_notice_protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+// Demand every live replica is credited with, in requests/sec, so an idle
+// replica keeps a small lease and can pick up traffic before the next round
+constexpr double kDemandFloor = 1.0;
+
+uint64_t toMicros(double amount) {
+    return amount > 0.0 ? static_cast<uint64_t>(amount * 1e6 + 0.5) : 0;
+}
+
+}
+
+CampaignBudgets::CampaignBudgets(const std::unordered_map<std::string, double>& budgets, uint32_t node_id,
+                                 size_t expected_replicas)
+{
+    uint32_t incarnation = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    replica_id_ = static_cast<uint64_t>(node_id) << 32 | incarnation;
+    
+    for (const auto& [id, budget] : budgets) {
+        auto campaign = std::make_unique<Campaign>();
+        campaign->id = id;
+        campaign->key = winNoticeKey(id.data(), std::min(id.size(), kWinNoticeCampaignBytes));
+        campaign->budget_micros = toMicros(budget);
+        campaign->lease_micros.store(campaign->budget_micros / std::max<size_t>(expected_replicas, 1));
+        campaign->replicas[replica_id_];
+        by_id_[id] = campaign.get();
+        by_key_[campaign->key] = campaign.get();
+        campaigns_.push_back(std::move(campaign));
+    }
+}
+
+CampaignBudgets::Campaign* CampaignBudgets::find(const std::string& campaign_id) const {
+    if (by_id_.empty()) {
+        return nullptr;
+    }
+    auto it = by_id_.find(campaign_id);
+    return it == by_id_.end() ? nullptr : it->second;
+}
+
+bool CampaignBudgets::allow(const std::string& campaign_id) {
+    Campaign* campaign = find(campaign_id);
+    if (!campaign) {
+        return true;
+    }
+    campaign->demand.add();
+    if (campaign->spend_micros.load(std::memory_order_relaxed) < campaign->lease_micros.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    campaign->exhausted.add();
+    return false;
+}
+
+void CampaignBudgets::recordWin(const char* campaign_id, uint64_t price_micros) {
+    if (by_key_.empty()) {
+        return;
+    }
+    auto it = by_key_.find(winNoticeKey(campaign_id, strnlen(campaign_id, kWinNoticeCampaignBytes)));
+    if (it != by_key_.end()) {
+        it->second->spend_micros.fetch_add(price_micros, std::memory_order_relaxed);
+    }
+}
+
+double CampaignBudgets::remaining(const std::string& campaign_id) const {
+    Campaign* campaign = find(campaign_id);
+    if (!campaign) {
+        return std::numeric_limits<double>::infinity();
+    }
+    uint64_t spend = campaign->spend_micros.load(std::memory_order_relaxed);
+    uint64_t lease = campaign->lease_micros.load(std::memory_order_relaxed);
+    return spend < lease ? (lease - spend) / 1e6 : 0.0;
+}
+
+CampaignBudgets::ReplicaCounters& CampaignBudgets::refreshOwn(Campaign& campaign) {
+    ReplicaCounters& own = campaign.replicas[replica_id_];
+    uint64_t spend = campaign.spend_micros.load(std::memory_order_relaxed);
+    uint64_t demand = campaign.demand.value();
+    if (spend != own.spend_micros || demand != own.demand) {
+        own.spend_micros = spend;
+        own.demand = demand;
+        own.dirty = true;
+    }
+    return own;
+}
+
+bool CampaignBudgets::merge(const PeerCounter& counter) {
+    auto it = by_key_.find(counter.campaign_key);
+    // Our own counters only ever come back older than we have them
+    if (it == by_key_.end() || counter.replica == replica_id_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(view_mutex_);
+    ReplicaCounters& replica = it->second->replicas[counter.replica];
+    bool raised = false;
+    if (counter.spend_micros > replica.spend_micros) {
+        replica.spend_micros = counter.spend_micros;
+        raised = true;
+    }
+    if (counter.demand > replica.demand) {
+        replica.demand = counter.demand;
+        raised = true;
+    }
+    replica.dirty = replica.dirty || raised;
+    return raised;
+}
+
+size_t CampaignBudgets::takeCounters(std::vector<PeerCounter>& out, size_t max_entries, bool everything) {
+    std::lock_guard<std::mutex> lock(view_mutex_);
+    size_t taken = 0;
+    for (const auto& campaign : campaigns_) {
+        refreshOwn(*campaign);
+        if (everything) {
+            for (auto& entry : campaign->replicas) {
+                entry.second.dirty = true;
+            }
+        }
+    }
+    
+    // Own counters first: no one else can send them
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const auto& campaign : campaigns_) {
+            for (auto& [replica_id, replica] : campaign->replicas) {
+                if (taken >= max_entries) {
+                    return taken;
+                }
+                if (!replica.dirty || (replica_id == replica_id_) != (pass == 0)) {
+                    continue;
+                }
+                out.push_back({campaign->key, replica_id, replica.spend_micros, replica.demand});
+                replica.dirty = false;
+                ++taken;
+            }
+        }
+    }
+    return taken;
+}
+
+void CampaignBudgets::rebalance(const std::unordered_set<uint64_t>& live, double elapsed_seconds) {
+    std::lock_guard<std::mutex> lock(view_mutex_);
+    for (const auto& campaign : campaigns_) {
+        ReplicaCounters& own = refreshOwn(*campaign);
+        
+        uint64_t total_spend = 0;
+        double own_weight = 0.0;
+        double total_weight = 0.0;
+        for (auto& [replica_id, replica] : campaign->replicas) {
+            total_spend += replica.spend_micros;
+            if (elapsed_seconds > 0.0) {
+                double rate = (replica.demand - replica.rate_demand) / elapsed_seconds;
+                replica.demand_rate = replica.rate_demand == 0 ? rate : 0.5 * replica.demand_rate + 0.5 * rate;
+                replica.rate_demand = replica.demand;
+            }
+            bool is_self = replica_id == replica_id_;
+            if (!is_self && !live.count(replica_id)) {
+                continue;
+            }
+            double weight = replica.demand_rate + kDemandFloor;
+            total_weight += weight;
+            if (is_self) {
+                own_weight = weight;
+            }
+        }
+        // Live peers that have not reported this campaign yet still get the floor
+        for (uint64_t replica_id : live) {
+            if (!campaign->replicas.count(replica_id)) {
+                total_weight += kDemandFloor;
+            }
+        }
+        
+        campaign->known_spend_micros = total_spend;
+        uint64_t remaining = campaign->budget_micros > total_spend ? campaign->budget_micros - total_spend : 0;
+        double share = total_weight > 0.0 ? own_weight / total_weight : 1.0;
+        campaign->lease_micros.store(own.spend_micros + static_cast<uint64_t>(remaining * share),
+                                     std::memory_order_relaxed);
+    }
+}
+
+std::string CampaignBudgets::getPrometheusFormat() const {
+    std::ostringstream oss;
+    std::lock_guard<std::mutex> lock(view_mutex_);
+    
+    oss << "# HELP bidding_budget_total Campaign budget across all replicas\n";
+    oss << "# TYPE bidding_budget_total gauge\n";
+    for (const auto& campaign : campaigns_) {
+        oss << "bidding_budget_total{campaign=\"" << campaign->id << "\"} " << campaign->budget_micros / 1e6 << "\n";
+    }
+    
+    oss << "# HELP bidding_budget_spent Campaign spend across all replicas, as synced so far\n";
+    oss << "# TYPE bidding_budget_spent gauge\n";
+    for (const auto& campaign : campaigns_) {
+        uint64_t spent = std::max(campaign->known_spend_micros, campaign->spend_micros.load());
+        oss << "bidding_budget_spent{campaign=\"" << campaign->id << "\"} " << spent / 1e6 << "\n";
+    }
+    
+    oss << "# HELP bidding_budget_spent_local Campaign spend by this replica\n";
+    oss << "# TYPE bidding_budget_spent_local gauge\n";
+    for (const auto& campaign : campaigns_) {
+        oss << "bidding_budget_spent_local{campaign=\"" << campaign->id << "\"} "
+            << campaign->spend_micros.load() / 1e6 << "\n";
+    }
+    
+    oss << "# HELP bidding_budget_lease This replica's spend limit for the campaign\n";
+    oss << "# TYPE bidding_budget_lease gauge\n";
+    for (const auto& campaign : campaigns_) {
+        oss << "bidding_budget_lease{campaign=\"" << campaign->id << "\"} "
+            << campaign->lease_micros.load() / 1e6 << "\n";
+    }
+    
+    oss << "# HELP bidding_budget_exhausted_total Requests not bid on because the lease was spent\n";
+    oss << "# TYPE bidding_budget_exhausted_total counter\n";
+    for (const auto& campaign : campaigns_) {
+        oss << "bidding_budget_exhausted_total{campaign=\"" << campaign->id << "\"} "
+            << campaign->exhausted.value() << "\n";
+    }
+    
+    return oss.str();
+}
@@ -1,23 +1,52 @@
 #include "data_structures/bid_cache.h"
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Snapshot file: SnapshotHeader, then per entry a SnapshotRecord followed
+// by the key and the serialized response
+struct SnapshotHeader {
+    char magic[8];              // "BIDCACH\1"
+    uint64_t count;
+};
+
+struct SnapshotRecord {
+    uint32_t key_length;
+    uint32_t value_length;
+    uint64_t expiry_unix_ms;
+};
+
+constexpr char kSnapshotMagic[8] = {'B', 'I', 'D', 'C', 'A', 'C', 'H', '\1'};
+
+int64_t unixMs(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+}
 
 BidCache::BidCache(size_t max_size, size_t ttl_seconds)
     : max_size_(max_size)
     , ttl_seconds_(ttl_seconds)
-    , hits_(0)
-    , misses_(0)
+    , mutex_("BidCache")
 {
 }
 
 bool BidCache::get(const std::string& key, bidding::BidResponse& value) {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::shared_lock<ProfiledSharedMutex> lock(mutex_);
     
     auto it = cache_.find(key);
     if (it != cache_.end()) {
         auto now = std::chrono::steady_clock::now();
         if (now < it->second.expiry) {
             value = it->second.response;
-            hits_.fetch_add(1);
+            hits_.add();
             return true;
         } else {
             // Expired, remove it
@@ -26,12 +55,12 @@ bool BidCache::get(const std::string& key, bidding::BidResponse& value) {
         }
     }
     
-    misses_.fetch_add(1);
+    misses_.add();
     return false;
 }
 
 void BidCache::put(const std::string& key, const bidding::BidResponse& value) {
-    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::unique_lock<ProfiledSharedMutex> lock(mutex_);
     
     evictExpired();
     
@@ -51,26 +80,27 @@ void BidCache::put(const std::string& key, const bidding::BidResponse& value) {
 }
 
 void BidCache::evict(const std::string& key) {
-    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::unique_lock<ProfiledSharedMutex> lock(mutex_);
     cache_.erase(key);
 }
 
 void BidCache::clear() {
-    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::unique_lock<ProfiledSharedMutex> lock(mutex_);
     cache_.clear();
-    hits_.store(0);
-    misses_.store(0);
+    hits_.reset();
+    misses_.reset();
 }
 
 size_t BidCache::size() const {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::shared_lock<ProfiledSharedMutex> lock(mutex_);
     return cache_.size();
 }
 
 double BidCache::getHitRate() const {
-    uint64_t total = hits_.load() + misses_.load();
+    uint64_t hits = hits_.value();
+    uint64_t total = hits + misses_.value();
     if (total == 0) return 0.0;
-    return static_cast<double>(hits_.load()) / total * 100.0;
+    return static_cast<double>(hits) / total * 100.0;
 }
 
 void BidCache::evictExpired() {
@@ -85,3 +115,113 @@ void BidCache::evictExpired() {
     }
 }
 
+size_t BidCache::saveSnapshot(const std::string& path) const {
+    // Expiry is steady_clock; the file carries wall-clock time
+    auto steady_now = std::chrono::steady_clock::now();
+    int64_t unix_now = unixMs(std::chrono::system_clock::now());
+    
+    std::string data(sizeof(SnapshotHeader), '\0');
+    std::string value;
+    uint64_t count = 0;
+    {
+        std::shared_lock<ProfiledSharedMutex> lock(mutex_);
+        for (const auto& entry : cache_) {
+            if (entry.second.expiry <= steady_now) {
+                continue;
+            }
+            entry.second.response.SerializeToString(&value);
+            SnapshotRecord record;
+            record.key_length = static_cast<uint32_t>(entry.first.size());
+            record.value_length = static_cast<uint32_t>(value.size());
+            record.expiry_unix_ms = unix_now + std::chrono::duration_cast<std::chrono::milliseconds>(
+                entry.second.expiry - steady_now).count();
+            data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+            data.append(entry.first);
+            data.append(value);
+            ++count;
+        }
+    }
+    
+    SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.count = count;
+    std::memcpy(&data[0], &header, sizeof(header));
+    
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open cache snapshot " + temp);
+    }
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+        if (written <= 0) {
+            close(fd);
+            unlink(temp.c_str());
+            throw std::runtime_error("Failed to write cache snapshot " + temp);
+        }
+        offset += written;
+    }
+    bool ok = fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(temp.c_str(), path.c_str()) < 0) {
+        unlink(temp.c_str());
+        throw std::runtime_error("Failed to save cache snapshot " + path);
+    }
+    return count;
+}
+
+size_t BidCache::loadSnapshot(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t length = st.st_size;
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return 0;
+    }
+    
+    const char* data = static_cast<const char*>(mapped);
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    size_t loaded = 0;
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) == 0) {
+        auto steady_now = std::chrono::steady_clock::now();
+        int64_t unix_now = unixMs(std::chrono::system_clock::now());
+        
+        std::unique_lock<ProfiledSharedMutex> lock(mutex_);
+        size_t offset = sizeof(header);
+        for (uint64_t i = 0; i < header.count && cache_.size() < max_size_; ++i) {
+            SnapshotRecord record;
+            if (length - offset < sizeof(record)) {
+                break;
+            }
+            std::memcpy(&record, data + offset, sizeof(record));
+            offset += sizeof(record);
+            if (length - offset < static_cast<size_t>(record.key_length) + record.value_length) {
+                break;
+            }
+            const char* key = data + offset;
+            const char* value = key + record.key_length;
+            offset += static_cast<size_t>(record.key_length) + record.value_length;
+            
+            int64_t remaining_ms = static_cast<int64_t>(record.expiry_unix_ms) - unix_now;
+            CacheEntry entry;
+            if (remaining_ms <= 0 || !entry.response.ParseFromArray(value, record.value_length)) {
+                continue;
+            }
+            entry.expiry = steady_now + std::chrono::milliseconds(remaining_ms);
+            cache_[std::string(key, record.key_length)] = std::move(entry);
+            ++loaded;
+        }
+    }
+    munmap(mapped, length);
+    return loaded;
+}
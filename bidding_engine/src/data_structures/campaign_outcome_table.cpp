@@ -0,0 +1,112 @@
+#include "data_structures/campaign_outcome_table.h"
+#include <cstring>
+#include <thread>
+
+CampaignOutcomeTable::CampaignOutcomeTable(size_t max_campaigns)
+    : max_campaigns_(std::max<size_t>(max_campaigns, 1))
+    , used_(0)
+{
+    size_t capacity = 2;
+    while (capacity < max_campaigns_ * 2) {
+        capacity <<= 1;
+    }
+    mask_ = capacity - 1;
+    slots_.reset(new Slot[capacity]);
+}
+
+uint64_t CampaignOutcomeTable::keyFor(const char* campaign_id) {
+    // Three words of the padded id, mixed; cheaper than a byte-wise hash
+    // at millions of notices a second
+    uint64_t words[3];
+    static_assert(sizeof(words) == kWinNoticeCampaignBytes, "campaign id is three words");
+    std::memcpy(words, campaign_id, sizeof(words));
+    uint64_t hash = words[0] * 0x9e3779b97f4a7c15ULL;
+    hash ^= (hash >> 32) ^ words[1];
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= (hash >> 29) ^ words[2];
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash < 2 ? hash + 2 : hash;
+}
+
+CampaignOutcomeTable::Slot* CampaignOutcomeTable::find(const char* campaign_id, bool insert) const {
+    uint64_t key = keyFor(campaign_id);
+    for (size_t probe = 0; probe <= mask_; ++probe) {
+        Slot& slot = slots_[(key + probe) & mask_];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        while (current == kClaiming) {
+            std::this_thread::yield();
+            current = slot.key.load(std::memory_order_acquire);
+        }
+        if (current == key && std::memcmp(slot.campaign_id, campaign_id, kWinNoticeCampaignBytes) == 0) {
+            return &slot;
+        }
+        if (current != kEmpty) {
+            continue;
+        }
+        if (!insert) {
+            return nullptr;
+        }
+        
+        // The cap keeps the table at half load so probes stay short
+        if (used_.fetch_add(1, std::memory_order_relaxed) >= max_campaigns_) {
+            used_.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if (slot.key.compare_exchange_strong(current, kClaiming, std::memory_order_acquire)) {
+            std::memcpy(slot.campaign_id, campaign_id, kWinNoticeCampaignBytes);
+            slot.key.store(key, std::memory_order_release);
+            return &slot;
+        }
+        // Lost the slot to another campaign or to this one; look again
+        used_.fetch_sub(1, std::memory_order_relaxed);
+        --probe;
+    }
+    return nullptr;
+}
+
+bool CampaignOutcomeTable::apply(const char* campaign_id, NoticeOutcome outcome,
+                                 uint32_t bid_micros, uint32_t price_micros) {
+    Slot* slot = find(campaign_id, true);
+    if (!slot) {
+        return false;
+    }
+    slot->notices.fetch_add(1, std::memory_order_relaxed);
+    if (outcome == NoticeOutcome::WIN) {
+        slot->wins.fetch_add(1, std::memory_order_relaxed);
+        slot->spend_micros.fetch_add(price_micros, std::memory_order_relaxed);
+        slot->won_bid_micros.fetch_add(bid_micros, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+CampaignOutcome CampaignOutcomeTable::read(const Slot& slot) {
+    CampaignOutcome outcome;
+    outcome.campaign_id.assign(slot.campaign_id, strnlen(slot.campaign_id, kWinNoticeCampaignBytes));
+    outcome.notices = slot.notices.load(std::memory_order_relaxed);
+    outcome.wins = slot.wins.load(std::memory_order_relaxed);
+    outcome.spend_micros = slot.spend_micros.load(std::memory_order_relaxed);
+    outcome.won_bid_micros = slot.won_bid_micros.load(std::memory_order_relaxed);
+    return outcome;
+}
+
+bool CampaignOutcomeTable::get(const std::string& campaign_id, CampaignOutcome& outcome) const {
+    WinNotice padded;
+    setNoticeCampaign(padded, campaign_id);
+    const Slot* slot = find(padded.campaign_id, false);
+    if (!slot) {
+        return false;
+    }
+    outcome = read(*slot);
+    return true;
+}
+
+std::vector<CampaignOutcome> CampaignOutcomeTable::snapshot() const {
+    std::vector<CampaignOutcome> outcomes;
+    for (size_t i = 0; i <= mask_; ++i) {
+        if (slots_[i].key.load(std::memory_order_acquire) > kClaiming) {
+            outcomes.push_back(read(slots_[i]));
+        }
+    }
+    return outcomes;
+}
@@ -7,17 +7,31 @@ CircuitBreaker::CircuitBreaker(size_t failure_threshold, size_t timeout_seconds)
     , success_count_(0)
     , failure_threshold_(failure_threshold)
     , timeout_seconds_(timeout_seconds)
+    , mutex_("CircuitBreaker")
     , half_open_requests_(5)
 {
 }
 
 bool CircuitBreaker::isOpen() const {
+    // Closed is the common case and needs no lock
+    if (state_.load(std::memory_order_acquire) == CircuitState::CLOSED) {
+        return false;
+    }
     checkAndUpdateState();
     return state_.load() == CircuitState::OPEN;
 }
 
 void CircuitBreaker::recordSuccess() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // While closed a success only ends a failure streak; reading first keeps
+    // the line shared between workers instead of written by each of them
+    if (state_.load(std::memory_order_acquire) == CircuitState::CLOSED) {
+        if (failure_count_.load(std::memory_order_relaxed) != 0) {
+            failure_count_.store(0, std::memory_order_relaxed);
+        }
+        return;
+    }
+    
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     if (state_.load() == CircuitState::HALF_OPEN) {
         success_count_.fetch_add(1);
@@ -32,7 +46,7 @@ void CircuitBreaker::recordSuccess() {
 }
 
 void CircuitBreaker::recordFailure() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     failure_count_.fetch_add(1);
     last_failure_time_ = std::chrono::steady_clock::now();
@@ -45,14 +59,14 @@ void CircuitBreaker::recordFailure() {
 }
 
 void CircuitBreaker::checkAndUpdateState() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     if (state_.load() == CircuitState::OPEN) {
         auto now = std::chrono::steady_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
             now - last_failure_time_).count();
         
-        if (elapsed >= timeout_seconds_) {
+        if (elapsed >= static_cast<int64_t>(timeout_seconds_)) {
             state_.store(CircuitState::HALF_OPEN);
             success_count_.store(0);
         }
@@ -0,0 +1,505 @@
+#include "data_structures/frequency_cap_store.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Word layout: fingerprint 63..40 | window 39..24 | previous 23..12 | current 11..0
+constexpr unsigned kWindowShift = 24;
+constexpr unsigned kPreviousShift = 12;
+constexpr unsigned kFingerprintShift = 40;
+constexpr uint64_t kCountMask = 0xfff;
+
+struct Counts {
+    uint32_t previous;
+    uint32_t current;
+};
+
+uint32_t fingerprintOf(uint64_t word) {
+    return static_cast<uint32_t>(word >> kFingerprintShift);
+}
+
+uint64_t pack(uint32_t fingerprint, uint16_t window, uint32_t previous, uint32_t current) {
+    return uint64_t(fingerprint) << kFingerprintShift | uint64_t(window) << kWindowShift |
+           uint64_t(previous) << kPreviousShift | current;
+}
+
+// The word's counts as seen from `window`: shifted by one if it was last
+// touched in the previous window, empty if earlier
+Counts roll(uint64_t word, uint16_t window) {
+    uint16_t touched = static_cast<uint16_t>(word >> kWindowShift);
+    uint32_t previous = static_cast<uint32_t>((word >> kPreviousShift) & kCountMask);
+    uint32_t current = static_cast<uint32_t>(word & kCountMask);
+    if (touched == window) {
+        return {previous, current};
+    }
+    if (static_cast<uint16_t>(touched + 1) == window) {
+        return {current, 0};
+    }
+    return {0, 0};
+}
+
+constexpr char kSnapshotMagic[8] = {'B', 'I', 'D', 'F', 'C', 'A', 'P', '\1'};
+constexpr uint32_t kSnapshotVersion = 1;
+
+uint64_t unixMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool writeAll(int fd, const void* data, size_t length, off_t offset) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+}
+
+FrequencyCapStore::FrequencyCapStore(const FrequencyCapConfig& config)
+    : bucket_count_(1)
+    , bucket_mask_(0)
+    , buckets_(nullptr)
+    , pages_(config.pages)
+    , window_ms_(std::max<uint64_t>(config.window_seconds, 1) * 1000)
+    , default_cap_(config.default_cap)
+    , campaign_caps_(config.campaign_caps)
+    , snapshot_file_(config.snapshot_file)
+    , snapshot_interval_seconds_(std::max(config.snapshot_interval_seconds, 1u))
+    , snapshot_fd_(-1)
+    , restored_(false)
+    , chunk_count_(0)
+    , snapshot_running_(false)
+    , snapshots_(0)
+    , snapshot_bytes_(0)
+    , snapshot_failures_(0)
+{
+    // Largest power of two that fits the budget, so a bucket is hash & mask
+    size_t budget = config.memory_mb * 1024 * 1024 / sizeof(Bucket);
+    while (bucket_count_ * 2 <= budget) {
+        bucket_count_ *= 2;
+    }
+    bucket_mask_ = bucket_count_ - 1;
+    
+    if (!snapshot_file_.empty()) {
+        chunk_count_ = (bucket_count_ + kChunkBuckets - 1) / kChunkBuckets;
+        dirty_.reset(new std::atomic<uint8_t>[chunk_count_]);
+        for (size_t i = 0; i < chunk_count_; ++i) {
+            dirty_[i].store(0, std::memory_order_relaxed);
+        }
+        restored_ = mapSnapshot();
+    }
+    
+    if (!restored_) {
+        // Zero (all slots empty); unless prefaulted, only takes memory as
+        // buckets are first written
+        region_ = std::make_unique<HugePageRegion>("frequency_caps", memoryBytes(), pages_);
+        buckets_ = static_cast<Bucket*>(region_->data());
+        if (!snapshot_file_.empty()) {
+            createSnapshot();
+        }
+    }
+}
+
+FrequencyCapStore::~FrequencyCapStore() {
+    stop();
+    if (!region_) {
+        munmap(buckets_, memoryBytes());
+    }
+    if (snapshot_fd_ >= 0) {
+        close(snapshot_fd_);
+    }
+}
+
+bool FrequencyCapStore::mapSnapshot() {
+    int fd = open(snapshot_file_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    
+    FrequencyCapSnapshotHeader header;
+    struct stat st;
+    bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) && fstat(fd, &st) == 0 &&
+                 std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) == 0 &&
+                 header.version == kSnapshotVersion && header.bucket_count == bucket_count_ &&
+                 header.window_ms == window_ms_ &&
+                 static_cast<size_t>(st.st_size) >= kSnapshotTableOffset + memoryBytes();
+    if (valid && unixMs() - header.saved_unix_ms >= window_ms_) {
+        // Everything in it has rolled out of the sliding window anyway
+        valid = false;
+    }
+    
+    if (valid && (pages_.mode != HugePageMode::NONE || pages_.prefault)) {
+        if (!readSnapshot(fd)) {
+            close(fd);
+            return false;
+        }
+        snapshot_fd_ = fd;
+        occupied_.add(header.occupied);
+        return true;
+    }
+    
+    // Private mapping: the table's writes stay in memory until a snapshot
+    // copies them out. Pages never written still read through to the page
+    // cache, and only chunks already changed in memory are ever rewritten,
+    // so the two always agree.
+    void* table = valid ? mmap(nullptr, memoryBytes(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE,
+                               fd, kSnapshotTableOffset)
+                        : MAP_FAILED;
+    if (table == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    buckets_ = static_cast<Bucket*>(table);
+    snapshot_fd_ = fd;
+    occupied_.add(header.occupied);
+    return true;
+}
+
+bool FrequencyCapStore::readSnapshot(int fd) {
+    region_ = std::make_unique<HugePageRegion>("frequency_caps", memoryBytes(), pages_);
+    char* table = static_cast<char*>(region_->data());
+    size_t offset = 0;
+    while (offset < memoryBytes()) {
+        ssize_t got = pread(fd, table + offset, std::min<size_t>(memoryBytes() - offset, 1 << 20),
+                            kSnapshotTableOffset + offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            region_.reset();
+            return false;
+        }
+        offset += got;
+    }
+    buckets_ = reinterpret_cast<Bucket*>(table);
+    return true;
+}
+
+void FrequencyCapStore::createSnapshot() {
+    // Sparse: the holes read as empty slots, matching the fresh table
+    int fd = open(snapshot_file_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, kSnapshotTableOffset + memoryBytes()) < 0) {
+        std::cerr << "Failed to create frequency cap snapshot " << snapshot_file_ << ": "
+                  << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    snapshot_fd_ = fd;
+}
+
+void FrequencyCapStore::start() {
+    if (snapshot_fd_ < 0 || snapshot_thread_.joinable()) {
+        return;
+    }
+    snapshot_running_ = true;
+    snapshot_thread_ = std::thread(&FrequencyCapStore::snapshotThread, this);
+}
+
+void FrequencyCapStore::stop() {
+    if (!snapshot_thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        snapshot_running_ = false;
+    }
+    snapshot_cv_.notify_all();
+    snapshot_thread_.join();
+    snapshot();
+}
+
+void FrequencyCapStore::snapshotThread() {
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    while (snapshot_running_) {
+        snapshot_cv_.wait_for(lock, std::chrono::seconds(snapshot_interval_seconds_));
+        if (!snapshot_running_) {
+            break;
+        }
+        lock.unlock();
+        snapshot();
+        lock.lock();
+    }
+}
+
+size_t FrequencyCapStore::snapshot() {
+    if (snapshot_fd_ < 0) {
+        return 0;
+    }
+    
+    const size_t chunk_bytes = kChunkBuckets * sizeof(Bucket);
+    std::unique_ptr<uint64_t[]> copy(new uint64_t[chunk_bytes / sizeof(uint64_t)]);
+    size_t written = 0;
+    bool ok = true;
+    
+    for (size_t chunk = 0; chunk < chunk_count_ && ok; ++chunk) {
+        // Cleared before copying: a record() racing with the copy marks
+        // the chunk again and it goes out next time
+        if (dirty_[chunk].load(std::memory_order_relaxed) == 0 || dirty_[chunk].exchange(0) == 0) {
+            continue;
+        }
+        size_t first = chunk * kChunkBuckets;
+        size_t buckets = std::min(kChunkBuckets, bucket_count_ - first);
+        size_t words = 0;
+        for (size_t b = first; b < first + buckets; ++b) {
+            for (size_t i = 0; i < kBucketSlots; ++i) {
+                copy[words++] = buckets_[b].slots[i].load(std::memory_order_relaxed);
+            }
+        }
+        ok = writeAll(snapshot_fd_, copy.get(), words * sizeof(uint64_t),
+                      kSnapshotTableOffset + first * sizeof(Bucket));
+        if (!ok) {
+            dirty_[chunk].store(1, std::memory_order_relaxed);
+        }
+        written += words * sizeof(uint64_t);
+    }
+    
+    // The header goes last, so a file whose table write failed half way
+    // still has a header no newer than its oldest chunk
+    FrequencyCapSnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.bucket_count = bucket_count_;
+    header.window_ms = window_ms_;
+    header.saved_unix_ms = unixMs();
+    header.occupied = occupied_.value();
+    ok = ok && fdatasync(snapshot_fd_) == 0 && writeAll(snapshot_fd_, &header, sizeof(header), 0) &&
+         fdatasync(snapshot_fd_) == 0;
+    
+    if (!ok) {
+        snapshot_failures_.fetch_add(1, std::memory_order_relaxed);
+        return written;
+    }
+    snapshots_.fetch_add(1, std::memory_order_relaxed);
+    snapshot_bytes_.fetch_add(written, std::memory_order_relaxed);
+    return written;
+}
+
+uint32_t FrequencyCapStore::capFor(const std::string& campaign_id) const {
+    auto it = campaign_caps_.find(campaign_id);
+    return it != campaign_caps_.end() ? it->second : default_cap_;
+}
+
+uint64_t FrequencyCapStore::pairHash(const std::string& user_id, const std::string& campaign_id) {
+    uint64_t user = std::hash<std::string>()(user_id);
+    uint64_t campaign = std::hash<std::string>()(campaign_id);
+    return mix(user ^ (campaign + 0x9e3779b97f4a7c15ULL + (user << 6) + (user >> 2)));
+}
+
+FrequencyCapStore::Window FrequencyCapStore::currentWindow() const {
+    uint64_t elapsed = unixMs();
+    float into = static_cast<float>(elapsed % window_ms_) / static_cast<float>(window_ms_);
+    return {static_cast<uint16_t>(elapsed / window_ms_), 1.0f - into};
+}
+
+FrequencyCapStore::Bucket& FrequencyCapStore::bucketFor(uint64_t hash) const {
+    return buckets_[hash & bucket_mask_];
+}
+
+void FrequencyCapStore::markDirty(uint64_t hash) {
+    // Load first so hot chunks don't keep bouncing their dirty byte
+    std::atomic<uint8_t>& dirty = dirty_[(hash & bucket_mask_) / kChunkBuckets];
+    if (dirty.load(std::memory_order_relaxed) == 0) {
+        dirty.store(1, std::memory_order_relaxed);
+    }
+}
+
+uint32_t FrequencyCapStore::count(const std::string& user_id, const std::string& campaign_id) const {
+    uint64_t hash = pairHash(user_id, campaign_id);
+    uint32_t fingerprint = fingerprintOf(hash) | 1;     // 0 marks an empty slot
+    Window window = currentWindow();
+    
+    Bucket& bucket = bucketFor(hash);
+    for (size_t i = 0; i < kBucketSlots; ++i) {
+        uint64_t word = bucket.slots[i].load(std::memory_order_acquire);
+        if (word != 0 && fingerprintOf(word) == fingerprint) {
+            Counts counts = roll(word, window.index);
+            return counts.current + static_cast<uint32_t>(counts.previous * window.previous_weight + 0.5f);
+        }
+    }
+    return 0;
+}
+
+void FrequencyCapStore::record(const std::string& user_id, const std::string& campaign_id, uint32_t impressions) {
+    // Nothing to enforce, so don't spend table space on it
+    if (impressions == 0 || capFor(campaign_id) == 0) {
+        return;
+    }
+    uint64_t hash = pairHash(user_id, campaign_id);
+    recordHashed(hash, impressions);
+    if (replicator_) {
+        replicator_(hash, impressions);
+    }
+}
+
+void FrequencyCapStore::recordHashed(uint64_t hash, uint32_t impressions) {
+    if (impressions == 0) {
+        return;
+    }
+    recorded_.add(impressions);
+    addCounts(bucketFor(hash), fingerprintOf(hash) | 1, currentWindow().index, 0,
+              impressions < kMaxCount ? impressions : kMaxCount);
+    if (dirty_) {
+        markDirty(hash);
+    }
+}
+
+void FrequencyCapStore::addCounts(Bucket& bucket, uint32_t fingerprint, uint16_t window, uint32_t previous,
+                                  uint32_t current) {
+    for (;;) {
+        uint64_t words[kBucketSlots];
+        size_t match = kBucketSlots;
+        size_t empty = kBucketSlots;
+        size_t victim = 0;
+        uint32_t victim_count = UINT32_MAX;
+        for (size_t i = 0; i < kBucketSlots; ++i) {
+            words[i] = bucket.slots[i].load(std::memory_order_acquire);
+            if (words[i] == 0) {
+                if (empty == kBucketSlots) {
+                    empty = i;
+                }
+                continue;
+            }
+            if (fingerprintOf(words[i]) == fingerprint) {
+                match = i;
+                break;
+            }
+            Counts counts = roll(words[i], window);
+            if (counts.previous + counts.current < victim_count) {
+                victim = i;
+                victim_count = counts.previous + counts.current;
+            }
+        }
+        
+        if (match < kBucketSlots) {
+            Counts counts = roll(words[match], window);
+            uint64_t word = pack(fingerprint, window, std::min(counts.previous + previous, kMaxCount),
+                                 std::min(counts.current + current, kMaxCount));
+            if (bucket.slots[match].compare_exchange_weak(words[match], word, std::memory_order_acq_rel)) {
+                return;
+            }
+            continue;
+        }
+        
+        // New pair: take an empty slot, else the slot with the fewest
+        // impressions (pairs idle for two windows count as zero). Sequentially
+        // consistent so that of two threads inserting the same pair into
+        // different slots, at least one sees the other's slot afterwards.
+        size_t slot = empty < kBucketSlots ? empty : victim;
+        if (bucket.slots[slot].compare_exchange_weak(words[slot], pack(fingerprint, window, previous, current),
+                                                     std::memory_order_seq_cst)) {
+            if (empty < kBucketSlots) {
+                occupied_.add();
+            } else if (victim_count > 0) {
+                evictions_.add();
+            }
+            mergeDuplicates(bucket, fingerprint, window);
+            return;
+        }
+    }
+}
+
+void FrequencyCapStore::mergeDuplicates(Bucket& bucket, uint32_t fingerprint, uint16_t window) {
+    // Lookups stop at the first match, so any later slot holding the same
+    // pair is emptied and its counts added to the first. Both inserters may
+    // get here; the CAS to empty decides which one moves the counts.
+    bool seen_first = false;
+    for (size_t i = 0; i < kBucketSlots; ++i) {
+        uint64_t word = bucket.slots[i].load(std::memory_order_seq_cst);
+        if (word == 0 || fingerprintOf(word) != fingerprint) {
+            continue;
+        }
+        if (!seen_first) {
+            seen_first = true;
+            continue;
+        }
+        bool claimed = false;
+        while (!claimed && word != 0 && fingerprintOf(word) == fingerprint) {
+            claimed = bucket.slots[i].compare_exchange_weak(word, 0, std::memory_order_seq_cst);
+        }
+        if (claimed) {
+            occupied_.sub();
+            Counts counts = roll(word, window);
+            addCounts(bucket, fingerprint, window, counts.previous, counts.current);
+        }
+    }
+}
+
+bool FrequencyCapStore::isCapped(const std::string& user_id, const std::string& campaign_id) {
+    uint32_t cap = capFor(campaign_id);
+    if (cap == 0 || count(user_id, campaign_id) < cap) {
+        return false;
+    }
+    filtered_.add();
+    return true;
+}
+
+std::string FrequencyCapStore::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_frequency_cap_slots Frequency cap table capacity in (user, campaign) pairs\n";
+    oss << "# TYPE bidding_frequency_cap_slots gauge\n";
+    oss << "bidding_frequency_cap_slots " << capacity() << "\n";
+    
+    oss << "# HELP bidding_frequency_cap_slots_used Table slots holding a pair\n";
+    oss << "# TYPE bidding_frequency_cap_slots_used gauge\n";
+    oss << "bidding_frequency_cap_slots_used " << occupied_.value() << "\n";
+    
+    oss << "# HELP bidding_frequency_cap_impressions_total Impressions recorded against capped campaigns\n";
+    oss << "# TYPE bidding_frequency_cap_impressions_total counter\n";
+    oss << "bidding_frequency_cap_impressions_total " << recorded_.value() << "\n";
+    
+    oss << "# HELP bidding_frequency_cap_filtered_total Candidates dropped for reaching their cap\n";
+    oss << "# TYPE bidding_frequency_cap_filtered_total counter\n";
+    oss << "bidding_frequency_cap_filtered_total " << filtered_.value() << "\n";
+    
+    oss << "# HELP bidding_frequency_cap_evictions_total Live pairs evicted from a full bucket\n";
+    oss << "# TYPE bidding_frequency_cap_evictions_total counter\n";
+    oss << "bidding_frequency_cap_evictions_total " << evictions_.value() << "\n";
+    
+    if (!snapshot_file_.empty()) {
+        oss << "# HELP bidding_frequency_cap_snapshots_total Incremental table snapshots written\n";
+        oss << "# TYPE bidding_frequency_cap_snapshots_total counter\n";
+        oss << "bidding_frequency_cap_snapshots_total " << snapshots_.load(std::memory_order_relaxed) << "\n";
+        
+        oss << "# HELP bidding_frequency_cap_snapshot_bytes_total Changed table bytes written to the snapshot\n";
+        oss << "# TYPE bidding_frequency_cap_snapshot_bytes_total counter\n";
+        oss << "bidding_frequency_cap_snapshot_bytes_total " << snapshot_bytes_.load(std::memory_order_relaxed) << "\n";
+        
+        oss << "# HELP bidding_frequency_cap_snapshot_failures_total Snapshots that failed to write\n";
+        oss << "# TYPE bidding_frequency_cap_snapshot_failures_total counter\n";
+        oss << "bidding_frequency_cap_snapshot_failures_total " << snapshot_failures_.load(std::memory_order_relaxed) << "\n";
+    }
+    
+    return oss.str();
+}
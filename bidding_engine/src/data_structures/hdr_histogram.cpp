@@ -0,0 +1,151 @@
+#include "data_structures/hdr_histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+
+HdrHistogram::HdrHistogram(uint64_t highest_trackable_value, int significant_digits)
+    : highest_trackable_value_(std::max<uint64_t>(highest_trackable_value, 2))
+    , sub_bucket_bits_(1)
+    , total_count_(0)
+    , min_value_(UINT64_MAX)
+    , max_value_(0)
+    , sum_(0)
+{
+    significant_digits = std::clamp(significant_digits, 1, 5);
+    
+    // Smallest power of two giving 10^digits resolution across each half bucket
+    uint64_t largest_single_unit = 2 * static_cast<uint64_t>(std::pow(10, significant_digits));
+    while ((1ULL << sub_bucket_bits_) < largest_single_unit) {
+        sub_bucket_bits_++;
+    }
+    sub_bucket_count_ = 1ULL << sub_bucket_bits_;
+    sub_bucket_half_count_ = sub_bucket_count_ / 2;
+    
+    counts_.assign(indexFor(highest_trackable_value_) + 1, 0);
+}
+
+size_t HdrHistogram::indexFor(uint64_t value) const {
+    if (value < sub_bucket_count_) {
+        return static_cast<size_t>(value);
+    }
+    
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (sub_bucket_bits_ - 1);
+    uint64_t sub_bucket = value >> shift;
+    return static_cast<size_t>(sub_bucket_count_ +
+        (shift - 1) * sub_bucket_half_count_ + (sub_bucket - sub_bucket_half_count_));
+}
+
+uint64_t HdrHistogram::highestEquivalentValue(size_t index) const {
+    if (index < sub_bucket_count_) {
+        return index;
+    }
+    
+    uint64_t offset = index - sub_bucket_count_;
+    int shift = static_cast<int>(offset / sub_bucket_half_count_) + 1;
+    uint64_t sub_bucket = offset % sub_bucket_half_count_ + sub_bucket_half_count_;
+    return (sub_bucket << shift) + (1ULL << shift) - 1;
+}
+
+void HdrHistogram::recordCount(uint64_t value, uint64_t count) {
+    if (value > highest_trackable_value_) {
+        value = highest_trackable_value_;
+    }
+    
+    counts_[indexFor(value)] += count;
+    total_count_ += count;
+    sum_ += static_cast<long double>(value) * count;
+    min_value_ = std::min(min_value_, value);
+    max_value_ = std::max(max_value_, value);
+}
+
+void HdrHistogram::merge(const HdrHistogram& other) {
+    if (other.total_count_ == 0) {
+        return;
+    }
+    
+    if (other.counts_.size() == counts_.size() && other.sub_bucket_bits_ == sub_bucket_bits_) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_count_ += other.total_count_;
+        sum_ += other.sum_;
+        min_value_ = std::min(min_value_, other.min_value_);
+        max_value_ = std::max(max_value_, other.max_value_);
+        return;
+    }
+    
+    // Differently shaped histogram: re-record bucket by bucket
+    for (size_t i = 0; i < other.counts_.size(); ++i) {
+        if (other.counts_[i] > 0) {
+            recordCount(other.highestEquivalentValue(i), other.counts_[i]);
+        }
+    }
+}
+
+void HdrHistogram::reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_count_ = 0;
+    min_value_ = UINT64_MAX;
+    max_value_ = 0;
+    sum_ = 0;
+}
+
+double HdrHistogram::mean() const {
+    if (total_count_ == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(sum_ / total_count_);
+}
+
+uint64_t HdrHistogram::valueAtPercentile(double percentile) const {
+    if (total_count_ == 0) {
+        return 0;
+    }
+    
+    percentile = std::clamp(percentile, 0.0, 100.0);
+    uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total_count_));
+    target = std::max<uint64_t>(target, 1);
+    
+    uint64_t running = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        running += counts_[i];
+        if (running >= target) {
+            return std::min(highestEquivalentValue(i), max_value_);
+        }
+    }
+    return max_value_;
+}
+
+void HdrHistogram::printPercentiles(std::ostream& os, double unit_scale, const char* unit) const {
+    static const double percentiles[] = {
+        50.0, 75.0, 90.0, 95.0, 99.0, 99.5, 99.9, 99.95, 99.99, 100.0
+    };
+    
+    os << std::fixed << std::setprecision(3);
+    os << std::setw(16) << ("Value(" + std::string(unit) + ")") << std::setw(14) << "Percentile"
+       << std::setw(14) << "TotalCount" << std::setw(18) << "1/(1-Percentile)" << "\n";
+    
+    for (double percentile : percentiles) {
+        uint64_t value = valueAtPercentile(percentile);
+        uint64_t below = 0;
+        size_t last = indexFor(value);
+        for (size_t i = 0; i <= last && i < counts_.size(); ++i) {
+            below += counts_[i];
+        }
+        
+        os << std::setw(16) << value / unit_scale
+           << std::setw(14) << std::setprecision(6) << percentile / 100.0
+           << std::setw(14) << below;
+        if (percentile < 100.0) {
+            os << std::setw(18) << std::setprecision(2) << 1.0 / (1.0 - percentile / 100.0);
+        } else {
+            os << std::setw(18) << "inf";
+        }
+        os << std::setprecision(3) << "\n";
+    }
+    
+    os << "#[Mean    = " << mean() / unit_scale << ", Max = " << max_value_ / unit_scale << "]\n";
+    os << "#[Samples = " << total_count_ << "]\n";
+}
@@ -0,0 +1,241 @@
+#include "data_structures/huge_pages.h"
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace {
+
+constexpr size_t kSmallPage = 4096;
+constexpr size_t kTransparentPage = 2 << 20;
+
+std::mutex g_regions_mutex;
+std::vector<const HugePageRegion*> g_regions;
+
+size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Default hugetlb page size
+size_t explicitPageSize() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        if (line.compare(0, 13, "Hugepagesize:") == 0) {
+            return std::stoull(line.substr(13)) * 1024;
+        }
+    }
+    return kTransparentPage;
+}
+
+// Huge-page kB per smaps entry: AnonHugePages for THP, the Hugetlb
+// fields for MAP_HUGETLB
+struct SmapsEntry {
+    uintptr_t start;
+    uintptr_t end;
+    size_t huge_bytes;
+};
+
+std::vector<SmapsEntry> readSmaps() {
+    std::vector<SmapsEntry> entries;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    while (std::getline(smaps, line)) {
+        size_t dash = line.find('-');
+        size_t space = line.find(' ');
+        if (dash != std::string::npos && space != std::string::npos && dash < space &&
+            line.find(':') > space) {
+            SmapsEntry entry;
+            entry.start = std::stoull(line.substr(0, dash), nullptr, 16);
+            entry.end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+            entry.huge_bytes = 0;
+            entries.push_back(entry);
+            continue;
+        }
+        if (entries.empty()) {
+            continue;
+        }
+        if (line.compare(0, 14, "AnonHugePages:") == 0 || line.compare(0, 16, "Private_Hugetlb:") == 0 ||
+            line.compare(0, 15, "Shared_Hugetlb:") == 0) {
+            entries.back().huge_bytes += std::stoull(line.substr(line.find(':') + 1)) * 1024;
+        }
+    }
+    return entries;
+}
+
+}
+
+HugePageRegion::HugePageRegion(const std::string& name, size_t bytes, const HugePageConfig& config)
+    : name_(name)
+    , data_(nullptr)
+    , size_(bytes)
+    , mapping_(nullptr)
+    , mapping_size_(0)
+    , backing_(HugePageMode::NONE)
+    , requested_(config.mode)
+{
+    bool mapped = config.mode == HugePageMode::EXPLICIT && mapExplicit(bytes);
+    if (!mapped) {
+        mapAnonymous(bytes, config.mode != HugePageMode::NONE);
+    }
+    if (config.mode != HugePageMode::NONE && backing_ != config.mode) {
+        std::cerr << name_ << ": " << modeName(config.mode) << " pages unavailable, using "
+                  << modeName(backing_) << std::endl;
+    }
+    
+    if (config.numa_node >= 0) {
+        bindNode(config.numa_node);
+    }
+    if (config.prefault) {
+        prefault();
+    }
+    
+    std::lock_guard<std::mutex> lock(g_regions_mutex);
+    g_regions.push_back(this);
+}
+
+HugePageRegion::~HugePageRegion() {
+    {
+        std::lock_guard<std::mutex> lock(g_regions_mutex);
+        g_regions.erase(std::remove(g_regions.begin(), g_regions.end(), this), g_regions.end());
+    }
+    munmap(mapping_, mapping_size_);
+}
+
+bool HugePageRegion::mapExplicit(size_t bytes) {
+    // Reserved pages are taken at mmap time, so this is all or nothing
+    size_t length = roundUp(std::max<size_t>(bytes, 1), explicitPageSize());
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    mapping_ = mapping;
+    mapping_size_ = length;
+    data_ = mapping;
+    backing_ = HugePageMode::EXPLICIT;
+    return true;
+}
+
+void HugePageRegion::mapAnonymous(size_t bytes, bool transparent) {
+    // THP can only back 2 MB-aligned extents; over-map and align by hand
+    size_t alignment = transparent ? kTransparentPage : kSmallPage;
+    size_t length = roundUp(std::max<size_t>(bytes, 1), alignment);
+    size_t reserve = transparent ? length + alignment : length;
+    void* mapping = mmap(nullptr, reserve, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map " + name_ + ": " + std::strerror(errno));
+    }
+    
+    uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+    uintptr_t aligned = roundUp(start, alignment);
+    if (aligned > start) {
+        munmap(mapping, aligned - start);
+    }
+    if (start + reserve > aligned + length) {
+        munmap(reinterpret_cast<void*>(aligned + length), start + reserve - aligned - length);
+    }
+    mapping_ = reinterpret_cast<void*>(aligned);
+    mapping_size_ = length;
+    data_ = mapping_;
+    backing_ = HugePageMode::NONE;
+    
+    if (transparent && madvise(mapping_, mapping_size_, MADV_HUGEPAGE) == 0) {
+        backing_ = HugePageMode::TRANSPARENT;
+    }
+}
+
+void HugePageRegion::bindNode(int node) {
+    if (node >= 64) {
+        std::cerr << name_ << ": NUMA node " << node << " out of range, not binding" << std::endl;
+        return;
+    }
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, mapping_, mapping_size_, MPOL_BIND, &mask, 64, 0) != 0) {
+        std::cerr << name_ << ": failed to bind to NUMA node " << node << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+void HugePageRegion::prefault() {
+    // Hugetlb pages are already allocated; touching them is cheap either way
+    if (madvise(mapping_, mapping_size_, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    // Kernels before 5.14: write a zero into every page
+    volatile char* bytes = static_cast<volatile char*>(mapping_);
+    for (size_t offset = 0; offset < mapping_size_; offset += kSmallPage) {
+        bytes[offset] = 0;
+    }
+}
+
+HugePageMode HugePageRegion::parseMode(const std::string& name) {
+    if (name == "thp") {
+        return HugePageMode::TRANSPARENT;
+    }
+    if (name == "hugetlb") {
+        return HugePageMode::EXPLICIT;
+    }
+    return HugePageMode::NONE;
+}
+
+const char* HugePageRegion::modeName(HugePageMode mode) {
+    switch (mode) {
+        case HugePageMode::TRANSPARENT:
+            return "thp";
+        case HugePageMode::EXPLICIT:
+            return "hugetlb";
+        default:
+            return "none";
+    }
+}
+
+std::string HugePageRegion::getPrometheusFormat() {
+    std::lock_guard<std::mutex> lock(g_regions_mutex);
+    if (g_regions.empty()) {
+        return "";
+    }
+    std::vector<SmapsEntry> smaps = readSmaps();
+    
+    std::ostringstream oss;
+    oss << "# HELP bidding_memory_region_bytes Size of large engine tables\n";
+    oss << "# TYPE bidding_memory_region_bytes gauge\n";
+    for (const HugePageRegion* region : g_regions) {
+        oss << "bidding_memory_region_bytes{region=\"" << region->name_ << "\",requested=\""
+            << modeName(region->requested_) << "\",backing=\"" << modeName(region->backing_) << "\"} "
+            << region->size_ << "\n";
+    }
+    
+    oss << "# HELP bidding_memory_region_huge_bytes Bytes of the table currently on huge pages\n";
+    oss << "# TYPE bidding_memory_region_huge_bytes gauge\n";
+    for (const HugePageRegion* region : g_regions) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(region->mapping_);
+        uintptr_t end = start + region->mapping_size_;
+        size_t huge = 0;
+        for (const SmapsEntry& entry : smaps) {
+            // A VMA can be shared with a neighbouring mapping; count the
+            // overlapping share
+            if (entry.start < end && entry.end > start && entry.end > entry.start) {
+                size_t overlap = std::min(end, entry.end) - std::max(start, entry.start);
+                huge += entry.huge_bytes * overlap / (entry.end - entry.start);
+            }
+        }
+        oss << "bidding_memory_region_huge_bytes{region=\"" << region->name_ << "\"} "
+            << std::min(huge, region->mapping_size_) << "\n";
+    }
+    
+    return oss.str();
+}
@@ -1,43 +1,42 @@
 #include "data_structures/memory_pool.h"
 #include <cstdlib>
-#include <algorithm>
 
-MemoryPool::MemoryPool(size_t pool_size)
+MemoryPool::MemoryPool(size_t pool_size, size_t block_size, const HugePageConfig& pages, const std::string& name)
     : pool_size_(pool_size)
+    , block_size_((block_size + 63) & ~size_t(63))
+    , arena_(nullptr)
     , used_count_(0)
 {
-    blocks_.reserve(pool_size_);
-    for (size_t i = 0; i < pool_size_; ++i) {
-        Block block;
-        block.data = std::malloc(1024); // 1KB per block
-        block.in_use = false;
-        blocks_.push_back(block);
+    region_ = std::make_unique<HugePageRegion>(name, pool_size_ * block_size_, pages);
+    arena_ = static_cast<char*>(region_->data());
+    
+    // Hand out low addresses first
+    free_blocks_.reserve(pool_size_);
+    for (size_t i = pool_size_; i > 0; --i) {
+        free_blocks_.push_back(arena_ + (i - 1) * block_size_);
     }
 }
 
-MemoryPool::~MemoryPool() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto& block : blocks_) {
-        if (block.data) {
-            std::free(block.data);
-        }
-    }
+MemoryPool::~MemoryPool() = default;
+
+bool MemoryPool::owns(const void* ptr) const {
+    const char* p = static_cast<const char*>(ptr);
+    return p >= arena_ && p < arena_ + pool_size_ * block_size_;
 }
 
 void* MemoryPool::allocate(size_t size) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (size > 1024) {
+    if (size > block_size_) {
         return std::malloc(size); // Fallback to malloc for large allocations
     }
     
-    auto it = std::find_if(blocks_.begin(), blocks_.end(),
-        [](const Block& b) { return !b.in_use; });
-    
-    if (it != blocks_.end()) {
-        it->in_use = true;
-        used_count_++;
-        return it->data;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_blocks_.empty()) {
+            void* block = free_blocks_.back();
+            free_blocks_.pop_back();
+            used_count_.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
     }
     
     // Pool exhausted, fallback to malloc
@@ -45,16 +44,15 @@ void* MemoryPool::allocate(size_t size) {
 }
 
 void MemoryPool::deallocate(void* ptr) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = std::find_if(blocks_.begin(), blocks_.end(),
-        [ptr](const Block& b) { return b.data == ptr; });
-    
-    if (it != blocks_.end()) {
-        it->in_use = false;
-        used_count_--;
-    } else {
+    if (!ptr) {
+        return;
+    }
+    if (!owns(ptr)) {
         std::free(ptr); // Was allocated with malloc
+        return;
     }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_blocks_.push_back(ptr);
+    used_count_.fetch_sub(1, std::memory_order_relaxed);
 }
-
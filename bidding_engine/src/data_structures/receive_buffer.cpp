@@ -0,0 +1,159 @@
+#include "data_structures/receive_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <arpa/inet.h>
+
+namespace {
+
+// Enough of an oversized frame to read the request id from
+constexpr size_t kTooLargePrefixBytes = 256;
+
+}
+
+ReceiveBuffer::ReceiveBuffer(MemoryPool& pool, size_t max_frame_bytes)
+    : pool_(pool)
+    , slab_bytes_(pool.getBlockSize())
+    , max_frame_bytes_(max_frame_bytes)
+    , size_(0)
+    , pending_bytes_(0)
+    , pending_too_large_(false)
+    , pending_batch_(false)
+    , skip_remaining_(0)
+{
+}
+
+ReceiveBuffer::~ReceiveBuffer() {
+    for (const Slab& slab : slabs_) {
+        pool_.deallocate(slab.data);
+    }
+}
+
+size_t ReceiveBuffer::prepareWrite(char*& dest) {
+    if (slabs_.empty() || slabs_.back().end == slab_bytes_) {
+        char* data = static_cast<char*>(pool_.allocate(slab_bytes_));
+        if (!data) {
+            throw std::bad_alloc();
+        }
+        slabs_.push_back(Slab{data, 0, 0});
+    }
+    
+    Slab& tail = slabs_.back();
+    dest = tail.data + tail.end;
+    return slab_bytes_ - tail.end;
+}
+
+void ReceiveBuffer::commitWrite(size_t bytes) {
+    slabs_.back().end += bytes;
+    size_ += bytes;
+}
+
+void ReceiveBuffer::append(const char* data, size_t length) {
+    while (length > 0) {
+        char* dest;
+        size_t chunk = std::min(prepareWrite(dest), length);
+        std::memcpy(dest, data, chunk);
+        commitWrite(chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+ReceiveBuffer::FrameStatus ReceiveBuffer::nextFrame(const char*& data, size_t& length) {
+    if (skip_remaining_ > 0) {
+        size_t skipped = std::min(skip_remaining_, size_);
+        consume(skipped);
+        skip_remaining_ -= skipped;
+        if (skip_remaining_ > 0) {
+            return FrameStatus::INCOMPLETE;
+        }
+    }
+    if (size_ < 4) {
+        return FrameStatus::INCOMPLETE;
+    }
+    
+    uint32_t message_length = 0;
+    copyOut(0, reinterpret_cast<char*>(&message_length), 4);
+    message_length = ntohl(message_length);
+    pending_batch_ = (message_length & kBatchFrameFlag) != 0;
+    message_length &= ~kBatchFrameFlag;
+    pending_bytes_ = 4 + static_cast<size_t>(message_length);
+    
+    if (message_length > max_frame_bytes_) {
+        size_t prefix = std::min(static_cast<size_t>(message_length), kTooLargePrefixBytes);
+        if (size_ - 4 < prefix) {
+            return FrameStatus::INCOMPLETE;
+        }
+        pending_too_large_ = true;
+        scratch_.resize(prefix);
+        copyOut(4, &scratch_[0], prefix);
+        data = scratch_.data();
+        length = scratch_.size();
+        return FrameStatus::TOO_LARGE;
+    }
+    if (size_ < pending_bytes_) {
+        return FrameStatus::INCOMPLETE;
+    }
+    
+    pending_too_large_ = false;
+    length = message_length;
+    const Slab& head = slabs_.front();
+    if (head.end - head.begin >= pending_bytes_) {
+        data = head.data + head.begin + 4;
+    } else {
+        // Frame spans slabs: linearize it for the parser
+        scratch_.resize(message_length);
+        copyOut(4, &scratch_[0], message_length);
+        data = scratch_.data();
+    }
+    return FrameStatus::COMPLETE;
+}
+
+void ReceiveBuffer::consumeFrame() {
+    size_t consumed = std::min(pending_bytes_, size_);
+    consume(consumed);
+    if (pending_too_large_) {
+        skip_remaining_ = pending_bytes_ - consumed;
+    }
+    pending_bytes_ = 0;
+    pending_too_large_ = false;
+}
+
+void ReceiveBuffer::copyOut(size_t offset, char* dest, size_t length) const {
+    for (const Slab& slab : slabs_) {
+        if (length == 0) {
+            break;
+        }
+        size_t available = slab.end - slab.begin;
+        if (offset >= available) {
+            offset -= available;
+            continue;
+        }
+        size_t chunk = std::min(available - offset, length);
+        std::memcpy(dest, slab.data + slab.begin + offset, chunk);
+        dest += chunk;
+        length -= chunk;
+        offset = 0;
+    }
+}
+
+void ReceiveBuffer::consume(size_t bytes) {
+    while (bytes > 0 && !slabs_.empty()) {
+        Slab& head = slabs_.front();
+        size_t chunk = std::min(bytes, head.end - head.begin);
+        head.begin += chunk;
+        size_ -= chunk;
+        bytes -= chunk;
+        
+        if (head.begin == head.end) {
+            if (slabs_.size() > 1) {
+                pool_.deallocate(head.data);
+                slabs_.pop_front();
+            } else {
+                // Keep the last slab so an idle connection does not churn the pool
+                head.begin = 0;
+                head.end = 0;
+            }
+        }
+    }
+}
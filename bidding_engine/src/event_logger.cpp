@@ -0,0 +1,328 @@
+#include "event_logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+constexpr size_t kMaxBatchRecords = 8192;
+
+std::atomic<uint64_t> g_next_instance_id(1);
+
+uint64_t nowUnixNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void copyField(char* dest, size_t size, const std::string& value) {
+    size_t length = std::min(value.size(), size - 1);
+    std::memcpy(dest, value.data(), length);
+    std::memset(dest + length, 0, size - length);
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}
+
+EventLogger::EventLogger(const EventLoggerConfig& config)
+    : config_(config)
+    , instance_id_(g_next_instance_id.fetch_add(1))
+    , running_(false)
+    , fd_(-1)
+    , fd_direct_(false)
+    , file_bytes_(0)
+    , file_sequence_(0)
+    , block_buffer_(nullptr)
+    , block_buffer_size_(0)
+    , written_count_(0)
+    , write_errors_(0)
+    , bytes_written_(0)
+    , rotations_(0)
+{
+}
+
+EventLogger::~EventLogger() {
+    stop();
+    std::free(block_buffer_);
+}
+
+void EventLogger::start() {
+    if (running_.load()) {
+        return;
+    }
+    
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(config_.directory, ec);
+    if (!openNextFile()) {
+        throw std::runtime_error("Failed to open event log in " + config_.directory);
+    }
+    
+    running_.store(true);
+    writer_thread_ = std::thread(&EventLogger::writerThread, this);
+}
+
+void EventLogger::stop() {
+    if (!running_.load()) {
+        return;
+    }
+    
+    running_.store(false);
+    if (writer_thread_.joinable()) {
+        writer_thread_.join();
+    }
+    closeFile();
+}
+
+EventLogger::ThreadRing* EventLogger::localRing() {
+    // One ring per (thread, logger); registration takes the lock once per thread
+    thread_local uint64_t cached_instance = 0;
+    thread_local ThreadRing* cached_ring = nullptr;
+    if (cached_instance == instance_id_) {
+        return cached_ring;
+    }
+    
+    auto ring = std::make_unique<ThreadRing>(config_.ring_capacity);
+    ThreadRing* raw = ring.get();
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(std::move(ring));
+    }
+    cached_instance = instance_id_;
+    cached_ring = raw;
+    return raw;
+}
+
+bool EventLogger::log(const BidEventRecord& record) {
+    if (!running_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    
+    ThreadRing* ring = localRing();
+    if (!ring->ring.tryPush(record)) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void EventLogger::logBid(const bidding::BidResponse& response) {
+    BidEventRecord record;
+    record.timestamp_ns = nowUnixNanos();
+    record.winning_bid = response.winning_bid();
+    record.price = response.price();
+    record.latency_ms = response.latency_ms();
+    record.type = static_cast<uint8_t>(response.won() ? BidEventType::WIN : BidEventType::BID);
+    record.status = static_cast<uint8_t>(statusFromString(response.status()));
+    record.won = response.won() ? 1 : 0;
+    record.reserved = 0;
+    copyField(record.request_id, sizeof(record.request_id), response.id());
+    copyField(record.campaign_id, sizeof(record.campaign_id), response.campaign_id());
+    log(record);
+}
+
+uint64_t EventLogger::getDroppedCount() const {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    uint64_t dropped = 0;
+    for (const auto& ring : rings_) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+size_t EventLogger::drain(std::vector<BidEventRecord>& batch) {
+    std::vector<ThreadRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (const auto& ring : rings_) {
+            rings.push_back(ring.get());
+        }
+    }
+    
+    size_t drained = 0;
+    BidEventRecord record;
+    for (ThreadRing* ring : rings) {
+        while (batch.size() < kMaxBatchRecords && ring->ring.tryPop(record)) {
+            batch.push_back(record);
+            drained++;
+        }
+    }
+    return drained;
+}
+
+void EventLogger::writerThread() {
+    std::vector<BidEventRecord> batch;
+    batch.reserve(kMaxBatchRecords);
+    auto last_flush = std::chrono::steady_clock::now();
+    
+    while (running_.load()) {
+        size_t drained = drain(batch);
+        
+        auto now = std::chrono::steady_clock::now();
+        bool interval_elapsed = now - last_flush >= std::chrono::milliseconds(config_.flush_interval_ms);
+        if (batch.size() >= kMaxBatchRecords || (interval_elapsed && !batch.empty())) {
+            writeBlock(batch);
+            batch.clear();
+            last_flush = now;
+        } else if (drained == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    
+    while (drain(batch) > 0 || !batch.empty()) {
+        writeBlock(batch);
+        batch.clear();
+    }
+}
+
+void EventLogger::writeBlock(const std::vector<BidEventRecord>& batch) {
+    if (batch.empty() || fd_ < 0) {
+        return;
+    }
+    
+    uLong raw_bytes = batch.size() * sizeof(BidEventRecord);
+    size_t needed = alignUp(sizeof(EventBlockHeader) + compressBound(raw_bytes), kEventBlockAlign);
+    if (needed > block_buffer_size_) {
+        std::free(block_buffer_);
+        block_buffer_ = nullptr;
+        block_buffer_size_ = 0;
+        if (posix_memalign(reinterpret_cast<void**>(&block_buffer_), kEventBlockAlign, needed) != 0) {
+            write_errors_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        block_buffer_size_ = needed;
+    }
+    
+    uLongf compressed_bytes = compressBound(raw_bytes);
+    Bytef* payload = reinterpret_cast<Bytef*>(block_buffer_ + sizeof(EventBlockHeader));
+    if (compress2(payload, &compressed_bytes, reinterpret_cast<const Bytef*>(batch.data()),
+                  raw_bytes, Z_BEST_SPEED) != Z_OK) {
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    EventBlockHeader header;
+    header.magic = kEventBlockMagic;
+    header.record_count = static_cast<uint32_t>(batch.size());
+    header.raw_bytes = static_cast<uint32_t>(raw_bytes);
+    header.compressed_bytes = static_cast<uint32_t>(compressed_bytes);
+    header.first_timestamp_ns = batch.front().timestamp_ns;
+    header.last_timestamp_ns = batch.back().timestamp_ns;
+    std::memcpy(block_buffer_, &header, sizeof(header));
+    
+    // O_DIRECT needs aligned length as well as aligned address
+    size_t used = sizeof(EventBlockHeader) + compressed_bytes;
+    size_t block_bytes = alignUp(used, kEventBlockAlign);
+    std::memset(block_buffer_ + used, 0, block_bytes - used);
+    
+    ssize_t written = write(fd_, block_buffer_, block_bytes);
+    if (written < 0 && errno == EINVAL && fd_direct_) {
+        // Filesystem rejected direct I/O after open (e.g. tmpfs); fall back
+        int flags = fcntl(fd_, F_GETFL);
+        fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+        fd_direct_ = false;
+        written = write(fd_, block_buffer_, block_bytes);
+    }
+    if (written != static_cast<ssize_t>(block_bytes)) {
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    file_bytes_ += block_bytes;
+    bytes_written_.fetch_add(block_bytes, std::memory_order_relaxed);
+    written_count_.fetch_add(batch.size(), std::memory_order_relaxed);
+    
+    if (file_bytes_ >= config_.rotate_bytes) {
+        closeFile();
+        if (openNextFile()) {
+            rotations_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool EventLogger::openNextFile() {
+    uint64_t seconds = nowUnixNanos() / 1000000000ULL;
+    std::string path = config_.directory + "/" + config_.prefix + "-" +
+        std::to_string(seconds) + "-" + std::to_string(file_sequence_++) + ".evlog";
+    
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    fd_direct_ = false;
+    if (config_.direct_io) {
+        fd_ = open(path.c_str(), flags | O_DIRECT, 0644);
+        fd_direct_ = fd_ >= 0;
+    }
+    if (fd_ < 0) {
+        fd_ = open(path.c_str(), flags, 0644);
+    }
+    if (fd_ < 0) {
+        std::cerr << "Failed to open event log " << path << std::endl;
+        return false;
+    }
+    
+    file_bytes_ = 0;
+    files_.push_back(path);
+    while (config_.max_files > 0 && files_.size() > config_.max_files) {
+        unlink(files_.front().c_str());
+        files_.pop_front();
+    }
+    return true;
+}
+
+void EventLogger::closeFile() {
+    if (fd_ >= 0) {
+        fdatasync(fd_);
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+BidEventStatus EventLogger::statusFromString(const std::string& status) {
+    if (status == "success") {
+        return BidEventStatus::SUCCESS;
+    }
+    if (status == "throttled") {
+        return BidEventStatus::THROTTLED;
+    }
+    if (status == "circuit_breaker_open") {
+        return BidEventStatus::CIRCUIT_OPEN;
+    }
+    if (status == "error") {
+        return BidEventStatus::ERROR;
+    }
+    return BidEventStatus::OTHER;
+}
+
+std::string EventLogger::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_event_log_written_total Bid events written to disk\n";
+    oss << "# TYPE bidding_event_log_written_total counter\n";
+    oss << "bidding_event_log_written_total " << getWrittenCount() << "\n";
+    
+    oss << "# HELP bidding_event_log_dropped_total Bid events dropped because a ring was full\n";
+    oss << "# TYPE bidding_event_log_dropped_total counter\n";
+    oss << "bidding_event_log_dropped_total " << getDroppedCount() << "\n";
+    
+    oss << "# HELP bidding_event_log_write_errors_total Failed event log block writes\n";
+    oss << "# TYPE bidding_event_log_write_errors_total counter\n";
+    oss << "bidding_event_log_write_errors_total " << write_errors_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_event_log_bytes_total Compressed bytes written\n";
+    oss << "# TYPE bidding_event_log_bytes_total counter\n";
+    oss << "bidding_event_log_bytes_total " << bytes_written_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_event_log_rotations_total Event log file rotations\n";
+    oss << "# TYPE bidding_event_log_rotations_total counter\n";
+    oss << "bidding_event_log_rotations_total " << rotations_.load(std::memory_order_relaxed) << "\n";
+    
+    return oss.str();
+}
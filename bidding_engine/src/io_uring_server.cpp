@@ -0,0 +1,1134 @@
+#include "io_uring_server.h"
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+enum OpType : uint64_t {
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_CLOSE = 4,
+    OP_CANCEL = 5,
+    OP_WAKE = 6,
+    OP_PROVIDE = 7,
+    OP_PROBE = 8,
+    OP_TIMER = 9
+};
+
+constexpr uint16_t kBufferGroup = 0;
+constexpr unsigned kMaxProvidedBuffers = 32768;
+
+using Clock = std::chrono::steady_clock;
+
+// How long a parked frame whose timeout passed while it was still queued
+// waits before asking again
+constexpr std::chrono::milliseconds kParkRecheck(1);
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int ring_fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+uint64_t encode(OpType op, int fd) {
+    return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd);
+}
+
+unsigned roundUpPowerOfTwo(unsigned value) {
+    unsigned result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+class IoUringServer::Loop {
+public:
+    Loop(IoUringServer& server, const IoUringConfig& config, uint32_t index);
+    ~Loop();
+    
+    // Accepts on `inherited` (shared with the other loops, not owned) or,
+    // if empty, on a listener of its own
+    void setup(const std::string& host, int port, const std::vector<int>& inherited);
+    void run();
+    void wake();
+    // Queues a parked connection to be served again; any thread
+    void resume(int fd);
+    // Forgets parked connections once run() has returned
+    void cancelParked();
+    bool usesBufferRing() const { return !legacy_buffers_; }
+    const std::vector<int>& listeners() const { return listen_fds_; }
+    
+    std::atomic<size_t> open_connections{0};
+    std::atomic<uint64_t> enter_calls{0};
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> buffer_exhausted{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> recv_pauses{0};
+
+private:
+    struct Connection {
+        uint32_t id = 0;
+        size_t tenant = 0;
+        std::unique_ptr<ReceiveBuffer> input;
+        std::string output;         // responses queued behind an in-flight send
+        std::string sending;
+        size_t send_offset = 0;
+        bool recv_armed = false;
+        bool send_inflight = false;
+        bool closing = false;
+        bool parked = false;        // the handler is holding the next frame back
+        bool recv_paused = false;   // recv cancelled while parked with a full buffer
+        Clock::time_point park_deadline;
+    };
+    
+    void setupRing();
+    void setupBuffers();
+    bool bufferRingWorks();
+    void setupListener(const std::string& host, int port);
+    
+    io_uring_sqe* getSqe();
+    int submitAndWait(unsigned wait_nr);
+    
+    void armAccept(int listen_fd);
+    void armRecv(int fd, Connection& conn);
+    void armSend(int fd, Connection& conn);
+    void armWake();
+    void armTimer(Clock::time_point deadline);
+    void recycleBuffer(uint16_t bid);
+    void provideBuffers(uint16_t first_bid, unsigned count, unsigned sqe_flags);
+    
+    void handleCompletion(const io_uring_cqe& cqe);
+    void onAccept(int listen_fd, int res, uint32_t flags);
+    void onRecv(int fd, int res, uint32_t flags);
+    void onSend(int fd, int res);
+    bool drainFrames(int fd, Connection& conn);
+    void park(int fd, Connection& conn);
+    void unpark(int fd, Connection& conn);
+    void pauseRecv(int fd, Connection& conn);
+    void cancelRequest(uint64_t target);
+    void retryCancels();
+    void serveParked(int fd);
+    void resumeReady();
+    void onTimer();
+    uint64_t resumeToken(int fd) const { return static_cast<uint64_t>(index_) << 32 | static_cast<uint32_t>(fd); }
+    void beginClose(int fd, Connection& conn);
+    void maybeClose(int fd, Connection& conn);
+    void beginDrain();
+    bool idle(const Connection& conn) const;
+    
+    IoUringServer& server_;
+    IoUringConfig config_;
+    uint32_t index_;
+    
+    int ring_fd_;
+    void* ring_ptr_;
+    size_t ring_size_;
+    io_uring_sqe* sqes_;
+    size_t sqes_size_;
+    unsigned sq_entries_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_flags_;
+    unsigned sq_local_tail_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    io_uring_cqe* cqes_;
+    
+    io_uring_buf_ring* buf_ring_;
+    size_t buf_ring_size_;
+    char* buffers_;
+    size_t buffers_size_;
+    unsigned buf_entries_;
+    uint16_t buf_tail_;
+    bool legacy_buffers_;
+    
+    std::vector<int> listen_fds_;
+    bool owns_listener_;
+    bool draining_;
+    int wake_fd_;
+    uint64_t wake_value_;
+    std::unordered_map<int, Connection> connections_;
+    
+    // Parking: fds resume() was called for, and the deadline of each park
+    std::mutex ready_mutex_;
+    std::vector<int> ready_;
+    std::vector<int> ready_taken_;
+    std::vector<std::pair<Clock::time_point, int>> park_deadlines_;
+    // Cancels that found the SQ full, resubmitted after the next submit
+    std::vector<uint64_t> pending_cancels_;
+    __kernel_timespec timer_spec_;
+    unsigned timers_inflight_;
+    Clock::time_point timer_deadline_;
+};
+
+IoUringServer::Loop::Loop(IoUringServer& server, const IoUringConfig& config, uint32_t index)
+    : server_(server)
+    , config_(config)
+    , index_(index)
+    , ring_fd_(-1)
+    , ring_ptr_(MAP_FAILED)
+    , ring_size_(0)
+    , sqes_(static_cast<io_uring_sqe*>(MAP_FAILED))
+    , sqes_size_(0)
+    , sq_entries_(0)
+    , sq_head_(nullptr)
+    , sq_tail_(nullptr)
+    , sq_mask_(nullptr)
+    , sq_flags_(nullptr)
+    , sq_local_tail_(0)
+    , cq_head_(nullptr)
+    , cq_tail_(nullptr)
+    , cq_mask_(nullptr)
+    , cqes_(nullptr)
+    , buf_ring_(static_cast<io_uring_buf_ring*>(MAP_FAILED))
+    , buf_ring_size_(0)
+    , buffers_(static_cast<char*>(MAP_FAILED))
+    , buffers_size_(0)
+    , buf_entries_(0)
+    , buf_tail_(0)
+    , legacy_buffers_(false)
+    , owns_listener_(false)
+    , draining_(false)
+    , wake_fd_(-1)
+    , wake_value_(0)
+    , timers_inflight_(0)
+{
+}
+
+IoUringServer::Loop::~Loop() {
+    for (auto& entry : connections_) {
+        close(entry.first);
+    }
+    if (owns_listener_) {
+        for (int fd : listen_fds_) {
+            close(fd);
+        }
+    }
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+    }
+    // Closing the ring cancels whatever is still in flight
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (ring_ptr_ != MAP_FAILED) {
+        munmap(ring_ptr_, ring_size_);
+    }
+    if (buf_ring_ != MAP_FAILED) {
+        munmap(buf_ring_, buf_ring_size_);
+    }
+    if (buffers_ != MAP_FAILED) {
+        munmap(buffers_, buffers_size_);
+    }
+}
+
+void IoUringServer::Loop::setup(const std::string& host, int port, const std::vector<int>& inherited) {
+    setupRing();
+    setupBuffers();
+    if (inherited.empty()) {
+        setupListener(host, port);
+    } else {
+        listen_fds_ = inherited;
+    }
+    
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        throw std::runtime_error("io_uring: failed to create eventfd");
+    }
+}
+
+void IoUringServer::Loop::setupRing() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    // Multishot requests post many CQEs per SQE, so size the CQ generously
+    params.cq_entries = config_.queue_depth * 4;
+    if (config_.sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = config_.sqpoll_idle_ms;
+    } else {
+        params.flags |= IORING_SETUP_COOP_TASKRUN;
+    }
+    
+    ring_fd_ = ioUringSetup(config_.queue_depth, &params);
+    if (ring_fd_ < 0) {
+        throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        throw std::runtime_error("io_uring: kernel too old");
+    }
+    
+    // Multishot recv and SEND_ZC landed together in 6.0; the probe is the
+    // cheapest way to tell whether the former is available
+    size_t probe_bytes = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> probe_buffer(probe_bytes, 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+    if (ioUringRegister(ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+        probe->last_op < IORING_OP_SEND_ZC ||
+        !(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED)) {
+        throw std::runtime_error("io_uring: multishot recv not supported by this kernel");
+    }
+    
+    size_t sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring_size_ = std::max(sq_bytes, cq_bytes);
+    ring_ptr_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQ_RING);
+    if (ring_ptr_ == MAP_FAILED) {
+        throw std::runtime_error("io_uring: failed to map rings");
+    }
+    
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        throw std::runtime_error("io_uring: failed to map SQEs");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    
+    char* base = static_cast<char*>(ring_ptr_);
+    sq_entries_ = params.sq_entries;
+    sq_head_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sq_flags_ = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+    cq_head_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    
+    // Identity-map the SQ index array once; afterwards only the tail moves
+    unsigned* sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+        sq_array[i] = i;
+    }
+    sq_local_tail_ = *sq_tail_;
+}
+
+void IoUringServer::Loop::setupBuffers() {
+    buf_entries_ = std::min(roundUpPowerOfTwo(std::max(config_.buffer_count, 1u)), kMaxProvidedBuffers);
+    buf_ring_size_ = buf_entries_ * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw std::runtime_error("io_uring: failed to allocate buffer ring");
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+    
+    buffers_size_ = static_cast<size_t>(buf_entries_) * config_.buffer_size;
+    void* buffers = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (buffers == MAP_FAILED) {
+        throw std::runtime_error("io_uring: failed to allocate receive buffers");
+    }
+    buffers_ = static_cast<char*>(buffers);
+    
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = buf_entries_;
+    reg.bgid = kBufferGroup;
+    if (ioUringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+        for (unsigned bid = 0; bid < buf_entries_; ++bid) {
+            recycleBuffer(static_cast<uint16_t>(bid));
+        }
+        if (bufferRingWorks()) {
+            return;
+        }
+        ioUringRegister(ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    
+    // Some kernels accept the registration yet never hand out ring buffers;
+    // classic provided buffers cost one extra SQE per recycle but no syscall
+    std::cerr << "io_uring: buffer ring unusable, using IORING_OP_PROVIDE_BUFFERS" << std::endl;
+    legacy_buffers_ = true;
+    provideBuffers(0, buf_entries_, 0);
+}
+
+bool IoUringServer::Loop::bufferRingWorks() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return false;
+    }
+    
+    char byte = 0;
+    bool works = false;
+    io_uring_sqe* sqe = getSqe();
+    if (sqe && write(sv[1], &byte, 1) == 1) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = encode(OP_PROBE, sv[0]);
+        
+        if (submitAndWait(1) >= 0) {
+            unsigned head = *cq_head_;
+            if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe cqe = cqes_[head & *cq_mask_];
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                works = cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER);
+                if (works) {
+                    recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+            }
+        }
+    }
+    
+    close(sv[0]);
+    close(sv[1]);
+    return works;
+}
+
+void IoUringServer::Loop::setupListener(const std::string& host, int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+    listen_fds_.push_back(listen_fd);
+    owns_listener_ = true;
+    
+    // Every loop binds its own listener; the kernel spreads connections
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(host.c_str());
+    address.sin_port = htons(port);
+    
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        throw std::runtime_error("Failed to bind socket");
+    }
+    if (listen(listen_fd, 1024) < 0) {
+        throw std::runtime_error("Failed to listen");
+    }
+}
+
+io_uring_sqe* IoUringServer::Loop::getSqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head >= sq_entries_) {
+        // SQ full: push what we have to the kernel to make room
+        submitAndWait(0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sq_local_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+    }
+    
+    io_uring_sqe* sqe = &sqes_[sq_local_tail_ & *sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_local_tail_++;
+    return sqe;
+}
+
+int IoUringServer::Loop::submitAndWait(unsigned wait_nr) {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    
+    unsigned flags = 0;
+    unsigned to_submit = 0;
+    if (config_.sqpoll) {
+        // The kernel thread picks up new SQEs by itself unless it went idle
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+    } else {
+        to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    }
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (to_submit == 0 && flags == 0) {
+        return 0;
+    }
+    
+    enter_calls.fetch_add(1, std::memory_order_relaxed);
+    return ioUringEnter(ring_fd_, to_submit, wait_nr, flags);
+}
+
+void IoUringServer::Loop::armAccept(int listen_fd) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = encode(OP_ACCEPT, listen_fd);
+}
+
+void IoUringServer::Loop::armRecv(int fd, Connection& conn) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        beginClose(fd, conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = encode(OP_RECV, fd);
+    conn.recv_armed = true;
+}
+
+void IoUringServer::Loop::armSend(int fd, Connection& conn) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        conn.send_inflight = false;
+        beginClose(fd, conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(conn.sending.data() + conn.send_offset);
+    sqe->len = static_cast<uint32_t>(conn.sending.size() - conn.send_offset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = encode(OP_SEND, fd);
+    conn.send_inflight = true;
+}
+
+void IoUringServer::Loop::armWake() {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+    sqe->len = sizeof(wake_value_);
+    sqe->user_data = encode(OP_WAKE, wake_fd_);
+}
+
+void IoUringServer::Loop::armTimer(Clock::time_point deadline) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    auto delay = std::max(Clock::duration::zero(), deadline - Clock::now());
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(delay);
+    timer_spec_.tv_sec = seconds.count();
+    timer_spec_.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(delay - seconds).count();
+    // The kernel copies the timespec at submission, so one member serves
+    // every timer in flight
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&timer_spec_);
+    sqe->len = 1;
+    sqe->user_data = encode(OP_TIMER, 0);
+    timer_deadline_ = timers_inflight_ == 0 ? deadline : std::min(timer_deadline_, deadline);
+    timers_inflight_++;
+}
+
+void IoUringServer::Loop::recycleBuffer(uint16_t bid) {
+    if (legacy_buffers_) {
+        provideBuffers(bid, 1, IOSQE_CQE_SKIP_SUCCESS);
+        return;
+    }
+    
+    io_uring_buf* buf = &buf_ring_->bufs[buf_tail_ & (buf_entries_ - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(bid) * config_.buffer_size);
+    buf->len = config_.buffer_size;
+    buf->bid = bid;
+    buf_tail_++;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+void IoUringServer::Loop::provideBuffers(uint16_t first_bid, unsigned count, unsigned sqe_flags) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(first_bid) * config_.buffer_size);
+    sqe->len = config_.buffer_size;
+    sqe->off = first_bid;
+    sqe->buf_group = kBufferGroup;
+    sqe->flags = sqe_flags;
+    sqe->user_data = encode(OP_PROVIDE, 0);
+}
+
+void IoUringServer::Loop::wake() {
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        std::cerr << "io_uring: failed to wake loop" << std::endl;
+    }
+}
+
+void IoUringServer::Loop::resume(int fd) {
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        ready_.push_back(fd);
+    }
+    wake();
+}
+
+void IoUringServer::Loop::cancelParked() {
+    if (!server_.park_cancel_) {
+        return;
+    }
+    for (auto& entry : connections_) {
+        if (entry.second.parked) {
+            server_.park_cancel_(entry.second.id, entry.second.tenant);
+            entry.second.parked = false;
+        }
+    }
+}
+
+void IoUringServer::Loop::run() {
+    armWake();
+    for (int fd : listen_fds_) {
+        armAccept(fd);
+    }
+    
+    while (server_.running_.load(std::memory_order_relaxed)) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            int ret = submitAndWait(1);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                std::cerr << "io_uring_enter failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        }
+        
+        while (head != tail) {
+            io_uring_cqe cqe = cqes_[head & *cq_mask_];
+            head++;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            handleCompletion(cqe);
+        }
+        
+        // Push the SQEs produced by this batch without waiting
+        submitAndWait(0);
+        retryCancels();
+    }
+}
+
+void IoUringServer::Loop::handleCompletion(const io_uring_cqe& cqe) {
+    OpType op = static_cast<OpType>(cqe.user_data >> 32);
+    int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFF);
+    
+    switch (op) {
+        case OP_ACCEPT:
+            onAccept(fd, cqe.res, cqe.flags);
+            break;
+        case OP_RECV:
+            onRecv(fd, cqe.res, cqe.flags);
+            break;
+        case OP_SEND:
+            onSend(fd, cqe.res);
+            break;
+        case OP_WAKE:
+            if (server_.draining_.load()) {
+                beginDrain();
+            }
+            resumeReady();
+            if (server_.running_.load()) {
+                armWake();
+            }
+            break;
+        case OP_TIMER:
+            onTimer();
+            break;
+        default:
+            break;
+    }
+}
+
+void IoUringServer::Loop::onAccept(int listen_fd, int res, uint32_t flags) {
+    if (res >= 0 && draining_) {
+        // Raced with the cancel; the peer reconnects to the new engine
+        close(res);
+    } else if (res >= 0) {
+        int opt = 1;
+        setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        
+        Connection& conn = connections_[res];
+        conn.id = server_.next_connection_id_.fetch_add(1, std::memory_order_relaxed);
+        conn.tenant = server_.classifier_ ? server_.classifier_(res) : 0;
+        conn.input = std::make_unique<ReceiveBuffer>(server_.receive_pool_, server_.max_frame_bytes_);
+        accepted.fetch_add(1, std::memory_order_relaxed);
+        open_connections.fetch_add(1, std::memory_order_relaxed);
+        armRecv(res, conn);
+    } else if (server_.running_.load() && !draining_) {
+        std::cerr << "Failed to accept connection: " << std::strerror(-res) << std::endl;
+    }
+    
+    if (!(flags & IORING_CQE_F_MORE) && server_.running_.load() && !draining_) {
+        armAccept(listen_fd);
+    }
+}
+
+void IoUringServer::Loop::onRecv(int fd, int res, uint32_t flags) {
+    auto it = connections_.find(fd);
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (it != connections_.end() && !it->second.closing) {
+            it->second.input->append(buffers_ + static_cast<size_t>(bid) * config_.buffer_size, res);
+        }
+        // Copied out, so the buffer can go straight back to the kernel
+        recycleBuffer(bid);
+    }
+    if (it == connections_.end()) {
+        return;
+    }
+    
+    Connection& conn = it->second;
+    if (res > 0) {
+        if (conn.parked) {
+            // The handler will get to this data once the connection resumes
+            if (!conn.closing && conn.input->size() > server_.max_frame_bytes_) {
+                pauseRecv(fd, conn);
+            }
+        } else if (!conn.closing && (!drainFrames(fd, conn) || (draining_ && idle(conn)))) {
+            beginClose(fd, conn);
+        }
+    } else if (res == -ENOBUFS) {
+        buffer_exhausted.fetch_add(1, std::memory_order_relaxed);
+    } else if (res != -ECANCELED || !conn.recv_paused) {
+        // 0 is an orderly shutdown by the peer, anything else an error
+        conn.closing = true;
+    }
+    
+    if (!(flags & IORING_CQE_F_MORE)) {
+        conn.recv_armed = false;
+        // Resumed while the cancel was still in flight
+        if (conn.recv_paused && !conn.parked) {
+            conn.recv_paused = false;
+        }
+        if (!conn.closing && !conn.recv_paused && server_.running_.load()) {
+            armRecv(fd, conn);
+        }
+    }
+    maybeClose(fd, conn);
+}
+
+void IoUringServer::Loop::onSend(int fd, int res) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end()) {
+        return;
+    }
+    
+    Connection& conn = it->second;
+    conn.send_inflight = false;
+    if (res < 0) {
+        beginClose(fd, conn);
+    } else if (!conn.closing) {
+        conn.send_offset += res;
+        if (conn.send_offset < conn.sending.size()) {
+            armSend(fd, conn);
+        } else if (!conn.output.empty()) {
+            conn.sending.swap(conn.output);
+            conn.output.clear();
+            conn.send_offset = 0;
+            armSend(fd, conn);
+        } else if (draining_ && idle(conn)) {
+            beginClose(fd, conn);
+        }
+    }
+    maybeClose(fd, conn);
+}
+
+bool IoUringServer::Loop::drainFrames(int fd, Connection& conn) {
+    FrameResult result = server_.handler_(conn.id, conn.tenant, resumeToken(fd), *conn.input, conn.output);
+    if (result == FrameResult::CLOSE) {
+        return false;
+    }
+    if (result == FrameResult::PARKED) {
+        park(fd, conn);
+    } else if (conn.parked) {
+        unpark(fd, conn);
+    }
+    
+    // Everything answered from this completion goes out in one send
+    if (!conn.output.empty() && !conn.send_inflight) {
+        conn.sending.swap(conn.output);
+        conn.output.clear();
+        conn.send_offset = 0;
+        armSend(fd, conn);
+    }
+    return true;
+}
+
+void IoUringServer::Loop::park(int fd, Connection& conn) {
+    Clock::time_point now = Clock::now();
+    if (conn.parked && now < conn.park_deadline) {
+        return;
+    }
+    if (!conn.parked) {
+        parks.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Parked again once the timeout passed: the waiter is still queued, so
+    // check back shortly rather than spin on it
+    conn.park_deadline = now + (conn.parked ? std::chrono::duration_cast<Clock::duration>(kParkRecheck)
+                                            : std::chrono::duration_cast<Clock::duration>(server_.park_timeout_));
+    conn.parked = true;
+    park_deadlines_.emplace_back(conn.park_deadline, fd);
+    if (timers_inflight_ == 0 || conn.park_deadline < timer_deadline_) {
+        armTimer(conn.park_deadline);
+    }
+}
+
+void IoUringServer::Loop::unpark(int fd, Connection& conn) {
+    conn.parked = false;
+    // With the cancel still in flight, onRecv re-arms once it completes
+    if (conn.recv_paused && !conn.recv_armed) {
+        conn.recv_paused = false;
+        if (!conn.closing && server_.running_.load()) {
+            armRecv(fd, conn);
+        }
+    }
+}
+
+// Stops reading a parked connection that already buffered a whole frame
+// past the one waiting, so a flooding client is held back by TCP
+void IoUringServer::Loop::pauseRecv(int fd, Connection& conn) {
+    if (conn.recv_paused || !conn.recv_armed) {
+        return;
+    }
+    cancelRequest(encode(OP_RECV, fd));
+    conn.recv_paused = true;
+    recv_pauses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IoUringServer::Loop::serveParked(int fd) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end() || !it->second.parked || it->second.closing) {
+        return;
+    }
+    Connection& conn = it->second;
+    if (!drainFrames(fd, conn) || (draining_ && idle(conn))) {
+        beginClose(fd, conn);
+    }
+    maybeClose(fd, conn);
+}
+
+void IoUringServer::Loop::resumeReady() {
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        ready_taken_.swap(ready_);
+    }
+    for (int fd : ready_taken_) {
+        serveParked(fd);
+    }
+    ready_taken_.clear();
+}
+
+void IoUringServer::Loop::onTimer() {
+    timers_inflight_--;
+    Clock::time_point now = Clock::now();
+    std::vector<int> due;
+    size_t kept = 0;
+    for (const auto& entry : park_deadlines_) {
+        auto it = connections_.find(entry.second);
+        // Entries of connections that resumed, or parked again since, are stale
+        if (it == connections_.end() || !it->second.parked || it->second.park_deadline != entry.first) {
+            continue;
+        }
+        if (entry.first <= now) {
+            due.push_back(entry.second);
+        } else {
+            park_deadlines_[kept++] = entry;
+        }
+    }
+    park_deadlines_.resize(kept);
+    for (int fd : due) {
+        serveParked(fd);
+    }
+    
+    if (park_deadlines_.empty()) {
+        return;
+    }
+    Clock::time_point next = park_deadlines_.front().first;
+    for (const auto& entry : park_deadlines_) {
+        next = std::min(next, entry.first);
+    }
+    if (timers_inflight_ == 0 || next < timer_deadline_) {
+        armTimer(next);
+    }
+}
+
+// Cancels the multishot request whose user_data is target. A cancel must
+// not be lost: the connection would wait for its recv forever.
+void IoUringServer::Loop::cancelRequest(uint64_t target) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        pending_cancels_.push_back(target);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = target;
+    sqe->user_data = encode(OP_CANCEL, static_cast<int>(target & 0xFFFFFFFF));
+}
+
+// Runs right after a submit, when the SQ has room again
+void IoUringServer::Loop::retryCancels() {
+    if (pending_cancels_.empty()) {
+        return;
+    }
+    std::vector<uint64_t> pending;
+    pending.swap(pending_cancels_);
+    for (uint64_t target : pending) {
+        // Drop cancels for a recv that already ended; its fd may belong to a
+        // new connection by now
+        if (static_cast<OpType>(target >> 32) == OP_RECV) {
+            auto it = connections_.find(static_cast<int>(target & 0xFFFFFFFF));
+            if (it == connections_.end() || !it->second.recv_armed ||
+                !(it->second.closing || it->second.recv_paused)) {
+                continue;
+            }
+        }
+        cancelRequest(target);
+    }
+}
+
+void IoUringServer::Loop::beginClose(int fd, Connection& conn) {
+    if (conn.closing) {
+        return;
+    }
+    conn.closing = true;
+    if (conn.recv_armed) {
+        cancelRequest(encode(OP_RECV, fd));
+    }
+}
+
+void IoUringServer::Loop::maybeClose(int fd, Connection& conn) {
+    // The fd may only be reused once no request refers to it any more
+    if (!conn.closing || conn.recv_armed || conn.send_inflight) {
+        return;
+    }
+    if (conn.parked && server_.park_cancel_) {
+        server_.park_cancel_(conn.id, conn.tenant);
+    }
+    connections_.erase(fd);
+    open_connections.fetch_sub(1, std::memory_order_relaxed);
+    
+    io_uring_sqe* sqe = getSqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = encode(OP_CLOSE, fd);
+    } else {
+        close(fd);
+    }
+}
+
+bool IoUringServer::Loop::idle(const Connection& conn) const {
+    return conn.input->size() == 0 && !conn.send_inflight && conn.output.empty();
+}
+
+// Runs on the loop thread after IoUringServer::beginDrain() wakes it
+void IoUringServer::Loop::beginDrain() {
+    if (draining_) {
+        return;
+    }
+    draining_ = true;
+    
+    for (int fd : listen_fds_) {
+        cancelRequest(encode(OP_ACCEPT, fd));
+        if (owns_listener_) {
+            close(fd);
+        }
+    }
+    listen_fds_.clear();
+    
+    std::vector<int> idle_fds;
+    for (auto& entry : connections_) {
+        if (idle(entry.second)) {
+            idle_fds.push_back(entry.first);
+        }
+    }
+    for (int fd : idle_fds) {
+        Connection& conn = connections_[fd];
+        beginClose(fd, conn);
+        maybeClose(fd, conn);
+    }
+}
+
+IoUringServer::IoUringServer(const std::string& host, int port, const IoUringConfig& config,
+                             MemoryPool& receive_pool, size_t max_frame_bytes, FrameHandler handler)
+    : host_(host)
+    , port_(port)
+    , config_(config)
+    , receive_pool_(receive_pool)
+    , max_frame_bytes_(max_frame_bytes)
+    , handler_(handler)
+    , park_timeout_(0)
+    , running_(false)
+    , draining_(false)
+    , next_connection_id_(0)
+{
+    if (config_.loops <= 0) {
+        config_.loops = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+IoUringServer::~IoUringServer() {
+    stop();
+}
+
+void IoUringServer::start() {
+    if (running_.load()) {
+        return;
+    }
+    
+    // Set everything up front so a missing feature surfaces before any
+    // loop starts serving
+    for (int i = 0; i < config_.loops; ++i) {
+        auto loop = std::make_unique<Loop>(*this, config_, static_cast<uint32_t>(i));
+        loop->setup(host_, port_, inherited_fds_);
+        loops_.push_back(std::move(loop));
+    }
+    
+    running_.store(true);
+    for (auto& loop : loops_) {
+        threads_.emplace_back(&Loop::run, loop.get());
+    }
+}
+
+void IoUringServer::stop() {
+    if (!running_.load()) {
+        loops_.clear();
+        return;
+    }
+    
+    running_.store(false);
+    for (auto& loop : loops_) {
+        loop->wake();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    for (auto& loop : loops_) {
+        loop->cancelParked();
+    }
+    loops_.clear();
+    for (int fd : inherited_fds_) {
+        close(fd);
+    }
+    inherited_fds_.clear();
+}
+
+void IoUringServer::setListeners(const std::vector<int>& fds) {
+    inherited_fds_ = fds;
+}
+
+std::vector<int> IoUringServer::getListeningSockets() const {
+    if (!inherited_fds_.empty()) {
+        return inherited_fds_;
+    }
+    std::vector<int> fds;
+    for (const auto& loop : loops_) {
+        fds.insert(fds.end(), loop->listeners().begin(), loop->listeners().end());
+    }
+    return fds;
+}
+
+void IoUringServer::resume(uint64_t resume_token) {
+    size_t index = static_cast<size_t>(resume_token >> 32);
+    if (index < loops_.size()) {
+        loops_[index]->resume(static_cast<int>(resume_token & 0xFFFFFFFF));
+    }
+}
+
+void IoUringServer::beginDrain() {
+    draining_.store(true);
+    for (auto& loop : loops_) {
+        loop->wake();
+    }
+}
+
+size_t IoUringServer::getActiveConnections() const {
+    size_t active = 0;
+    for (const auto& loop : loops_) {
+        active += loop->open_connections.load(std::memory_order_relaxed);
+    }
+    return active;
+}
+
+std::string IoUringServer::getPrometheusFormat() const {
+    uint64_t enter_calls = 0;
+    uint64_t accepted = 0;
+    uint64_t buffer_exhausted = 0;
+    uint64_t buffer_rings = 0;
+    uint64_t parks = 0;
+    uint64_t recv_pauses = 0;
+    for (const auto& loop : loops_) {
+        buffer_rings += loop->usesBufferRing() ? 1 : 0;
+        enter_calls += loop->enter_calls.load(std::memory_order_relaxed);
+        accepted += loop->accepted.load(std::memory_order_relaxed);
+        buffer_exhausted += loop->buffer_exhausted.load(std::memory_order_relaxed);
+        parks += loop->parks.load(std::memory_order_relaxed);
+        recv_pauses += loop->recv_pauses.load(std::memory_order_relaxed);
+    }
+    
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_io_uring_enter_total io_uring_enter syscalls issued by the event loops\n";
+    oss << "# TYPE bidding_io_uring_enter_total counter\n";
+    oss << "bidding_io_uring_enter_total " << enter_calls << "\n";
+    
+    oss << "# HELP bidding_io_uring_connections_total Connections accepted by the io_uring backend\n";
+    oss << "# TYPE bidding_io_uring_connections_total counter\n";
+    oss << "bidding_io_uring_connections_total " << accepted << "\n";
+    
+    oss << "# HELP bidding_io_uring_buffer_exhausted_total Receives that found no provided buffer\n";
+    oss << "# TYPE bidding_io_uring_buffer_exhausted_total counter\n";
+    oss << "bidding_io_uring_buffer_exhausted_total " << buffer_exhausted << "\n";
+    
+    oss << "# HELP bidding_io_uring_parked_total Connections parked with a frame waiting for its turn\n";
+    oss << "# TYPE bidding_io_uring_parked_total counter\n";
+    oss << "bidding_io_uring_parked_total " << parks << "\n";
+    
+    oss << "# HELP bidding_io_uring_recv_paused_total Parked connections whose reads were paused\n";
+    oss << "# TYPE bidding_io_uring_recv_paused_total counter\n";
+    oss << "bidding_io_uring_recv_paused_total " << recv_pauses << "\n";
+    
+    oss << "# HELP bidding_io_uring_buffer_rings Loops receiving through a registered buffer ring\n";
+    oss << "# TYPE bidding_io_uring_buffer_rings gauge\n";
+    oss << "bidding_io_uring_buffer_rings " << buffer_rings << "\n";
+    
+    oss << "# HELP bidding_io_uring_loops Event loop threads\n";
+    oss << "# TYPE bidding_io_uring_loops gauge\n";
+    oss << "bidding_io_uring_loops " << loops_.size() << "\n";
+    
+    return oss.str();
+}
@@ -1,31 +1,62 @@
 #include "bid_handler.h"
 #include "tcp_server.h"
 #include "metrics.h"
+#include "admission_controller.h"
+#include "qos_scheduler.h"
+#include "request_capture.h"
+#include "event_logger.h"
+#include "socket_handoff.h"
+#include "profiler.h"
+#include "win_notice_ingest.h"
+#include "campaign_budgets.h"
+#include "peer_sync.h"
 #include <iostream>
 #include <signal.h>
 #include <yaml-cpp/yaml.h>
+#include <boost/filesystem.hpp>
 #include <thread>
 #include <chrono>
 #include <sstream>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <cstring>
+#include <cstdlib>
 
 std::atomic<bool> g_running(true);
+std::atomic<bool> g_force_stop(false);
+std::atomic<bool> g_metrics_serving(true);
 TCPServer* g_tcp_server = nullptr;
 BidHandler* g_bid_handler = nullptr;
 MetricsCollector* g_metrics = nullptr;
+AdmissionController* g_admission = nullptr;
+QosScheduler* g_qos = nullptr;
+RequestCapture* g_capture = nullptr;
+EventLogger* g_event_logger = nullptr;
+FrequencyCapStore* g_frequency_caps = nullptr;
+SocketHandoff* g_handoff = nullptr;
+Profiler* g_profiler = nullptr;
+WinNoticeIngest* g_win_notices = nullptr;
+CampaignBudgets* g_budgets = nullptr;
+PeerSync* g_peer_sync = nullptr;
+int g_metrics_fd = -1;
 
+// The first signal drains, a second one stops without waiting
 void signalHandler(int signal) {
+    if (!g_running.exchange(false)) {
+        g_force_stop.store(true);
+        return;
+    }
     std::cout << "Received signal " << signal << ", shutting down..." << std::endl;
-    g_running.store(false);
 }
 
-void startMetricsServer(int port) {
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+int openMetricsListener(int port) {
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd < 0) {
-        return;
+        return -1;
     }
     
     int opt = 1;
@@ -38,31 +69,125 @@ void startMetricsServer(int port) {
     
     if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
         close(server_fd);
-        return;
+        return -1;
     }
     
     if (listen(server_fd, 10) < 0) {
         close(server_fd);
-        return;
+        return -1;
     }
-    
-    while (g_running.load()) {
+    return server_fd;
+}
+
+// Target of the request line, e.g. "/debug/profile?seconds=10"
+std::string readRequestTarget(int client_fd) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n") == std::string::npos && request.size() < 8192) {
+        struct pollfd pfd = {client_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            break;
+        }
+        ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (bytes_read <= 0) {
+            break;
+        }
+        request.append(buffer, bytes_read);
+    }
+    size_t start = request.find(' ');
+    if (start == std::string::npos) {
+        return "/";
+    }
+    size_t end = request.find_first_of(" \r", start + 1);
+    return request.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+}
+
+std::string queryParam(const std::string& target, const std::string& name) {
+    size_t query = target.find('?');
+    while (query != std::string::npos) {
+        size_t begin = query + 1;
+        size_t end = target.find('&', begin);
+        std::string pair = target.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        if (pair.compare(0, name.size() + 1, name + "=") == 0) {
+            return pair.substr(name.size() + 1);
+        }
+        query = end;
+    }
+    return "";
+}
+
+void sendHttpResponse(int client_fd, const std::string& status, const std::string& body) {
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t bytes = send(client_fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (bytes <= 0) {
+            break;
+        }
+        sent += bytes;
+    }
+    close(client_fd);
+}
+
+// GET /debug/profile?mode=cpu|offcpu&seconds=N, answered with folded stacks
+void serveProfile(int client_fd, std::string target) {
+    ProfileMode mode = Profiler::parseMode(queryParam(target, "mode"));
+    int seconds = std::atoi(queryParam(target, "seconds").c_str());
+    if (seconds <= 0) {
+        seconds = 10;
+    }
+    try {
+        sendHttpResponse(client_fd, "200 OK", g_profiler->profile(mode, std::chrono::seconds(seconds)));
+    } catch (const std::runtime_error& e) {
+        sendHttpResponse(client_fd, "409 Conflict", std::string(e.what()) + "\n");
+    }
+}
+
+void startMetricsServer(int server_fd) {
+    // Shared with the other engine around a handoff, so a ready socket may
+    // be empty by the time we accept
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+    // A profile takes seconds, so it is answered off this thread
+    std::thread profile_thread;
+    while (g_metrics_serving.load()) {
+        struct pollfd pfd = {server_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
         struct sockaddr_in client_address;
         socklen_t addr_len = sizeof(client_address);
         int client_fd = accept(server_fd, (struct sockaddr*)&client_address, &addr_len);
         
-        if (client_fd >= 0 && g_metrics) {
-            std::string metrics = g_metrics->getPrometheusFormat();
-            std::string response = "HTTP/1.1 200 OK\r\n"
-                                 "Content-Type: text/plain\r\n"
-                                 "Content-Length: " + std::to_string(metrics.size()) + "\r\n"
-                                 "\r\n" + metrics;
-            
-            send(client_fd, response.c_str(), response.size(), 0);
+        if (client_fd < 0) {
+            continue;
+        }
+        
+        std::string target = readRequestTarget(client_fd);
+        if (target.compare(0, 14, "/debug/profile") == 0) {
+            if (!g_profiler) {
+                sendHttpResponse(client_fd, "404 Not Found", "Profiler disabled\n");
+            } else if (g_profiler->active()) {
+                sendHttpResponse(client_fd, "409 Conflict", "A profiling session is already running\n");
+            } else {
+                if (profile_thread.joinable()) {
+                    profile_thread.join();
+                }
+                profile_thread = std::thread(serveProfile, client_fd, target);
+            }
+        } else if (g_metrics) {
+            sendHttpResponse(client_fd, "200 OK", g_metrics->getPrometheusFormat());
+        } else {
             close(client_fd);
         }
     }
     
+    if (profile_thread.joinable()) {
+        g_profiler->shutdown();
+        profile_thread.join();
+    }
     close(server_fd);
 }
 
@@ -70,10 +195,23 @@ int main(int argc, char* argv[]) {
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     
+    std::string config_file = "config/config.yaml";
+    bool takeover = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            config_file = argv[++i];
+        } else if (std::strcmp(argv[i], "--takeover") == 0) {
+            takeover = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--config PATH] [--takeover]" << std::endl;
+            return 1;
+        }
+    }
+    
     // Load config
     YAML::Node config;
     try {
-        config = YAML::LoadFile("config/config.yaml");
+        config = YAML::LoadFile(config_file);
     } catch (...) {
         std::cerr << "Failed to load config, using defaults" << std::endl;
     }
@@ -81,52 +219,587 @@ int main(int argc, char* argv[]) {
     std::string host = config["server"]["host"] ? config["server"]["host"].as<std::string>() : "0.0.0.0";
     int port = config["server"]["port"] ? config["server"]["port"].as<int>() : 5000;
     int metrics_port = config["server"]["metrics_port"] ? config["server"]["metrics_port"].as<int>() : 9090;
+    std::string backend_name = config["server"]["backend"] ? config["server"]["backend"].as<std::string>() : "threads";
+    int drain_timeout_ms = config["server"]["drain_timeout_ms"] ? config["server"]["drain_timeout_ms"].as<int>() : 5000;
+    
+    YAML::Node handoff_node = config["server"]["handoff"];
+    HandoffConfig handoff_config;
+    if (handoff_node["enabled"]) {
+        handoff_config.enabled = handoff_node["enabled"].as<bool>();
+    }
+    if (handoff_node["path"]) {
+        handoff_config.path = handoff_node["path"].as<std::string>();
+    }
+    if (handoff_node["timeout_ms"]) {
+        handoff_config.timeout_ms = handoff_node["timeout_ms"].as<int>();
+    }
+    
+    YAML::Node memory_node = config["memory"];
+    HugePageConfig page_config;
+    if (memory_node["huge_pages"]) {
+        page_config.mode = HugePageRegion::parseMode(memory_node["huge_pages"].as<std::string>());
+    }
+    if (memory_node["prefault"]) {
+        page_config.prefault = memory_node["prefault"].as<bool>();
+    }
+    if (memory_node["numa_node"]) {
+        page_config.numa_node = memory_node["numa_node"].as<int>();
+    }
+    
+    ReceiveBufferConfig receive_config;
+    receive_config.pages = page_config;
+    if (config["server"]["max_frame_bytes"]) {
+        receive_config.max_frame_bytes = config["server"]["max_frame_bytes"].as<size_t>();
+    }
+    YAML::Node receive_node = config["server"]["receive_buffer"];
+    if (receive_node["slab_bytes"]) {
+        receive_config.slab_bytes = receive_node["slab_bytes"].as<size_t>();
+    }
+    if (receive_node["pool_slabs"]) {
+        receive_config.pool_slabs = receive_node["pool_slabs"].as<size_t>();
+    }
+    
+    YAML::Node shm_node = config["server"]["shm"];
+    ShmTransportConfig shm_config;
+    if (shm_node["enabled"]) {
+        shm_config.enabled = shm_node["enabled"].as<bool>();
+    }
+    if (shm_node["path"]) {
+        shm_config.path = shm_node["path"].as<std::string>();
+    }
+    if (shm_node["ring_bytes"]) {
+        shm_config.ring_bytes = shm_node["ring_bytes"].as<size_t>();
+    }
+    if (shm_node["spin_us"]) {
+        shm_config.spin_us = shm_node["spin_us"].as<unsigned>();
+    }
+    if (shm_node["max_clients"]) {
+        shm_config.max_clients = shm_node["max_clients"].as<size_t>();
+    }
+    
+    YAML::Node io_uring_node = config["server"]["io_uring"];
+    IoUringConfig io_uring_config;
+    if (io_uring_node["loops"]) {
+        io_uring_config.loops = io_uring_node["loops"].as<int>();
+    }
+    if (io_uring_node["queue_depth"]) {
+        io_uring_config.queue_depth = io_uring_node["queue_depth"].as<unsigned>();
+    }
+    if (io_uring_node["buffer_count"]) {
+        io_uring_config.buffer_count = io_uring_node["buffer_count"].as<unsigned>();
+    }
+    if (io_uring_node["buffer_size"]) {
+        io_uring_config.buffer_size = io_uring_node["buffer_size"].as<unsigned>();
+    }
+    if (io_uring_node["sqpoll"]) {
+        io_uring_config.sqpoll = io_uring_node["sqpoll"].as<bool>();
+    }
+    if (io_uring_node["sqpoll_idle_ms"]) {
+        io_uring_config.sqpoll_idle_ms = io_uring_node["sqpoll_idle_ms"].as<unsigned>();
+    }
     size_t thread_pool_size = config["thread_pool"]["size"] ? config["thread_pool"]["size"].as<size_t>() : 8;
     
+    // Rules listed in config are interpreted; without them the compiled kBidRules apply
+    ScoringRuleSet scoring_rules;
+    for (const auto& rule : config["scoring"]["rules"]) {
+        std::string key = rule["key"] ? rule["key"].as<std::string>() : "";
+        double multiplier = rule["multiplier"] ? rule["multiplier"].as<double>() : 1.0;
+        if (key.empty()) {
+            std::cerr << "Ignoring scoring rule without a key" << std::endl;
+            continue;
+        }
+        if (rule["equals"]) {
+            scoring_rules.add(key, RuleMatch::EQUALS, rule["equals"].as<std::string>(), multiplier);
+        } else {
+            scoring_rules.add(key, RuleMatch::PRESENT, "", multiplier);
+        }
+    }
+    
+    std::string pricing_model_file = config["pricing"]["model_file"] ? config["pricing"]["model_file"].as<std::string>() : "";
+    
+    YAML::Node frequency_node = config["frequency_cap"];
+    FrequencyCapConfig frequency_config;
+    frequency_config.pages = page_config;
+    if (frequency_node["enabled"]) {
+        frequency_config.enabled = frequency_node["enabled"].as<bool>();
+    }
+    if (frequency_node["memory_mb"]) {
+        frequency_config.memory_mb = frequency_node["memory_mb"].as<size_t>();
+    }
+    if (frequency_node["window_seconds"]) {
+        frequency_config.window_seconds = frequency_node["window_seconds"].as<unsigned>();
+    }
+    if (frequency_node["default_cap"]) {
+        frequency_config.default_cap = frequency_node["default_cap"].as<uint32_t>();
+    }
+    if (frequency_node["snapshot_file"]) {
+        frequency_config.snapshot_file = frequency_node["snapshot_file"].as<std::string>();
+    }
+    if (frequency_node["snapshot_interval_seconds"]) {
+        frequency_config.snapshot_interval_seconds = frequency_node["snapshot_interval_seconds"].as<unsigned>();
+    }
+    for (const auto& campaign : frequency_node["campaigns"]) {
+        frequency_config.campaign_caps[campaign.first.as<std::string>()] = campaign.second.as<uint32_t>();
+    }
+    
+    // Budgets are per campaign across all replicas; peer_sync shares them out
+    std::unordered_map<std::string, double> campaign_budgets;
+    for (const auto& campaign : config["budgets"]["campaigns"]) {
+        campaign_budgets[campaign.first.as<std::string>()] = campaign.second.as<double>();
+    }
+    
+    YAML::Node peer_sync_node = config["peer_sync"];
+    PeerSyncConfig peer_sync_config;
+    if (peer_sync_node["enabled"]) {
+        peer_sync_config.enabled = peer_sync_node["enabled"].as<bool>();
+    }
+    if (peer_sync_node["node_id"]) {
+        peer_sync_config.node_id = peer_sync_node["node_id"].as<uint32_t>();
+    }
+    if (peer_sync_node["host"]) {
+        peer_sync_config.host = peer_sync_node["host"].as<std::string>();
+    }
+    if (peer_sync_node["port"]) {
+        peer_sync_config.port = peer_sync_node["port"].as<int>();
+    }
+    for (const auto& peer : peer_sync_node["peers"]) {
+        peer_sync_config.peers.push_back(peer.as<std::string>());
+    }
+    if (peer_sync_node["interval_ms"]) {
+        peer_sync_config.interval_ms = peer_sync_node["interval_ms"].as<unsigned>();
+    }
+    if (peer_sync_node["full_sync_every"]) {
+        peer_sync_config.full_sync_every = peer_sync_node["full_sync_every"].as<unsigned>();
+    }
+    if (peer_sync_node["max_datagrams_per_round"]) {
+        peer_sync_config.max_datagrams_per_round = peer_sync_node["max_datagrams_per_round"].as<size_t>();
+    }
+    if (peer_sync_node["peer_timeout_ms"]) {
+        peer_sync_config.peer_timeout_ms = peer_sync_node["peer_timeout_ms"].as<unsigned>();
+    }
+    if (peer_sync_node["impression_queue"]) {
+        peer_sync_config.impression_queue = peer_sync_node["impression_queue"].as<size_t>();
+    }
+    
+    YAML::Node admission_node = config["admission"];
+    bool admission_enabled = admission_node["enabled"] ? admission_node["enabled"].as<bool>() : true;
+    AdmissionConfig admission_config;
+    if (admission_node["algorithm"]) {
+        admission_config.algorithm = AdmissionController::parseAlgorithm(admission_node["algorithm"].as<std::string>());
+    }
+    if (admission_node["initial_limit"]) {
+        admission_config.initial_limit = admission_node["initial_limit"].as<size_t>();
+    }
+    if (admission_node["min_limit"]) {
+        admission_config.min_limit = admission_node["min_limit"].as<size_t>();
+    }
+    if (admission_node["max_limit"]) {
+        admission_config.max_limit = admission_node["max_limit"].as<size_t>();
+    }
+    if (admission_node["latency_threshold_us"]) {
+        admission_config.latency_threshold_us = admission_node["latency_threshold_us"].as<int64_t>();
+    }
+    if (admission_node["backoff_ratio"]) {
+        admission_config.backoff_ratio = admission_node["backoff_ratio"].as<double>();
+    }
+    if (admission_node["tolerance"]) {
+        admission_config.tolerance = admission_node["tolerance"].as<double>();
+    }
+    
+    YAML::Node qos_node = config["qos"];
+    QosConfig qos_config;
+    if (qos_node["enabled"]) {
+        qos_config.enabled = qos_node["enabled"].as<bool>();
+    }
+    if (qos_node["concurrency"]) {
+        qos_config.concurrency = qos_node["concurrency"].as<size_t>();
+    }
+    if (qos_node["max_wait_us"]) {
+        qos_config.max_wait_us = qos_node["max_wait_us"].as<unsigned>();
+    }
+    if (qos_node["default_class"]) {
+        qos_config.default_class = qos_node["default_class"].as<std::string>();
+    }
+    for (const auto& class_node : qos_node["classes"]) {
+        QosClassConfig class_config;
+        class_config.name = class_node["name"] ? class_node["name"].as<std::string>() : "";
+        if (class_node["weight"]) {
+            class_config.weight = class_node["weight"].as<unsigned>();
+        }
+        if (class_node["max_queue"]) {
+            class_config.max_queue = class_node["max_queue"].as<size_t>();
+        }
+        for (const auto& source : class_node["sources"]) {
+            class_config.sources.push_back(source.as<std::string>());
+        }
+        if (class_config.name.empty()) {
+            std::cerr << "Ignoring QoS class without a name" << std::endl;
+            continue;
+        }
+        qos_config.classes.push_back(class_config);
+    }
+    
+    YAML::Node capture_node = config["capture"];
+    bool capture_enabled = capture_node["enabled"] ? capture_node["enabled"].as<bool>() : false;
+    std::string capture_file = capture_node["file"] ? capture_node["file"].as<std::string>() : "requests.bcap";
+    size_t capture_ring_slots = capture_node["ring_slots"] ? capture_node["ring_slots"].as<size_t>() : 65536;
+    size_t capture_max_frame = capture_node["max_frame_bytes"] ? capture_node["max_frame_bytes"].as<size_t>() : 4096;
+    
+    YAML::Node profiler_node = config["profiler"];
+    ProfilerConfig profiler_config;
+    if (profiler_node["enabled"]) {
+        profiler_config.enabled = profiler_node["enabled"].as<bool>();
+    }
+    if (profiler_node["frequency_hz"]) {
+        profiler_config.frequency_hz = profiler_node["frequency_hz"].as<unsigned>();
+    }
+    if (profiler_node["max_seconds"]) {
+        profiler_config.max_seconds = profiler_node["max_seconds"].as<unsigned>();
+    }
+    if (profiler_node["max_samples"]) {
+        profiler_config.max_samples = profiler_node["max_samples"].as<size_t>();
+    }
+    
+    YAML::Node win_notice_node = config["win_notices"];
+    WinNoticeConfig win_notice_config;
+    if (win_notice_node["enabled"]) {
+        win_notice_config.enabled = win_notice_node["enabled"].as<bool>();
+    }
+    if (win_notice_node["host"]) {
+        win_notice_config.host = win_notice_node["host"].as<std::string>();
+    }
+    if (win_notice_node["port"]) {
+        win_notice_config.port = win_notice_node["port"].as<int>();
+    }
+    if (win_notice_node["threads"]) {
+        win_notice_config.threads = win_notice_node["threads"].as<size_t>();
+    }
+    if (win_notice_node["batch"]) {
+        win_notice_config.batch = win_notice_node["batch"].as<size_t>();
+    }
+    if (win_notice_node["max_campaigns"]) {
+        win_notice_config.max_campaigns = win_notice_node["max_campaigns"].as<size_t>();
+    }
+    if (win_notice_node["receive_buffer_bytes"]) {
+        win_notice_config.receive_buffer_bytes = win_notice_node["receive_buffer_bytes"].as<int>();
+    }
+    
+    // Binary bid/win events go next to logging.file unless a directory is given
+    YAML::Node logging_node = config["logging"];
+    YAML::Node event_log_node = logging_node["event_log"];
+    bool event_log_enabled = event_log_node["enabled"] ? event_log_node["enabled"].as<bool>() : false;
+    EventLoggerConfig event_log_config;
+    if (logging_node["file"]) {
+        boost::filesystem::path log_file(logging_node["file"].as<std::string>());
+        if (log_file.has_parent_path()) {
+            event_log_config.directory = log_file.parent_path().string();
+        }
+    }
+    if (event_log_node["directory"]) {
+        event_log_config.directory = event_log_node["directory"].as<std::string>();
+    }
+    if (event_log_node["ring_capacity"]) {
+        event_log_config.ring_capacity = event_log_node["ring_capacity"].as<size_t>();
+    }
+    if (event_log_node["rotate_mb"]) {
+        event_log_config.rotate_bytes = event_log_node["rotate_mb"].as<size_t>() << 20;
+    }
+    if (event_log_node["max_files"]) {
+        event_log_config.max_files = event_log_node["max_files"].as<size_t>();
+    }
+    if (event_log_node["flush_interval_ms"]) {
+        event_log_config.flush_interval_ms = event_log_node["flush_interval_ms"].as<int>();
+    }
+    if (event_log_node["direct_io"]) {
+        event_log_config.direct_io = event_log_node["direct_io"].as<bool>();
+    }
+    
     std::cout << "Starting Bidding Engine..." << std::endl;
     std::cout << "Host: " << host << std::endl;
     std::cout << "Port: " << port << std::endl;
     std::cout << "Thread Pool Size: " << thread_pool_size << std::endl;
+    std::cout << "Huge Pages: " << HugePageRegion::modeName(page_config.mode)
+              << (page_config.prefault ? " (prefaulted)" : "") << std::endl;
     
     // Initialize components
     g_metrics = new MetricsCollector();
+    g_metrics->addExporter([]() { return HugePageRegion::getPrometheusFormat(); });
     g_bid_handler = new BidHandler(thread_pool_size);
+    g_metrics->addExporter([]() { return g_bid_handler->getPrometheusFormat(); });
+    if (!scoring_rules.empty()) {
+        g_bid_handler->setScoringRules(scoring_rules);
+        std::cout << "Scoring Rules: " << scoring_rules.size() << " from config (interpreted)" << std::endl;
+    } else {
+        std::cout << "Scoring Rules: " << CompiledScorer<kBidRules>::kRuleCount << " compiled" << std::endl;
+    }
+    if (!pricing_model_file.empty()) {
+        try {
+            auto model = PricingModel::loadFile(pricing_model_file);
+            std::cout << "Pricing Model: " << pricing_model_file << " (" << model->featureCount() << " features, "
+                      << model->treeCount() << " trees)" << std::endl;
+            g_bid_handler->setPricingModel(std::move(model));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", using flat bid shading" << std::endl;
+        }
+    }
+    if (frequency_config.enabled) {
+        try {
+            g_frequency_caps = new FrequencyCapStore(frequency_config);
+            g_bid_handler->setFrequencyCaps(g_frequency_caps);
+            g_metrics->addExporter([]() { return g_frequency_caps->getPrometheusFormat(); });
+            std::cout << "Frequency Caps: " << g_frequency_caps->capacity() << " pairs in "
+                      << (g_frequency_caps->memoryBytes() >> 20) << " MB, "
+                      << frequency_config.window_seconds << "s window" << std::endl;
+            if (g_frequency_caps->restoredFromSnapshot()) {
+                std::cout << "Frequency Caps: restored from " << frequency_config.snapshot_file << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", frequency caps disabled" << std::endl;
+        }
+    }
+    if (!campaign_budgets.empty()) {
+        size_t replicas = peer_sync_config.enabled ? peer_sync_config.peers.size() + 1 : 1;
+        g_budgets = new CampaignBudgets(campaign_budgets, peer_sync_config.node_id, replicas);
+        g_bid_handler->setBudgets(g_budgets);
+        g_metrics->addExporter([]() { return g_budgets->getPrometheusFormat(); });
+        std::cout << "Budgets: " << campaign_budgets.size() << " campaigns" << std::endl;
+    }
+    if (peer_sync_config.enabled) {
+        g_peer_sync = new PeerSync(peer_sync_config, g_budgets, g_frequency_caps);
+        try {
+            g_peer_sync->start();
+            if (g_frequency_caps) {
+                g_frequency_caps->setReplicator([](uint64_t pair_hash, uint32_t impressions) {
+                    g_peer_sync->enqueueImpression(pair_hash, impressions);
+                });
+            }
+            g_metrics->addExporter([]() { return g_peer_sync->getPrometheusFormat(); });
+            std::cout << "Peer sync: udp " << peer_sync_config.host << ":" << peer_sync_config.port << " as node "
+                      << peer_sync_config.node_id << ", " << peer_sync_config.peers.size() << " peers" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", peer sync disabled" << std::endl;
+            delete g_peer_sync;
+            g_peer_sync = nullptr;
+        }
+    }
     g_tcp_server = new TCPServer(host, port);
+    g_tcp_server->setBackend(TCPServer::parseBackend(backend_name), io_uring_config);
+    g_tcp_server->setReceiveBufferConfig(receive_config);
+    g_tcp_server->setShmTransport(shm_config);
+    g_metrics->addExporter([]() { return g_tcp_server->getPrometheusFormat(); });
+    
+    if (admission_enabled) {
+        g_admission = new AdmissionController(admission_config);
+        g_tcp_server->setAdmissionController(g_admission);
+        g_metrics->addExporter([]() { return g_admission->getPrometheusFormat(); });
+        std::cout << "Admission Limit: " << g_admission->getLimit() << " (adaptive)" << std::endl;
+    }
+    
+    if (qos_config.enabled) {
+        try {
+            g_qos = new QosScheduler(qos_config);
+            g_tcp_server->setQosScheduler(g_qos);
+            g_metrics->addExporter([]() { return g_qos->getPrometheusFormat(); });
+            std::cout << "QoS: " << g_qos->classCount() << " classes sharing " << qos_config.concurrency
+                      << " scoring slots" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", QoS disabled" << std::endl;
+        }
+    }
+    
+    if (capture_enabled) {
+        g_capture = new RequestCapture(capture_file, capture_ring_slots, capture_max_frame);
+        try {
+            g_capture->start();
+            g_tcp_server->setRequestCapture(g_capture);
+            g_metrics->addExporter([]() { return g_capture->getPrometheusFormat(); });
+            std::cout << "Capturing requests to " << capture_file << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", capture disabled" << std::endl;
+            delete g_capture;
+            g_capture = nullptr;
+        }
+    }
+    
+    if (event_log_enabled) {
+        g_event_logger = new EventLogger(event_log_config);
+        try {
+            g_event_logger->start();
+            g_metrics->addExporter([]() { return g_event_logger->getPrometheusFormat(); });
+            std::cout << "Event log: " << event_log_config.directory << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", event log disabled" << std::endl;
+            delete g_event_logger;
+            g_event_logger = nullptr;
+        }
+    }
+    
+    if (win_notice_config.enabled) {
+        g_win_notices = new WinNoticeIngest(win_notice_config);
+        g_win_notices->setBudgets(g_budgets);
+        try {
+            g_win_notices->start();
+            g_bid_handler->setOutcomes(&g_win_notices->outcomes());
+            g_metrics->addExporter([]() { return g_win_notices->getPrometheusFormat(); });
+            std::cout << "Win notices: udp " << win_notice_config.host << ":" << win_notice_config.port
+                      << " (" << win_notice_config.threads << " threads)" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", win notices disabled" << std::endl;
+            delete g_win_notices;
+            g_win_notices = nullptr;
+        }
+    }
+    if (g_budgets && !g_win_notices) {
+        std::cerr << "Budgets: win notices disabled, spend will not be charged" << std::endl;
+    }
+    
+    if (profiler_config.enabled) {
+        try {
+            g_profiler = new Profiler(profiler_config);
+            g_metrics->addExporter([]() { return g_profiler->getPrometheusFormat(); });
+            std::cout << "Profiler: /debug/profile on port " << metrics_port << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", profiler disabled" << std::endl;
+        }
+    }
     
     // Set up bid handler callback
     g_bid_handler->setBidCallback([&](const bidding::BidResponse& response) {
         if (g_metrics) {
             g_metrics->recordRequest(response.latency_ms(), response.status() == "success");
         }
+        if (g_event_logger) {
+            g_event_logger->logBid(response);
+        }
     });
     
     // Set up TCP server request handler
     g_tcp_server->setRequestHandler([&](const bidding::BidRequest& request) {
         return g_bid_handler->processBid(request);
     });
+    g_tcp_server->setBatchHandler([&](const bidding::BidBatchRequest& request) {
+        return g_bid_handler->processBatch(request);
+    });
+    
+    // Take the listening sockets over from a running engine, else bind our own
+    std::unique_ptr<SocketHandoff::Takeover> handoff_source;
+    if (takeover) {
+        try {
+            handoff_source.reset(new SocketHandoff::Takeover(handoff_config.path, handoff_config.timeout_ms));
+            g_tcp_server->adoptListeners(handoff_source->sockets().server);
+            g_metrics_fd = handoff_source->sockets().metrics;
+            std::cout << "Took over " << handoff_source->sockets().server.size() << " listening sockets from "
+                      << handoff_config.path << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", binding new sockets" << std::endl;
+        }
+    }
     
     // Start services
     g_bid_handler->start();
+    if (g_frequency_caps) {
+        g_frequency_caps->start();
+    }
     g_tcp_server->start();
+    std::cout << "Network Backend: "
+              << (g_tcp_server->getBackend() == ServerBackend::IO_URING ? "io_uring" : "threads") << std::endl;
+    if (g_tcp_server->isShmEnabled()) {
+        std::cout << "Shared-memory transport: " << shm_config.path << std::endl;
+    }
     
     // Start metrics server
-    std::thread metrics_thread(startMetricsServer, metrics_port);
-    metrics_thread.detach();
+    if (g_metrics_fd < 0) {
+        g_metrics_fd = openMetricsListener(metrics_port);
+    }
+    std::thread metrics_thread;
+    if (g_metrics_fd >= 0) {
+        metrics_thread = std::thread(startMetricsServer, g_metrics_fd);
+    }
+    
+    // We are accepting on the inherited sockets, so the old engine can drain
+    if (handoff_source) {
+        handoff_source->confirm();
+        handoff_source.reset();
+    }
+    
+    if (handoff_config.enabled) {
+        g_handoff = new SocketHandoff(handoff_config,
+            []() {
+                HandoffSockets sockets;
+                sockets.server = g_tcp_server->getListeningSockets();
+                sockets.metrics = g_metrics_fd;
+                return sockets;
+            },
+            []() { g_running.store(false); });
+        try {
+            g_handoff->start();
+            std::cout << "Socket handoff: " << handoff_config.path << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", socket handoff disabled" << std::endl;
+            delete g_handoff;
+            g_handoff = nullptr;
+        }
+    }
     
     std::cout << "Bidding Engine started successfully!" << std::endl;
     
     // Main loop
     while (g_running.load()) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    
+    // Stop taking new connections, then let open ones finish their
+    // in-flight requests until they go idle or the drain times out
+    std::cout << "Draining connections..." << std::endl;
+    if (g_handoff) {
+        g_handoff->stop();
+    }
+    g_metrics_serving.store(false);
+    if (metrics_thread.joinable()) {
+        metrics_thread.join();
+    }
+    g_tcp_server->beginDrain();
+    auto drain_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drain_timeout_ms);
+    while (g_tcp_server->getActiveConnections() > 0 && !g_force_stop.load() &&
+           std::chrono::steady_clock::now() < drain_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (g_tcp_server->getActiveConnections() > 0) {
+        std::cout << "Closing " << g_tcp_server->getActiveConnections() << " connections still open" << std::endl;
     }
     
     // Cleanup
     std::cout << "Shutting down..." << std::endl;
     g_tcp_server->stop();
     g_bid_handler->stop();
+    if (g_capture) {
+        g_capture->stop();
+    }
+    if (g_event_logger) {
+        g_event_logger->stop();
+    }
+    if (g_peer_sync) {
+        g_peer_sync->stop();
+    }
+    if (g_frequency_caps) {
+        g_frequency_caps->stop();
+    }
+    if (g_win_notices) {
+        g_win_notices->stop();
+    }
     
+    delete g_handoff;
     delete g_tcp_server;
     delete g_bid_handler;
+    delete g_peer_sync;
+    delete g_budgets;
+    delete g_frequency_caps;
+    delete g_admission;
+    delete g_qos;
+    delete g_capture;
+    delete g_event_logger;
+    delete g_win_notices;
+    delete g_profiler;
     delete g_metrics;
     
     return 0;
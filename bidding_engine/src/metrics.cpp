@@ -4,60 +4,57 @@
 #include <iomanip>
 
 MetricsCollector::MetricsCollector()
-    : total_requests_(0)
-    , successful_requests_(0)
-    , cache_hits_(0)
-    , cache_misses_(0)
-    , p50_latency_(0.0)
-    , p95_latency_(0.0)
-    , p99_latency_(0.0)
+    : mutex_("MetricsCollector")
+    , next_sample_(0)
 {
     latency_samples_.reserve(MAX_SAMPLES);
 }
 
 void MetricsCollector::recordRequest(int64_t latency_ms, bool success) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    total_requests_.fetch_add(1);
+    total_requests_.add();
     if (success) {
-        successful_requests_.fetch_add(1);
+        successful_requests_.add();
     }
     
-    latency_samples_.push_back(latency_ms);
-    if (latency_samples_.size() > MAX_SAMPLES) {
-        latency_samples_.erase(latency_samples_.begin());
+    // Percentiles are only computed when read
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    if (latency_samples_.size() < MAX_SAMPLES) {
+        latency_samples_.push_back(latency_ms);
+    } else {
+        latency_samples_[next_sample_] = latency_ms;
     }
-    
-    updatePercentiles();
+    next_sample_ = (next_sample_ + 1) % MAX_SAMPLES;
 }
 
 void MetricsCollector::recordCacheHit(bool hit) {
     if (hit) {
-        cache_hits_.fetch_add(1);
+        cache_hits_.add();
     } else {
-        cache_misses_.fetch_add(1);
+        cache_misses_.add();
     }
 }
 
 bidding::Metrics MetricsCollector::getMetrics() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     bidding::Metrics metrics;
     
-    uint64_t total = total_requests_.load();
+    uint64_t total = total_requests_.value();
     if (total > 0) {
+        Percentiles latency = percentiles();
         metrics.set_requests_per_sec(total); // Simplified
-        metrics.set_p50_latency_ms(p50_latency_);
-        metrics.set_p95_latency_ms(p95_latency_);
-        metrics.set_p99_latency_ms(p99_latency_);
+        metrics.set_p50_latency_ms(latency.p50);
+        metrics.set_p95_latency_ms(latency.p95);
+        metrics.set_p99_latency_ms(latency.p99);
         
-        double success_rate = static_cast<double>(successful_requests_.load()) / total * 100.0;
+        double success_rate = static_cast<double>(successful_requests_.value()) / total * 100.0;
         metrics.set_success_rate(success_rate);
     }
     
-    uint64_t cache_total = cache_hits_.load() + cache_misses_.load();
+    uint64_t cache_hits = cache_hits_.value();
+    uint64_t cache_total = cache_hits + cache_misses_.value();
     if (cache_total > 0) {
-        double hit_rate = static_cast<double>(cache_hits_.load()) / cache_total * 100.0;
+        double hit_rate = static_cast<double>(cache_hits) / cache_total * 100.0;
         metrics.set_cache_hit_rate(hit_rate);
     }
     
@@ -65,65 +62,76 @@ bidding::Metrics MetricsCollector::getMetrics() const {
 }
 
 std::string MetricsCollector::getPrometheusFormat() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     
     std::ostringstream oss;
     oss << std::fixed << std::setprecision(2);
+    Percentiles latency = percentiles();
     
     oss << "# HELP bidding_requests_total Total number of requests\n";
     oss << "# TYPE bidding_requests_total counter\n";
-    oss << "bidding_requests_total " << total_requests_.load() << "\n";
+    oss << "bidding_requests_total " << total_requests_.value() << "\n";
     
     oss << "# HELP bidding_requests_successful Total successful requests\n";
     oss << "# TYPE bidding_requests_successful counter\n";
-    oss << "bidding_requests_successful " << successful_requests_.load() << "\n";
+    oss << "bidding_requests_successful " << successful_requests_.value() << "\n";
     
     oss << "# HELP bidding_latency_p50 P50 latency in milliseconds\n";
     oss << "# TYPE bidding_latency_p50 gauge\n";
-    oss << "bidding_latency_p50 " << p50_latency_ << "\n";
+    oss << "bidding_latency_p50 " << latency.p50 << "\n";
     
     oss << "# HELP bidding_latency_p95 P95 latency in milliseconds\n";
     oss << "# TYPE bidding_latency_p95 gauge\n";
-    oss << "bidding_latency_p95 " << p95_latency_ << "\n";
+    oss << "bidding_latency_p95 " << latency.p95 << "\n";
     
     oss << "# HELP bidding_latency_p99 P99 latency in milliseconds\n";
     oss << "# TYPE bidding_latency_p99 gauge\n";
-    oss << "bidding_latency_p99 " << p99_latency_ << "\n";
+    oss << "bidding_latency_p99 " << latency.p99 << "\n";
     
-    uint64_t cache_total = cache_hits_.load() + cache_misses_.load();
+    uint64_t cache_hits = cache_hits_.value();
+    uint64_t cache_total = cache_hits + cache_misses_.value();
     if (cache_total > 0) {
-        double hit_rate = static_cast<double>(cache_hits_.load()) / cache_total * 100.0;
+        double hit_rate = static_cast<double>(cache_hits) / cache_total * 100.0;
         oss << "# HELP bidding_cache_hit_rate Cache hit rate percentage\n";
         oss << "# TYPE bidding_cache_hit_rate gauge\n";
         oss << "bidding_cache_hit_rate " << hit_rate << "\n";
     }
     
+    for (const auto& exporter : exporters_) {
+        oss << exporter();
+    }
+    
     return oss.str();
 }
 
+void MetricsCollector::addExporter(std::function<std::string()> exporter) {
+    std::lock_guard<ProfiledMutex> lock(mutex_);
+    exporters_.push_back(std::move(exporter));
+}
+
 void MetricsCollector::reset() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<ProfiledMutex> lock(mutex_);
     latency_samples_.clear();
-    total_requests_.store(0);
-    successful_requests_.store(0);
-    cache_hits_.store(0);
-    cache_misses_.store(0);
-    p50_latency_ = 0.0;
-    p95_latency_ = 0.0;
-    p99_latency_ = 0.0;
+    next_sample_ = 0;
+    total_requests_.reset();
+    successful_requests_.reset();
+    cache_hits_.reset();
+    cache_misses_.reset();
 }
 
-void MetricsCollector::updatePercentiles() {
+MetricsCollector::Percentiles MetricsCollector::percentiles() const {
+    Percentiles result;
     if (latency_samples_.empty()) {
-        return;
+        return result;
     }
     
     std::vector<int64_t> sorted = latency_samples_;
     std::sort(sorted.begin(), sorted.end());
     
     size_t size = sorted.size();
-    p50_latency_ = sorted[size * 0.5];
-    p95_latency_ = sorted[size * 0.95];
-    p99_latency_ = sorted[size * 0.99];
+    result.p50 = sorted[size * 0.5];
+    result.p95 = sorted[size * 0.95];
+    result.p99 = sorted[size * 0.99];
+    return result;
 }
 
@@ -0,0 +1,339 @@
+#include "peer_sync.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kPayloadBytes = kPeerSyncDatagramBytes - sizeof(PeerSyncHeader);
+constexpr size_t kCountersPerDatagram = kPayloadBytes / sizeof(PeerCounter);
+
+struct sockaddr_in parsePeer(const std::string& peer) {
+    size_t colon = peer.rfind(':');
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    if (colon == std::string::npos || inet_pton(AF_INET, peer.substr(0, colon).c_str(), &address.sin_addr) != 1) {
+        throw std::runtime_error("Invalid sync peer " + peer + ", expected ip:port");
+    }
+    int port = std::atoi(peer.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) {
+        throw std::runtime_error("Invalid sync peer " + peer + ", expected ip:port");
+    }
+    address.sin_port = htons(port);
+    return address;
+}
+
+}
+
+PeerSync::PeerSync(const PeerSyncConfig& config, CampaignBudgets* budgets, FrequencyCapStore* frequency_caps)
+    : config_(config)
+    , budgets_(budgets)
+    , frequency_caps_(frequency_caps)
+    , impressions_(config.impression_queue)
+    , fd_(-1)
+    , wake_fd_(-1)
+    , running_(false)
+    , live_peers_(0)
+{
+    config_.interval_ms = std::max(config_.interval_ms, 1u);
+    config_.max_datagrams_per_round = std::max<size_t>(config_.max_datagrams_per_round, 1);
+    if (budgets_) {
+        replica_id_ = budgets_->replicaId();
+    } else {
+        uint32_t incarnation = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        replica_id_ = static_cast<uint64_t>(config_.node_id) << 32 | incarnation;
+    }
+}
+
+PeerSync::~PeerSync() {
+    stop();
+}
+
+void PeerSync::start() {
+    if (running_.load()) {
+        return;
+    }
+    peer_addresses_.clear();
+    for (const auto& peer : config_.peers) {
+        peer_addresses_.push_back(parsePeer(peer));
+    }
+    
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to create peer sync socket");
+    }
+    int opt = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(config_.host.c_str());
+    address.sin_port = htons(config_.port);
+    if (bind(fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        close(fd_);
+        fd_ = -1;
+        throw std::runtime_error("Failed to bind peer sync port " + std::to_string(config_.port) + ": " + error);
+    }
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        close(fd_);
+        fd_ = -1;
+        throw std::runtime_error("Failed to create peer sync eventfd");
+    }
+    
+    running_.store(true);
+    thread_ = std::thread(&PeerSync::syncThread, this);
+}
+
+void PeerSync::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        // The thread still sees running_ at the end of its round
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(fd_);
+    close(wake_fd_);
+    fd_ = -1;
+    wake_fd_ = -1;
+}
+
+void PeerSync::enqueueImpression(uint64_t pair_hash, uint32_t impressions) {
+    if (!impressions_.push({pair_hash, impressions})) {
+        impressions_dropped_.add(impressions);
+    }
+}
+
+void PeerSync::syncThread() {
+    std::vector<char> buffer(kPeerSyncDatagramBytes);
+    auto interval = std::chrono::milliseconds(config_.interval_ms);
+    auto last_round = Clock::now();
+    auto next_round = last_round;
+    uint64_t round = 0;
+    
+    while (running_.load(std::memory_order_relaxed)) {
+        auto now = Clock::now();
+        if (now >= next_round) {
+            bool full = config_.full_sync_every > 0 && round % config_.full_sync_every == 0;
+            runRound(full, std::chrono::duration<double>(now - last_round).count());
+            ++round;
+            last_round = now;
+            next_round = now + interval;
+            continue;
+        }
+        
+        int timeout_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(next_round - now).count()) + 1;
+        struct pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (poll(fds, 2, timeout_ms) < 0 && errno != EINTR) {
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        ssize_t length;
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        while ((length = recvfrom(fd_, buffer.data(), buffer.size(), MSG_DONTWAIT | MSG_TRUNC,
+                                  (struct sockaddr*)&from, &from_length)) >= 0) {
+            if (static_cast<size_t>(length) > buffer.size() || from_length != sizeof(from)) {
+                datagrams_received_.add();
+                malformed_.add();
+            } else {
+                receive(buffer.data(), length, from);
+            }
+            from_length = sizeof(from);
+        }
+    }
+}
+
+bool PeerSync::isPeer(const struct sockaddr_in& address) const {
+    for (const auto& peer : peer_addresses_) {
+        if (address.sin_family == AF_INET && address.sin_port == peer.sin_port &&
+            address.sin_addr.s_addr == peer.sin_addr.s_addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PeerSync::receive(const char* data, size_t length, const struct sockaddr_in& from) {
+    datagrams_received_.add();
+    bytes_received_.add(length);
+    
+    if (!isPeer(from)) {
+        unknown_sender_.add();
+        return;
+    }
+    
+    PeerSyncHeader header;
+    if (length < sizeof(header)) {
+        malformed_.add();
+        return;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != kPeerSyncMagic || header.version != kPeerSyncVersion ||
+        length != sizeof(header) + header.counter_count * sizeof(PeerCounter) +
+                  header.impression_count * sizeof(PeerImpression)) {
+        malformed_.add();
+        return;
+    }
+    // A peer list that names this engine itself
+    if (header.sender == replica_id_) {
+        return;
+    }
+    last_seen_[header.sender] = Clock::now();
+    
+    const char* records = data + sizeof(header);
+    if (budgets_) {
+        for (size_t i = 0; i < header.counter_count; ++i) {
+            PeerCounter counter;
+            std::memcpy(&counter, records + i * sizeof(PeerCounter), sizeof(counter));
+            if (budgets_->merge(counter)) {
+                counters_merged_.add();
+            }
+        }
+    }
+    records += header.counter_count * sizeof(PeerCounter);
+    if (frequency_caps_) {
+        for (size_t i = 0; i < header.impression_count; ++i) {
+            PeerImpression impression;
+            std::memcpy(&impression, records + i * sizeof(PeerImpression), sizeof(impression));
+            frequency_caps_->recordHashed(impression.pair_hash, impression.impressions);
+            impressions_applied_.add(impression.impressions);
+        }
+    }
+}
+
+void PeerSync::runRound(bool full, double elapsed_seconds) {
+    rounds_.add();
+    
+    auto now = Clock::now();
+    auto timeout = std::chrono::milliseconds(config_.peer_timeout_ms);
+    std::unordered_set<uint64_t> live;
+    for (auto it = last_seen_.begin(); it != last_seen_.end();) {
+        if (now - it->second > timeout) {
+            it = last_seen_.erase(it);
+        } else {
+            live.insert(it->first);
+            ++it;
+        }
+    }
+    live_peers_.store(live.size(), std::memory_order_relaxed);
+    
+    // Counters go first, since a lost impression costs less than a stale
+    // lease; impressions fill what is left of this round's datagrams
+    std::vector<PeerCounter> counters;
+    if (budgets_) {
+        budgets_->rebalance(live, elapsed_seconds);
+        budgets_->takeCounters(counters, config_.max_datagrams_per_round * kCountersPerDatagram, full);
+    }
+    
+    std::vector<std::vector<char>> datagrams;
+    size_t next_counter = 0;
+    bool impressions_left = true;
+    do {
+        PeerSyncHeader header;
+        header.magic = kPeerSyncMagic;
+        header.version = kPeerSyncVersion;
+        header.reserved = 0;
+        header.sender = replica_id_;
+        header.reserved2 = 0;
+        
+        size_t counter_count = std::min(counters.size() - next_counter, kCountersPerDatagram);
+        std::vector<char> datagram(sizeof(header) + counter_count * sizeof(PeerCounter));
+        std::memcpy(datagram.data() + sizeof(header), counters.data() + next_counter,
+                    counter_count * sizeof(PeerCounter));
+        next_counter += counter_count;
+        
+        size_t impression_count = 0;
+        size_t room = (kPayloadBytes - counter_count * sizeof(PeerCounter)) / sizeof(PeerImpression);
+        PeerImpression impression;
+        while (impressions_left && impression_count < room) {
+            if (!impressions_.pop(impression)) {
+                impressions_left = false;
+                break;
+            }
+            const char* bytes = reinterpret_cast<const char*>(&impression);
+            datagram.insert(datagram.end(), bytes, bytes + sizeof(impression));
+            impressions_sent_.add(impression.impressions);
+            ++impression_count;
+        }
+        
+        header.counter_count = static_cast<uint16_t>(counter_count);
+        header.impression_count = static_cast<uint16_t>(impression_count);
+        std::memcpy(datagram.data(), &header, sizeof(header));
+        datagrams.push_back(std::move(datagram));
+    } while ((next_counter < counters.size() || impressions_left) &&
+             datagrams.size() < config_.max_datagrams_per_round);
+    counters_sent_.add(next_counter);
+    
+    for (const auto& address : peer_addresses_) {
+        for (const auto& datagram : datagrams) {
+            ssize_t sent = sendto(fd_, datagram.data(), datagram.size(), MSG_DONTWAIT,
+                                  (const struct sockaddr*)&address, sizeof(address));
+            if (sent < 0) {
+                send_errors_.add();
+                continue;
+            }
+            datagrams_sent_.add();
+            bytes_sent_.add(sent);
+        }
+    }
+}
+
+std::string PeerSync::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_peer_sync_live_peers Peers heard from within the peer timeout\n";
+    oss << "# TYPE bidding_peer_sync_live_peers gauge\n";
+    oss << "bidding_peer_sync_live_peers " << live_peers_.load() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_rounds_total Sync rounds run\n";
+    oss << "# TYPE bidding_peer_sync_rounds_total counter\n";
+    oss << "bidding_peer_sync_rounds_total " << rounds_.value() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_datagrams_total Sync datagrams by direction\n";
+    oss << "# TYPE bidding_peer_sync_datagrams_total counter\n";
+    oss << "bidding_peer_sync_datagrams_total{direction=\"sent\"} " << datagrams_sent_.value() << "\n";
+    oss << "bidding_peer_sync_datagrams_total{direction=\"received\"} " << datagrams_received_.value() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_bytes_total Sync payload bytes by direction\n";
+    oss << "# TYPE bidding_peer_sync_bytes_total counter\n";
+    oss << "bidding_peer_sync_bytes_total{direction=\"sent\"} " << bytes_sent_.value() << "\n";
+    oss << "bidding_peer_sync_bytes_total{direction=\"received\"} " << bytes_received_.value() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_errors_total Sync datagrams that failed to send or parse, or were not from a peer\n";
+    oss << "# TYPE bidding_peer_sync_errors_total counter\n";
+    oss << "bidding_peer_sync_errors_total{reason=\"send\"} " << send_errors_.value() << "\n";
+    oss << "bidding_peer_sync_errors_total{reason=\"malformed\"} " << malformed_.value() << "\n";
+    oss << "bidding_peer_sync_errors_total{reason=\"unknown_sender\"} " << unknown_sender_.value() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_counters_total Budget counters sent, and received ones that raised our view\n";
+    oss << "# TYPE bidding_peer_sync_counters_total counter\n";
+    oss << "bidding_peer_sync_counters_total{result=\"sent\"} " << counters_sent_.value() << "\n";
+    oss << "bidding_peer_sync_counters_total{result=\"merged\"} " << counters_merged_.value() << "\n";
+    
+    oss << "# HELP bidding_peer_sync_impressions_total Frequency cap impressions replicated\n";
+    oss << "# TYPE bidding_peer_sync_impressions_total counter\n";
+    oss << "bidding_peer_sync_impressions_total{result=\"sent\"} " << impressions_sent_.value() << "\n";
+    oss << "bidding_peer_sync_impressions_total{result=\"applied\"} " << impressions_applied_.value() << "\n";
+    oss << "bidding_peer_sync_impressions_total{result=\"dropped\"} " << impressions_dropped_.value() << "\n";
+    
+    return oss.str();
+}
@@ -0,0 +1,501 @@
+#include "pricing_model.h"
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kSimdWidth = 8;
+constexpr uint64_t kHashSeed = 0x9e3779b97f4a7c15ULL;
+constexpr uint64_t kHashMultiplier = 0xff51afd7ed558ccdULL;
+
+// Eight bytes per step; targeting keys and values are short, so this is a
+// couple of multiplies where a byte-wise hash would take a dozen
+uint64_t hashString(const std::string& s, uint64_t hash = kHashSeed) {
+    const char* data = s.data();
+    size_t length = s.size();
+    hash ^= length * kHashMultiplier;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        hash = (hash ^ word) * kHashMultiplier;
+        hash ^= hash >> 29;
+    }
+    // Tail without a variable-length memcpy call: two overlapping 4-byte
+    // loads, or first/middle/last byte below four
+    if (length >= 4) {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + length - 4, 4);
+        hash = (hash ^ (uint64_t(high) << 32 | low)) * kHashMultiplier;
+        hash ^= hash >> 29;
+    } else if (length > 0) {
+        uint64_t word = uint64_t(uint8_t(data[0])) << 16 | uint64_t(uint8_t(data[length / 2])) << 8 |
+                        uint8_t(data[length - 1]);
+        hash = (hash ^ word) * kHashMultiplier;
+        hash ^= hash >> 29;
+    }
+    return hash ^ (hash >> 32);
+}
+
+// Hash of key=value, seeded with the key's hash
+uint64_t valueHash(uint64_t key_hash, const std::string& value) {
+    return hashString(value, key_hash ^ kHashSeed);
+}
+
+size_t internalNodes(unsigned depth) {
+    return (size_t(1) << depth) - 1;
+}
+
+// Branch-free walk from the root; returns the leaf's index within its tree
+inline size_t leafIndex(const PricingModel::Split* splits, unsigned depth, const float* row) {
+    size_t node = 0;
+    for (unsigned level = 0; level < depth; ++level) {
+        const PricingModel::Split& split = splits[node];
+        node = 2 * node + 1 + (row[split.feature] > split.threshold);
+    }
+    return node - internalNodes(depth);
+}
+
+// Re-lays a level-order tree of depth `from` as depth `to`. Below the old
+// leaves every split always goes left (nothing is greater than +inf) and
+// all leaves under an old leaf carry its value.
+void padTree(unsigned from, unsigned to, std::vector<PricingModel::Split>& splits, std::vector<float>& leaves) {
+    std::vector<PricingModel::Split> padded_splits(internalNodes(to), {0, std::numeric_limits<float>::infinity()});
+    std::copy(splits.begin(), splits.end(), padded_splits.begin());
+    std::vector<float> padded_leaves(size_t(1) << to);
+    for (size_t i = 0; i < padded_leaves.size(); ++i) {
+        padded_leaves[i] = leaves[i >> (to - from)];
+    }
+    splits.swap(padded_splits);
+    leaves.swap(padded_leaves);
+}
+
+}
+
+PricingModel::PricingModel()
+    : feature_count_(0)
+    , row_stride_(0)
+    , floor_price_column_(-1)
+    , targeting_count_column_(-1)
+    , keys_(16)
+    , values_(16)
+    , key_count_(0)
+    , value_count_(0)
+    , bias_(0.0f)
+    , has_linear_(false)
+    , depth_(0)
+    , tree_count_(0)
+    , min_shade_(0.5f)
+    , max_shade_(1.0f)
+    , target_win_rate_(0.0f)
+    , feedback_gain_(0.0f)
+    , feedback_min_notices_(0)
+{
+}
+
+std::unique_ptr<PricingModel> PricingModel::loadFile(const std::string& path) {
+    YAML::Node root;
+    try {
+        root = YAML::LoadFile(path);
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Cannot load pricing model " + path + ": " + e.what());
+    }
+    
+    auto model = std::make_unique<PricingModel>();
+    try {
+        for (const auto& feature : root["features"]) {
+            if (feature["numeric"]) {
+                std::string name = feature["numeric"].as<std::string>();
+                if (name == "floor_price") {
+                    model->addFloorPriceFeature();
+                } else if (name == "targeting_count") {
+                    model->addTargetingCountFeature();
+                } else {
+                    throw std::runtime_error("unknown numeric feature '" + name + "'");
+                }
+            } else if (feature["key"] && feature["equals"]) {
+                model->addKeyValueFeature(feature["key"].as<std::string>(), feature["equals"].as<std::string>());
+            } else if (feature["key"]) {
+                model->addKeyFeature(feature["key"].as<std::string>());
+            } else {
+                throw std::runtime_error("feature needs 'numeric' or 'key'");
+            }
+        }
+        
+        if (root["bias"] || root["weights"]) {
+            float bias = root["bias"] ? root["bias"].as<float>() : 0.0f;
+            std::vector<float> weights;
+            if (root["weights"]) {
+                weights = root["weights"].as<std::vector<float>>();
+            }
+            model->setLinear(bias, weights);
+        }
+        
+        for (const auto& tree : root["trees"]) {
+            unsigned depth = tree["depth"].as<unsigned>();
+            std::vector<Split> splits;
+            for (const auto& node : tree["splits"]) {
+                splits.push_back({node[0].as<uint32_t>(), node[1].as<float>()});
+            }
+            model->addTree(depth, splits, tree["leaves"].as<std::vector<float>>());
+        }
+        
+        if (root["shade"]) {
+            model->setShadeRange(root["shade"]["min"].as<float>(), root["shade"]["max"].as<float>());
+        }
+        
+        if (root["feedback"]) {
+            const auto& feedback = root["feedback"];
+            model->setWinRateFeedback(feedback["target_win_rate"].as<float>(), feedback["gain"].as<float>(),
+                                      feedback["min_notices"] ? feedback["min_notices"].as<uint64_t>() : 100);
+        }
+    } catch (const YAML::Exception& e) {
+        throw std::runtime_error("Invalid pricing model " + path + ": " + e.what());
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("Invalid pricing model " + path + ": " + e.what());
+    }
+    
+    if (!model->has_linear_ && model->tree_count_ == 0) {
+        throw std::runtime_error("Invalid pricing model " + path + ": no weights or trees");
+    }
+    return model;
+}
+
+size_t PricingModel::addColumn() {
+    if (feature_count_ == kMaxFeatures) {
+        throw std::runtime_error("more than " + std::to_string(kMaxFeatures) + " features");
+    }
+    size_t column = feature_count_++;
+    row_stride_ = (feature_count_ + kSimdWidth - 1) / kSimdWidth * kSimdWidth;
+    weights_.resize(row_stride_, 0.0f);
+    return column;
+}
+
+size_t PricingModel::addFloorPriceFeature() {
+    if (floor_price_column_ >= 0) {
+        throw std::runtime_error("duplicate feature floor_price");
+    }
+    floor_price_column_ = static_cast<int32_t>(addColumn());
+    return floor_price_column_;
+}
+
+size_t PricingModel::addTargetingCountFeature() {
+    if (targeting_count_column_ >= 0) {
+        throw std::runtime_error("duplicate feature targeting_count");
+    }
+    targeting_count_column_ = static_cast<int32_t>(addColumn());
+    return targeting_count_column_;
+}
+
+size_t PricingModel::addKeyFeature(const std::string& key) {
+    KeyEntry& entry = internKey(key);
+    if (entry.present_column >= 0) {
+        throw std::runtime_error("duplicate feature key " + key);
+    }
+    entry.present_column = static_cast<int32_t>(addColumn());
+    return entry.present_column;
+}
+
+size_t PricingModel::addKeyValueFeature(const std::string& key, const std::string& value) {
+    uint64_t hash = valueHash(hashString(key), value);
+    if (findValue(hash, key, value)) {
+        throw std::runtime_error("duplicate feature " + key + "=" + value);
+    }
+    internKey(key).has_values = true;
+    size_t column = addColumn();
+    
+    if (2 * (value_count_ + 1) > values_.size()) {
+        rehash();
+    }
+    size_t mask = values_.size() - 1;
+    size_t slot = hash & mask;
+    while (!values_[slot].key.empty()) {
+        slot = (slot + 1) & mask;
+    }
+    values_[slot] = {hash, key, value, static_cast<uint32_t>(column)};
+    ++value_count_;
+    return column;
+}
+
+PricingModel::KeyEntry& PricingModel::internKey(const std::string& key) {
+    if (key.empty()) {
+        throw std::runtime_error("empty targeting key");
+    }
+    uint64_t hash = hashString(key);
+    if (const KeyEntry* existing = findKey(hash, key)) {
+        return const_cast<KeyEntry&>(*existing);
+    }
+    if (2 * (key_count_ + 1) > keys_.size()) {
+        rehash();
+    }
+    size_t mask = keys_.size() - 1;
+    size_t slot = hash & mask;
+    while (!keys_[slot].key.empty()) {
+        slot = (slot + 1) & mask;
+    }
+    keys_[slot] = {hash, key, -1, false};
+    ++key_count_;
+    return keys_[slot];
+}
+
+void PricingModel::rehash() {
+    std::vector<KeyEntry> old_keys(keys_.size() * 2);
+    old_keys.swap(keys_);
+    for (auto& entry : old_keys) {
+        if (entry.key.empty()) {
+            continue;
+        }
+        size_t slot = entry.hash & (keys_.size() - 1);
+        while (!keys_[slot].key.empty()) {
+            slot = (slot + 1) & (keys_.size() - 1);
+        }
+        keys_[slot] = std::move(entry);
+    }
+    
+    std::vector<ValueEntry> old_values(values_.size() * 2);
+    old_values.swap(values_);
+    for (auto& entry : old_values) {
+        if (entry.key.empty()) {
+            continue;
+        }
+        size_t slot = entry.hash & (values_.size() - 1);
+        while (!values_[slot].key.empty()) {
+            slot = (slot + 1) & (values_.size() - 1);
+        }
+        values_[slot] = std::move(entry);
+    }
+}
+
+const PricingModel::KeyEntry* PricingModel::findKey(uint64_t hash, const std::string& key) const {
+    size_t mask = keys_.size() - 1;
+    for (size_t slot = hash & mask; !keys_[slot].key.empty(); slot = (slot + 1) & mask) {
+        if (keys_[slot].hash == hash && keys_[slot].key == key) {
+            return &keys_[slot];
+        }
+    }
+    return nullptr;
+}
+
+const PricingModel::ValueEntry* PricingModel::findValue(uint64_t hash, const std::string& key,
+                                                        const std::string& value) const {
+    size_t mask = values_.size() - 1;
+    for (size_t slot = hash & mask; !values_[slot].key.empty(); slot = (slot + 1) & mask) {
+        const ValueEntry& entry = values_[slot];
+        if (entry.hash == hash && entry.key == key && entry.value == value) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void PricingModel::setLinear(float bias, const std::vector<float>& weights) {
+    if (weights.size() > feature_count_) {
+        throw std::runtime_error(std::to_string(weights.size()) + " weights for " +
+                                 std::to_string(feature_count_) + " features");
+    }
+    bias_ = bias;
+    std::fill(weights_.begin(), weights_.end(), 0.0f);
+    std::copy(weights.begin(), weights.end(), weights_.begin());
+    has_linear_ = true;
+}
+
+void PricingModel::addTree(unsigned depth, const std::vector<Split>& splits, const std::vector<float>& leaves) {
+    if (depth == 0 || depth > kMaxDepth) {
+        throw std::runtime_error("tree depth must be 1-" + std::to_string(kMaxDepth));
+    }
+    if (splits.size() != internalNodes(depth) || leaves.size() != (size_t(1) << depth)) {
+        throw std::runtime_error("a depth " + std::to_string(depth) + " tree needs " +
+                                 std::to_string(internalNodes(depth)) + " splits and " +
+                                 std::to_string(size_t(1) << depth) + " leaves");
+    }
+    for (const auto& split : splits) {
+        if (split.feature >= feature_count_) {
+            throw std::runtime_error("split on unknown feature " + std::to_string(split.feature));
+        }
+    }
+    
+    // Every tree shares the deepest tree's layout
+    if (depth > depth_ && tree_count_ > 0) {
+        std::vector<Split> splits_out;
+        std::vector<float> leaves_out;
+        for (size_t t = 0; t < tree_count_; ++t) {
+            std::vector<Split> tree_splits(splits_.begin() + t * internalNodes(depth_),
+                                           splits_.begin() + (t + 1) * internalNodes(depth_));
+            std::vector<float> tree_leaves(leaves_.begin() + (t << depth_), leaves_.begin() + ((t + 1) << depth_));
+            padTree(depth_, depth, tree_splits, tree_leaves);
+            splits_out.insert(splits_out.end(), tree_splits.begin(), tree_splits.end());
+            leaves_out.insert(leaves_out.end(), tree_leaves.begin(), tree_leaves.end());
+        }
+        splits_.swap(splits_out);
+        leaves_.swap(leaves_out);
+    }
+    depth_ = std::max(depth_, depth);
+    
+    std::vector<Split> tree_splits = splits;
+    std::vector<float> tree_leaves = leaves;
+    if (depth < depth_) {
+        padTree(depth, depth_, tree_splits, tree_leaves);
+    }
+    splits_.insert(splits_.end(), tree_splits.begin(), tree_splits.end());
+    leaves_.insert(leaves_.end(), tree_leaves.begin(), tree_leaves.end());
+    ++tree_count_;
+}
+
+void PricingModel::setShadeRange(float min_shade, float max_shade) {
+    if (!(min_shade > 0.0f && min_shade <= max_shade && max_shade <= 1.0f)) {
+        throw std::runtime_error("shade range must satisfy 0 < min <= max <= 1");
+    }
+    min_shade_ = min_shade;
+    max_shade_ = max_shade;
+}
+
+void PricingModel::setWinRateFeedback(float target_win_rate, float gain, uint64_t min_notices) {
+    if (!(target_win_rate > 0.0f && target_win_rate < 1.0f) || gain < 0.0f) {
+        throw std::runtime_error("feedback needs 0 < target_win_rate < 1 and gain >= 0");
+    }
+    target_win_rate_ = target_win_rate;
+    feedback_gain_ = gain;
+    feedback_min_notices_ = std::max<uint64_t>(min_notices, 1);
+}
+
+void PricingModel::extract(double floor_price, const TargetingMap& targeting, float* row) const {
+    std::memset(row, 0, row_stride_ * sizeof(float));
+    if (floor_price_column_ >= 0) {
+        row[floor_price_column_] = static_cast<float>(floor_price);
+    }
+    if (targeting_count_column_ >= 0) {
+        row[targeting_count_column_] = static_cast<float>(targeting.size());
+    }
+    
+    for (const auto& entry : targeting) {
+        uint64_t hash = hashString(entry.first);
+        const KeyEntry* key = findKey(hash, entry.first);
+        if (!key) {
+            continue;
+        }
+        if (key->present_column >= 0) {
+            row[key->present_column] = 1.0f;
+        }
+        if (key->has_values) {
+            const ValueEntry* value = findValue(valueHash(hash, entry.second), entry.first, entry.second);
+            if (value) {
+                row[value->column] = 1.0f;
+            }
+        }
+    }
+}
+
+void PricingModel::extractSlots(const double* floor_prices, size_t count, const TargetingMap& targeting,
+                                float* rows) const {
+    if (count == 0) {
+        return;
+    }
+    extract(floor_prices[0], targeting, rows);
+    for (size_t r = 1; r < count; ++r) {
+        float* row = rows + r * row_stride_;
+        std::memcpy(row, rows, row_stride_ * sizeof(float));
+        if (floor_price_column_ >= 0) {
+            row[floor_price_column_] = static_cast<float>(floor_prices[r]);
+        }
+    }
+}
+
+float PricingModel::linear(const float* row) const {
+    const float* weights = weights_.data();
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 sum = _mm256_setzero_ps();
+    for (size_t i = 0; i < row_stride_; i += kSimdWidth) {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(row + i), _mm256_loadu_ps(weights + i), sum);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    return bias_ + _mm_cvtss_f32(half);
+#else
+    float sum = 0.0f;
+    for (size_t i = 0; i < row_stride_; ++i) {
+        sum += row[i] * weights[i];
+    }
+    return bias_ + sum;
+#endif
+}
+
+float PricingModel::toShade(float logit) const {
+    float win_rate = 1.0f / (1.0f + std::exp(-logit));
+    return min_shade_ + (max_shade_ - min_shade_) * win_rate;
+}
+
+float PricingModel::shade(const float* row) const {
+    float logit = has_linear_ ? linear(row) : 0.0f;
+    
+    size_t nodes = internalNodes(depth_);
+    const Split* splits = splits_.data();
+    const float* leaves = leaves_.data();
+    for (size_t t = 0; t < tree_count_; ++t) {
+        logit += leaves[leafIndex(splits, depth_, row)];
+        splits += nodes;
+        leaves += nodes + 1;
+    }
+    return toShade(logit);
+}
+
+void PricingModel::shadeBatch(const float* rows, size_t count, float* shades) const {
+    constexpr size_t kLanes = 8;
+    for (size_t r = 0; r < count; ++r) {
+        shades[r] = has_linear_ ? linear(rows + r * row_stride_) : 0.0f;
+    }
+    
+    size_t nodes = internalNodes(depth_);
+    const Split* splits = splits_.data();
+    const float* leaves = leaves_.data();
+    for (size_t t = 0; t < tree_count_; ++t) {
+        size_t r = 0;
+        // Eight rows descend level by level together, so their dependent
+        // loads overlap instead of serializing one walk after another
+        for (; r + kLanes <= count; r += kLanes) {
+            size_t node[kLanes] = {};
+            for (unsigned level = 0; level < depth_; ++level) {
+                for (size_t k = 0; k < kLanes; ++k) {
+                    const Split& split = splits[node[k]];
+                    node[k] = 2 * node[k] + 1 + (rows[(r + k) * row_stride_ + split.feature] > split.threshold);
+                }
+            }
+            for (size_t k = 0; k < kLanes; ++k) {
+                shades[r + k] += leaves[node[k] - nodes];
+            }
+        }
+        for (; r < count; ++r) {
+            shades[r] += leaves[leafIndex(splits, depth_, rows + r * row_stride_)];
+        }
+        splits += nodes;
+        leaves += nodes + 1;
+    }
+    
+    for (size_t r = 0; r < count; ++r) {
+        shades[r] = toShade(shades[r]);
+    }
+}
+
+float PricingModel::adjustShade(float shade, const CampaignOutcome& outcome) const {
+    if (feedback_gain_ == 0.0f || outcome.notices < feedback_min_notices_) {
+        return shade;
+    }
+    float error = target_win_rate_ - static_cast<float>(outcome.winRate());
+    return std::min(std::max(shade + feedback_gain_ * error, min_shade_), max_shade_);
+}
+
+double PricingModel::price(double bid_amount, const bidding::BidRequest& request,
+                           const CampaignOutcome* outcome) const {
+    alignas(32) float row[kMaxFeatures];
+    extract(request.floor_price(), request.targeting(), row);
+    float shaded = outcome ? adjustShade(shade(row), *outcome) : shade(row);
+    return std::max(bid_amount * shaded, request.floor_price());
+}
@@ -0,0 +1,313 @@
+#include "profiler.h"
+#include "stats.h"
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<Profiler::Session*> Profiler::current_(nullptr);
+std::atomic<int> Profiler::in_flight_(0);
+std::atomic<uint64_t> Profiler::session_dropped_(0);
+std::atomic<bool> Profiler::off_cpu_active_(false);
+
+namespace {
+
+// Constant-initialized, so safe to touch from the signal handler
+thread_local size_t t_buffer_index = SIZE_MAX;
+std::atomic<size_t> g_next_buffer_index(0);
+
+size_t bufferIndex() {
+    if (t_buffer_index == SIZE_MAX) {
+        t_buffer_index = g_next_buffer_index.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t_buffer_index;
+}
+
+std::string symbolize(void* address) {
+    Dl_info info;
+    if (dladdr(address, &info) == 0) {
+        std::ostringstream oss;
+        oss << "0x" << std::hex << reinterpret_cast<uintptr_t>(address);
+        return oss.str();
+    }
+    if (info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name;
+    }
+    std::string module = info.dli_fname ? info.dli_fname : "?";
+    size_t slash = module.rfind('/');
+    if (slash != std::string::npos) {
+        module = module.substr(slash + 1);
+    }
+    std::ostringstream oss;
+    oss << module << "+0x" << std::hex
+        << reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+    return oss.str();
+}
+
+}
+
+Profiler::Profiler(const ProfilerConfig& config)
+    : config_(config)
+    , session_running_(false)
+    , stopped_(false)
+    , sessions_(0)
+    , samples_(0)
+    , dropped_(0)
+{
+    if (config_.frequency_hz == 0) {
+        config_.frequency_hz = 1;
+    }
+    
+    // The first backtrace() loads the unwinder, which allocates; do it here
+    // rather than inside the signal handler
+    void* warmup[4];
+    backtrace(warmup, 4);
+    
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = signalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) < 0) {
+        throw std::runtime_error("Failed to install SIGPROF handler: " + std::string(std::strerror(errno)));
+    }
+}
+
+Profiler::~Profiler() {
+    shutdown();
+    // The handler stays installed: a SIGPROF still in flight would
+    // otherwise kill the process
+}
+
+ProfileMode Profiler::parseMode(const std::string& name) {
+    if (name == "offcpu" || name == "off_cpu" || name == "off-cpu") {
+        return ProfileMode::OFF_CPU;
+    }
+    return ProfileMode::CPU;
+}
+
+const char* Profiler::modeName(ProfileMode mode) {
+    return mode == ProfileMode::OFF_CPU ? "offcpu" : "cpu";
+}
+
+std::string Profiler::profile(ProfileMode mode, std::chrono::milliseconds duration) {
+    bool expected = false;
+    if (!session_running_.compare_exchange_strong(expected, true)) {
+        throw std::runtime_error("A profiling session is already running");
+    }
+    duration = std::min<std::chrono::milliseconds>(duration, std::chrono::seconds(config_.max_seconds));
+    
+    Session session;
+    session.mode = mode;
+    session.buffer_count = stats::slotCount();
+    session.per_buffer = std::max<size_t>(1, config_.max_samples / session.buffer_count);
+    session.buffers.reset(new ThreadBuffer[session.buffer_count]);
+    for (size_t i = 0; i < session.buffer_count; ++i) {
+        session.buffers[i].samples.reset(new Sample[session.per_buffer]);
+    }
+    session_dropped_.store(0);
+    current_.store(&session);
+    
+    bool armed = true;
+    if (mode == ProfileMode::CPU) {
+        struct itimerval timer;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_usec = std::max<long>(1, 1000000 / config_.frequency_hz);
+        timer.it_value = timer.it_interval;
+        armed = setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+    } else {
+        off_cpu_active_.store(true);
+    }
+    
+    if (armed) {
+        std::unique_lock<std::mutex> lock(session_mutex_);
+        session_cv_.wait_for(lock, duration, [this] { return stopped_; });
+    }
+    
+    if (mode == ProfileMode::CPU) {
+        struct itimerval timer;
+        std::memset(&timer, 0, sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, nullptr);
+    } else {
+        off_cpu_active_.store(false);
+    }
+    // Samples being written finish before the buffers are read
+    current_.store(nullptr);
+    while (in_flight_.load() != 0) {
+        std::this_thread::yield();
+    }
+    
+    if (!armed) {
+        session_running_.store(false);
+        throw std::runtime_error("Failed to start profiling timer: " + std::string(std::strerror(errno)));
+    }
+    
+    std::string folded = fold(session);
+    sessions_.fetch_add(1);
+    dropped_.fetch_add(session_dropped_.load());
+    session_running_.store(false);
+    return folded;
+}
+
+void Profiler::shutdown() {
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    stopped_ = true;
+    session_cv_.notify_all();
+}
+
+__attribute__((noinline)) void Profiler::signalHandler(int) {
+    int saved_errno = errno;
+    // Frames: record, this handler, the kernel's signal trampoline
+    record(3, 1, nullptr);
+    errno = saved_errno;
+}
+
+__attribute__((noinline)) void Profiler::recordBlocked(const char* site, std::chrono::nanoseconds waited) {
+    // Frames: record, this function, the mutex's contended path
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+    record(3, std::max<uint64_t>(1, micros), site);
+}
+
+__attribute__((noinline)) void Profiler::record(int skip, uint64_t weight, const char* site) {
+    in_flight_.fetch_add(1);
+    Session* session = current_.load();
+    if (!session) {
+        in_flight_.fetch_sub(1);
+        return;
+    }
+    
+    ThreadBuffer& buffer = session->buffers[bufferIndex() & (session->buffer_count - 1)];
+    size_t index = buffer.next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= session->per_buffer) {
+        session_dropped_.fetch_add(1, std::memory_order_relaxed);
+        in_flight_.fetch_sub(1);
+        return;
+    }
+    
+    void* frames[kMaxFrames + 4];
+    int depth = backtrace(frames, kMaxFrames + 4);
+    skip = std::min(skip, depth);
+    Sample& sample = buffer.samples[index];
+    sample.weight = weight;
+    sample.site = site;
+    sample.depth = std::min(depth - skip, kMaxFrames);
+    std::memcpy(sample.frames, frames + skip, sample.depth * sizeof(void*));
+    in_flight_.fetch_sub(1);
+}
+
+std::string Profiler::fold(const Session& session) {
+    std::unordered_map<void*, std::string> symbols;
+    std::map<std::string, uint64_t> stacks;
+    uint64_t sample_count = 0;
+    
+    for (size_t b = 0; b < session.buffer_count; ++b) {
+        const ThreadBuffer& buffer = session.buffers[b];
+        size_t count = std::min(buffer.next.load(), session.per_buffer);
+        for (size_t i = 0; i < count; ++i) {
+            const Sample& sample = buffer.samples[i];
+            std::string stack;
+            for (int f = sample.depth - 1; f >= 0; --f) {
+                // Callers are return addresses; step back into the call so
+                // the line belongs to the calling function. A CPU sample's
+                // leaf is the interrupted instruction itself.
+                char* address = static_cast<char*>(sample.frames[f]);
+                bool exact = f == 0 && session.mode == ProfileMode::CPU;
+                void* lookup = exact ? address : address - 1;
+                auto it = symbols.find(lookup);
+                if (it == symbols.end()) {
+                    it = symbols.emplace(lookup, symbolize(lookup)).first;
+                }
+                if (!stack.empty()) {
+                    stack += ';';
+                }
+                stack += it->second;
+            }
+            if (sample.site) {
+                stack += stack.empty() ? "" : ";";
+                stack += std::string("[blocked on ") + sample.site + "]";
+            }
+            if (stack.empty()) {
+                stack = "[unknown]";
+            }
+            stacks[stack] += sample.weight;
+            ++sample_count;
+        }
+    }
+    samples_.fetch_add(sample_count);
+    
+    std::string folded;
+    for (const auto& stack : stacks) {
+        folded += stack.first;
+        folded += ' ';
+        folded += std::to_string(stack.second);
+        folded += '\n';
+    }
+    return folded;
+}
+
+std::string Profiler::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_profiler_active Whether a profiling session is running\n";
+    oss << "# TYPE bidding_profiler_active gauge\n";
+    oss << "bidding_profiler_active " << (session_running_.load() ? 1 : 0) << "\n";
+    
+    oss << "# HELP bidding_profiler_sessions_total Profiling sessions completed\n";
+    oss << "# TYPE bidding_profiler_sessions_total counter\n";
+    oss << "bidding_profiler_sessions_total " << sessions_.load() << "\n";
+    
+    oss << "# HELP bidding_profiler_samples_total Stacks sampled across sessions\n";
+    oss << "# TYPE bidding_profiler_samples_total counter\n";
+    oss << "bidding_profiler_samples_total " << samples_.load() << "\n";
+    
+    oss << "# HELP bidding_profiler_dropped_samples_total Samples dropped for a full thread buffer\n";
+    oss << "# TYPE bidding_profiler_dropped_samples_total counter\n";
+    oss << "bidding_profiler_dropped_samples_total " << dropped_.load() << "\n";
+    
+    return oss.str();
+}
+
+__attribute__((noinline)) void ProfiledMutex::lockContended() {
+    if (!Profiler::offCpuActive()) {
+        mutex_.lock();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    Profiler::recordBlocked(site_, std::chrono::steady_clock::now() - start);
+}
+
+__attribute__((noinline)) void ProfiledSharedMutex::lockContended() {
+    if (!Profiler::offCpuActive()) {
+        mutex_.lock();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    Profiler::recordBlocked(site_, std::chrono::steady_clock::now() - start);
+}
+
+__attribute__((noinline)) void ProfiledSharedMutex::lockSharedContended() {
+    if (!Profiler::offCpuActive()) {
+        mutex_.lock_shared();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    mutex_.lock_shared();
+    Profiler::recordBlocked(site_, std::chrono::steady_clock::now() - start);
+}
@@ -0,0 +1,254 @@
+#include "qos_scheduler.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+QosScheduler::QosScheduler(const QosConfig& config)
+    : concurrency_(std::max<size_t>(config.concurrency, 1))
+    , max_wait_(config.max_wait_us)
+    , unix_class_(SIZE_MAX)
+    , in_flight_(0)
+    , waiting_(0)
+    , cursor_(0)
+{
+    classes_.reserve(config.classes.size() + 1);
+    for (const auto& class_config : config.classes) {
+        size_t tenant = findOrAddClass(class_config.name, class_config.weight, class_config.max_queue);
+        for (const auto& source : class_config.sources) {
+            if (source == "unix") {
+                unix_class_ = tenant;
+                continue;
+            }
+            size_t slash = source.find('/');
+            struct in_addr address;
+            int prefix = slash == std::string::npos ? 32 : std::atoi(source.c_str() + slash + 1);
+            if (inet_pton(AF_INET, source.substr(0, slash).c_str(), &address) != 1 || prefix < 0 || prefix > 32) {
+                throw std::runtime_error("Invalid QoS source " + source + " in class " + class_config.name);
+            }
+            uint32_t mask = prefix == 0 ? 0 : ~uint32_t(0) << (32 - prefix);
+            networks_.push_back({ntohl(address.s_addr) & mask, mask, tenant});
+        }
+    }
+    default_class_ = findOrAddClass(config.default_class, 1, 1024);
+    if (unix_class_ >= classes_.size()) {
+        unix_class_ = default_class_;
+    }
+    std::stable_sort(networks_.begin(), networks_.end(),
+                     [](const Network& a, const Network& b) { return a.mask > b.mask; });
+}
+
+size_t QosScheduler::findOrAddClass(const std::string& name, unsigned weight, size_t max_queue) {
+    for (size_t i = 0; i < classes_.size(); ++i) {
+        if (classes_[i].name == name) {
+            return i;
+        }
+    }
+    classes_.emplace_back();
+    TenantClass& tenant = classes_.back();
+    tenant.name = name;
+    tenant.weight = std::max(weight, 1u);
+    tenant.max_queue = max_queue;
+    return classes_.size() - 1;
+}
+
+size_t QosScheduler::classify(int fd) const {
+    struct sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr*)&peer, &length) < 0) {
+        return default_class_;
+    }
+    if (peer.ss_family == AF_UNIX) {
+        return unix_class_;
+    }
+    if (peer.ss_family != AF_INET) {
+        return default_class_;
+    }
+    uint32_t address = ntohl(reinterpret_cast<struct sockaddr_in*>(&peer)->sin_addr.s_addr);
+    for (const auto& network : networks_) {
+        if ((address & network.mask) == network.address) {
+            return network.tenant;
+        }
+    }
+    return default_class_;
+}
+
+bool QosScheduler::acquire(size_t tenant) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    TenantClass& self = classes_[tenant];
+    if (in_flight_ < concurrency_ && waiting_ == 0) {
+        ++in_flight_;
+        ++self.admitted;
+        return true;
+    }
+    if (self.queue.size() >= self.max_queue) {
+        ++self.shed_full;
+        return false;
+    }
+    
+    Waiter waiter;
+    self.queue.push_back(&waiter);
+    ++waiting_;
+    ++self.queued;
+    if (!waiter.cv.wait_for(lock, max_wait_, [&waiter] { return waiter.granted; })) {
+        self.queue.erase(std::find(self.queue.begin(), self.queue.end(), &waiter));
+        --waiting_;
+        ++self.shed_timeout;
+        return false;
+    }
+    ++self.admitted;
+    return true;
+}
+
+QosScheduler::Admission QosScheduler::admit(size_t tenant, uint64_t key, const std::function<void()>& on_grant,
+                                            int64_t& queued_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TenantClass& self = classes_[tenant];
+    auto now = std::chrono::steady_clock::now();
+    
+    auto it = self.parked.find(key);
+    if (it != self.parked.end()) {
+        Waiter& waiter = *it->second;
+        if (waiter.granted) {
+            queued_us = std::chrono::duration_cast<std::chrono::microseconds>(now - waiter.queued_at).count();
+            self.parked.erase(it);
+            ++self.admitted;
+            return Admission::ADMITTED;
+        }
+        if (now - waiter.queued_at < max_wait_) {
+            return Admission::QUEUED;
+        }
+        self.queue.erase(std::find(self.queue.begin(), self.queue.end(), &waiter));
+        self.parked.erase(it);
+        --waiting_;
+        ++self.shed_timeout;
+        return Admission::SHED;
+    }
+    
+    if (in_flight_ < concurrency_ && waiting_ == 0) {
+        ++in_flight_;
+        ++self.admitted;
+        queued_us = 0;
+        return Admission::ADMITTED;
+    }
+    if (self.queue.size() >= self.max_queue) {
+        ++self.shed_full;
+        return Admission::SHED;
+    }
+    auto waiter = std::make_shared<Waiter>();
+    waiter->on_grant = on_grant;
+    waiter->queued_at = now;
+    self.queue.push_back(waiter.get());
+    self.parked[key] = std::move(waiter);
+    ++waiting_;
+    ++self.queued;
+    return Admission::QUEUED;
+}
+
+void QosScheduler::cancel(size_t tenant, uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TenantClass& self = classes_[tenant];
+    auto it = self.parked.find(key);
+    if (it == self.parked.end()) {
+        return;
+    }
+    if (it->second->granted) {
+        --in_flight_;
+    } else {
+        self.queue.erase(std::find(self.queue.begin(), self.queue.end(), it->second.get()));
+        --waiting_;
+    }
+    self.parked.erase(it);
+    dispatch();
+}
+
+void QosScheduler::release(size_t tenant, int64_t latency_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    classes_[tenant].latency_us.record(latency_us > 0 ? latency_us : 0);
+    --in_flight_;
+    dispatch();
+}
+
+void QosScheduler::dispatch() {
+    // Deficit round robin with every frame costing one: a class's turn
+    // grants up to weight frames, then the next class with waiters goes
+    while (in_flight_ < concurrency_ && waiting_ > 0) {
+        TenantClass& current = classes_[cursor_];
+        if (current.queue.empty()) {
+            current.deficit = 0;
+            cursor_ = (cursor_ + 1) % classes_.size();
+            continue;
+        }
+        if (current.deficit == 0) {
+            current.deficit = current.weight;
+        }
+        
+        Waiter* waiter = current.queue.front();
+        current.queue.pop_front();
+        --waiting_;
+        ++in_flight_;
+        waiter->granted = true;
+        if (waiter->on_grant) {
+            waiter->on_grant();
+        } else {
+            waiter->cv.notify_one();
+        }
+        
+        if (--current.deficit == 0 || current.queue.empty()) {
+            current.deficit = 0;
+            cursor_ = (cursor_ + 1) % classes_.size();
+        }
+    }
+}
+
+std::string QosScheduler::getPrometheusFormat() const {
+    std::ostringstream oss;
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    oss << "# HELP bidding_qos_in_flight Frames being scored, across classes\n";
+    oss << "# TYPE bidding_qos_in_flight gauge\n";
+    oss << "bidding_qos_in_flight " << in_flight_ << "\n";
+    
+    oss << "# HELP bidding_qos_queue_depth Frames waiting for a scoring slot\n";
+    oss << "# TYPE bidding_qos_queue_depth gauge\n";
+    for (const auto& tenant : classes_) {
+        oss << "bidding_qos_queue_depth{class=\"" << tenant.name << "\"} " << tenant.queue.size() << "\n";
+    }
+    
+    oss << "# HELP bidding_qos_admitted_total Frames given a scoring slot\n";
+    oss << "# TYPE bidding_qos_admitted_total counter\n";
+    for (const auto& tenant : classes_) {
+        oss << "bidding_qos_admitted_total{class=\"" << tenant.name << "\"} " << tenant.admitted << "\n";
+    }
+    
+    oss << "# HELP bidding_qos_queued_total Frames that had to wait for a slot\n";
+    oss << "# TYPE bidding_qos_queued_total counter\n";
+    for (const auto& tenant : classes_) {
+        oss << "bidding_qos_queued_total{class=\"" << tenant.name << "\"} " << tenant.queued << "\n";
+    }
+    
+    oss << "# HELP bidding_qos_shed_total Frames answered \"throttled\" without scoring\n";
+    oss << "# TYPE bidding_qos_shed_total counter\n";
+    for (const auto& tenant : classes_) {
+        oss << "bidding_qos_shed_total{class=\"" << tenant.name << "\",reason=\"queue_full\"} "
+            << tenant.shed_full << "\n";
+        oss << "bidding_qos_shed_total{class=\"" << tenant.name << "\",reason=\"timeout\"} "
+            << tenant.shed_timeout << "\n";
+    }
+    
+    oss << "# HELP bidding_qos_latency_us Frame latency from arrival to response, queueing included\n";
+    oss << "# TYPE bidding_qos_latency_us summary\n";
+    for (const auto& tenant : classes_) {
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            oss << "bidding_qos_latency_us{class=\"" << tenant.name << "\",quantile=\"" << quantile << "\"} "
+                << tenant.latency_us.valueAtPercentile(quantile * 100.0) << "\n";
+        }
+        oss << "bidding_qos_latency_us_count{class=\"" << tenant.name << "\"} " << tenant.latency_us.count() << "\n";
+    }
+    
+    return oss.str();
+}
@@ -0,0 +1,218 @@
+#include "request_capture.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+constexpr size_t kWriteBatchBytes = 1 << 20;
+
+size_t roundUpPowerOfTwo(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+RequestCapture::RequestCapture(const std::string& path, size_t ring_slots, size_t max_frame_bytes)
+    : path_(path)
+    , capacity_(roundUpPowerOfTwo(ring_slots))
+    , mask_(capacity_ - 1)
+    , max_frame_bytes_(max_frame_bytes)
+    , slot_stride_((sizeof(SlotHeader) + max_frame_bytes + 63) & ~size_t(63))
+    , slots_(nullptr)
+    , fd_(-1)
+    , running_(false)
+    , enqueue_pos_(0)
+    , dequeue_pos_(0)
+    , bytes_written_(0)
+{
+    slots_ = static_cast<char*>(::operator new(capacity_ * slot_stride_, std::align_val_t(64)));
+    for (size_t i = 0; i < capacity_; ++i) {
+        new (slotAt(i)) SlotHeader();
+        slotAt(i)->sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+RequestCapture::~RequestCapture() {
+    stop();
+    ::operator delete(slots_, std::align_val_t(64));
+}
+
+void RequestCapture::start() {
+    if (running_.load()) {
+        return;
+    }
+    
+    boost::filesystem::path parent = boost::filesystem::path(path_).parent_path();
+    if (!parent.empty()) {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(parent, ec);
+    }
+    
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open capture file " + path_);
+    }
+    
+    start_time_ = std::chrono::steady_clock::now();
+    
+    CaptureFileHeader header;
+    std::memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+    header.version = kCaptureVersion;
+    header.reserved = 0;
+    header.start_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (write(fd_, &header, sizeof(header)) != sizeof(header)) {
+        close(fd_);
+        fd_ = -1;
+        throw std::runtime_error("Failed to write capture header");
+    }
+    
+    running_.store(true);
+    writer_thread_ = std::thread(&RequestCapture::writerThread, this);
+}
+
+void RequestCapture::stop() {
+    if (!running_.load()) {
+        return;
+    }
+    
+    running_.store(false);
+    if (writer_thread_.joinable()) {
+        writer_thread_.join();
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+RequestCapture::SlotHeader* RequestCapture::slotAt(uint64_t pos) const {
+    return reinterpret_cast<SlotHeader*>(slots_ + (pos & mask_) * slot_stride_);
+}
+
+bool RequestCapture::record(uint32_t connection_id, const char* data, size_t length, bool batch) {
+    if (!running_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if (length > max_frame_bytes_) {
+        dropped_count_.add();
+        return false;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    
+    // Claim a slot (bounded MPMC ring, single consumer)
+    SlotHeader* slot;
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = slotAt(pos);
+        uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Writer has fallen behind: drop rather than stall the request
+            dropped_count_.add();
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    
+    slot->record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - start_time_).count();
+    slot->record.connection_id = connection_id;
+    slot->record.length = static_cast<uint32_t>(length) | (batch ? kBatchFrameFlag : 0);
+    std::memcpy(reinterpret_cast<char*>(slot) + sizeof(SlotHeader), data, length);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    
+    captured_count_.add();
+    return true;
+}
+
+bool RequestCapture::drainSlot(std::vector<char>& batch) {
+    SlotHeader* slot = slotAt(dequeue_pos_);
+    if (slot->sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+        return false;
+    }
+    
+    const char* record = reinterpret_cast<const char*>(&slot->record);
+    batch.insert(batch.end(), record, record + sizeof(CaptureRecordHeader));
+    const char* payload = reinterpret_cast<const char*>(slot) + sizeof(SlotHeader);
+    batch.insert(batch.end(), payload, payload + (slot->record.length & ~kBatchFrameFlag));
+    
+    slot->sequence.store(dequeue_pos_ + capacity_, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+}
+
+void RequestCapture::flush(std::vector<char>& batch) {
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        ssize_t written = write(fd_, batch.data() + offset, batch.size() - offset);
+        if (written <= 0) {
+            std::cerr << "Capture write failed, discarding " << batch.size() - offset << " bytes" << std::endl;
+            break;
+        }
+        offset += written;
+    }
+    bytes_written_.fetch_add(offset, std::memory_order_relaxed);
+    batch.clear();
+}
+
+void RequestCapture::writerThread() {
+    std::vector<char> batch;
+    batch.reserve(kWriteBatchBytes + slot_stride_);
+    
+    while (running_.load()) {
+        bool drained = false;
+        while (batch.size() < kWriteBatchBytes && drainSlot(batch)) {
+            drained = true;
+        }
+        
+        if (batch.size() >= kWriteBatchBytes || (!drained && !batch.empty())) {
+            flush(batch);
+        } else if (!drained) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    
+    // Final drain; a frame racing with stop() may miss the log
+    while (drainSlot(batch)) {
+        if (batch.size() >= kWriteBatchBytes) {
+            flush(batch);
+        }
+    }
+    flush(batch);
+}
+
+std::string RequestCapture::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_capture_frames_total Frames written to the capture log\n";
+    oss << "# TYPE bidding_capture_frames_total counter\n";
+    oss << "bidding_capture_frames_total " << getCapturedCount() << "\n";
+    
+    oss << "# HELP bidding_capture_dropped_total Frames not captured (ring full or oversize)\n";
+    oss << "# TYPE bidding_capture_dropped_total counter\n";
+    oss << "bidding_capture_dropped_total " << getDroppedCount() << "\n";
+    
+    oss << "# HELP bidding_capture_bytes_total Bytes written to the capture log\n";
+    oss << "# TYPE bidding_capture_bytes_total counter\n";
+    oss << "bidding_capture_bytes_total " << bytes_written_.load(std::memory_order_relaxed) << "\n";
+    
+    return oss.str();
+}
@@ -0,0 +1,19 @@
+#include "scoring_rules.h"
+
+void ScoringRuleSet::add(const std::string& key, RuleMatch match, const std::string& value, double multiplier) {
+    rules_.push_back({key, match, value, multiplier});
+}
+
+double ScoringRuleSet::multiplier(const TargetingMap& targeting) const {
+    double result = 1.0;
+    for (const auto& rule : rules_) {
+        auto it = targeting.find(rule.key);
+        if (it == targeting.end()) {
+            continue;
+        }
+        if (rule.match == RuleMatch::PRESENT || it->second == rule.value) {
+            result *= rule.multiplier;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,440 @@
+#include "shm_server.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Request bytes taken per pass, so responses start flowing back and
+// shutdown/hangup are noticed while a deep backlog is being served
+constexpr size_t kMaxReadBytes = 64 * 1024;
+constexpr auto kLivenessInterval = std::chrono::milliseconds(10);
+
+size_t roundUpPowerOfTwo(size_t value) {
+    size_t result = 4096;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// The client never writes to the control socket, so readable means gone
+bool peerClosed(int control_fd, int timeout_ms) {
+    struct pollfd fd = {control_fd, POLLIN, 0};
+    return poll(&fd, 1, timeout_ms) > 0 && (fd.revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+bool sendHello(int control_fd, const ShmHello& hello, const int (&fds)[SHM_FD_COUNT]) {
+    struct iovec iov;
+    iov.iov_base = const_cast<ShmHello*>(&hello);
+    iov.iov_len = sizeof(hello);
+    
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+    
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    return sendmsg(control_fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(hello));
+}
+
+}
+
+struct ShmServer::Client {
+    int control_fd = -1;
+    int server_event = -1;
+    int client_data = -1;
+    int client_space = -1;
+    void* segment = MAP_FAILED;
+    size_t segment_bytes = 0;
+    ShmRing requests;
+    ShmRing responses;
+    std::thread thread;
+    std::atomic<bool> done{false};
+    
+    ~Client() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (segment != MAP_FAILED) {
+            munmap(segment, segment_bytes);
+        }
+        for (int fd : {control_fd, server_event, client_data, client_space}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+};
+
+ShmServer::ShmServer(const ShmTransportConfig& config, MemoryPool& receive_pool, size_t max_frame_bytes,
+                     FrameHandler handler)
+    : config_(config)
+    , receive_pool_(receive_pool)
+    , max_frame_bytes_(max_frame_bytes)
+    , handler_(std::move(handler))
+    , listen_fd_(-1)
+    , stop_fd_(-1)
+    , running_(false)
+    , next_connection_id_(0)
+    , clients_total_(0)
+    , clients_active_(0)
+    , wakeups_sent_(0)
+    , sleeps_(0)
+    , malformed_(0)
+{
+    config_.ring_bytes = roundUpPowerOfTwo(config_.ring_bytes);
+}
+
+ShmServer::~ShmServer() {
+    stop();
+}
+
+void ShmServer::start() {
+    if (running_.load()) {
+        return;
+    }
+    
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (config_.path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("shm: control socket path too long: " + config_.path);
+    }
+    std::strncpy(address.sun_path, config_.path.c_str(), sizeof(address.sun_path) - 1);
+    
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("shm: failed to create control socket");
+    }
+    
+    // A previous engine that died without cleaning up leaves the path behind
+    unlink(config_.path.c_str());
+    if (bind(listen_fd_, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd_, 16) < 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        throw std::runtime_error("shm: failed to bind " + config_.path + ": " + std::strerror(errno));
+    }
+    
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd_ < 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        throw std::runtime_error("shm: failed to create eventfd");
+    }
+    
+    running_.store(true);
+    accept_thread_ = std::thread(&ShmServer::acceptClients, this);
+}
+
+void ShmServer::stop() {
+    if (!running_.load()) {
+        return;
+    }
+    
+    // stop_fd_ is never drained, so every poll() on it returns from now on
+    running_.store(false);
+    uint64_t one = 1;
+    ssize_t written = write(stop_fd_, &one, sizeof(one));
+    (void)written;
+    if (accept_thread_.joinable()) {
+        accept_thread_.join();
+    }
+    reapClients(true);
+    
+    close(listen_fd_);
+    listen_fd_ = -1;
+    close(stop_fd_);
+    stop_fd_ = -1;
+    unlink(config_.path.c_str());
+}
+
+void ShmServer::acceptClients() {
+    while (running_.load()) {
+        struct pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        if (poll(fds, 2, 1000) < 0 && errno != EINTR) {
+            break;
+        }
+        reapClients(false);
+        if (!running_.load() || !(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        
+        int control_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (control_fd < 0) {
+            continue;
+        }
+        if (clients_active_.load() >= config_.max_clients) {
+            std::cerr << "shm: client limit reached, rejecting connection" << std::endl;
+            close(control_fd);
+            continue;
+        }
+        
+        std::unique_ptr<Client> client = createClient(control_fd);
+        if (!client) {
+            continue;
+        }
+        clients_total_.fetch_add(1, std::memory_order_relaxed);
+        clients_active_.fetch_add(1, std::memory_order_relaxed);
+        client->thread = std::thread(&ShmServer::serveClient, this, client.get());
+        
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        clients_.push_back(std::move(client));
+    }
+}
+
+std::unique_ptr<ShmServer::Client> ShmServer::createClient(int control_fd) {
+    auto client = std::make_unique<Client>();
+    client->control_fd = control_fd;
+    client->segment_bytes = shmSegmentBytes(config_.ring_bytes);
+    
+    int segment_fd = memfd_create("bidding-shm", MFD_CLOEXEC);
+    if (segment_fd < 0 || ftruncate(segment_fd, client->segment_bytes) < 0) {
+        std::cerr << "shm: failed to create segment: " << std::strerror(errno) << std::endl;
+        if (segment_fd >= 0) {
+            close(segment_fd);
+        }
+        return nullptr;
+    }
+    client->segment = mmap(nullptr, client->segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    client->server_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    client->client_data = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    client->client_space = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (client->segment == MAP_FAILED || client->server_event < 0 ||
+        client->client_data < 0 || client->client_space < 0) {
+        std::cerr << "shm: failed to map segment" << std::endl;
+        close(segment_fd);
+        return nullptr;
+    }
+    
+    auto* header = static_cast<ShmSegmentHeader*>(client->segment);
+    header->magic = kShmMagic;
+    header->version = kShmVersion;
+    header->ring_bytes = config_.ring_bytes;
+    client->requests = shmRequestRing(client->segment, config_.ring_bytes);
+    client->responses = shmResponseRing(client->segment, config_.ring_bytes);
+    client->requests.init();
+    client->responses.init();
+    
+    ShmHello hello;
+    std::memset(&hello, 0, sizeof(hello));
+    hello.magic = kShmMagic;
+    hello.version = kShmVersion;
+    hello.segment_bytes = client->segment_bytes;
+    hello.ring_bytes = config_.ring_bytes;
+    hello.spin_us = config_.spin_us;
+    
+    int fds[SHM_FD_COUNT];
+    fds[SHM_FD_SEGMENT] = segment_fd;
+    fds[SHM_FD_SERVER_EVENT] = client->server_event;
+    fds[SHM_FD_CLIENT_DATA] = client->client_data;
+    fds[SHM_FD_CLIENT_SPACE] = client->client_space;
+    bool sent = sendHello(control_fd, hello, fds);
+    
+    // The client holds its own references now; the mapping keeps ours alive
+    close(segment_fd);
+    if (!sent) {
+        return nullptr;
+    }
+    return client;
+}
+
+void ShmServer::serveClient(Client* client) {
+    uint32_t connection_id = next_connection_id_.fetch_add(1, std::memory_order_relaxed);
+    size_t tenant = classifier_ ? classifier_(client->control_fd) : 0;
+    ReceiveBuffer input(receive_pool_, max_frame_bytes_);
+    std::string output;
+    size_t output_sent = 0;
+    auto spin = std::chrono::microseconds(config_.spin_us);
+    auto last_progress = std::chrono::steady_clock::now();
+    auto last_liveness_check = last_progress;
+    
+    while (running_.load(std::memory_order_relaxed)) {
+        bool progress = false;
+        
+        if (output_sent < output.size()) {
+            size_t n = client->responses.write(output.data() + output_sent, output.size() - output_sent);
+            if (n > 0) {
+                progress = true;
+                output_sent += n;
+                if (client->responses.consumerNeedsWake()) {
+                    signal(client->client_data);
+                }
+            }
+            if (output_sent == output.size()) {
+                output.clear();
+                output_sent = 0;
+            }
+        }
+        
+        // Read more only once earlier responses are out, so a client that
+        // stops reading stalls its own requests instead of growing output
+        if (output.empty() && client->requests.readable() > 0) {
+            size_t taken = 0;
+            while (taken < kMaxReadBytes) {
+                char* dest;
+                size_t space = std::min(input.prepareWrite(dest), kMaxReadBytes - taken);
+                size_t n = client->requests.read(dest, space);
+                input.commitWrite(n);
+                taken += n;
+                if (n < space) {
+                    break;
+                }
+            }
+            progress = true;
+            if (client->requests.producerNeedsWake()) {
+                signal(client->client_space);
+            }
+            if (!handler_(connection_id, tenant, input, output)) {
+                break;
+            }
+        }
+        
+        // Indexes the client pushed out of range; nothing was copied past
+        // the rings, but the stream is unrecoverable
+        if (client->requests.corrupt() || client->responses.corrupt()) {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        
+        if (progress) {
+            last_progress = std::chrono::steady_clock::now();
+            if (last_progress - last_liveness_check > kLivenessInterval) {
+                last_liveness_check = last_progress;
+                if (peerClosed(client->control_fd, 0)) {
+                    break;
+                }
+            }
+            continue;
+        }
+        if (std::chrono::steady_clock::now() - last_progress < spin) {
+            cpuRelax();
+            continue;
+        }
+        if (!waitForWork(client, output.empty())) {
+            break;
+        }
+        last_progress = std::chrono::steady_clock::now();
+    }
+    
+    // Closing the control socket tells the client the session is over
+    shutdown(client->control_fd, SHUT_RDWR);
+    clients_active_.fetch_sub(1, std::memory_order_relaxed);
+    client->done.store(true);
+}
+
+bool ShmServer::waitForWork(Client* client, bool want_input) {
+    ShmRing& ring = want_input ? client->requests : client->responses;
+    if (want_input) {
+        ring.setConsumerWaiting(true);
+    } else {
+        ring.setProducerWaiting(true);
+    }
+    
+    // Re-check after publishing the flag: the client may have raced us
+    bool ready = want_input ? ring.readable() > 0 : ring.writable() > 0;
+    bool alive = true;
+    if (!ready) {
+        sleeps_.fetch_add(1, std::memory_order_relaxed);
+        struct pollfd fds[3] = {
+            {client->server_event, POLLIN, 0},
+            {client->control_fd, POLLIN, 0},
+            {stop_fd_, POLLIN, 0}
+        };
+        if (poll(fds, 3, -1) < 0 && errno != EINTR) {
+            alive = false;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            ssize_t drained = read(client->server_event, &value, sizeof(value));
+            (void)drained;
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            alive = false;
+        }
+    }
+    
+    if (want_input) {
+        ring.setConsumerWaiting(false);
+    } else {
+        ring.setProducerWaiting(false);
+    }
+    return alive;
+}
+
+void ShmServer::signal(int event_fd) {
+    uint64_t one = 1;
+    ssize_t written = write(event_fd, &one, sizeof(one));
+    (void)written;
+    wakeups_sent_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShmServer::reapClients(bool all) {
+    std::vector<std::unique_ptr<Client>> finished;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            if (all || (*it)->done.load()) {
+                finished.push_back(std::move(*it));
+                it = clients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // Client destructors join the serving threads outside the lock
+}
+
+std::string ShmServer::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_shm_clients Connected shared-memory clients\n";
+    oss << "# TYPE bidding_shm_clients gauge\n";
+    oss << "bidding_shm_clients " << clients_active_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_shm_clients_total Shared-memory sessions opened\n";
+    oss << "# TYPE bidding_shm_clients_total counter\n";
+    oss << "bidding_shm_clients_total " << clients_total_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_shm_wakeups_total Eventfd wakeups sent to clients\n";
+    oss << "# TYPE bidding_shm_wakeups_total counter\n";
+    oss << "bidding_shm_wakeups_total " << wakeups_sent_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_shm_sleeps_total Times a serving thread blocked after its spin window\n";
+    oss << "# TYPE bidding_shm_sleeps_total counter\n";
+    oss << "bidding_shm_sleeps_total " << sleeps_.load(std::memory_order_relaxed) << "\n";
+    
+    oss << "# HELP bidding_shm_malformed_total Sessions dropped for ring indexes out of range\n";
+    oss << "# TYPE bidding_shm_malformed_total counter\n";
+    oss << "bidding_shm_malformed_total " << malformed_.load(std::memory_order_relaxed) << "\n";
+    
+    return oss.str();
+}
@@ -0,0 +1,223 @@
+#include "socket_handoff.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+bool makeAddress(const std::string& path, struct sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+bool waitReadable(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0;
+}
+
+}
+
+SocketHandoff::SocketHandoff(const HandoffConfig& config, SocketProvider provider, std::function<void()> on_handed_off)
+    : config_(config)
+    , provider_(std::move(provider))
+    , on_handed_off_(std::move(on_handed_off))
+    , listen_fd_(-1)
+    , stop_fd_(-1)
+    , handed_off_(false)
+{
+}
+
+SocketHandoff::~SocketHandoff() {
+    stop();
+}
+
+void SocketHandoff::start() {
+    struct sockaddr_un address;
+    if (!makeAddress(config_.path, address)) {
+        throw std::runtime_error("Handoff path too long: " + config_.path);
+    }
+    
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Failed to create handoff socket");
+    }
+    // A previous engine either handed off already or is gone; either way
+    // its socket file is ours now
+    unlink(config_.path.c_str());
+    if (bind(listen_fd_, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd_, 4) < 0) {
+        std::string error = std::strerror(errno);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        throw std::runtime_error("Failed to bind handoff socket " + config_.path + ": " + error);
+    }
+    
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    thread_ = std::thread(&SocketHandoff::listenThread, this);
+}
+
+void SocketHandoff::stop() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t written = write(stop_fd_, &one, sizeof(one));
+        (void)written;
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        // After a handoff the path belongs to the new engine
+        if (!handed_off_.load()) {
+            unlink(config_.path.c_str());
+        }
+    }
+    if (stop_fd_ >= 0) {
+        close(stop_fd_);
+        stop_fd_ = -1;
+    }
+}
+
+void SocketHandoff::listenThread() {
+    while (!handed_off_.load()) {
+        struct pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        
+        int client_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            continue;
+        }
+        bool confirmed = serve(client_fd);
+        close(client_fd);
+        if (confirmed) {
+            handed_off_.store(true);
+            std::cout << "Sockets handed off, draining" << std::endl;
+            on_handed_off_();
+        } else {
+            std::cerr << "Socket handoff not confirmed, still serving" << std::endl;
+        }
+    }
+}
+
+bool SocketHandoff::serve(int client_fd) {
+    HandoffSockets sockets = provider_();
+    std::vector<int> fds = sockets.server;
+    if (sockets.metrics >= 0) {
+        fds.push_back(sockets.metrics);
+    }
+    if (sockets.server.empty() || fds.size() > kHandoffMaxSockets) {
+        return false;
+    }
+    
+    HandoffHello hello;
+    hello.magic = kHandoffMagic;
+    hello.version = kHandoffVersion;
+    hello.server_count = static_cast<uint8_t>(sockets.server.size());
+    hello.has_metrics = sockets.metrics >= 0 ? 1 : 0;
+    
+    struct iovec iov = {&hello, sizeof(hello)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    
+    if (sendmsg(client_fd, &message, MSG_NOSIGNAL) != sizeof(hello)) {
+        return false;
+    }
+    
+    uint8_t reply = 0;
+    return waitReadable(client_fd, config_.timeout_ms) && read(client_fd, &reply, 1) == 1 && reply == kHandoffReady;
+}
+
+SocketHandoff::Takeover::Takeover(const std::string& path, int timeout_ms)
+    : fd_(-1)
+{
+    struct sockaddr_un address;
+    if (!makeAddress(path, address)) {
+        throw std::runtime_error("Handoff path too long: " + path);
+    }
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || connect(fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        throw std::runtime_error("No engine to take over at " + path + ": " + error);
+    }
+    
+    HandoffHello hello;
+    std::memset(&hello, 0, sizeof(hello));
+    struct iovec iov = {&hello, sizeof(hello)};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kHandoffMaxSockets));
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    
+    ssize_t received = waitReadable(fd_, timeout_ms) ? recvmsg(fd_, &message, MSG_CMSG_CLOEXEC) : -1;
+    
+    std::vector<int> fds;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); received > 0 && cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            fds.resize(count);
+            std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * count);
+        }
+    }
+    
+    bool valid = received == sizeof(hello) && hello.magic == kHandoffMagic && hello.version == kHandoffVersion &&
+                 !(message.msg_flags & MSG_CTRUNC) && hello.server_count > 0 &&
+                 fds.size() == size_t(hello.server_count) + hello.has_metrics;
+    if (!valid) {
+        for (int fd : fds) {
+            close(fd);
+        }
+        close(fd_);
+        throw std::runtime_error("Socket handoff from " + path + " failed");
+    }
+    
+    sockets_.server.assign(fds.begin(), fds.begin() + hello.server_count);
+    if (hello.has_metrics) {
+        sockets_.metrics = fds.back();
+    }
+}
+
+SocketHandoff::Takeover::~Takeover() {
+    close(fd_);
+}
+
+bool SocketHandoff::Takeover::confirm() {
+    uint8_t ready = kHandoffReady;
+    return send(fd_, &ready, 1, MSG_NOSIGNAL) == 1;
+}
@@ -0,0 +1,61 @@
+#include "stats.h"
+#include <thread>
+
+namespace stats {
+
+size_t slotCount() {
+    static const size_t count = [] {
+        size_t threads = std::thread::hardware_concurrency();
+        size_t slots = 1;
+        while (slots < threads && slots < 256) {
+            slots <<= 1;
+        }
+        return slots;
+    }();
+    return count;
+}
+
+size_t assignSlot() {
+    static std::atomic<size_t> next_slot(0);
+    return next_slot.fetch_add(1, std::memory_order_relaxed) & (slotCount() - 1);
+}
+
+Counter::Counter()
+    : cells_(new Cell[slotCount()])
+{
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < slotCount(); ++i) {
+        total += cells_[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Counter::reset() {
+    for (size_t i = 0; i < slotCount(); ++i) {
+        cells_[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+Gauge::Gauge()
+    : cells_(new Cell[slotCount()])
+{
+}
+
+int64_t Gauge::value() const {
+    int64_t total = 0;
+    for (size_t i = 0; i < slotCount(); ++i) {
+        total += cells_[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Gauge::reset() {
+    for (size_t i = 0; i < slotCount(); ++i) {
+        cells_[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+}
@@ -1,51 +1,186 @@
 #include "tcp_server.h"
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 #include <iostream>
 #include <cstring>
+#include <chrono>
+#include <sstream>
+
+namespace {
+
+// Idle connection threads wake this often to notice drain and stop
+constexpr int kIdleCheckMs = 100;
+
+// Pulls field 1 (id) out of a serialized BidRequest without a full parse.
+// Proto3 writes fields in number order, so a non-empty id comes first.
+std::string peekRequestId(const char* data, size_t length) {
+    if (length < 2 || static_cast<uint8_t>(data[0]) != 0x0A) {
+        return std::string();
+    }
+    
+    uint64_t id_length = 0;
+    size_t pos = 1;
+    for (int shift = 0; pos < length && shift < 35; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        id_length |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            if (id_length > length - pos) {
+                return std::string();
+            }
+            return std::string(data + pos, id_length);
+        }
+    }
+    return std::string();
+}
+
+bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Reply carrying only an id and a status, built without parsing the request
+template <typename Response>
+void statusResponse(const char* data, size_t length, const std::string& status, std::string& response_data) {
+    Response response;
+    response.set_id(peekRequestId(data, length));
+    response.set_status(status);
+    response.SerializeToString(&response_data);
+}
+
+void appendFrame(std::string& output, const std::string& payload, bool batch) {
+    uint32_t length = htonl(static_cast<uint32_t>(payload.size()) | (batch ? kBatchFrameFlag : 0));
+    output.append(reinterpret_cast<const char*>(&length), 4);
+    output.append(payload);
+}
+
+}
 
 TCPServer::TCPServer(const std::string& host, int port)
     : host_(host)
     , port_(port)
-    , server_fd_(-1)
+    , stop_fd_(-1)
     , running_(false)
+    , draining_(false)
+    , admission_(nullptr)
+    , qos_(nullptr)
+    , capture_(nullptr)
+    , next_connection_id_(0)
+    , backend_(ServerBackend::THREADS)
 {
 }
 
 TCPServer::~TCPServer() {
     stop();
+    for (int fd : inherited_fds_) {
+        close(fd);
+    }
 }
 
 void TCPServer::start() {
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ < 0) {
+    receive_pool_ = std::make_unique<MemoryPool>(receive_config_.pool_slabs, receive_config_.slab_bytes,
+                                                 receive_config_.pages, "receive_pool");
+    
+    if (shm_config_.enabled) {
+        shm_ = std::make_unique<ShmServer>(shm_config_, *receive_pool_, receive_config_.max_frame_bytes,
+            [this](uint32_t connection_id, size_t tenant, ReceiveBuffer& input, std::string& output) {
+                return serveFrames({connection_id, tenant, true, 0}, input, output) !=
+                       IoUringServer::FrameResult::CLOSE;
+            });
+        if (qos_) {
+            shm_->setTenantClassifier([this](int fd) { return qos_->classify(fd); });
+        }
+        try {
+            shm_->start();
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << ", shared-memory transport disabled" << std::endl;
+            shm_.reset();
+        }
+    }
+    
+    if (backend_ == ServerBackend::IO_URING) {
+        io_uring_ = std::make_unique<IoUringServer>(host_, port_, io_uring_config_,
+            *receive_pool_, receive_config_.max_frame_bytes,
+            [this](uint32_t connection_id, size_t tenant, uint64_t resume_token, ReceiveBuffer& input,
+                   std::string& output) {
+                return serveFrames({connection_id, tenant, false, resume_token}, input, output);
+            });
+        io_uring_->setListeners(inherited_fds_);
+        if (qos_) {
+            io_uring_->setTenantClassifier([this](int fd) { return qos_->classify(fd); });
+            io_uring_->setParking(qos_->maxWait(), [this](uint32_t connection_id, size_t tenant) {
+                qos_->cancel(tenant, connection_id);
+            });
+        }
+        try {
+            io_uring_->start();
+            inherited_fds_.clear();
+            running_.store(true);
+            return;
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << ", falling back to threaded backend" << std::endl;
+            io_uring_.reset();
+            backend_ = ServerBackend::THREADS;
+        }
+    }
+    
+    if (inherited_fds_.empty()) {
+        listen_fds_.push_back(openListener());
+    } else {
+        listen_fds_.swap(inherited_fds_);
+    }
+    // Non-blocking, so a connection taken by another engine sharing the
+    // socket during a handoff cannot stall accept
+    for (int fd : listen_fds_) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd_ < 0) {
+        throw std::runtime_error("Failed to create eventfd");
+    }
+    
+    running_.store(true);
+    accept_thread_ = std::thread(&TCPServer::acceptConnections, this);
+}
+
+int TCPServer::openListener() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
         throw std::runtime_error("Failed to create socket");
     }
     
     int opt = 1;
-    setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
     
     struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = inet_addr(host_.c_str());
     address.sin_port = htons(port_);
     
-    if (bind(server_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        close(server_fd_);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
         throw std::runtime_error("Failed to bind socket");
     }
     
-    if (listen(server_fd_, 128) < 0) {
-        close(server_fd_);
+    if (listen(fd, 128) < 0) {
+        close(fd);
         throw std::runtime_error("Failed to listen");
     }
-    
-    running_.store(true);
-    std::thread accept_thread(&TCPServer::acceptConnections, this);
-    accept_thread.detach();
+    return fd;
 }
 
 void TCPServer::stop() {
@@ -53,84 +188,382 @@ void TCPServer::stop() {
         return;
     }
     
+    stopAccepting();
     running_.store(false);
-    if (server_fd_ >= 0) {
-        close(server_fd_);
-        server_fd_ = -1;
+    if (shm_) {
+        shm_->stop();
+    }
+    if (io_uring_) {
+        io_uring_->stop();
     }
     
-    for (auto& thread : client_threads_) {
-        if (thread.joinable()) {
-            thread.join();
+    // Connection threads see running_ within kIdleCheckMs
+    reapClients(true);
+    if (stop_fd_ >= 0) {
+        close(stop_fd_);
+        stop_fd_ = -1;
+    }
+}
+
+void TCPServer::beginDrain() {
+    if (!running_.load() || draining_.exchange(true)) {
+        return;
+    }
+    stopAccepting();
+    if (io_uring_) {
+        io_uring_->beginDrain();
+    }
+}
+
+void TCPServer::stopAccepting() {
+    if (accept_thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t written = write(stop_fd_, &one, sizeof(one));
+        (void)written;
+        accept_thread_.join();
+    }
+    // Only our descriptors: after a handoff the new engine shares these
+    // sockets, so they must never be shut down
+    for (int fd : listen_fds_) {
+        close(fd);
+    }
+    listen_fds_.clear();
+}
+
+size_t TCPServer::getActiveConnections() const {
+    if (io_uring_) {
+        return io_uring_->getActiveConnections();
+    }
+    return connections_active_.value();
+}
+
+void TCPServer::adoptListeners(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        if (getsockname(fd, (struct sockaddr*)&address, &length) < 0 || address.sin_family != AF_INET ||
+            ntohs(address.sin_port) != port_) {
+            std::cerr << "Ignoring inherited socket not bound to port " << port_ << std::endl;
+            close(fd);
+            continue;
         }
+        inherited_fds_.push_back(fd);
+    }
+}
+
+std::vector<int> TCPServer::getListeningSockets() const {
+    if (io_uring_) {
+        return io_uring_->getListeningSockets();
     }
-    client_threads_.clear();
+    return listen_fds_;
 }
 
 void TCPServer::setRequestHandler(std::function<bidding::BidResponse(const bidding::BidRequest&)> handler) {
     request_handler_ = handler;
 }
 
+void TCPServer::setBatchHandler(std::function<bidding::BidBatchResponse(const bidding::BidBatchRequest&)> handler) {
+    batch_handler_ = handler;
+}
+
+void TCPServer::setAdmissionController(AdmissionController* admission) {
+    admission_ = admission;
+}
+
+void TCPServer::setQosScheduler(QosScheduler* qos) {
+    qos_ = qos;
+}
+
+void TCPServer::setRequestCapture(RequestCapture* capture) {
+    capture_ = capture;
+}
+
+void TCPServer::setBackend(ServerBackend backend, const IoUringConfig& io_uring_config) {
+    backend_ = backend;
+    io_uring_config_ = io_uring_config;
+}
+
+void TCPServer::setReceiveBufferConfig(const ReceiveBufferConfig& config) {
+    receive_config_ = config;
+}
+
+void TCPServer::setShmTransport(const ShmTransportConfig& config) {
+    shm_config_ = config;
+}
+
+ServerBackend TCPServer::parseBackend(const std::string& name) {
+    if (name == "io_uring") {
+        return ServerBackend::IO_URING;
+    }
+    return ServerBackend::THREADS;
+}
+
 void TCPServer::acceptConnections() {
-    while (running_.load()) {
-        struct sockaddr_in client_address;
-        socklen_t addr_len = sizeof(client_address);
+    std::vector<struct pollfd> fds;
+    for (int fd : listen_fds_) {
+        fds.push_back({fd, POLLIN, 0});
+    }
+    fds.push_back({stop_fd_, POLLIN, 0});
+    
+    for (;;) {
+        if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+            std::cerr << "Failed to poll listening sockets" << std::endl;
+            break;
+        }
+        reapClients(false);
+        if (fds.back().revents & POLLIN) {
+            break;
+        }
         
-        int client_fd = accept(server_fd_, (struct sockaddr*)&client_address, &addr_len);
-        if (client_fd < 0) {
-            if (running_.load()) {
-                std::cerr << "Failed to accept connection" << std::endl;
+        for (size_t i = 0; i + 1 < fds.size(); ++i) {
+            if (!(fds[i].revents & POLLIN)) {
+                continue;
             }
-            continue;
+            int client_fd = accept4(fds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+                    std::cerr << "Failed to accept connection" << std::endl;
+                }
+                continue;
+            }
+            
+            auto client = std::make_unique<ClientThread>();
+            connections_active_.add();
+            client->thread = std::thread(&TCPServer::handleClient, this, client_fd, client.get());
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            client_threads_.push_back(std::move(client));
         }
-        
-        client_threads_.emplace_back(&TCPServer::handleClient, this, client_fd);
     }
 }
 
-void TCPServer::handleClient(int client_fd) {
-    char buffer[4096];
+void TCPServer::reapClients(bool all) {
+    std::list<std::unique_ptr<ClientThread>> finished;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        for (auto it = client_threads_.begin(); it != client_threads_.end();) {
+            if (all || (*it)->done.load()) {
+                finished.push_back(std::move(*it));
+                it = client_threads_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // Join outside the lock
+    for (auto& client : finished) {
+        if (client->thread.joinable()) {
+            client->thread.join();
+        }
+    }
+}
+
+void TCPServer::handleClient(int client_fd, ClientThread* self) {
+    FrameOrigin origin;
+    origin.connection_id = next_connection_id_.fetch_add(1, std::memory_order_relaxed);
+    origin.tenant = qos_ ? qos_->classify(client_fd) : 0;
+    origin.may_block = true;
+    origin.resume_token = 0;
+    ReceiveBuffer input(*receive_pool_, receive_config_.max_frame_bytes);
+    std::string output;
+    
+    // Bounded blocking, so an idle connection still notices drain and stop
+    struct timeval timeout = {0, kIdleCheckMs * 1000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
     
     while (running_.load()) {
-        // Read message length (4 bytes)
-        uint32_t message_length = 0;
-        ssize_t bytes_read = recv(client_fd, &message_length, 4, MSG_WAITALL);
-        if (bytes_read != 4) {
+        // Draining: leave once everything read so far has been answered
+        if (draining_.load(std::memory_order_relaxed) && input.size() == 0) {
             break;
         }
         
-        message_length = ntohl(message_length);
-        if (message_length > sizeof(buffer)) {
+        // Take whatever has arrived, up to the free space in the tail slab
+        char* dest;
+        size_t space = input.prepareWrite(dest);
+        ssize_t bytes_read = recv(client_fd, dest, space, 0);
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            continue;
+        }
+        if (bytes_read <= 0) {
             break;
         }
+        input.commitWrite(bytes_read);
+        
+        output.clear();
+        bool keep_open = serveFrames(origin, input, output) != IoUringServer::FrameResult::CLOSE;
         
-        // Read message
-        bytes_read = recv(client_fd, buffer, message_length, MSG_WAITALL);
-        if (bytes_read != message_length) {
+        // One send for every response produced by this read
+        if (!output.empty() && !sendAll(client_fd, output.data(), output.size())) {
             break;
         }
-        
-        // Parse protobuf
-        bidding::BidRequest request;
-        if (!request.ParseFromArray(buffer, message_length)) {
+        if (!keep_open) {
             break;
         }
+    }
+    
+    close(client_fd);
+    connections_active_.sub();
+    self->done.store(true);
+}
+
+IoUringServer::FrameResult TCPServer::serveFrames(const FrameOrigin& origin, ReceiveBuffer& input,
+                                                  std::string& output) {
+    const char* data;
+    size_t length;
+    std::string response_data;
+    
+    for (;;) {
+        ReceiveBuffer::FrameStatus status = input.nextFrame(data, length);
+        if (status == ReceiveBuffer::FrameStatus::INCOMPLETE) {
+            return IoUringServer::FrameResult::SERVED;
+        }
         
-        // Process request
-        if (request_handler_) {
-            bidding::BidResponse response = request_handler_(request);
-            
-            // Serialize response
-            std::string response_data;
-            response.SerializeToString(&response_data);
-            
-            // Send length + data
-            uint32_t response_length = htonl(response_data.size());
-            send(client_fd, &response_length, 4, 0);
-            send(client_fd, response_data.data(), response_data.size(), 0);
+        bool batch = input.isBatchFrame();
+        response_data.clear();
+        if (status == ReceiveBuffer::FrameStatus::TOO_LARGE) {
+            frames_too_large_.add();
+            if (batch) {
+                statusResponse<bidding::BidBatchResponse>(data, length, "frame_too_large", response_data);
+            } else {
+                statusResponse<bidding::BidResponse>(data, length, "frame_too_large", response_data);
+            }
+        } else {
+            // A parked frame stays in input, unconsumed, until its turn
+            Turn turn = takeTurn(origin);
+            if (turn.state == Turn::PARKED) {
+                return IoUringServer::FrameResult::PARKED;
+            }
+            bool parsed = handleFrame(origin, turn, data, length, batch, response_data);
+            if (turn.state == Turn::ADMITTED && qos_) {
+                qos_->release(origin.tenant, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - turn.arrival).count());
+            }
+            if (!parsed) {
+                return IoUringServer::FrameResult::CLOSE;
+            }
+        }
+        input.consumeFrame();
+        frames_served_.add();
+        
+        if (request_handler_ || batch) {
+            appendFrame(output, response_data, batch);
         }
     }
+}
+
+// Waits for the class's turn first, so a burst from one tenant queues
+// behind its own weight instead of tripping the shared limit for all.
+// Threads block in the queue; io_uring loops park the connection instead
+// and are resumed when dispatch reaches it.
+TCPServer::Turn TCPServer::takeTurn(const FrameOrigin& origin) {
+    auto now = std::chrono::steady_clock::now();
+    if (!qos_) {
+        return {Turn::ADMITTED, now};
+    }
+    if (origin.may_block) {
+        return {qos_->acquire(origin.tenant) ? Turn::ADMITTED : Turn::SHED, now};
+    }
     
-    close(client_fd);
+    int64_t queued_us = 0;
+    uint64_t token = origin.resume_token;
+    switch (qos_->admit(origin.tenant, origin.connection_id, [this, token]() { io_uring_->resume(token); },
+                        queued_us)) {
+        case QosScheduler::Admission::ADMITTED:
+            return {Turn::ADMITTED, now - std::chrono::microseconds(queued_us)};
+        case QosScheduler::Admission::QUEUED:
+            return {Turn::PARKED, now};
+        default:
+            return {Turn::SHED, now};
+    }
+}
+
+bool TCPServer::handleFrame(const FrameOrigin& origin, const Turn& turn, const char* data, size_t length,
+                            bool batch, std::string& response_data) {
+    if (capture_) {
+        capture_->record(origin.connection_id, data, length, batch);
+    }
+    return processFrame(turn, data, length, batch, response_data);
+}
+
+bool TCPServer::processFrame(const Turn& turn, const char* data, size_t length, bool batch,
+                             std::string& response_data) {
+    if (batch) {
+        if (!batch_handler_) {
+            statusResponse<bidding::BidBatchResponse>(data, length, "unsupported", response_data);
+            return true;
+        }
+        return processMessage(turn, data, length, batch_handler_, response_data);
+    }
+    
+    if (!request_handler_) {
+        return true;
+    }
+    return processMessage(turn, data, length, request_handler_, response_data);
+}
+
+template <typename Request, typename Response>
+bool TCPServer::processMessage(const Turn& turn, const char* data, size_t length,
+                               const std::function<Response(const Request&)>& handler,
+                               std::string& response_data) {
+    if (turn.state == Turn::SHED) {
+        statusResponse<Response>(data, length, "throttled", response_data);
+        return true;
+    }
+    
+    // Shed load before paying for the protobuf parse; a batch is one unit
+    if (admission_ && !admission_->tryAcquire()) {
+        statusResponse<Response>(data, length, "throttled", response_data);
+        return true;
+    }
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    Request request;
+    if (!request.ParseFromArray(data, length)) {
+        if (admission_) {
+            admission_->cancel();
+        }
+        return false;
+    }
+    
+    Response response = handler(request);
+    response.SerializeToString(&response_data);
+    
+    if (admission_) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time).count();
+        admission_->release(latency, response.status() == "circuit_breaker_open");
+    }
+    
+    return true;
 }
 
+std::string TCPServer::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_server_backend Active network backend\n";
+    oss << "# TYPE bidding_server_backend gauge\n";
+    oss << "bidding_server_backend{backend=\"" << (io_uring_ ? "io_uring" : "threads") << "\"} 1\n";
+    
+    oss << "# HELP bidding_server_frames_total Request frames answered\n";
+    oss << "# TYPE bidding_server_frames_total counter\n";
+    oss << "bidding_server_frames_total " << frames_served_.value() << "\n";
+    
+    oss << "# HELP bidding_server_frames_too_large_total Frames rejected for exceeding max_frame_bytes\n";
+    oss << "# TYPE bidding_server_frames_too_large_total counter\n";
+    oss << "bidding_server_frames_too_large_total " << frames_too_large_.value() << "\n";
+    
+    if (receive_pool_) {
+        oss << "# HELP bidding_receive_slabs_in_use Pooled receive slabs held by connections\n";
+        oss << "# TYPE bidding_receive_slabs_in_use gauge\n";
+        oss << "bidding_receive_slabs_in_use " << receive_pool_->getUsedCount() << "\n";
+    }
+    
+    if (io_uring_) {
+        oss << io_uring_->getPrometheusFormat();
+    }
+    if (shm_) {
+        oss << shm_->getPrometheusFormat();
+    }
+    
+    return oss.str();
+}
@@ -0,0 +1,286 @@
+#include "win_notice_ingest.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Room for a jumbo frame; larger datagrams are counted as truncated
+constexpr size_t kMaxDatagramBytes = 9216;
+
+std::string escapeLabel(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+}
+
+WinNoticeIngest::WinNoticeIngest(const WinNoticeConfig& config)
+    : config_(config)
+    , outcomes_(config.max_campaigns)
+    , budgets_(nullptr)
+    , wake_fd_(-1)
+    , running_(false)
+{
+    config_.threads = std::max<size_t>(config_.threads, 1);
+    config_.batch = std::max<size_t>(config_.batch, 1);
+}
+
+WinNoticeIngest::~WinNoticeIngest() {
+    stop();
+}
+
+int WinNoticeIngest::openSocket() {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create win notice socket");
+    }
+    
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config_.receive_buffer_bytes, sizeof(config_.receive_buffer_bytes));
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt));
+    
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(config_.host.c_str());
+    address.sin_port = htons(config_.port);
+    
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        throw std::runtime_error("Failed to bind win notice port " + std::to_string(config_.port) + ": " +
+                                 std::strerror(errno));
+    }
+    return fd;
+}
+
+void WinNoticeIngest::start() {
+    if (running_.load()) {
+        return;
+    }
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        throw std::runtime_error("Failed to create win notice eventfd");
+    }
+    try {
+        for (size_t i = 0; i < config_.threads; ++i) {
+            sockets_.push_back(openSocket());
+        }
+    } catch (const std::runtime_error&) {
+        for (int fd : sockets_) {
+            close(fd);
+        }
+        sockets_.clear();
+        close(wake_fd_);
+        wake_fd_ = -1;
+        throw;
+    }
+    
+    kernel_drops_.reset(new std::atomic<uint64_t>[sockets_.size()]);
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+        kernel_drops_[i].store(0);
+    }
+    running_.store(true);
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+        threads_.emplace_back(&WinNoticeIngest::receiveThread, this, i);
+    }
+}
+
+void WinNoticeIngest::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        // The threads still see running_ on their next datagram
+    }
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    for (int fd : sockets_) {
+        close(fd);
+    }
+    // kernel_drops_ is kept for the final scrape
+    sockets_.clear();
+    close(wake_fd_);
+    wake_fd_ = -1;
+}
+
+void WinNoticeIngest::receiveThread(size_t index) {
+    int fd = sockets_[index];
+    std::vector<char> buffers(config_.batch * kMaxDatagramBytes);
+    std::vector<struct iovec> iovecs(config_.batch);
+    std::vector<struct mmsghdr> messages(config_.batch);
+    // Each datagram carries the socket's running drop count
+    constexpr size_t kControlBytes = CMSG_SPACE(sizeof(uint32_t));
+    std::vector<char> controls(config_.batch * kControlBytes);
+    for (size_t i = 0; i < config_.batch; ++i) {
+        iovecs[i].iov_base = buffers.data() + i * kMaxDatagramBytes;
+        iovecs[i].iov_len = kMaxDatagramBytes;
+        std::memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    
+    while (running_.load(std::memory_order_relaxed)) {
+        // Drain without sleeping while datagrams keep coming; poll only
+        // once the socket is empty
+        for (size_t i = 0; i < config_.batch; ++i) {
+            messages[i].msg_hdr.msg_control = controls.data() + i * kControlBytes;
+            messages[i].msg_hdr.msg_controllen = kControlBytes;
+        }
+        int received = recvmmsg(fd, messages.data(), config_.batch, MSG_DONTWAIT, nullptr);
+        if (received > 0) {
+            receive_calls_.add();
+            struct msghdr& last = messages[received - 1].msg_hdr;
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&last); cmsg; cmsg = CMSG_NXTHDR(&last, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t dropped;
+                    std::memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                    kernel_drops_[index].store(dropped, std::memory_order_relaxed);
+                }
+            }
+            for (int i = 0; i < received; ++i) {
+                if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                    datagrams_.add();
+                    truncated_.add();
+                    continue;
+                }
+                ingest(static_cast<const char*>(iovecs[i].iov_base), messages[i].msg_len);
+            }
+            continue;
+        }
+        
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            break;
+        }
+    }
+}
+
+size_t WinNoticeIngest::ingest(const char* data, size_t length) {
+    datagrams_.add();
+    
+    WinNoticeHeader header;
+    if (length < sizeof(header)) {
+        malformed_.add();
+        return 0;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != kWinNoticeMagic || header.version != kWinNoticeVersion ||
+        length != sizeof(header) + header.count * sizeof(WinNotice)) {
+        malformed_.add();
+        return 0;
+    }
+    
+    const char* records = data + sizeof(header);
+    size_t applied = 0;
+    size_t wins = 0;
+    for (size_t i = 0; i < header.count; ++i) {
+        WinNotice notice;
+        std::memcpy(&notice, records + i * sizeof(WinNotice), sizeof(notice));
+        NoticeOutcome outcome = notice.outcome == static_cast<uint8_t>(NoticeOutcome::WIN)
+            ? NoticeOutcome::WIN : NoticeOutcome::LOSS;
+        // Charged even when the outcome table is full
+        if (budgets_ && outcome == NoticeOutcome::WIN) {
+            budgets_->recordWin(notice.campaign_id, notice.price_micros);
+        }
+        if (outcomes_.apply(notice.campaign_id, outcome, notice.bid_micros, notice.price_micros)) {
+            ++applied;
+            wins += outcome == NoticeOutcome::WIN;
+        }
+    }
+    
+    notices_.add(applied);
+    wins_.add(wins);
+    if (applied < header.count) {
+        unplaced_.add(header.count - applied);
+    }
+    return applied;
+}
+
+std::string WinNoticeIngest::getPrometheusFormat() const {
+    std::ostringstream oss;
+    
+    oss << "# HELP bidding_win_notice_datagrams_total Outcome notice datagrams received\n";
+    oss << "# TYPE bidding_win_notice_datagrams_total counter\n";
+    oss << "bidding_win_notice_datagrams_total " << datagrams_.value() << "\n";
+    
+    oss << "# HELP bidding_win_notice_receive_calls_total recvmmsg calls that returned datagrams\n";
+    oss << "# TYPE bidding_win_notice_receive_calls_total counter\n";
+    oss << "bidding_win_notice_receive_calls_total " << receive_calls_.value() << "\n";
+    
+    oss << "# HELP bidding_win_notices_total Outcome notices applied\n";
+    oss << "# TYPE bidding_win_notices_total counter\n";
+    oss << "bidding_win_notices_total " << notices_.value() << "\n";
+    
+    oss << "# HELP bidding_win_notice_wins_total Applied notices that were wins\n";
+    oss << "# TYPE bidding_win_notice_wins_total counter\n";
+    oss << "bidding_win_notice_wins_total " << wins_.value() << "\n";
+    
+    oss << "# HELP bidding_win_notice_rejected_total Datagrams or notices that could not be applied\n";
+    oss << "# TYPE bidding_win_notice_rejected_total counter\n";
+    oss << "bidding_win_notice_rejected_total{reason=\"malformed\"} " << malformed_.value() << "\n";
+    oss << "bidding_win_notice_rejected_total{reason=\"truncated\"} " << truncated_.value() << "\n";
+    oss << "bidding_win_notice_rejected_total{reason=\"campaigns_full\"} " << unplaced_.value() << "\n";
+    
+    uint64_t kernel_drops = 0;
+    for (size_t i = 0; kernel_drops_ && i < config_.threads; ++i) {
+        kernel_drops += kernel_drops_[i].load(std::memory_order_relaxed);
+    }
+    oss << "# HELP bidding_win_notice_kernel_drops_total Datagrams dropped by the kernel for a full receive buffer\n";
+    oss << "# TYPE bidding_win_notice_kernel_drops_total counter\n";
+    oss << "bidding_win_notice_kernel_drops_total " << kernel_drops << "\n";
+    
+    oss << "# HELP bidding_win_notice_campaigns Campaigns with outcome statistics\n";
+    oss << "# TYPE bidding_win_notice_campaigns gauge\n";
+    oss << "bidding_win_notice_campaigns " << outcomes_.size() << "\n";
+    
+    std::vector<CampaignOutcome> campaigns = outcomes_.snapshot();
+    if (!campaigns.empty()) {
+        oss << "# HELP bidding_campaign_auction_outcomes_total Outcome notices per campaign\n";
+        oss << "# TYPE bidding_campaign_auction_outcomes_total counter\n";
+        for (const auto& campaign : campaigns) {
+            std::string label = escapeLabel(campaign.campaign_id);
+            oss << "bidding_campaign_auction_outcomes_total{campaign=\"" << label << "\",outcome=\"win\"} "
+                << campaign.wins << "\n";
+            oss << "bidding_campaign_auction_outcomes_total{campaign=\"" << label << "\",outcome=\"loss\"} "
+                << campaign.notices - campaign.wins << "\n";
+        }
+        oss << "# HELP bidding_campaign_spend_total Clearing prices paid on won auctions\n";
+        oss << "# TYPE bidding_campaign_spend_total counter\n";
+        for (const auto& campaign : campaigns) {
+            oss << "bidding_campaign_spend_total{campaign=\"" << escapeLabel(campaign.campaign_id) << "\"} "
+                << campaign.spend() << "\n";
+        }
+        oss << "# HELP bidding_campaign_price_to_bid Average share of the bid paid on wins\n";
+        oss << "# TYPE bidding_campaign_price_to_bid gauge\n";
+        for (const auto& campaign : campaigns) {
+            oss << "bidding_campaign_price_to_bid{campaign=\"" << escapeLabel(campaign.campaign_id) << "\"} "
+                << campaign.priceToBid() << "\n";
+        }
+    }
+    
+    return oss.str();
+}
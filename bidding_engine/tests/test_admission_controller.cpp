@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "admission_controller.h"
+#include "tcp_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+
+namespace {
+
+AdmissionConfig aimdConfig() {
+    AdmissionConfig config;
+    config.algorithm = LimitAlgorithm::AIMD;
+    config.initial_limit = 2;
+    config.min_limit = 1;
+    config.max_limit = 64;
+    return config;
+}
+
+// Sends one frame on a new connection and waits for the server to close it
+bool sendAndAwaitClose(int port, const std::string& payload) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    
+    uint32_t length = htonl(static_cast<uint32_t>(payload.size()));
+    std::string frame(reinterpret_cast<const char*>(&length), sizeof(length));
+    frame += payload;
+    bool closed = send(fd, frame.data(), frame.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(frame.size());
+    char byte;
+    closed = closed && recv(fd, &byte, 1, 0) == 0;
+    close(fd);
+    return closed;
+}
+
+}
+
+TEST(AdmissionControllerTest, CancelFreesTheSlotWithoutMovingTheLimit) {
+    AdmissionController admission(aimdConfig());
+    ASSERT_TRUE(admission.tryAcquire());
+    ASSERT_TRUE(admission.tryAcquire());
+    EXPECT_FALSE(admission.tryAcquire());
+    
+    admission.cancel();
+    admission.cancel();
+    EXPECT_EQ(admission.getInFlight(), 0u);
+    EXPECT_EQ(admission.getLimit(), 2u);
+    
+    // A fast release with the limit in use grows it, which cancel must not
+    ASSERT_TRUE(admission.tryAcquire());
+    admission.release(0);
+    EXPECT_EQ(admission.getLimit(), 3u);
+}
+
+TEST(AdmissionControllerTest, MalformedFramesLeaveTheLimitUnchanged) {
+    AdmissionController admission(aimdConfig());
+    TCPServer server("127.0.0.1", 0);
+    server.setRequestHandler([](const bidding::BidRequest&) { return bidding::BidResponse(); });
+    server.setAdmissionController(&admission);
+    server.start();
+    
+    auto listeners = server.getListeningSockets();
+    ASSERT_FALSE(listeners.empty());
+    struct sockaddr_in bound;
+    socklen_t bound_length = sizeof(bound);
+    ASSERT_EQ(getsockname(listeners[0], (struct sockaddr*)&bound, &bound_length), 0);
+    
+    // A truncated varint: the server closes the connection without a reply
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(sendAndAwaitClose(ntohs(bound.sin_port), std::string(5, '\xff')));
+    }
+    
+    EXPECT_EQ(admission.getLimit(), 2u);
+    EXPECT_EQ(admission.getInFlight(), 0u);
+    server.stop();
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include "bid_handler.h"
+#include "campaign_budgets.h"
+#include "data_structures/frequency_cap_store.h"
+#include "pricing_model.h"
+#include "win_notice_protocol.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+bidding::BidBatchRequest makeBatch(const std::vector<std::pair<std::string, double>>& candidates,
+                                   size_t slots, double floor_price) {
+    bidding::BidBatchRequest request;
+    request.set_id("page");
+    request.set_user_id("user");
+    for (size_t i = 0; i < slots; ++i) {
+        auto* slot = request.add_slots();
+        slot->set_ad_slot_id("slot" + std::to_string(i));
+        slot->set_floor_price(floor_price);
+    }
+    for (const auto& [campaign_id, bid] : candidates) {
+        auto* candidate = request.add_candidates();
+        candidate->set_campaign_id(campaign_id);
+        candidate->set_bid(bid);
+    }
+    return request;
+}
+
+}
+
+TEST(BidHandlerBatchTest, EachSlotHasItsOwnSecondPrice) {
+    BidHandler handler(1);
+    auto batch = handler.scoreBatch(makeBatch({{"a", 3.0}, {"b", 2.0}}, 2, 0.5));
+    ASSERT_EQ(batch.responses_size(), 2);
+    for (const auto& response : batch.responses()) {
+        EXPECT_TRUE(response.won());
+        EXPECT_EQ(response.campaign_id(), "a");
+        EXPECT_DOUBLE_EQ(response.price(), 2.0);
+    }
+    
+    batch = handler.scoreBatch(makeBatch({{"a", 3.0}}, 1, 0.5));
+    EXPECT_DOUBLE_EQ(batch.responses(0).price(), 0.5);
+    
+    batch = handler.scoreBatch(makeBatch({{"a", 0.4}}, 1, 0.5));
+    EXPECT_FALSE(batch.responses(0).won());
+}
+
+TEST(BidHandlerBatchTest, SlotsMoveOnOnceCapOrLeaseRunsOut) {
+    FrequencyCapConfig cap_config;
+    cap_config.enabled = true;
+    cap_config.memory_mb = 1;
+    cap_config.campaign_caps["a"] = 1;
+    FrequencyCapStore caps(cap_config);
+    CampaignBudgets budgets({{"b", 1.0}}, 1);
+    
+    BidHandler handler(1);
+    handler.setFrequencyCaps(&caps);
+    handler.setBudgets(&budgets);
+    
+    // a's second candidate must not win it a second slot past its cap
+    auto batch = handler.scoreBatch(makeBatch({{"a", 3.0}, {"a", 2.5}, {"b", 2.0}, {"c", 1.0}}, 4, 0.5));
+    ASSERT_EQ(batch.responses_size(), 4);
+    
+    EXPECT_EQ(batch.responses(0).campaign_id(), "a");
+    EXPECT_DOUBLE_EQ(batch.responses(0).price(), 2.0);
+    // a is at its cap, so b wins and c sets the price; that spends b's lease
+    EXPECT_EQ(batch.responses(1).campaign_id(), "b");
+    EXPECT_DOUBLE_EQ(batch.responses(1).price(), 1.0);
+    EXPECT_EQ(batch.responses(2).campaign_id(), "c");
+    EXPECT_DOUBLE_EQ(batch.responses(2).price(), 0.5);
+    EXPECT_EQ(batch.responses(3).campaign_id(), "c");
+    
+    EXPECT_EQ(caps.count("user", "a"), 1u);
+    EXPECT_TRUE(caps.isCapped("user", "a"));
+}
+
+TEST(BidHandlerBatchTest, PricingModelShadesEachSlotLikeScoreBid) {
+    auto makeModel = []() {
+        auto model = std::make_unique<PricingModel>();
+        model->addFloorPriceFeature();
+        model->addKeyFeature("premium_user");
+        model->setLinear(-1.0f, {0.8f, 0.5f});
+        model->setShadeRange(0.5f, 0.9f);
+        return model;
+    };
+    auto reference = makeModel();
+    
+    BidHandler handler(1);
+    handler.setPricingModel(makeModel());
+    
+    auto request = makeBatch({{"a", 3.0}, {"b", 2.9}}, 3, 0.5);
+    request.mutable_slots(1)->set_floor_price(1.5);
+    request.mutable_slots(2)->set_floor_price(3.0);
+    (*request.mutable_targeting())["premium_user"] = "true";
+    auto batch = handler.scoreBatch(request);
+    ASSERT_EQ(batch.responses_size(), 3);
+    
+    for (int i = 0; i < 3; ++i) {
+        bidding::BidRequest single;
+        single.set_floor_price(request.slots(i).floor_price());
+        *single.mutable_targeting() = request.targeting();
+        const auto& response = batch.responses(i);
+        EXPECT_EQ(response.campaign_id(), "a");
+        EXPECT_DOUBLE_EQ(response.price(), reference->price(response.winning_bid(), single)) << "slot " << i;
+    }
+    EXPECT_LT(batch.responses(0).price(), batch.responses(1).price());
+}
+
+TEST(BidHandlerBatchTest, OutcomesCorrectTheShadeOfEachWinner) {
+    auto model = std::make_unique<PricingModel>();
+    model->setLinear(0.0f, {});
+    model->setShadeRange(0.5f, 0.9f);
+    model->setWinRateFeedback(0.3f, 0.5f, 100);
+    
+    CampaignOutcomeTable outcomes(16);
+    WinNotice notice;
+    setNoticeCampaign(notice, "a");
+    for (int i = 0; i < 200; ++i) {
+        NoticeOutcome outcome = i < 20 ? NoticeOutcome::WIN : NoticeOutcome::LOSS;
+        outcomes.apply(notice.campaign_id, outcome, 1000000, 500000);
+    }
+    
+    BidHandler handler(1);
+    handler.setPricingModel(std::move(model));
+    handler.setOutcomes(&outcomes);
+    
+    // a wins 10% against a 30% target, so it pays 0.7 + 0.5 * 0.2 of its bid; b has no notices
+    auto batch = handler.scoreBatch(makeBatch({{"a", 2.0}}, 1, 0.1));
+    EXPECT_DOUBLE_EQ(batch.responses(0).price(), 2.0 * 0.8f);
+    batch = handler.scoreBatch(makeBatch({{"b", 2.0}}, 1, 0.1));
+    EXPECT_DOUBLE_EQ(batch.responses(0).price(), 2.0 * 0.7f);
+    
+    bidding::BidRequest request;
+    request.set_id("r");
+    request.set_user_id("user");
+    request.set_ad_slot_id("slot");
+    request.set_campaign_id("a");
+    request.set_floor_price(1.0);
+    (*request.mutable_targeting())["premium_user"] = "true";
+    EXPECT_DOUBLE_EQ(handler.scoreBid(request).price(), 1.5 * 0.8f);
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "campaign_budgets.h"
+#include "win_notice_ingest.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+uint64_t campaignKey(const std::string& campaign_id) {
+    return winNoticeKey(campaign_id.data(), std::min(campaign_id.size(), kWinNoticeCampaignBytes));
+}
+
+void addNotice(std::vector<char>& datagram, const std::string& campaign_id, NoticeOutcome outcome,
+               uint32_t price_micros) {
+    WinNotice notice;
+    std::memset(&notice, 0, sizeof(notice));
+    setNoticeCampaign(notice, campaign_id);
+    notice.bid_micros = price_micros * 2;
+    notice.price_micros = price_micros;
+    notice.outcome = static_cast<uint8_t>(outcome);
+    const char* bytes = reinterpret_cast<const char*>(&notice);
+    datagram.insert(datagram.end(), bytes, bytes + sizeof(notice));
+    
+    WinNoticeHeader header;
+    std::memcpy(&header, datagram.data(), sizeof(header));
+    ++header.count;
+    std::memcpy(datagram.data(), &header, sizeof(header));
+}
+
+std::vector<char> emptyDatagram() {
+    WinNoticeHeader header{kWinNoticeMagic, kWinNoticeVersion, 0, 1};
+    const char* bytes = reinterpret_cast<const char*>(&header);
+    return std::vector<char>(bytes, bytes + sizeof(header));
+}
+
+}
+
+TEST(CampaignBudgetsTest, WinNoticesChargeClearingPrices) {
+    const std::string long_id = "campaign-with-a-very-long-identifier";
+    CampaignBudgets budgets({{"c1", 1.0}, {long_id, 1.0}}, 1);
+    WinNoticeIngest ingest(WinNoticeConfig{});
+    ingest.setBudgets(&budgets);
+    
+    auto datagram = emptyDatagram();
+    addNotice(datagram, "c1", NoticeOutcome::WIN, 400000);
+    addNotice(datagram, "c1", NoticeOutcome::LOSS, 300000);
+    addNotice(datagram, long_id, NoticeOutcome::WIN, 250000);
+    addNotice(datagram, "unbudgeted", NoticeOutcome::WIN, 100000);
+    EXPECT_EQ(ingest.ingest(datagram.data(), datagram.size()), 4u);
+    
+    EXPECT_DOUBLE_EQ(budgets.remaining("c1"), 0.6);
+    EXPECT_DOUBLE_EQ(budgets.remaining(long_id), 0.75);
+    EXPECT_TRUE(budgets.allow("c1"));
+    
+    datagram = emptyDatagram();
+    addNotice(datagram, "c1", NoticeOutcome::WIN, 600000);
+    ingest.ingest(datagram.data(), datagram.size());
+    EXPECT_DOUBLE_EQ(budgets.remaining("c1"), 0.0);
+    EXPECT_FALSE(budgets.allow("c1"));
+}
+
+TEST(CampaignBudgetsTest, MergeKeepsTheHighestCountersPerReplica) {
+    CampaignBudgets budgets({{"c", 10.0}}, 1);
+    const uint64_t peer = uint64_t(2) << 32 | 7;
+    const uint64_t key = campaignKey("c");
+    
+    EXPECT_TRUE(budgets.merge({key, peer, 300000, 5}));
+    EXPECT_FALSE(budgets.merge({key, peer, 200000, 4}));
+    EXPECT_TRUE(budgets.merge({key, peer, 300000, 6}));
+    // Own counters, and campaigns without a budget here, are ignored
+    EXPECT_FALSE(budgets.merge({key, budgets.replicaId(), 900000, 9}));
+    EXPECT_FALSE(budgets.merge({campaignKey("other"), peer, 100, 1}));
+    
+    std::vector<PeerCounter> counters;
+    ASSERT_EQ(budgets.takeCounters(counters, 16, true), 2u);
+    EXPECT_EQ(counters[0].replica, budgets.replicaId());
+    EXPECT_EQ(counters[0].spend_micros, 0u);
+    EXPECT_EQ(counters[1].replica, peer);
+    EXPECT_EQ(counters[1].spend_micros, 300000u);
+    EXPECT_EQ(counters[1].demand, 6u);
+    
+    // Nothing changed since, so only a full resend has anything to take
+    counters.clear();
+    EXPECT_EQ(budgets.takeCounters(counters, 16, false), 0u);
+    EXPECT_EQ(budgets.takeCounters(counters, 1, true), 1u);
+    EXPECT_EQ(counters[0].replica, budgets.replicaId());
+}
+
+TEST(CampaignBudgetsTest, RebalanceSharesTheRemainderByDemand) {
+    CampaignBudgets budgets({{"c", 100.0}}, 1, 2);
+    EXPECT_DOUBLE_EQ(budgets.remaining("c"), 50.0);
+    
+    const uint64_t peer = uint64_t(2) << 32 | 7;
+    for (int i = 0; i < 300; ++i) {
+        budgets.allow("c");
+    }
+    budgets.merge({campaignKey("c"), peer, 10000000, 100});
+    
+    // Demand rates of 300 and 100/s, each plus the floor of 1, split the 90 left
+    budgets.rebalance({peer}, 1.0);
+    EXPECT_NEAR(budgets.remaining("c"), 90.0 * 301.0 / 402.0, 1e-5);
+    
+    // Once the peer goes quiet the whole remainder is ours, but its spend still counts
+    budgets.rebalance({}, 1.0);
+    EXPECT_NEAR(budgets.remaining("c"), 90.0, 1e-5);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include "data_structures/frequency_cap_store.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+FrequencyCapConfig smallConfig(unsigned window_seconds) {
+    FrequencyCapConfig config;
+    config.enabled = true;
+    config.memory_mb = 1;
+    config.window_seconds = window_seconds;
+    config.default_cap = 100;
+    return config;
+}
+
+// Sleeps until `into` milliseconds past the start of the next one-second window
+void sleepIntoNextSecond(unsigned into) {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000 - now % 1000 + into));
+}
+
+}
+
+TEST(FrequencyCapStoreTest, CountsPerPairAndUncappedCampaignsAreNotStored) {
+    FrequencyCapConfig config = smallConfig(3600);
+    config.campaign_caps["free"] = 0;
+    FrequencyCapStore store(config);
+    
+    store.record("u1", "c1", 3);
+    store.record("u1", "c1");
+    store.record("u2", "c1");
+    store.record("u1", "free", 7);
+    EXPECT_EQ(store.count("u1", "c1"), 4u);
+    EXPECT_EQ(store.count("u2", "c1"), 1u);
+    EXPECT_EQ(store.count("u1", "c2"), 0u);
+    EXPECT_EQ(store.count("u1", "free"), 0u);
+    
+    EXPECT_FALSE(store.isCapped("u1", "c1"));
+    store.record("u1", "c1", 96);
+    EXPECT_TRUE(store.isCapped("u1", "c1"));
+}
+
+TEST(FrequencyCapStoreTest, CountsSaturate) {
+    FrequencyCapStore store(smallConfig(3600));
+    store.record("u", "c", 4000);
+    store.record("u", "c", 4000);
+    EXPECT_EQ(store.count("u", "c"), FrequencyCapStore::kMaxCount);
+}
+
+TEST(FrequencyCapStoreTest, PreviousWindowFadesOutOfTheSlidingWindow) {
+    FrequencyCapStore store(smallConfig(1));
+    sleepIntoNextSecond(20);
+    store.record("u", "c", 100);
+    EXPECT_EQ(store.count("u", "c"), 100u);
+    
+    // Half way into the next window, half of the previous one still counts
+    sleepIntoNextSecond(500);
+    uint32_t halfway = store.count("u", "c");
+    EXPECT_GE(halfway, 40u);
+    EXPECT_LE(halfway, 60u);
+    
+    // An update rolls the word: the old count becomes the previous window
+    store.record("u", "c", 10);
+    uint32_t rolled = store.count("u", "c");
+    EXPECT_GE(rolled, halfway + 10 - 5);
+    EXPECT_LE(rolled, halfway + 10 + 5);
+    
+    // Two windows on, nothing is left
+    sleepIntoNextSecond(0);
+    sleepIntoNextSecond(20);
+    EXPECT_EQ(store.count("u", "c"), 0u);
+}
+
+TEST(FrequencyCapStoreTest, ConcurrentInsertsOfOnePairAreNotSplit) {
+    constexpr int kThreads = 8;
+    constexpr int kPairs = 2000;
+    FrequencyCapStore store(smallConfig(3600));
+    std::vector<std::string> users;
+    for (int i = 0; i < kPairs; ++i) {
+        users.push_back("user-" + std::to_string(i));
+    }
+    
+    // Every thread walks the same new pairs in the same order, so first
+    // inserts of a pair collide as often as possible
+    std::atomic<int> ready(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&]() {
+            ready.fetch_add(1);
+            while (ready.load() < kThreads) {
+            }
+            for (const auto& user : users) {
+                store.record(user, "campaign");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    for (const auto& user : users) {
+        ASSERT_EQ(store.count(user, "campaign"), static_cast<uint32_t>(kThreads)) << user;
+    }
+    EXPECT_NE(store.getPrometheusFormat().find("bidding_frequency_cap_slots_used " + std::to_string(kPairs)),
+              std::string::npos);
+}
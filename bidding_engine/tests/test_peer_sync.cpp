@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "campaign_budgets.h"
+#include "peer_sync.h"
+#include "win_notice_protocol.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+// UDP socket on 127.0.0.1 and an ephemeral port
+int boundSocket(int& port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        getsockname(fd, (struct sockaddr*)&address, &length) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+void sendCounter(int fd, int port, uint64_t sender, const PeerCounter& counter) {
+    char datagram[sizeof(PeerSyncHeader) + sizeof(PeerCounter)];
+    PeerSyncHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = kPeerSyncMagic;
+    header.version = kPeerSyncVersion;
+    header.sender = sender;
+    header.counter_count = 1;
+    std::memcpy(datagram, &header, sizeof(header));
+    std::memcpy(datagram + sizeof(header), &counter, sizeof(counter));
+    
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    ASSERT_EQ(sendto(fd, datagram, sizeof(datagram), 0, (struct sockaddr*)&address, sizeof(address)),
+              static_cast<ssize_t>(sizeof(datagram)));
+}
+
+bool waitForMetric(const PeerSync& sync, const std::string& line) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (sync.getPrometheusFormat().find(line) != std::string::npos) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+}
+
+TEST(PeerSyncTest, DropsDatagramsFromOutsideThePeerList) {
+    int peer_port = 0;
+    int stranger_port = 0;
+    int engine_port = 0;
+    int peer = boundSocket(peer_port);
+    int stranger = boundSocket(stranger_port);
+    int probe = boundSocket(engine_port);
+    ASSERT_GE(peer, 0);
+    ASSERT_GE(stranger, 0);
+    ASSERT_GE(probe, 0);
+    close(probe);
+    
+    CampaignBudgets budgets({{"c", 10.0}}, 1);
+    PeerSyncConfig config;
+    config.enabled = true;
+    config.node_id = 1;
+    config.host = "127.0.0.1";
+    config.port = engine_port;
+    config.peers = {"127.0.0.1:" + std::to_string(peer_port)};
+    config.interval_ms = 10;
+    PeerSync sync(config, &budgets, nullptr);
+    sync.start();
+    
+    const uint64_t key = winNoticeKey("c", 1);
+    sendCounter(stranger, engine_port, uint64_t(3) << 32 | 1, {key, uint64_t(3) << 32 | 1, 9000000, 10});
+    EXPECT_TRUE(waitForMetric(sync, "bidding_peer_sync_errors_total{reason=\"unknown_sender\"} 1\n"));
+    EXPECT_NE(sync.getPrometheusFormat().find("bidding_peer_sync_counters_total{result=\"merged\"} 0\n"),
+              std::string::npos);
+    
+    sendCounter(peer, engine_port, uint64_t(2) << 32 | 1, {key, uint64_t(2) << 32 | 1, 1000000, 10});
+    EXPECT_TRUE(waitForMetric(sync, "bidding_peer_sync_counters_total{result=\"merged\"} 1\n"));
+    
+    sync.stop();
+    close(peer);
+    close(stranger);
+}
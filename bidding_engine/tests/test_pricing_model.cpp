@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include "pricing_model.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace {
+
+CampaignOutcome outcomeWith(uint64_t notices, uint64_t wins) {
+    CampaignOutcome outcome;
+    outcome.notices = notices;
+    outcome.wins = wins;
+    return outcome;
+}
+
+}
+
+TEST(PricingModelTest, FeedbackMovesTheShadeTowardsTheTargetWinRate) {
+    PricingModel model;
+    model.setLinear(0.0f, {});
+    model.setShadeRange(0.5f, 0.9f);
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(1000, 100)), 0.7f);
+    
+    model.setWinRateFeedback(0.3f, 0.5f, 100);
+    // Too few notices to trust yet
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(99, 0)), 0.7f);
+    // Losing too often pays more of the bid, winning too often less
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(1000, 100)), 0.8f);
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(1000, 500)), 0.6f);
+    // Never outside the shade range
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(1000, 0)), 0.85f);
+    EXPECT_FLOAT_EQ(model.adjustShade(0.7f, outcomeWith(1000, 1000)), 0.5f);
+    
+    bidding::BidRequest request;
+    request.set_floor_price(0.1);
+    CampaignOutcome losing = outcomeWith(1000, 100);
+    EXPECT_DOUBLE_EQ(model.price(1.0, request), 0.7f);
+    EXPECT_DOUBLE_EQ(model.price(1.0, request, &losing), 0.8f);
+    
+    EXPECT_THROW(model.setWinRateFeedback(1.0f, 0.5f, 100), std::runtime_error);
+    EXPECT_THROW(model.setWinRateFeedback(0.3f, -1.0f, 100), std::runtime_error);
+}
+
+TEST(PricingModelTest, LoadsFeedbackFromTheModelFile) {
+    std::string path = ::testing::TempDir() + "pricing_model_feedback.yaml";
+    {
+        std::ofstream file(path);
+        file << "features:\n"
+                "  - numeric: floor_price\n"
+                "bias: 0.0\n"
+                "weights: [0.0]\n"
+                "shade: {min: 0.5, max: 0.9}\n"
+                "feedback: {target_win_rate: 0.4, gain: 1.0}\n";
+    }
+    auto model = PricingModel::loadFile(path);
+    std::remove(path.c_str());
+    
+    // min_notices defaults to 100
+    EXPECT_FLOAT_EQ(model->adjustShade(0.7f, outcomeWith(99, 0)), 0.7f);
+    EXPECT_FLOAT_EQ(model->adjustShade(0.7f, outcomeWith(100, 30)), 0.8f);
+}
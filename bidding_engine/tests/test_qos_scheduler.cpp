@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "qos_scheduler.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+QosConfig twoClasses(unsigned weight_a, unsigned weight_b, size_t max_queue) {
+    QosConfig config;
+    config.enabled = true;
+    config.concurrency = 1;
+    config.max_wait_us = 1000000;
+    config.classes.push_back({"a", weight_a, max_queue, {}});
+    config.classes.push_back({"b", weight_b, max_queue, {}});
+    return config;
+}
+
+bool hasMetric(const QosScheduler& qos, const std::string& line) {
+    return qos.getPrometheusFormat().find(line) != std::string::npos;
+}
+
+}
+
+TEST(QosSchedulerTest, FreedSlotsGoToClassesByWeight) {
+    QosScheduler qos(twoClasses(2, 1, 16));
+    std::vector<uint64_t> granted;
+    auto record = [&granted](uint64_t key) { return [&granted, key]() { granted.push_back(key); }; };
+    
+    int64_t queued_us = 0;
+    ASSERT_EQ(qos.admit(0, 100, record(100), queued_us), QosScheduler::Admission::ADMITTED);
+    EXPECT_EQ(queued_us, 0);
+    for (uint64_t key : {1, 2, 3, 4}) {
+        EXPECT_EQ(qos.admit(0, key, record(key), queued_us), QosScheduler::Admission::QUEUED);
+    }
+    for (uint64_t key : {11, 12, 13}) {
+        EXPECT_EQ(qos.admit(1, key, record(key), queued_us), QosScheduler::Admission::QUEUED);
+    }
+    // Asking again before the grant changes nothing
+    EXPECT_EQ(qos.admit(0, 1, record(1), queued_us), QosScheduler::Admission::QUEUED);
+    EXPECT_TRUE(granted.empty());
+    
+    // One slot: every release hands it to exactly one waiter, which takes it
+    size_t tenant = 0;
+    for (size_t i = 0; i < 7; ++i) {
+        qos.release(tenant, 0);
+        ASSERT_EQ(granted.size(), i + 1);
+        uint64_t key = granted.back();
+        tenant = key > 10 ? 1 : 0;
+        EXPECT_EQ(qos.admit(tenant, key, record(key), queued_us), QosScheduler::Admission::ADMITTED);
+        EXPECT_GE(queued_us, 0);
+    }
+    qos.release(tenant, 0);
+    
+    EXPECT_EQ(granted, (std::vector<uint64_t>{1, 2, 11, 3, 4, 12, 13}));
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_in_flight 0\n"));
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_admitted_total{class=\"a\"} 5\n"));
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_admitted_total{class=\"b\"} 3\n"));
+}
+
+TEST(QosSchedulerTest, ShedsWhenTheQueueIsFullOrTheWaitTooLong) {
+    QosConfig config = twoClasses(1, 1, 1);
+    config.max_wait_us = 1000;
+    QosScheduler qos(config);
+    bool woken = false;
+    auto wake = [&woken]() { woken = true; };
+    
+    int64_t queued_us = 0;
+    ASSERT_EQ(qos.admit(0, 1, wake, queued_us), QosScheduler::Admission::ADMITTED);
+    EXPECT_EQ(qos.admit(0, 2, wake, queued_us), QosScheduler::Admission::QUEUED);
+    EXPECT_EQ(qos.admit(0, 3, wake, queued_us), QosScheduler::Admission::SHED);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(qos.admit(0, 2, wake, queued_us), QosScheduler::Admission::SHED);
+    qos.release(0, 0);
+    EXPECT_FALSE(woken);
+    
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_shed_total{class=\"a\",reason=\"queue_full\"} 1\n"));
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_shed_total{class=\"a\",reason=\"timeout\"} 1\n"));
+    EXPECT_EQ(qos.admit(1, 4, wake, queued_us), QosScheduler::Admission::ADMITTED);
+}
+
+TEST(QosSchedulerTest, CancelWithdrawsAWaiterOrGivesItsSlotBack) {
+    QosScheduler qos(twoClasses(1, 1, 16));
+    std::vector<uint64_t> granted;
+    auto record = [&granted](uint64_t key) { return [&granted, key]() { granted.push_back(key); }; };
+    
+    int64_t queued_us = 0;
+    ASSERT_EQ(qos.admit(0, 1, record(1), queued_us), QosScheduler::Admission::ADMITTED);
+    EXPECT_EQ(qos.admit(0, 2, record(2), queued_us), QosScheduler::Admission::QUEUED);
+    EXPECT_EQ(qos.admit(1, 3, record(3), queued_us), QosScheduler::Admission::QUEUED);
+    
+    // A closed connection's waiter never gets the slot
+    qos.cancel(0, 2);
+    qos.release(0, 0);
+    EXPECT_EQ(granted, (std::vector<uint64_t>{3}));
+    
+    // Granted but gone before taking it: the slot comes back
+    qos.cancel(1, 3);
+    EXPECT_TRUE(hasMetric(qos, "bidding_qos_in_flight 0\n"));
+    EXPECT_EQ(qos.admit(0, 4, record(4), queued_us), QosScheduler::Admission::ADMITTED);
+}
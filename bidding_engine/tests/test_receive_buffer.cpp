@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include "data_structures/receive_buffer.h"
+#include <arpa/inet.h>
+#include <string>
+
+namespace {
+
+constexpr size_t kSlabBytes = 64;
+
+std::string frame(const std::string& body, bool batch = false) {
+    uint32_t prefix = static_cast<uint32_t>(body.size()) | (batch ? kBatchFrameFlag : 0);
+    prefix = htonl(prefix);
+    return std::string(reinterpret_cast<const char*>(&prefix), sizeof(prefix)) + body;
+}
+
+std::string pattern(size_t length, char seed) {
+    std::string body(length, '\0');
+    for (size_t i = 0; i < length; ++i) {
+        body[i] = static_cast<char>(seed + i % 23);
+    }
+    return body;
+}
+
+}
+
+TEST(ReceiveBufferTest, ReassemblesFramesFedOneByteAtATime) {
+    MemoryPool pool(32, kSlabBytes);
+    ReceiveBuffer input(pool, 1024);
+    std::string bodies[] = {pattern(10, 'a'), pattern(kSlabBytes * 3 + 5, 'b'), pattern(0, 'c'), pattern(60, 'd')};
+    std::string stream;
+    for (const auto& body : bodies) {
+        stream += frame(body);
+    }
+    
+    size_t next = 0;
+    for (char byte : stream) {
+        input.append(&byte, 1);
+        const char* data;
+        size_t length;
+        while (input.nextFrame(data, length) == ReceiveBuffer::FrameStatus::COMPLETE) {
+            ASSERT_LT(next, 4u);
+            EXPECT_EQ(std::string(data, length), bodies[next]);
+            input.consumeFrame();
+            ++next;
+        }
+    }
+    EXPECT_EQ(next, 4u);
+    EXPECT_EQ(input.size(), 0u);
+}
+
+TEST(ReceiveBufferTest, FrameSpanningSlabsIsLinearized) {
+    MemoryPool pool(32, kSlabBytes);
+    ReceiveBuffer input(pool, 1024);
+    std::string body = pattern(kSlabBytes * 5, 'x');
+    input.append(frame(body, true).data(), body.size() + 4);
+    
+    const char* data;
+    size_t length;
+    ASSERT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::COMPLETE);
+    EXPECT_TRUE(input.isBatchFrame());
+    EXPECT_EQ(std::string(data, length), body);
+    input.consumeFrame();
+    
+    // Slabs go back to the pool, apart from the one kept for the next recv
+    EXPECT_EQ(pool.getUsedCount(), 1u);
+}
+
+TEST(ReceiveBufferTest, PrefixSplitAcrossReads) {
+    MemoryPool pool(32, kSlabBytes);
+    ReceiveBuffer input(pool, 1024);
+    std::string stream = frame("hello") + frame("world");
+    const char* data;
+    size_t length;
+    
+    input.append(stream.data(), 2);
+    EXPECT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::INCOMPLETE);
+    // The rest of the first frame and half of the second's prefix
+    input.append(stream.data() + 2, 9);
+    ASSERT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::COMPLETE);
+    EXPECT_EQ(std::string(data, length), "hello");
+    EXPECT_FALSE(input.isBatchFrame());
+    input.consumeFrame();
+    EXPECT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::INCOMPLETE);
+    input.append(stream.data() + 11, stream.size() - 11);
+    ASSERT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::COMPLETE);
+    EXPECT_EQ(std::string(data, length), "world");
+}
+
+TEST(ReceiveBufferTest, OversizedFrameIsReportedOnceThenSkipped) {
+    MemoryPool pool(32, kSlabBytes);
+    ReceiveBuffer input(pool, 100);
+    std::string big = pattern(1000, 'q');
+    std::string stream = frame(big) + frame("after");
+    const char* data;
+    size_t length;
+    
+    // Arrives in pieces smaller than the frame; the body is dropped as it comes
+    input.append(stream.data(), 300);
+    ASSERT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::TOO_LARGE);
+    EXPECT_EQ(length, 256u);
+    EXPECT_EQ(std::string(data, length), big.substr(0, 256));
+    input.consumeFrame();
+    EXPECT_EQ(input.size(), 0u);
+    
+    size_t offset = 300;
+    while (offset < stream.size()) {
+        size_t chunk = std::min<size_t>(200, stream.size() - offset);
+        input.append(stream.data() + offset, chunk);
+        offset += chunk;
+        EXPECT_LE(input.size(), 200u);
+        if (offset < 4 + big.size()) {
+            EXPECT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::INCOMPLETE);
+        }
+    }
+    ASSERT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::COMPLETE);
+    EXPECT_EQ(std::string(data, length), "after");
+}
+
+TEST(ReceiveBufferTest, OversizedFrameWaitsForItsPrefix) {
+    MemoryPool pool(32, kSlabBytes);
+    ReceiveBuffer input(pool, 100);
+    std::string stream = frame(pattern(500, 'z'));
+    const char* data;
+    size_t length;
+    
+    input.append(stream.data(), 4 + 100);
+    EXPECT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::INCOMPLETE);
+    input.append(stream.data() + 104, 200);
+    EXPECT_EQ(input.nextFrame(data, length), ReceiveBuffer::FrameStatus::TOO_LARGE);
+}
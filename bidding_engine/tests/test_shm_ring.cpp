@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+#include "shm_protocol.h"
+#include "shm_server.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kCapacity = 4096;
+constexpr char kCanary = 0x5a;
+
+// One segment seen through two views, as the engine and a client would
+struct RingFixture {
+    alignas(64) char memory[sizeof(ShmRingHeader) + kCapacity + 256];
+    ShmRing producer;
+    ShmRing consumer;
+    
+    RingFixture() {
+        std::memset(memory, kCanary, sizeof(memory));
+        producer = ShmRing(memory, kCapacity);
+        consumer = ShmRing(memory, kCapacity);
+        producer.init();
+    }
+    
+    ShmRingHeader* header() { return reinterpret_cast<ShmRingHeader*>(memory); }
+    
+    bool canaryIntact() const {
+        for (size_t i = ShmRing::bytesFor(kCapacity); i < sizeof(memory); ++i) {
+            if (memory[i] != kCanary) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+TEST(ShmRingTest, WrapsAroundTheDataArea) {
+    RingFixture ring;
+    std::string sent;
+    std::string received;
+    char buffer[1000];
+    
+    // Odd sizes so chunks straddle the end of the data area many times
+    for (int round = 0; round < 200; ++round) {
+        std::string chunk(997, static_cast<char>('a' + round % 26));
+        chunk[0] = static_cast<char>(round);
+        ASSERT_EQ(ring.producer.write(chunk.data(), chunk.size()), chunk.size());
+        sent += chunk;
+        
+        size_t n = ring.consumer.read(buffer, sizeof(buffer));
+        ASSERT_EQ(n, chunk.size());
+        received.append(buffer, n);
+    }
+    EXPECT_EQ(sent, received);
+    EXPECT_FALSE(ring.producer.corrupt());
+    EXPECT_FALSE(ring.consumer.corrupt());
+    EXPECT_TRUE(ring.canaryIntact());
+}
+
+TEST(ShmRingTest, FullRingTakesOnlyWhatFits) {
+    RingFixture ring;
+    std::string data(kCapacity + 100, 'x');
+    
+    EXPECT_EQ(ring.producer.write(data.data(), data.size()), kCapacity);
+    EXPECT_EQ(ring.producer.writable(), 0u);
+    EXPECT_EQ(ring.producer.write(data.data(), 1), 0u);
+    EXPECT_EQ(ring.consumer.readable(), kCapacity);
+    EXPECT_FALSE(ring.producer.corrupt());
+    
+    std::vector<char> out(kCapacity);
+    ring.consumer.read(out.data(), 10);
+    EXPECT_EQ(ring.producer.writable(), 10u);
+    EXPECT_TRUE(ring.canaryIntact());
+}
+
+TEST(ShmRingTest, TailPastHeadMarksProducerCorrupt) {
+    RingFixture ring;
+    std::string data(100, 'x');
+    ring.producer.write(data.data(), data.size());
+    
+    // The consumer's process moves tail beyond head: head - tail wraps
+    ring.header()->tail.store(ring.header()->head.load() + 64);
+    std::string big(2 * kCapacity, 'y');
+    EXPECT_EQ(ring.producer.write(big.data(), big.size()), 0u);
+    EXPECT_EQ(ring.producer.writable(), 0u);
+    EXPECT_TRUE(ring.producer.corrupt());
+    EXPECT_TRUE(ring.canaryIntact());
+}
+
+TEST(ShmRingTest, HeadTooFarAheadMarksConsumerCorrupt) {
+    RingFixture ring;
+    
+    // The producer's process claims more bytes than the ring can hold
+    ring.header()->head.store(16 * kCapacity);
+    std::vector<char> out(64 * 1024, 0);
+    EXPECT_EQ(ring.consumer.readable(), 0u);
+    EXPECT_EQ(ring.consumer.read(out.data(), out.size()), 0u);
+    EXPECT_TRUE(ring.consumer.corrupt());
+    
+    // Sticky: putting the index back does not revive the ring
+    ring.header()->head.store(0);
+    EXPECT_EQ(ring.consumer.readable(), 0u);
+    EXPECT_TRUE(ring.canaryIntact());
+}
+
+TEST(ShmRingTest, ConsumerTailPastHeadMarksCorrupt) {
+    RingFixture ring;
+    std::string data(100, 'x');
+    ring.producer.write(data.data(), data.size());
+    ASSERT_EQ(ring.consumer.readable(), 100u);
+    
+    ring.header()->tail.store(1000);
+    char out[256];
+    EXPECT_EQ(ring.consumer.peek(out, sizeof(out)), 0u);
+    EXPECT_TRUE(ring.consumer.corrupt());
+}
+
+namespace {
+
+// Just enough of the client handshake to get at the segment
+struct RawClient {
+    int control_fd = -1;
+    int fds[SHM_FD_COUNT] = {-1, -1, -1, -1};
+    void* segment = MAP_FAILED;
+    size_t segment_bytes = 0;
+    ShmHello hello;
+    
+    bool connect(const std::string& path) {
+        struct sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        control_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (::connect(control_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            return false;
+        }
+        
+        struct iovec iov = {&hello, sizeof(hello)};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(control_fd, &msg, MSG_WAITALL) != static_cast<ssize_t>(sizeof(hello))) {
+            return false;
+        }
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+            return false;
+        }
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        segment_bytes = hello.segment_bytes;
+        segment = mmap(nullptr, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fds[SHM_FD_SEGMENT], 0);
+        return segment != MAP_FAILED;
+    }
+    
+    ShmRingHeader* requestHeader() {
+        return reinterpret_cast<ShmRingHeader*>(static_cast<char*>(segment) + sizeof(ShmSegmentHeader));
+    }
+    
+    // True once the engine has closed the session
+    bool waitForHangup(int timeout_ms) {
+        struct pollfd pfd = {control_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        char byte;
+        return recv(control_fd, &byte, 1, MSG_DONTWAIT) == 0;
+    }
+    
+    ~RawClient() {
+        if (segment != MAP_FAILED) {
+            munmap(segment, segment_bytes);
+        }
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        if (control_fd >= 0) {
+            close(control_fd);
+        }
+    }
+};
+
+}
+
+TEST(ShmServerTest, DropsSessionWithCorruptRequestIndexes) {
+    ShmTransportConfig config;
+    config.enabled = true;
+    config.path = "/tmp/bidding_test_shm_" + std::to_string(getpid()) + ".sock";
+    config.ring_bytes = kCapacity;
+    config.spin_us = 0;
+    MemoryPool pool(64, 8192);
+    size_t frames = 0;
+    ShmServer server(config, pool, 1 << 20,
+                     [&frames](uint32_t, size_t, ReceiveBuffer& input, std::string&) {
+                         const char* data;
+                         size_t length;
+                         while (input.nextFrame(data, length) == ReceiveBuffer::FrameStatus::COMPLETE) {
+                             input.consumeFrame();
+                             ++frames;
+                         }
+                         return true;
+                     });
+    server.start();
+    
+    RawClient client;
+    ASSERT_TRUE(client.connect(config.path));
+    ASSERT_EQ(client.hello.ring_bytes, kCapacity);
+    
+    // Claim ten ring's worth of requests, well under the engine's per-pass
+    // read limit, then wake the serving thread
+    client.requestHeader()->head.store(10 * kCapacity, std::memory_order_release);
+    uint64_t one = 1;
+    ASSERT_EQ(write(client.fds[SHM_FD_SERVER_EVENT], &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    
+    EXPECT_TRUE(client.waitForHangup(5000));
+    EXPECT_EQ(frames, 0u);
+    EXPECT_NE(server.getPrometheusFormat().find("bidding_shm_malformed_total 1"), std::string::npos);
+    server.stop();
+}
@@ -0,0 +1,90 @@
+#include "event_logger.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// bidding_eventlog_dump: prints the records of one or more .evlog files
+// written by the engine's event logger as CSV.
+
+namespace {
+
+const char* typeName(uint8_t type) {
+    return type == static_cast<uint8_t>(BidEventType::WIN) ? "win" : "bid";
+}
+
+const char* statusName(uint8_t status) {
+    switch (static_cast<BidEventStatus>(status)) {
+        case BidEventStatus::SUCCESS: return "success";
+        case BidEventStatus::THROTTLED: return "throttled";
+        case BidEventStatus::CIRCUIT_OPEN: return "circuit_breaker_open";
+        case BidEventStatus::ERROR: return "error";
+        default: return "other";
+    }
+}
+
+bool dumpFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    
+    std::vector<char> compressed;
+    std::vector<BidEventRecord> records;
+    uint64_t offset = 0;
+    EventBlockHeader header;
+    
+    while (in.seekg(offset) && in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        if (header.magic != kEventBlockMagic ||
+            header.raw_bytes != header.record_count * sizeof(BidEventRecord)) {
+            std::cerr << path << ": bad block at offset " << offset << std::endl;
+            return false;
+        }
+        
+        compressed.resize(header.compressed_bytes);
+        records.resize(header.record_count);
+        if (!in.read(compressed.data(), compressed.size())) {
+            std::cerr << path << ": truncated block at offset " << offset << std::endl;
+            return false;
+        }
+        
+        uLongf raw_bytes = header.raw_bytes;
+        if (uncompress(reinterpret_cast<Bytef*>(records.data()), &raw_bytes,
+                       reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()) != Z_OK) {
+            std::cerr << path << ": corrupt block at offset " << offset << std::endl;
+            return false;
+        }
+        
+        for (const auto& r : records) {
+            std::cout << r.timestamp_ns << ',' << typeName(r.type) << ','
+                      << statusName(r.status) << ','
+                      << std::string(r.request_id, strnlen(r.request_id, sizeof(r.request_id))) << ','
+                      << std::string(r.campaign_id, strnlen(r.campaign_id, sizeof(r.campaign_id))) << ','
+                      << r.winning_bid << ',' << r.price << ',' << int(r.won) << ','
+                      << r.latency_ms << '\n';
+        }
+        
+        size_t used = sizeof(EventBlockHeader) + header.compressed_bytes;
+        offset += (used + kEventBlockAlign - 1) & ~(kEventBlockAlign - 1);
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: bidding_eventlog_dump FILE.evlog..." << std::endl;
+        return 1;
+    }
+    
+    std::cout << "timestamp_ns,type,status,request_id,campaign_id,winning_bid,price,won,latency_ms\n";
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        ok = dumpFile(argv[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
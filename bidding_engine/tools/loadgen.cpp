@@ -0,0 +1,508 @@
+#include "wire_client.h"
+#include "bidding_shm.h"
+#include "data_structures/hdr_histogram.h"
+#include "data_structures/lockfree_queue.h"
+#include "proto/bid.pb.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bidding_loadgen: drives length-prefixed BidRequest frames at the engine,
+// or BidBatchRequest frames carrying --slots ad slots each.
+//
+//   closed loop: each connection keeps exactly one request outstanding.
+//   open loop:   requests are sent on a fixed schedule regardless of how
+//                fast responses come back, and latency is measured from the
+//                intended send time so stalls are not hidden (no
+//                coordinated omission).
+//
+// With --shm the same frames go through the engine's shared-memory
+// transport instead of TCP, one session per connection.
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadgenOptions {
+    std::string host = "127.0.0.1";
+    int port = 5000;
+    std::string source;             // local address to connect from, e.g. to pick a QoS class
+    std::string shm_path;           // non-empty: use the shared-memory transport
+    size_t connections = 4;
+    std::string mode = "closed";
+    double rate = 10000.0;
+    double duration_s = 10.0;
+    double warmup_s = 1.0;
+    size_t pool_size = 4096;
+    size_t targeting_keys = 6;
+    std::string targeting_dist = "uniform";
+    double zipf_skew = 1.1;
+    size_t value_bytes = 8;
+    double premium_ratio = 0.2;
+    size_t users = 1000000;
+    size_t slots = 0;               // 0 = single BidRequest frames
+    size_t candidates = 8;
+    uint64_t seed = 1;
+};
+
+struct ConnectionStats {
+    HdrHistogram latency_ns;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t errors = 0;
+    uint64_t slot_responses = 0;
+    std::map<std::string, uint64_t> statuses;
+};
+
+namespace {
+
+void usage() {
+    std::cerr <<
+        "Usage: bidding_loadgen [options]\n"
+        "  --host HOST              engine host (127.0.0.1)\n"
+        "  --source ADDR            local address to connect from (any)\n"
+        "  --port PORT              engine port (5000)\n"
+        "  --shm PATH               connect over shared memory via this control socket\n"
+        "  --connections N          concurrent connections (4)\n"
+        "  --mode closed|open       closed loop or constant arrival rate (closed)\n"
+        "  --rate R                 open loop: total requests/sec (10000)\n"
+        "  --duration S             measured seconds (10)\n"
+        "  --warmup S               unmeasured warmup seconds (1)\n"
+        "  --pool N                 distinct pre-built requests (4096)\n"
+        "  --targeting-keys N       max targeting keys per request (6)\n"
+        "  --targeting-dist D       uniform|zipf key popularity (uniform)\n"
+        "  --zipf-skew S            skew for zipf keys and user ids (1.1)\n"
+        "  --value-bytes N          bytes per targeting value, sets payload size (8)\n"
+        "  --premium-ratio P        fraction of requests tagged premium_user (0.2)\n"
+        "  --users N                distinct user ids (1000000)\n"
+        "  --slots N                send batch frames with N ad slots (0 = single requests)\n"
+        "  --candidates N           batch mode: candidate campaigns per frame (8)\n"
+        "  --seed N                 RNG seed (1)\n";
+}
+
+bool parseOptions(int argc, char* argv[], LoadgenOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--host") options.host = value;
+        else if (arg == "--source") options.source = value;
+        else if (arg == "--port") options.port = std::stoi(value);
+        else if (arg == "--shm") options.shm_path = value;
+        else if (arg == "--connections") options.connections = std::stoul(value);
+        else if (arg == "--mode") options.mode = value;
+        else if (arg == "--rate") options.rate = std::stod(value);
+        else if (arg == "--duration") options.duration_s = std::stod(value);
+        else if (arg == "--warmup") options.warmup_s = std::stod(value);
+        else if (arg == "--pool") options.pool_size = std::stoul(value);
+        else if (arg == "--targeting-keys") options.targeting_keys = std::stoul(value);
+        else if (arg == "--targeting-dist") options.targeting_dist = value;
+        else if (arg == "--zipf-skew") options.zipf_skew = std::stod(value);
+        else if (arg == "--value-bytes") options.value_bytes = std::stoul(value);
+        else if (arg == "--premium-ratio") options.premium_ratio = std::stod(value);
+        else if (arg == "--users") options.users = std::stoul(value);
+        else if (arg == "--slots") options.slots = std::stoul(value);
+        else if (arg == "--candidates") options.candidates = std::stoul(value);
+        else if (arg == "--seed") options.seed = std::stoull(value);
+        else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    
+    if (options.mode != "closed" && options.mode != "open") {
+        std::cerr << "--mode must be closed or open" << std::endl;
+        return false;
+    }
+    options.connections = std::max<size_t>(options.connections, 1);
+    options.pool_size = std::max<size_t>(options.pool_size, 1);
+    options.candidates = std::max<size_t>(options.candidates, 1);
+    return true;
+}
+
+// Inverse-CDF sampler over [0, n)
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double skew) : cdf_(std::max<size_t>(n, 1)) {
+        double sum = 0.0;
+        for (size_t i = 0; i < cdf_.size(); ++i) {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+            cdf_[i] = sum;
+        }
+        for (auto& value : cdf_) {
+            value /= sum;
+        }
+    }
+    
+    size_t operator()(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+std::vector<std::string> buildRequestPool(const LoadgenOptions& options) {
+    static const std::vector<std::string> vocabulary = {
+        "high_value_region", "mobile", "geo", "os", "device", "browser",
+        "language", "age_bucket", "interest", "site_category", "connection",
+        "hour_of_day", "gender", "carrier", "publisher", "page_type"
+    };
+    
+    std::mt19937_64 rng(options.seed);
+    ZipfSampler user_sampler(options.users, options.zipf_skew);
+    ZipfSampler key_sampler(vocabulary.size(), options.zipf_skew);
+    std::uniform_int_distribution<size_t> uniform_key(0, vocabulary.size() - 1);
+    std::uniform_int_distribution<size_t> key_count(0, options.targeting_keys);
+    std::uniform_real_distribution<double> floor_price(0.05, 5.0);
+    std::uniform_real_distribution<double> candidate_bid(0.1, 10.0);
+    std::bernoulli_distribution premium(options.premium_ratio);
+    bool zipf_keys = options.targeting_dist == "zipf";
+    
+    auto fillTargeting = [&](google::protobuf::Map<std::string, std::string>& targeting) {
+        if (premium(rng)) {
+            targeting["premium_user"] = "true";
+        }
+        size_t keys = key_count(rng);
+        for (size_t k = 0; k < keys; ++k) {
+            size_t index = zipf_keys ? key_sampler(rng) : uniform_key(rng);
+            std::string value(options.value_bytes, 'a' + static_cast<char>(rng() % 26));
+            targeting[vocabulary[index]] = value;
+        }
+    };
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    
+    std::vector<std::string> pool;
+    pool.reserve(options.pool_size);
+    for (size_t i = 0; i < options.pool_size; ++i) {
+        if (options.slots > 0) {
+            bidding::BidBatchRequest request;
+            request.set_id("lg-" + std::to_string(i));
+            request.set_timestamp(now_ms);
+            request.set_user_id("user-" + std::to_string(user_sampler(rng)));
+            fillTargeting(*request.mutable_targeting());
+            for (size_t s = 0; s < options.slots; ++s) {
+                auto* slot = request.add_slots();
+                slot->set_ad_slot_id("slot-" + std::to_string((i * options.slots + s) % 64));
+                slot->set_floor_price(floor_price(rng));
+            }
+            for (size_t c = 0; c < options.candidates; ++c) {
+                auto* candidate = request.add_candidates();
+                candidate->set_campaign_id("campaign-" + std::to_string((i + c) % 100));
+                candidate->set_bid(candidate_bid(rng));
+            }
+            pool.push_back(wire::frame(request.SerializeAsString(), true));
+            continue;
+        }
+        
+        bidding::BidRequest request;
+        request.set_id("lg-" + std::to_string(i));
+        request.set_timestamp(now_ms);
+        request.set_user_id("user-" + std::to_string(user_sampler(rng)));
+        request.set_ad_slot_id("slot-" + std::to_string(i % 64));
+        request.set_floor_price(floor_price(rng));
+        request.set_campaign_id("campaign-" + std::to_string(i % 100));
+        fillTargeting(*request.mutable_targeting());
+        
+        pool.push_back(wire::frame(request.SerializeAsString()));
+    }
+    return pool;
+}
+
+void recordStatus(ConnectionStats& stats, const std::string& status) {
+    stats.statuses[status.empty() ? "(empty)" : status]++;
+}
+
+// Batch responses count one status per slot
+void recordResponse(ConnectionStats& stats, const std::string& payload, bool batch) {
+    if (batch) {
+        bidding::BidBatchResponse response;
+        if (!response.ParseFromString(payload)) {
+            stats.statuses["(unparseable)"]++;
+            return;
+        }
+        if (response.responses_size() == 0) {
+            recordStatus(stats, response.status());
+        }
+        for (const auto& slot : response.responses()) {
+            recordStatus(stats, slot.status());
+        }
+        stats.slot_responses += response.responses_size();
+        return;
+    }
+    
+    bidding::BidResponse response;
+    if (response.ParseFromString(payload)) {
+        recordStatus(stats, response.status());
+        stats.slot_responses++;
+    } else {
+        stats.statuses["(unparseable)"]++;
+    }
+}
+
+// One engine session over TCP or shared memory; pool frames carry the
+// length prefix, which the shared-memory library adds itself
+class Connection {
+public:
+    ~Connection() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        if (shm_) {
+            bidding_shm_close(shm_);
+        }
+    }
+    
+    bool open(const LoadgenOptions& options, int timeout_s) {
+        if (!options.shm_path.empty()) {
+            shm_ = bidding_shm_connect(options.shm_path.c_str());
+            timeout_ms_ = timeout_s > 0 ? timeout_s * 1000 : -1;
+            return shm_ != nullptr;
+        }
+        fd_ = wire::connectTo(options.host, options.port, options.source);
+        if (fd_ >= 0 && timeout_s > 0) {
+            struct timeval timeout = {timeout_s, 0};
+            setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+        return fd_ >= 0;
+    }
+    
+    bool send(const std::string& frame) {
+        if (shm_) {
+            bool batch = (static_cast<uint8_t>(frame[0]) & 0x80) != 0;
+            return bidding_shm_send(shm_, frame.data() + 4, static_cast<uint32_t>(frame.size() - 4), batch) == 0;
+        }
+        return wire::sendAll(fd_, frame.data(), frame.size());
+    }
+    
+    bool receive(std::string& payload, bool& batch) {
+        if (shm_) {
+            int is_batch = 0;
+            payload.resize(payload.capacity() > 0 ? payload.capacity() : 4096);
+            int64_t length = bidding_shm_recv(shm_, &payload[0], payload.size(), &is_batch, timeout_ms_);
+            if (length > static_cast<int64_t>(payload.size())) {
+                payload.resize(length);
+                length = bidding_shm_recv(shm_, &payload[0], payload.size(), &is_batch, timeout_ms_);
+            }
+            if (length < 0) {
+                return false;
+            }
+            payload.resize(length);
+            batch = is_batch != 0;
+            return true;
+        }
+        return wire::readFrame(fd_, payload, &batch);
+    }
+
+private:
+    int fd_ = -1;
+    bidding_shm_client* shm_ = nullptr;
+    int timeout_ms_ = -1;
+};
+
+int64_t nanosSince(Clock::time_point origin, Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count();
+}
+
+void runClosedLoop(const LoadgenOptions& options, const std::vector<std::string>& pool,
+                   size_t connection_index, Clock::time_point measure_start,
+                   Clock::time_point end, ConnectionStats& stats) {
+    Connection connection;
+    if (!connection.open(options, 0)) {
+        stats.errors++;
+        return;
+    }
+    
+    std::string payload;
+    bool batch = false;
+    size_t next = connection_index * 7919;
+    while (Clock::now() < end) {
+        const std::string& frame = pool[next++ % pool.size()];
+        auto sent_at = Clock::now();
+        if (!connection.send(frame) || !connection.receive(payload, batch)) {
+            stats.errors++;
+            break;
+        }
+        auto received_at = Clock::now();
+        
+        if (sent_at >= measure_start) {
+            stats.sent++;
+            stats.received++;
+            stats.latency_ns.record(nanosSince(sent_at, received_at));
+            recordResponse(stats, payload, batch);
+        }
+    }
+}
+
+void runOpenLoop(const LoadgenOptions& options, const std::vector<std::string>& pool,
+                 size_t connection_index, Clock::time_point start,
+                 Clock::time_point measure_start, Clock::time_point end,
+                 ConnectionStats& stats) {
+    // Give stragglers a bounded time to answer once sending stops
+    Connection connection;
+    if (!connection.open(options, 5)) {
+        stats.errors++;
+        return;
+    }
+    
+    auto interval = std::chrono::nanoseconds(static_cast<int64_t>(
+        1e9 * options.connections / std::max(options.rate, 1.0)));
+    LockFreeQueue<int64_t> intended(1 << 16);
+    std::atomic<bool> sending_done(false);
+    std::atomic<bool> reader_failed(false);
+    std::atomic<uint64_t> outstanding(0);
+    
+    std::thread reader([&]() {
+        std::string payload;
+        bool batch = false;
+        int64_t intended_ns = 0;
+        while (!sending_done.load() || outstanding.load() > 0) {
+            if (outstanding.load() == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            if (!connection.receive(payload, batch)) {
+                stats.errors++;
+                reader_failed.store(true);
+                break;
+            }
+            auto received_at = Clock::now();
+            while (!intended.pop(intended_ns)) {
+                std::this_thread::yield();
+            }
+            outstanding.fetch_sub(1);
+            
+            auto intended_at = start + std::chrono::nanoseconds(intended_ns);
+            if (intended_at >= measure_start) {
+                stats.received++;
+                stats.latency_ns.record(nanosSince(intended_at, received_at));
+                recordResponse(stats, payload, batch);
+            }
+        }
+    });
+    
+    // Stagger connections across one interval so arrivals are evenly spaced
+    auto next_send = start + interval * connection_index / options.connections;
+    size_t next = connection_index * 7919;
+    while (next_send < end && !reader_failed.load()) {
+        std::this_thread::sleep_until(next_send);
+        
+        int64_t intended_ns = nanosSince(start, next_send);
+        if (!intended.push(intended_ns)) {
+            // More than the queue's worth of requests outstanding: the
+            // engine has stalled, count it rather than block the schedule
+            stats.errors++;
+            break;
+        }
+        outstanding.fetch_add(1);
+        
+        const std::string& frame = pool[next++ % pool.size()];
+        if (!connection.send(frame)) {
+            stats.errors++;
+            break;
+        }
+        if (next_send >= measure_start) {
+            stats.sent++;
+        }
+        next_send += interval;
+    }
+    
+    sending_done.store(true);
+    reader.join();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    LoadgenOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+    
+    std::cout << "Building " << options.pool_size
+              << (options.slots > 0 ? " batch requests of " + std::to_string(options.slots) + " slots..."
+                                    : std::string(" requests..."))
+              << std::endl;
+    std::vector<std::string> pool = buildRequestPool(options);
+    size_t total_bytes = 0;
+    for (const auto& frame : pool) {
+        total_bytes += frame.size();
+    }
+    
+    std::cout << "Target: " << (options.shm_path.empty()
+                                    ? options.host + ":" + std::to_string(options.port)
+                                    : "shm " + options.shm_path)
+              << ", mode: " << options.mode
+              << ", connections: " << options.connections;
+    if (options.mode == "open") {
+        std::cout << ", rate: " << options.rate << "/s";
+    }
+    std::cout << ", avg frame: " << total_bytes / pool.size() << " bytes" << std::endl;
+    
+    std::vector<ConnectionStats> stats(options.connections);
+    std::vector<std::thread> threads;
+    
+    auto start = Clock::now() + std::chrono::milliseconds(100);
+    auto measure_start = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.warmup_s));
+    auto end = measure_start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.duration_s));
+    
+    for (size_t i = 0; i < options.connections; ++i) {
+        if (options.mode == "closed") {
+            threads.emplace_back(runClosedLoop, std::cref(options), std::cref(pool), i,
+                                 measure_start, end, std::ref(stats[i]));
+        } else {
+            threads.emplace_back(runOpenLoop, std::cref(options), std::cref(pool), i,
+                                 start, measure_start, end, std::ref(stats[i]));
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    ConnectionStats total;
+    for (const auto& s : stats) {
+        total.latency_ns.merge(s.latency_ns);
+        total.sent += s.sent;
+        total.received += s.received;
+        total.errors += s.errors;
+        total.slot_responses += s.slot_responses;
+        for (const auto& [status, count] : s.statuses) {
+            total.statuses[status] += count;
+        }
+    }
+    
+    std::cout << "\nSent: " << total.sent << ", received: " << total.received
+              << ", errors: " << total.errors << std::endl;
+    std::cout << "Throughput: " << static_cast<uint64_t>(total.received / options.duration_s)
+              << " responses/sec";
+    if (options.slots > 0) {
+        std::cout << ", " << static_cast<uint64_t>(total.slot_responses / options.duration_s)
+                  << " slot decisions/sec";
+    }
+    std::cout << std::endl;
+    for (const auto& [status, count] : total.statuses) {
+        std::cout << "  status " << status << ": " << count << std::endl;
+    }
+    std::cout << "\nLatency"
+              << (options.mode == "open" ? " (from intended send time)" : "") << ":\n";
+    total.latency_ns.printPercentiles(std::cout);
+    
+    return total.errors > 0 ? 2 : 0;
+}
@@ -0,0 +1,343 @@
+#include "wire_client.h"
+#include "request_capture.h"
+#include "data_structures/hdr_histogram.h"
+#include "proto/bid.pb.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bidding_replay: feeds a capture log written by the engine's capture mode
+// back to one engine, or to two engines in turn for comparison.
+//
+//   bidding_replay --log requests.bcap --target 127.0.0.1:5000
+//                  [--baseline 127.0.0.1:5001] [--speed original|max|<factor>]
+//
+// Frames keep their per-connection order; connections are folded onto
+// --connections sockets. With a baseline, responses are compared field by
+// field (latency_ms excluded; batch frames slot by slot) and both latency
+// distributions are printed.
+
+using Clock = std::chrono::steady_clock;
+
+struct CapturedFrame {
+    uint64_t timestamp_ns;
+    uint32_t connection_id;
+    bool batch;
+    std::string payload;
+};
+
+struct ReplayOptions {
+    std::string log;
+    std::string target;
+    std::string baseline;
+    double speed = 1.0;         // 0 = as fast as possible
+    size_t connections = 8;
+    size_t limit = 0;
+    size_t show_diffs = 10;
+};
+
+struct ReplayResult {
+    HdrHistogram latency_ns;
+    std::vector<std::string> responses;
+    uint64_t errors = 0;
+    double elapsed_s = 0.0;
+};
+
+namespace {
+
+void usage() {
+    std::cerr <<
+        "Usage: bidding_replay --log FILE --target HOST:PORT [options]\n"
+        "  --baseline HOST:PORT     second engine to replay against and compare\n"
+        "  --speed S                original | max | factor, e.g. 2 = twice as fast (original)\n"
+        "  --connections N          replay sockets per engine (8)\n"
+        "  --limit N                replay only the first N frames\n"
+        "  --show-diffs N           mismatching responses to print (10)\n";
+}
+
+bool parseOptions(int argc, char* argv[], ReplayOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--log") options.log = value;
+        else if (arg == "--target") options.target = value;
+        else if (arg == "--baseline") options.baseline = value;
+        else if (arg == "--connections") options.connections = std::max<size_t>(std::stoul(value), 1);
+        else if (arg == "--limit") options.limit = std::stoul(value);
+        else if (arg == "--show-diffs") options.show_diffs = std::stoul(value);
+        else if (arg == "--speed") {
+            if (value == "original") options.speed = 1.0;
+            else if (value == "max") options.speed = 0.0;
+            else options.speed = std::stod(value);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return !options.log.empty() && !options.target.empty();
+}
+
+bool splitHostPort(const std::string& endpoint, std::string& host, int& port) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    host = endpoint.substr(0, colon);
+    port = std::stoi(endpoint.substr(colon + 1));
+    return true;
+}
+
+bool loadCapture(const ReplayOptions& options, std::vector<CapturedFrame>& frames) {
+    std::ifstream in(options.log, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << options.log << std::endl;
+        return false;
+    }
+    
+    CaptureFileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kCaptureMagic, sizeof(header.magic)) != 0 ||
+        header.version < 1 || header.version > kCaptureVersion) {
+        std::cerr << options.log << " is not a capture log" << std::endl;
+        return false;
+    }
+    
+    CaptureRecordHeader record;
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        CapturedFrame frame;
+        frame.timestamp_ns = record.timestamp_ns;
+        frame.connection_id = record.connection_id;
+        frame.batch = (record.length & kBatchFrameFlag) != 0;
+        uint32_t length = record.length & ~kBatchFrameFlag;
+        frame.payload.resize(length);
+        if (length > 0 && !in.read(&frame.payload[0], length)) {
+            std::cerr << "Truncated record at frame " << frames.size() << ", stopping" << std::endl;
+            break;
+        }
+        frames.push_back(std::move(frame));
+        if (options.limit > 0 && frames.size() >= options.limit) {
+            break;
+        }
+    }
+    
+    // The writer drains in claim order, which can differ slightly from
+    // arrival order across connections
+    std::stable_sort(frames.begin(), frames.end(),
+        [](const CapturedFrame& a, const CapturedFrame& b) {
+            return a.timestamp_ns < b.timestamp_ns;
+        });
+    return true;
+}
+
+void replayConnection(const std::string& host, int port, const ReplayOptions& options,
+                      const std::vector<CapturedFrame>& frames,
+                      const std::vector<size_t>& indices, Clock::time_point start,
+                      ReplayResult& result, HdrHistogram& latency, uint64_t& errors) {
+    int fd = wire::connectTo(host, port);
+    if (fd < 0) {
+        errors += indices.size();
+        return;
+    }
+    
+    std::string response;
+    for (size_t index : indices) {
+        const CapturedFrame& frame = frames[index];
+        std::string framed = wire::frame(frame.payload, frame.batch);
+        
+        Clock::time_point reference = Clock::now();
+        if (options.speed > 0.0) {
+            auto offset = std::chrono::nanoseconds(static_cast<int64_t>(frame.timestamp_ns / options.speed));
+            reference = start + offset;
+            std::this_thread::sleep_until(reference);
+        }
+        
+        if (!wire::sendAll(fd, framed.data(), framed.size()) || !wire::readFrame(fd, response)) {
+            errors++;
+            break;
+        }
+        
+        // Paced replays measure from the scheduled time so a slow engine
+        // cannot hide its backlog
+        auto received_at = Clock::now();
+        latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(received_at - reference).count());
+        result.responses[index] = response;
+    }
+    close(fd);
+}
+
+bool replay(const std::string& endpoint, const ReplayOptions& options,
+            const std::vector<CapturedFrame>& frames, ReplayResult& result) {
+    std::string host;
+    int port = 0;
+    if (!splitHostPort(endpoint, host, port)) {
+        std::cerr << "Bad endpoint " << endpoint << ", expected HOST:PORT" << std::endl;
+        return false;
+    }
+    
+    std::vector<std::vector<size_t>> assignment(options.connections);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        assignment[frames[i].connection_id % options.connections].push_back(i);
+    }
+    
+    result.responses.assign(frames.size(), std::string());
+    std::vector<HdrHistogram> latencies(options.connections);
+    std::vector<uint64_t> errors(options.connections, 0);
+    std::vector<std::thread> threads;
+    
+    auto start = Clock::now() + std::chrono::milliseconds(50);
+    for (size_t c = 0; c < options.connections; ++c) {
+        if (assignment[c].empty()) {
+            continue;
+        }
+        threads.emplace_back(replayConnection, host, port, std::cref(options), std::cref(frames),
+                             std::cref(assignment[c]), start, std::ref(result),
+                             std::ref(latencies[c]), std::ref(errors[c]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    result.elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    for (size_t c = 0; c < options.connections; ++c) {
+        result.latency_ns.merge(latencies[c]);
+        result.errors += errors[c];
+    }
+    return true;
+}
+
+std::string describe(const bidding::BidResponse& r) {
+    std::ostringstream oss;
+    oss << "status=" << r.status() << " won=" << r.won() << " campaign=" << r.campaign_id()
+        << " bid=" << r.winning_bid() << " price=" << r.price();
+    return oss.str();
+}
+
+bool sameDecision(const bidding::BidResponse& a, const bidding::BidResponse& b) {
+    auto close_enough = [](double x, double y) {
+        return std::fabs(x - y) <= 1e-9 * std::max(1.0, std::max(std::fabs(x), std::fabs(y)));
+    };
+    return a.id() == b.id() && a.status() == b.status() && a.won() == b.won() &&
+           a.campaign_id() == b.campaign_id() &&
+           close_enough(a.winning_bid(), b.winning_bid()) && close_enough(a.price(), b.price());
+}
+
+void printSummary(const std::string& name, const ReplayResult& result, size_t frames) {
+    std::cout << "\n== " << name << " ==\n";
+    std::cout << "Frames: " << frames << ", errors: " << result.errors
+              << ", elapsed: " << std::fixed << std::setprecision(2) << result.elapsed_s << "s"
+              << ", rate: " << static_cast<uint64_t>(frames / std::max(result.elapsed_s, 1e-9)) << "/s\n";
+    result.latency_ns.printPercentiles(std::cout);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    ReplayOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+    
+    std::vector<CapturedFrame> frames;
+    if (!loadCapture(options, frames)) {
+        return 1;
+    }
+    if (frames.empty()) {
+        std::cerr << "Capture log is empty" << std::endl;
+        return 1;
+    }
+    
+    double span_s = frames.back().timestamp_ns / 1e9;
+    std::cout << "Loaded " << frames.size() << " frames spanning " << span_s << "s, speed: "
+              << (options.speed > 0.0 ? std::to_string(options.speed) + "x" : std::string("max"))
+              << std::endl;
+    
+    ReplayResult target;
+    if (!replay(options.target, options, frames, target)) {
+        return 1;
+    }
+    printSummary("target " + options.target, target, frames.size());
+    
+    if (options.baseline.empty()) {
+        return target.errors > 0 ? 2 : 0;
+    }
+    
+    ReplayResult baseline;
+    if (!replay(options.baseline, options, frames, baseline)) {
+        return 1;
+    }
+    printSummary("baseline " + options.baseline, baseline, frames.size());
+    
+    size_t mismatches = 0;
+    size_t missing = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (target.responses[i].empty() != baseline.responses[i].empty()) {
+            missing++;
+            continue;
+        }
+        
+        // Batch frames compare slot by slot; a single request is a batch of one
+        std::vector<bidding::BidResponse> a(1);
+        std::vector<bidding::BidResponse> b(1);
+        if (frames[i].batch) {
+            bidding::BidBatchResponse batch_a;
+            bidding::BidBatchResponse batch_b;
+            batch_a.ParseFromString(target.responses[i]);
+            batch_b.ParseFromString(baseline.responses[i]);
+            a.assign(batch_a.responses().begin(), batch_a.responses().end());
+            b.assign(batch_b.responses().begin(), batch_b.responses().end());
+            if (batch_a.status() != batch_b.status() || a.size() != b.size()) {
+                if (mismatches < options.show_diffs) {
+                    std::cout << "frame " << i << " id=" << batch_a.id()
+                              << "\n  target:   status=" << batch_a.status() << " slots=" << a.size()
+                              << "\n  baseline: status=" << batch_b.status() << " slots=" << b.size() << "\n";
+                }
+                mismatches++;
+                continue;
+            }
+        } else {
+            a[0].ParseFromString(target.responses[i]);
+            b[0].ParseFromString(baseline.responses[i]);
+        }
+        
+        for (size_t slot = 0; slot < a.size(); ++slot) {
+            if (!sameDecision(a[slot], b[slot])) {
+                if (mismatches < options.show_diffs) {
+                    std::cout << "frame " << i << " id=" << a[slot].id()
+                              << "\n  target:   " << describe(a[slot])
+                              << "\n  baseline: " << describe(b[slot]) << "\n";
+                }
+                mismatches++;
+                break;
+            }
+        }
+    }
+    
+    std::cout << "\n== comparison ==\n";
+    std::cout << "Response mismatches: " << mismatches << ", answered by only one side: " << missing << "\n";
+    std::cout << std::setw(10) << "pct" << std::setw(16) << "target(us)"
+              << std::setw(16) << "baseline(us)" << std::setw(10) << "delta" << "\n";
+    for (double percentile : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+        double t = target.latency_ns.valueAtPercentile(percentile) / 1000.0;
+        double b = baseline.latency_ns.valueAtPercentile(percentile) / 1000.0;
+        double delta = b > 0.0 ? (t - b) / b * 100.0 : 0.0;
+        std::cout << std::setw(10) << std::setprecision(1) << percentile
+                  << std::setw(16) << std::setprecision(1) << t
+                  << std::setw(16) << b
+                  << std::setw(9) << std::showpos << delta << std::noshowpos << "%\n";
+    }
+    
+    return (mismatches > 0 || missing > 0) ? 3 : 0;
+}
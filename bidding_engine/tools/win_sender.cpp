@@ -0,0 +1,224 @@
+#include "win_notice_protocol.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bidding_win_sender: sends synthetic auction outcome notices to the
+// engine's win notice port, batching datagrams with sendmmsg. Prints the
+// totals it sent so they can be checked against the engine's
+// bidding_win_notice_* and bidding_campaign_* metrics.
+
+using Clock = std::chrono::steady_clock;
+
+struct SenderOptions {
+    std::string host = "127.0.0.1";
+    int port = 5001;
+    double rate = 0.0;              // notices/sec, 0 = as fast as possible
+    double duration_s = 10.0;
+    size_t campaigns = 100;
+    double win_rate = 0.2;
+    size_t per_datagram = kWinNoticesPerDatagram;
+    size_t batch = 64;              // datagrams per sendmmsg
+    size_t pool = 1024;             // distinct pre-built datagrams
+    uint64_t seed = 1;
+};
+
+namespace {
+
+void usage() {
+    std::cerr <<
+        "Usage: bidding_win_sender [options]\n"
+        "  --host HOST              engine host (127.0.0.1)\n"
+        "  --port PORT              win notice port (5001)\n"
+        "  --rate R                 notices/sec, 0 = unthrottled (0)\n"
+        "  --duration S             seconds to send (10)\n"
+        "  --campaigns N            distinct campaign ids campaign-0..N-1 (100)\n"
+        "  --win-rate P             fraction of notices that are wins (0.2)\n"
+        "  --per-datagram N         notices per datagram (" << kWinNoticesPerDatagram << ")\n"
+        "  --batch N                datagrams per sendmmsg (64)\n"
+        "  --pool N                 distinct pre-built datagrams (1024)\n"
+        "  --seed N                 RNG seed (1)\n";
+}
+
+bool parseOptions(int argc, char* argv[], SenderOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--host") options.host = value;
+        else if (arg == "--port") options.port = std::stoi(value);
+        else if (arg == "--rate") options.rate = std::stod(value);
+        else if (arg == "--duration") options.duration_s = std::stod(value);
+        else if (arg == "--campaigns") options.campaigns = std::stoul(value);
+        else if (arg == "--win-rate") options.win_rate = std::stod(value);
+        else if (arg == "--per-datagram") options.per_datagram = std::stoul(value);
+        else if (arg == "--batch") options.batch = std::stoul(value);
+        else if (arg == "--pool") options.pool = std::stoul(value);
+        else if (arg == "--seed") options.seed = std::stoull(value);
+        else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    
+    options.campaigns = std::max<size_t>(options.campaigns, 1);
+    options.per_datagram = std::min<size_t>(std::max<size_t>(options.per_datagram, 1), 65535);
+    options.batch = std::max<size_t>(options.batch, 1);
+    options.pool = std::max<size_t>(options.pool, 1);
+    return true;
+}
+
+struct Datagram {
+    std::vector<char> bytes;
+    uint64_t wins = 0;
+    uint64_t spend_micros = 0;
+};
+
+std::vector<Datagram> buildPool(const SenderOptions& options) {
+    std::mt19937_64 rng(options.seed);
+    std::uniform_int_distribution<size_t> campaign(0, options.campaigns - 1);
+    std::uniform_int_distribution<uint32_t> bid(100000, 5000000);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    
+    std::vector<Datagram> pool(options.pool);
+    for (auto& datagram : pool) {
+        WinNoticeHeader header;
+        header.magic = kWinNoticeMagic;
+        header.version = kWinNoticeVersion;
+        header.count = static_cast<uint16_t>(options.per_datagram);
+        header.sequence = 0;
+        datagram.bytes.resize(sizeof(header) + options.per_datagram * sizeof(WinNotice));
+        std::memcpy(datagram.bytes.data(), &header, sizeof(header));
+        
+        for (size_t i = 0; i < options.per_datagram; ++i) {
+            WinNotice notice;
+            std::memset(&notice, 0, sizeof(notice));
+            std::string request_id = "req-" + std::to_string(rng());
+            setNoticeCampaign(notice, "campaign-" + std::to_string(campaign(rng)));
+            notice.request_key = winNoticeKey(request_id.data(), request_id.size());
+            notice.bid_micros = bid(rng);
+            if (unit(rng) < options.win_rate) {
+                notice.outcome = static_cast<uint8_t>(NoticeOutcome::WIN);
+                notice.price_micros = static_cast<uint32_t>(notice.bid_micros * (0.5 + 0.5 * unit(rng)));
+                datagram.wins++;
+                datagram.spend_micros += notice.price_micros;
+            } else {
+                notice.outcome = static_cast<uint8_t>(NoticeOutcome::LOSS);
+            }
+            std::memcpy(datagram.bytes.data() + sizeof(header) + i * sizeof(WinNotice), &notice, sizeof(notice));
+        }
+    }
+    return pool;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    SenderOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+    
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return 1;
+    }
+    int send_buffer = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(options.host.c_str());
+    address.sin_port = htons(options.port);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::cerr << "Failed to connect to " << options.host << ":" << options.port << std::endl;
+        return 1;
+    }
+    
+    std::vector<Datagram> pool = buildPool(options);
+    std::cout << "Sending to " << options.host << ":" << options.port << ", " << options.per_datagram
+              << " notices per " << pool[0].bytes.size() << "-byte datagram, "
+              << (options.rate > 0 ? std::to_string(static_cast<uint64_t>(options.rate)) + " notices/s"
+                                   : std::string("unthrottled"))
+              << std::endl;
+    
+    std::vector<struct iovec> iovecs(options.batch);
+    std::vector<struct mmsghdr> messages(options.batch);
+    std::vector<size_t> batch_indices(options.batch);
+    uint64_t sequence = 0;
+    uint64_t sent_datagrams = 0;
+    uint64_t sent_wins = 0;
+    uint64_t sent_spend_micros = 0;
+    uint64_t send_errors = 0;
+    size_t next = 0;
+    
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+    double datagram_interval_s = options.rate > 0 ? options.per_datagram / options.rate : 0.0;
+    
+    while (Clock::now() < end) {
+        size_t count = options.batch;
+        if (options.rate > 0) {
+            // Send what the schedule allows so far, sleeping when ahead of it
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            uint64_t due = static_cast<uint64_t>(elapsed / datagram_interval_s) + 1;
+            if (due <= sent_datagrams) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            count = std::min<size_t>(count, due - sent_datagrams);
+        }
+        
+        for (size_t i = 0; i < count; ++i) {
+            Datagram& datagram = pool[next];
+            batch_indices[i] = next;
+            next = (next + 1) % pool.size();
+            // Sequence sits right after magic, version and count
+            ++sequence;
+            std::memcpy(datagram.bytes.data() + 8, &sequence, sizeof(sequence));
+            iovecs[i].iov_base = datagram.bytes.data();
+            iovecs[i].iov_len = datagram.bytes.size();
+            std::memset(&messages[i], 0, sizeof(messages[i]));
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        int sent = sendmmsg(fd, messages.data(), count, 0);
+        if (sent < 0) {
+            ++send_errors;
+            continue;
+        }
+        for (int i = 0; i < sent; ++i) {
+            sent_wins += pool[batch_indices[i]].wins;
+            sent_spend_micros += pool[batch_indices[i]].spend_micros;
+        }
+        sent_datagrams += sent;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    close(fd);
+    
+    uint64_t sent_notices = sent_datagrams * options.per_datagram;
+    std::cout << "Sent: " << sent_datagrams << " datagrams, " << sent_notices << " notices ("
+              << static_cast<uint64_t>(sent_notices / elapsed) << "/s)" << std::endl;
+    std::cout << "  wins: " << sent_wins << ", spend: " << sent_spend_micros / 1e6
+              << ", send errors: " << send_errors << std::endl;
+    return 0;
+}
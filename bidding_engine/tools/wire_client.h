@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "data_structures/receive_buffer.h"
+
+// Blocking client side of the engine wire protocol: every frame is a
+// 4-byte big-endian length followed by a serialized protobuf message. The
+// top bit of the length (kBatchFrameFlag) marks a BidBatchRequest/Response.
+namespace wire {
+
+// source, if given, is the local address to connect from
+inline int connectTo(const std::string& host, int port, const std::string& source = std::string()) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    struct sockaddr_in address;
+    if (!source.empty()) {
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = inet_addr(source.c_str());
+        if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(host.c_str());
+    address.sin_port = htons(port);
+    
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+inline bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Prepends the length prefix; callers keep the framed bytes around so the
+// send path is a single syscall.
+inline std::string frame(const std::string& payload, bool batch = false) {
+    std::string framed(4 + payload.size(), '\0');
+    uint32_t length = htonl(static_cast<uint32_t>(payload.size()) | (batch ? kBatchFrameFlag : 0));
+    std::memcpy(&framed[0], &length, 4);
+    std::memcpy(&framed[4], payload.data(), payload.size());
+    return framed;
+}
+
+inline bool readFrame(int fd, std::string& payload, bool* batch = nullptr) {
+    uint32_t length = 0;
+    if (recv(fd, &length, 4, MSG_WAITALL) != 4) {
+        return false;
+    }
+    
+    length = ntohl(length);
+    if (batch) {
+        *batch = (length & kBatchFrameFlag) != 0;
+    }
+    length &= ~kBatchFrameFlag;
+    payload.resize(length);
+    if (length == 0) {
+        return true;
+    }
+    return recv(fd, &payload[0], length, MSG_WAITALL) == static_cast<ssize_t>(length);
+}
+
+}